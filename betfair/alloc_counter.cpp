@@ -0,0 +1,112 @@
+#include "alloc_counter.hpp"
+#include <openssl/crypto.h>
+#include <cstdlib>
+#include <new>
+
+namespace bfapi {
+namespace alloc_counter {
+
+namespace {
+
+thread_local counts current;
+
+//==============================================================================
+void* counted_malloc(std::size_t size)
+{
+    ++current.allocations;
+    current.bytes += size;
+    return std::malloc(size);
+}
+
+//==============================================================================
+void counted_free(void* p)
+{
+    if (p)
+    {
+        ++current.deallocations;
+        std::free(p);
+    }
+}
+
+//==============================================================================
+void* operator_new(std::size_t size)
+{
+    void* p = counted_malloc(size ? size : 1);
+    if (nullptr == p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+//==============================================================================
+void* operator_new_aligned(std::size_t size, std::size_t alignment)
+{
+    ++current.allocations;
+    current.bytes += size;
+    void* p = nullptr;
+    if (0 != posix_memalign(&p, alignment < sizeof(void*) ? sizeof(void*) : alignment, size ? size : 1))
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+//==============================================================================
+void* openssl_malloc(std::size_t size, const char*, int)
+{
+    ++current.openssl_allocations;
+    return std::malloc(size);
+}
+
+//==============================================================================
+void* openssl_realloc(void* p, std::size_t size, const char*, int)
+{
+    // A resize is counted as an allocation since it may move the block
+    ++current.openssl_allocations;
+    return std::realloc(p, size);
+}
+
+//==============================================================================
+void openssl_free(void* p, const char*, int)
+{
+    std::free(p);
+}
+
+} // end of anonymous namespace
+
+//==============================================================================
+counts thread_counts()
+{
+    return current;
+}
+
+//==============================================================================
+bool count_openssl()
+{
+    return 1 == CRYPTO_set_mem_functions(openssl_malloc, openssl_realloc, openssl_free);
+}
+
+} // end of namespace bfapi::alloc_counter
+} // end of namespace bfapi
+
+//==============================================================================
+// Replacement global allocation functions
+void* operator new(std::size_t size) { return bfapi::alloc_counter::operator_new(size); }
+void* operator new[](std::size_t size) { return bfapi::alloc_counter::operator_new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return bfapi::alloc_counter::counted_malloc(size ? size : 1); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return bfapi::alloc_counter::counted_malloc(size ? size : 1); }
+void operator delete(void* p) noexcept { bfapi::alloc_counter::counted_free(p); }
+void operator delete[](void* p) noexcept { bfapi::alloc_counter::counted_free(p); }
+void operator delete(void* p, std::size_t) noexcept { bfapi::alloc_counter::counted_free(p); }
+void operator delete[](void* p, std::size_t) noexcept { bfapi::alloc_counter::counted_free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { bfapi::alloc_counter::counted_free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { bfapi::alloc_counter::counted_free(p); }
+#if __cpp_aligned_new
+void* operator new(std::size_t size, std::align_val_t al) { return bfapi::alloc_counter::operator_new_aligned(size, static_cast<std::size_t>(al)); }
+void* operator new[](std::size_t size, std::align_val_t al) { return bfapi::alloc_counter::operator_new_aligned(size, static_cast<std::size_t>(al)); }
+void operator delete(void* p, std::align_val_t) noexcept { bfapi::alloc_counter::counted_free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { bfapi::alloc_counter::counted_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { bfapi::alloc_counter::counted_free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { bfapi::alloc_counter::counted_free(p); }
+#endif
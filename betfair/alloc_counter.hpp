@@ -0,0 +1,67 @@
+//==============================================================================
+//
+// Heap allocation counters for checking that a code path does not allocate.
+//
+// alloc_counter.cpp replaces the global operator new and operator delete with
+// versions that count calls per thread before forwarding to malloc and free.
+// The replacement only takes effect in programs that link alloc_counter.cpp,
+// so add it to benchmarks and tests, not to production builds.
+//
+// OpenSSL calls malloc directly; count_openssl() counts its allocations
+// separately (they happen inside its record layer and cannot be avoided by
+// the caller). It must be called before OpenSSL allocates anything, i.e. at
+// the start of main() before any ssl::context is created.
+//
+//         bfapi::alloc_counter::scope s;
+//         conn.place_orders(request, a, report, error);
+//         assert(s.elapsed().allocations == 0);
+//
+//==============================================================================
+#ifndef BFAPI_ALLOC_COUNTER_HPP
+#define BFAPI_ALLOC_COUNTER_HPP
+
+#include <cstdint>
+
+namespace bfapi {
+namespace alloc_counter {
+
+struct counts {
+	std::uint64_t allocations;          // operator new
+	std::uint64_t deallocations;        // operator delete
+	std::uint64_t bytes;                // Requested by allocations
+	std::uint64_t openssl_allocations;  // malloc and realloc by OpenSSL, if counted
+
+	counts() : allocations(0), deallocations(0), bytes(0), openssl_allocations(0) {}
+
+	counts operator-(const counts& other) const
+	{
+		counts c;
+		c.allocations = allocations - other.allocations;
+		c.deallocations = deallocations - other.deallocations;
+		c.bytes = bytes - other.bytes;
+		c.openssl_allocations = openssl_allocations - other.openssl_allocations;
+		return c;
+	}
+};
+
+// Counts for the calling thread since it started
+counts thread_counts();
+
+// Count OpenSSL allocations too. Returns false if OpenSSL has already allocated.
+bool count_openssl();
+
+// Measures the allocations made by the calling thread during its lifetime
+class scope {
+public:
+	scope() : start(thread_counts()) {}
+
+	counts elapsed() const { return thread_counts() - start; }
+
+private:
+	counts start;
+};
+
+} // end of namespace bfapi::alloc_counter
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,585 @@
+#include "analytics.hpp"
+#include <atomic>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BFAPI_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define BFAPI_SIMD_X86 0
+#endif
+
+namespace bfapi {
+namespace analytics {
+
+namespace {
+
+// Vector width in doubles of the widest implementation; arrays are padded to a multiple of it
+const std::size_t lane_count = 4;
+
+// Totals are summed from scratch after this many incremental updates to stop rounding errors accumulating
+const std::uint64_t full_sum_interval = 1024;
+
+// Compared as a std::string: a size check instead of strlen() and compare() on every runner
+const std::string active_status = "ACTIVE";
+
+//==============================================================================
+// Scalar implementations, also used for the tail of the vector loops
+
+double sum_reciprocals_scalar(const double* prices, std::size_t n)
+{
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        sum += prices[i] > 0.0 ? 1.0 / prices[i] : 0.0;
+    }
+    return sum;
+}
+
+double total_scalar(const double* values, std::size_t n)
+{
+    double sum = 0.0;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        sum += values[i];
+    }
+    return sum;
+}
+
+void reciprocals_scalar(const double* prices, double* out, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        out[i] = prices[i] > 0.0 ? 1.0 / prices[i] : 0.0;
+    }
+}
+
+void weighted_average_scalar(const double* const* prices, const double* const* sizes, int depth, std::size_t first, std::size_t n, double* out)
+{
+    for (std::size_t i = first; i < n; ++i)
+    {
+        double num = 0.0;
+        double den = 0.0;
+        for (int l = 0; l < depth; ++l)
+        {
+            num += prices[l][i] * sizes[l][i];
+            den += sizes[l][i];
+        }
+        out[i] = den > 0.0 ? num / den : 0.0;
+    }
+}
+
+void safe_ratio_scalar(const double* numerator, const double* denominator, double* out, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        out[i] = denominator[i] != 0.0 ? numerator[i] / denominator[i] : 0.0;
+    }
+}
+
+#if BFAPI_SIMD_X86
+
+//==============================================================================
+// SSE2: two runners per instruction
+
+__attribute__((target("sse2")))
+double sum_reciprocals_sse2(const double* prices, std::size_t n)
+{
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    __m128d acc = zero;
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        const __m128d p = _mm_loadu_pd(prices + i);
+        acc = _mm_add_pd(acc, _mm_and_pd(_mm_cmpgt_pd(p, zero), _mm_div_pd(one, p)));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, acc);
+    return lanes[0] + lanes[1] + sum_reciprocals_scalar(prices + i, n - i);
+}
+
+__attribute__((target("sse2")))
+double total_sse2(const double* values, std::size_t n)
+{
+    // Two accumulators hide the latency of the additions
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        acc0 = _mm_add_pd(acc0, _mm_loadu_pd(values + i));
+        acc1 = _mm_add_pd(acc1, _mm_loadu_pd(values + i + 2));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    return lanes[0] + lanes[1] + total_scalar(values + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void reciprocals_sse2(const double* prices, double* out, std::size_t n)
+{
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        const __m128d p = _mm_loadu_pd(prices + i);
+        _mm_storeu_pd(out + i, _mm_and_pd(_mm_cmpgt_pd(p, zero), _mm_div_pd(one, p)));
+    }
+    reciprocals_scalar(prices + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void weighted_average_sse2(const double* const* prices, const double* const* sizes, int depth, std::size_t n, double* out)
+{
+    const __m128d zero = _mm_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128d num = zero;
+        __m128d den = zero;
+        for (int l = 0; l < depth; ++l)
+        {
+            const __m128d s = _mm_loadu_pd(sizes[l] + i);
+            num = _mm_add_pd(num, _mm_mul_pd(_mm_loadu_pd(prices[l] + i), s));
+            den = _mm_add_pd(den, s);
+        }
+        _mm_storeu_pd(out + i, _mm_and_pd(_mm_cmpgt_pd(den, zero), _mm_div_pd(num, den)));
+    }
+    weighted_average_scalar(prices, sizes, depth, i, n, out);
+}
+
+__attribute__((target("sse2")))
+void safe_ratio_sse2(const double* numerator, const double* denominator, double* out, std::size_t n)
+{
+    const __m128d zero = _mm_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 2 <= n; i += 2)
+    {
+        const __m128d d = _mm_loadu_pd(denominator + i);
+        _mm_storeu_pd(out + i, _mm_and_pd(_mm_cmpneq_pd(d, zero), _mm_div_pd(_mm_loadu_pd(numerator + i), d)));
+    }
+    safe_ratio_scalar(numerator + i, denominator + i, out + i, n - i);
+}
+
+//==============================================================================
+// AVX2: four runners per instruction
+
+__attribute__((target("avx2")))
+double sum_reciprocals_avx2(const double* prices, std::size_t n)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    __m256d acc = zero;
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m256d p = _mm256_loadu_pd(prices + i);
+        acc = _mm256_add_pd(acc, _mm256_and_pd(_mm256_cmp_pd(p, zero, _CMP_GT_OQ), _mm256_div_pd(one, p)));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, acc);
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + sum_reciprocals_scalar(prices + i, n - i);
+}
+
+__attribute__((target("avx2")))
+double total_avx2(const double* values, std::size_t n)
+{
+    __m256d acc0 = _mm256_setzero_pd();
+    __m256d acc1 = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(values + i));
+        acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(values + i + 4));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+    return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + total_scalar(values + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void reciprocals_avx2(const double* prices, double* out, std::size_t n)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m256d p = _mm256_loadu_pd(prices + i);
+        _mm256_storeu_pd(out + i, _mm256_and_pd(_mm256_cmp_pd(p, zero, _CMP_GT_OQ), _mm256_div_pd(one, p)));
+    }
+    reciprocals_scalar(prices + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void weighted_average_avx2(const double* const* prices, const double* const* sizes, int depth, std::size_t n, double* out)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m256d num = zero;
+        __m256d den = zero;
+        for (int l = 0; l < depth; ++l)
+        {
+            const __m256d s = _mm256_loadu_pd(sizes[l] + i);
+            num = _mm256_add_pd(num, _mm256_mul_pd(_mm256_loadu_pd(prices[l] + i), s));
+            den = _mm256_add_pd(den, s);
+        }
+        _mm256_storeu_pd(out + i, _mm256_and_pd(_mm256_cmp_pd(den, zero, _CMP_GT_OQ), _mm256_div_pd(num, den)));
+    }
+    weighted_average_scalar(prices, sizes, depth, i, n, out);
+}
+
+__attribute__((target("avx2")))
+void safe_ratio_avx2(const double* numerator, const double* denominator, double* out, std::size_t n)
+{
+    const __m256d zero = _mm256_setzero_pd();
+    std::size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m256d d = _mm256_loadu_pd(denominator + i);
+        _mm256_storeu_pd(out + i, _mm256_and_pd(_mm256_cmp_pd(d, zero, _CMP_NEQ_OQ), _mm256_div_pd(_mm256_loadu_pd(numerator + i), d)));
+    }
+    safe_ratio_scalar(numerator + i, denominator + i, out + i, n - i);
+}
+
+#endif
+
+//==============================================================================
+simd_level detect()
+{
+#if BFAPI_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return simd_level::avx2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return simd_level::sse2;
+    }
+#endif
+    return simd_level::scalar;
+}
+
+std::atomic<int>& current_level()
+{
+    static std::atomic<int> level(static_cast<int>(detect()));
+    return level;
+}
+
+} // end of anonymous namespace
+
+//==============================================================================
+simd_level detected_simd()
+{
+    static const simd_level level = detect();
+    return level;
+}
+
+//==============================================================================
+simd_level active_simd()
+{
+    return static_cast<simd_level>(current_level().load(std::memory_order_relaxed));
+}
+
+//==============================================================================
+void set_simd(simd_level level)
+{
+    if (static_cast<int>(level) <= static_cast<int>(detected_simd()))
+    {
+        current_level().store(static_cast<int>(level), std::memory_order_relaxed);
+    }
+}
+
+//==============================================================================
+const char* simd_name(simd_level level)
+{
+    switch (level)
+    {
+    case simd_level::avx2:
+        return "AVX2";
+    case simd_level::sse2:
+        return "SSE2";
+    default:
+        return "scalar";
+    }
+}
+
+//==============================================================================
+double sum_reciprocals(const double* prices, std::size_t n)
+{
+#if BFAPI_SIMD_X86
+    switch (active_simd())
+    {
+    case simd_level::avx2:
+        return sum_reciprocals_avx2(prices, n);
+    case simd_level::sse2:
+        return sum_reciprocals_sse2(prices, n);
+    default:
+        break;
+    }
+#endif
+    return sum_reciprocals_scalar(prices, n);
+}
+
+//==============================================================================
+double total(const double* values, std::size_t n)
+{
+#if BFAPI_SIMD_X86
+    switch (active_simd())
+    {
+    case simd_level::avx2:
+        return total_avx2(values, n);
+    case simd_level::sse2:
+        return total_sse2(values, n);
+    default:
+        break;
+    }
+#endif
+    return total_scalar(values, n);
+}
+
+//==============================================================================
+void reciprocals(const double* prices, double* out, std::size_t n)
+{
+#if BFAPI_SIMD_X86
+    switch (active_simd())
+    {
+    case simd_level::avx2:
+        return reciprocals_avx2(prices, out, n);
+    case simd_level::sse2:
+        return reciprocals_sse2(prices, out, n);
+    default:
+        break;
+    }
+#endif
+    reciprocals_scalar(prices, out, n);
+}
+
+//==============================================================================
+void weighted_average(const double* const* prices, const double* const* sizes, int depth, std::size_t n, double* out)
+{
+#if BFAPI_SIMD_X86
+    switch (active_simd())
+    {
+    case simd_level::avx2:
+        return weighted_average_avx2(prices, sizes, depth, n, out);
+    case simd_level::sse2:
+        return weighted_average_sse2(prices, sizes, depth, n, out);
+    default:
+        break;
+    }
+#endif
+    weighted_average_scalar(prices, sizes, depth, 0, n, out);
+}
+
+//==============================================================================
+void safe_ratio(const double* numerator, const double* denominator, double* out, std::size_t n)
+{
+#if BFAPI_SIMD_X86
+    switch (active_simd())
+    {
+    case simd_level::avx2:
+        return safe_ratio_avx2(numerator, denominator, out, n);
+    case simd_level::sse2:
+        return safe_ratio_sse2(numerator, denominator, out, n);
+    default:
+        break;
+    }
+#endif
+    safe_ratio_scalar(numerator, denominator, out, n);
+}
+
+//==============================================================================
+market_analytics::market_analytics(int d) : depth(d > 0 ? d : 1),
+                                            stride(0),
+                                            level_pointers(4 * depth),
+                                            back_book(0.0),
+                                            lay_book(0.0),
+                                            since_full(0)
+{
+}
+
+//==============================================================================
+void market_analytics::load(const bfapi::responses::market_book& book)
+{
+    selection_ids.clear();
+    for (const bfapi::responses::runner_book& rb : book.runners)
+    {
+        selection_ids.push_back(rb.selection_id);
+    }
+    resize(selection_ids.size());
+    for (std::vector<double>* v : {&back_price, &back_size, &lay_price, &lay_size})
+    {
+        // Slots beyond the runner count must be empty for the kernels
+        std::fill(v->begin(), v->end(), 0.0);
+    }
+    for (std::size_t i = 0; i < book.runners.size(); ++i)
+    {
+        store_runner(i, book.runners[i]);
+    }
+    recompute();
+}
+
+//==============================================================================
+void market_analytics::recompute()
+{
+    compute_all();
+    ++stats.full_updates;
+    stats.runners_recomputed += selection_ids.size();
+}
+
+//==============================================================================
+void market_analytics::apply(const std::vector<bfapi::responses::runner_book>& changed)
+{
+    for (const bfapi::responses::runner_book& rb : changed)
+    {
+        int index = index_of(rb.selection_id);
+        if (index < 0)
+        {
+            selection_ids.push_back(rb.selection_id);
+            resize(selection_ids.size());
+            index = static_cast<int>(selection_ids.size()) - 1;
+        }
+        store_runner(index, rb);
+        compute_runner(index);
+        ++stats.runners_recomputed;
+    }
+    ++stats.incremental_updates;
+    if (++since_full >= full_sum_interval)
+    {
+        back_book = total(implied_back_prob.data(), stride);
+        lay_book = total(implied_lay_prob.data(), stride);
+        since_full = 0;
+    }
+}
+
+//==============================================================================
+int market_analytics::index_of(std::int64_t selection_id) const
+{
+    for (std::size_t i = 0; i < selection_ids.size(); ++i)
+    {
+        if (selection_ids[i] == selection_id)
+        {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+//==============================================================================
+void market_analytics::resize(std::size_t runners)
+{
+    const std::size_t new_stride = (runners + lane_count - 1) / lane_count * lane_count;
+    if (new_stride == stride && false == back_price.empty())
+    {
+        return;
+    }
+
+    // Ladders are level major so existing values move when the stride changes
+    auto relayout = [&](std::vector<double>& v, int levels)
+    {
+        std::vector<double> resized(levels * new_stride, 0.0);
+        for (int l = 0; l < levels && stride > 0; ++l)
+        {
+            std::copy(v.begin() + l * stride, v.begin() + l * stride + std::min(stride, new_stride), resized.begin() + l * new_stride);
+        }
+        v.swap(resized);
+    };
+    relayout(back_price, depth);
+    relayout(back_size, depth);
+    relayout(lay_price, depth);
+    relayout(lay_size, depth);
+    relayout(traded_value, 1);
+    relayout(traded_size, 1);
+    relayout(implied_back_prob, 1);
+    relayout(implied_lay_prob, 1);
+    relayout(back_wap_price, 1);
+    relayout(lay_wap_price, 1);
+    relayout(vwap, 1);
+    stride = new_stride;
+}
+
+//==============================================================================
+void market_analytics::store_runner(std::size_t index, const bfapi::responses::runner_book& rb)
+{
+    // Removed runners keep their slot but no longer have prices
+    const bool active = rb.status.empty() || rb.status == active_status;
+    for (int l = 0; l < depth; ++l)
+    {
+        const std::size_t pos = l * stride + index;
+        const bool has_back = active && static_cast<std::size_t>(l) < rb.available_to_back.size();
+        const bool has_lay = active && static_cast<std::size_t>(l) < rb.available_to_lay.size();
+        back_price[pos] = has_back ? rb.available_to_back[l].price : 0.0;
+        back_size[pos] = has_back ? rb.available_to_back[l].size : 0.0;
+        lay_price[pos] = has_lay ? rb.available_to_lay[l].price : 0.0;
+        lay_size[pos] = has_lay ? rb.available_to_lay[l].size : 0.0;
+    }
+
+    double value = 0.0;
+    double size = 0.0;
+    for (const bfapi::responses::price_size& ps : rb.traded_volume)
+    {
+        value += ps.price * ps.size;
+        size += ps.size;
+    }
+    traded_value[index] = value;
+    traded_size[index] = size;
+}
+
+//==============================================================================
+void market_analytics::compute_runner(std::size_t index)
+{
+    const double back = back_price[index] > 0.0 ? 1.0 / back_price[index] : 0.0;
+    const double lay = lay_price[index] > 0.0 ? 1.0 / lay_price[index] : 0.0;
+    back_book += back - implied_back_prob[index];
+    lay_book += lay - implied_lay_prob[index];
+    implied_back_prob[index] = back;
+    implied_lay_prob[index] = lay;
+
+    double back_num = 0.0, back_den = 0.0, lay_num = 0.0, lay_den = 0.0;
+    for (int l = 0; l < depth; ++l)
+    {
+        const std::size_t pos = l * stride + index;
+        back_num += back_price[pos] * back_size[pos];
+        back_den += back_size[pos];
+        lay_num += lay_price[pos] * lay_size[pos];
+        lay_den += lay_size[pos];
+    }
+    back_wap_price[index] = back_den > 0.0 ? back_num / back_den : 0.0;
+    lay_wap_price[index] = lay_den > 0.0 ? lay_num / lay_den : 0.0;
+    vwap[index] = traded_size[index] != 0.0 ? traded_value[index] / traded_size[index] : 0.0;
+}
+
+//==============================================================================
+void market_analytics::compute_all()
+{
+    // Padding slots hold zeros so the kernels run over the whole stride
+    reciprocals(back_price.data(), implied_back_prob.data(), stride);
+    reciprocals(lay_price.data(), implied_lay_prob.data(), stride);
+    back_book = total(implied_back_prob.data(), stride);
+    lay_book = total(implied_lay_prob.data(), stride);
+
+    const double** bp = &level_pointers[0];
+    const double** bs = &level_pointers[depth];
+    const double** lp = &level_pointers[2 * depth];
+    const double** ls = &level_pointers[3 * depth];
+    for (int l = 0; l < depth; ++l)
+    {
+        bp[l] = back_price.data() + l * stride;
+        bs[l] = back_size.data() + l * stride;
+        lp[l] = lay_price.data() + l * stride;
+        ls[l] = lay_size.data() + l * stride;
+    }
+    weighted_average(bp, bs, depth, stride, back_wap_price.data());
+    weighted_average(lp, ls, depth, stride, lay_wap_price.data());
+    safe_ratio(traded_value.data(), traded_size.data(), vwap.data(), stride);
+    since_full = 0;
+}
+
+} // end of namespace bfapi::analytics
+} // end of namespace bfapi
@@ -0,0 +1,127 @@
+//==============================================================================
+//
+// Market analytics computed on every book update: back and lay overround
+// (book percentage), implied probabilities, weighted average price to a given
+// depth of the ladder and traded volume VWAP for each runner.
+//
+// market_analytics keeps one market in contiguous structure-of-arrays form
+// (one array per ladder level and field, indexed by runner) so the kernels
+// below can process several runners per instruction. The kernels use AVX2 or
+// SSE2 when the CPU supports them and fall back to plain loops otherwise; the
+// choice is made once at run time.
+//
+// Loading a whole book recomputes everything with the vector kernels. When
+// only some runners changed (e.g. polling::book_update) apply() recomputes
+// just those runners and adjusts the market totals by the difference.
+//
+//==============================================================================
+#ifndef BFAPI_ANALYTICS_HPP
+#define BFAPI_ANALYTICS_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "responses.hpp"
+
+namespace bfapi {
+namespace analytics {
+
+enum class simd_level { scalar, sse2, avx2 };
+
+// Best instruction set supported by this CPU, and the one the kernels currently use
+simd_level detected_simd();
+simd_level active_simd();
+// Force a particular implementation (e.g. for benchmarks); levels the CPU lacks are ignored
+void set_simd(simd_level level);
+const char* simd_name(simd_level level);
+
+// Kernels over n contiguous runners. Prices of zero (no price) are skipped.
+
+// Sum of the values
+double total(const double* values, std::size_t n);
+// Sum of 1 / price
+double sum_reciprocals(const double* prices, std::size_t n);
+// out[i] = 1 / prices[i], or 0 without a price
+void reciprocals(const double* prices, double* out, std::size_t n);
+// out[i] = sum(price * size) / sum(size) over depth levels, each level an array of n runners
+void weighted_average(const double* const* prices, const double* const* sizes, int depth, std::size_t n, double* out);
+// out[i] = numerator[i] / denominator[i], or 0 if the denominator is 0
+void safe_ratio(const double* numerator, const double* denominator, double* out, std::size_t n);
+
+struct analytics_stats {
+	std::uint64_t full_updates;
+	std::uint64_t incremental_updates;
+	std::uint64_t runners_recomputed;
+
+	analytics_stats() : full_updates(0), incremental_updates(0), runners_recomputed(0) {}
+};
+
+class market_analytics {
+public:
+	// depth is the number of ladder levels used for the weighted average prices
+	explicit market_analytics(int depth = 3);
+
+	// Replace the market with a complete book and recompute everything
+	void load(const bfapi::responses::market_book& book);
+
+	// Recompute only the runners supplied, e.g. book_update::book.runners from the
+	// poller. Runners not seen before are added.
+	void apply(const std::vector<bfapi::responses::runner_book>& changed);
+
+	// Recompute every result from the stored ladders (load() does this itself)
+	void recompute();
+
+	std::size_t runner_count() const { return selection_ids.size(); }
+	int get_depth() const { return depth; }
+
+	// Per runner results, in the order runners were first seen
+	const std::vector<std::int64_t>& get_selection_ids() const { return selection_ids; }
+	int index_of(std::int64_t selection_id) const;
+
+	// Book percentages over the best available prices, e.g. 102.5
+	double back_overround() const { return back_book * 100.0; }
+	double lay_overround() const { return lay_book * 100.0; }
+
+	// Arrays of runner_count() values
+	const double* implied_back() const { return implied_back_prob.data(); }
+	const double* implied_lay() const { return implied_lay_prob.data(); }
+	const double* back_wap() const { return back_wap_price.data(); }
+	const double* lay_wap() const { return lay_wap_price.data(); }
+	const double* traded_vwap() const { return vwap.data(); }
+
+	analytics_stats get_stats() const { return stats; }
+
+private:
+	void resize(std::size_t runners);
+	void store_runner(std::size_t index, const bfapi::responses::runner_book& rb);
+	void compute_runner(std::size_t index);
+	void compute_all();
+
+	int depth;
+	std::size_t stride;                     // Array length: runner count rounded up to the vector width
+	std::vector<std::int64_t> selection_ids;
+
+	// Level major ladders: element [level * stride + runner]
+	std::vector<double> back_price;
+	std::vector<double> back_size;
+	std::vector<double> lay_price;
+	std::vector<double> lay_size;
+	std::vector<double> traded_value;       // Sum of price * size over the traded volume ladder
+	std::vector<double> traded_size;
+	std::vector<const double*> level_pointers;  // Start of each ladder level, passed to weighted_average()
+
+	std::vector<double> implied_back_prob;
+	std::vector<double> implied_lay_prob;
+	std::vector<double> back_wap_price;
+	std::vector<double> lay_wap_price;
+	std::vector<double> vwap;
+	double back_book;
+	double lay_book;
+	std::uint64_t since_full;               // Incremental updates since the totals were last summed from scratch
+	analytics_stats stats;
+};
+
+} // end of namespace bfapi::analytics
+} // end of namespace bfapi
+
+#endif
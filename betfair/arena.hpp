@@ -0,0 +1,191 @@
+//==============================================================================
+//
+// Monotonic arena for the memory used by one API call.
+//
+// Building a request and reading its response allocates many small objects:
+// JSON fragments, header fields, the response body and parsed strings. With
+// an arena these all come from one block that is handed back in a single step
+// by release() once the call completes. Nothing is freed individually.
+//
+// A call that does not fit spills into extra blocks taken from the heap. The
+// next release() replaces the blocks with one large enough for all of them, so
+// once an arena has seen a call of a given size, repeating it allocates
+// nothing from the heap.
+//
+// arena_allocator adapts an arena to standard containers and to beast, e.g.
+// the arena_string below or http::basic_fields<arena_allocator<char>>.
+// An arena is not thread safe; use one per thread or per connection.
+//
+//==============================================================================
+#ifndef BFAPI_ARENA_HPP
+#define BFAPI_ARENA_HPP
+
+#include <string>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+namespace bfapi {
+
+class arena {
+public:
+	explicit arena(std::size_t initial_capacity = 16384) : first(nullptr),
+	                                                       first_size(0),
+	                                                       extra(nullptr),
+	                                                       cur(nullptr),
+	                                                       limit(nullptr),
+	                                                       spilled(0),
+	                                                       upstream(0),
+	                                                       high_water(0)
+	{
+		reserve(initial_capacity);
+	}
+
+	~arena()
+	{
+		free_extra();
+		std::free(first);
+	}
+
+	arena(const arena&) = delete;
+	arena& operator=(const arena&) = delete;
+
+	void* allocate(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t))
+	{
+		char* p = align(cur, alignment);
+		if (p + bytes > limit || p < cur)
+		{
+			p = spill(bytes, alignment);
+		}
+		cur = p + bytes;
+		return p;
+	}
+
+	// Free everything allocated since the last release
+	void release()
+	{
+		const std::size_t used = bytes_used();
+		high_water = (used > high_water) ? used : high_water;
+		if (extra)
+		{
+			// The call outgrew the first block - size it for next time
+			free_extra();
+			reserve(first_size + used);
+		}
+		cur = first;
+		limit = first + first_size;
+		spilled = 0;
+	}
+
+	// Bytes handed out since the last release (approximate once spilled)
+	std::size_t bytes_used() const { return spilled + static_cast<std::size_t>(cur - (extra ? extra->data() : first)); }
+	std::size_t capacity() const { return first_size; }
+	std::size_t peak_bytes() const { return high_water; }
+
+	// Number of blocks taken from the heap over the lifetime of the arena
+	std::uint64_t upstream_allocations() const { return upstream; }
+
+private:
+	struct block {
+		block* next;
+		std::size_t size;
+
+		char* data() { return reinterpret_cast<char*>(this) + header_size(); }
+		static std::size_t header_size() { return (sizeof(block) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1); }
+	};
+
+	static char* align(char* p, std::size_t alignment)
+	{
+		const std::uintptr_t v = reinterpret_cast<std::uintptr_t>(p);
+		return reinterpret_cast<char*>((v + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1));
+	}
+
+	void reserve(std::size_t size)
+	{
+		std::free(first);
+		first_size = (size < 256) ? 256 : size;
+		first = static_cast<char*>(std::malloc(first_size));
+		if (nullptr == first)
+		{
+			throw std::bad_alloc();
+		}
+		++upstream;
+		cur = first;
+		limit = first + first_size;
+	}
+
+	char* spill(std::size_t bytes, std::size_t alignment)
+	{
+		// Count what was used of the block being left so release() can size the next first block
+		spilled += static_cast<std::size_t>(cur - (extra ? extra->data() : first));
+		const std::size_t previous = extra ? extra->size : first_size;
+		std::size_t size = previous * 2;
+		if (size < bytes + alignment)
+		{
+			size = bytes + alignment;
+		}
+		block* b = static_cast<block*>(std::malloc(block::header_size() + size));
+		if (nullptr == b)
+		{
+			throw std::bad_alloc();
+		}
+		++upstream;
+		b->next = extra;
+		b->size = size;
+		extra = b;
+		limit = b->data() + size;
+		return align(b->data(), alignment);
+	}
+
+	void free_extra()
+	{
+		while (extra)
+		{
+			block* next = extra->next;
+			std::free(extra);
+			extra = next;
+		}
+	}
+
+	char* first;
+	std::size_t first_size;
+	block* extra;               // Most recent spill block first
+	char* cur;
+	char* limit;
+	std::size_t spilled;        // Bytes used in blocks that have been left behind
+	std::uint64_t upstream;
+	std::size_t high_water;
+};
+
+// Standard allocator over an arena. deallocate() does nothing; the memory is
+// reclaimed when the arena is released.
+template<class T>
+class arena_allocator {
+public:
+	typedef T value_type;
+
+	explicit arena_allocator(arena& ar) : a(&ar) {}
+
+	template<class U>
+	arena_allocator(const arena_allocator<U>& other) : a(other.get_arena()) {}
+
+	T* allocate(std::size_t n) { return static_cast<T*>(a->allocate(n * sizeof(T), alignof(T))); }
+	void deallocate(T*, std::size_t) {}
+
+	arena* get_arena() const { return a; }
+
+	template<class U>
+	bool operator==(const arena_allocator<U>& other) const { return a == other.get_arena(); }
+	template<class U>
+	bool operator!=(const arena_allocator<U>& other) const { return a != other.get_arena(); }
+
+private:
+	arena* a;
+};
+
+typedef std::basic_string<char, std::char_traits<char>, arena_allocator<char>> arena_string;
+
+} // end of namespace bfapi
+
+#endif
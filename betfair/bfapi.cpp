@@ -1,4 +1,7 @@
 #include "bfapi.hpp"
+#include "endpoints.hpp"
+#include "governor.hpp"
+#include "timed_io.hpp"
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/ssl.hpp>
@@ -50,138 +53,112 @@ bool extract_user_credentials(const std::string& filename,
 }
 
 //==============================================================================
-bool placeOrders(const bfapi::accinfo& user_info,
-                 const std::string& session_token,
-                 std::string& bf_status,
-                 std::string& error,
-                 const bfapi::orders::place_limit_orders_request& request)
+bool post_json(const bfapi::accinfo& user_info,
+               const std::string& session_token,
+               const std::string& endpoint,
+               const std::string& body,
+               int& http_status,
+               std::string& response_body,
+               std::string& error,
+               const bfapi::deadlines& limits,
+               const std::shared_ptr<bfapi::request_governor>& governor)
 {
-    bool ok = false;    
+    return post_json(user_info, session_token, endpoint, body, http_status, response_body, error, limits, governor,
+                     bfapi::request_governor::priority_of(endpoint));
+}
+
+//==============================================================================
+bool post_json(const bfapi::accinfo& user_info,
+               const std::string& session_token,
+               const std::string& endpoint,
+               const std::string& body,
+               int& http_status,
+               std::string& response_body,
+               std::string& error,
+               const bfapi::deadlines& limits,
+               const std::shared_ptr<bfapi::request_governor>& governor,
+               bfapi::request_priority priority)
+{
+    bool ok = false;
     error = "";
-    bf_status = "";
+    http_status = 0;
+    response_body = "";
+    if (governor && false == governor->acquire(endpoint, priority))
+    {
+        error = "bfapi::post_json() error: request governor did not admit " + endpoint + " in time";
+        return false;
+    }
     try
-    {                                        
-        // The io_context is required for all I/O
+    {
         net::io_context ioc;
-
-        // The SSL context is required, and holds certificates
         ssl::context ctx(ssl::context::tlsv12_client);
-
-        // Verify server certificate 
-        ctx.set_verify_mode(ssl::verify_peer);                
+        ctx.set_verify_mode(ssl::verify_peer);
         ctx.set_default_verify_paths();
 
-        // These objects perform our I/O
-        tcp::resolver resolver(ioc);
         beast::ssl_stream<beast::tcp_stream> stream(ioc, ctx);
 
-        // Set SNI Hostname (many hosts need this to handshake successfully)
         if(! SSL_set_tlsext_host_name(stream.native_handle(), bfapi::bf_host.c_str()))
         {
             beast::error_code ec{static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()};
             throw beast::system_error{ec};
         }
 
-        // Look up the domain name
-        auto const results = resolver.resolve(bfapi::bf_host, bfapi::port);
-
-        // Make the connection on the IP address we get from a lookup
-        beast::get_lowest_layer(stream).connect(results);
+        beast::error_code ec = bfapi::shared_endpoints()->connect(ioc, beast::get_lowest_layer(stream), bfapi::bf_host, bfapi::port, limits.connect);
+        ec = ec ? ec : timed_io::handshake(ioc, stream, limits.connect);
+        if (ec)
+        {
+            throw beast::system_error{ec};
+        }
 
-        // Perform the SSL handshake
-        stream.handshake(ssl::stream_base::client);                  
-          
-        http::request<http::string_body> req{http::verb::post, bfapi::place_orders_endpoint, bfapi::http_version};                
-        req.set(http::field::host, bfapi::bf_host);        
+        http::request<http::string_body> req{http::verb::post, endpoint, bfapi::http_version};
+        req.set(http::field::host, bfapi::bf_host);
         req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
-                
         req.set("X-Application",user_info.appkey);
-        req.set("X-Authentication",session_token);        
+        req.set("X-Authentication",session_token);
         req.set("accept","application/json");
         req.set(http::field::content_type, "application/json");
-        req.body() = request.as_json_string();
-        req.prepare_payload();        
-        
-        std::cout << req.body() << std::endl;                                                                   
+        req.body() = body;
+        req.prepare_payload();
 
-        // Send the HTTP request to the remote host
-        http::write(stream, req);
-
-        // This buffer is used for reading and must be persisted
         beast::flat_buffer buffer;
-
-        // Declare a container to hold the response
         http::response<http::string_body> res;
-
-        // Receive the HTTP response
-        http::read(stream, buffer, res);        
-                
-        if (res.result_int() == 200)
-        {                       
-            // parse response with boost property_tree
-            ptree pt;
-            std::stringstream ss; 
-            ss << res.body();
-            read_json(ss, pt);            
-
-            int tc = pt.count("status");
-            if (tc > 0)
-            {
-                bf_status = pt.get<std::string>("status");
-            }
-            tc = pt.count("errorCode");
-            if (tc > 0)
-            {
-                error = pt.get<std::string>("errorCode");
-            }
-            if (bf_status == "SUCCESS")
-            {                
-                std::cout << "Reponse \"status\"=" << bf_status << std::endl;
-            }
-            else
-            {
-                error = "bfapi::login() error: Response \"status\" = " + bf_status + ", \"errorCode\" = " + error;
-            }            
+        ec = timed_io::request(ioc, stream, req, buffer, res, limits.request);
+        if (ec)
+        {
+            throw beast::system_error{ec};
         }
-        else
-        {            
-            // NOTE: must use explicit std::string constructor because res.reason() is actually a boost::string_view)        
-            error = "bfapi::login() error: HTTPS response error " + std::to_string(res.result_int()) + " " + std::string(res.reason());
-            std::cout << error << std::endl;            
-            for (auto& h : res.base()) 
-            {
-                std::cout << "Field: " << h.name() << "/text: " << h.name_string() << ", Value: " << h.value() << "\n";
-            }
-            std::cout << res.body() << std::endl;
-        } 
-                
-        // Try to gracefully close the stream - currently this fails with Stream truncated error code
-        beast::error_code ec;
-        stream.shutdown(ec);
-        if(ec == net::error::eof)
+
+        http_status = res.result_int();
+        response_body = std::move(res.body());
+        if (governor)
         {
-            // Rationale:
-            // http://stackoverflow.com/questions/25587403/boost-asio-ssl-async-shutdown-always-finishes-with-an-error
-            ec = {};
+            governor->record(endpoint, http_status, response_body.data(), response_body.size());
         }
-        if (ec)
+        ok = (http_status == 200);
+        if (false == ok)
         {
-            error = "bfapi::placeOrders() shutdown error: " + ec.message();
-            //throw beast::system_error{ec};
-        }        
+            // NOTE: must use explicit std::string constructor because res.reason() is actually a boost::string_view
+            error = "bfapi::post_json() error: HTTPS response error " + std::to_string(http_status) + " " + std::string(res.reason());
+        }
+
+        // Shutdown errors are not treated as failures since the response has already been received
+        beast::get_lowest_layer(stream).expires_after(limits.connect);
+        stream.async_shutdown(timed_io::completion{&ec});
+        timed_io::run(ioc);
     }
     catch(std::exception const& e)
     {
-        error = std::string("bfapi::placeOrders() exception occurred: ") + std::string(e.what());
+        error = std::string("bfapi::post_json() exception occurred: ") + std::string(e.what());
         ok = false;
     }
     return ok;
 }
 
 //==============================================================================
-bool login(const bfapi::accinfo& user_info, 
+bool login(const bfapi::accinfo& user_info,
            std::string& session_token, 
-           std::string& error)           
+           std::string& error,
+           const bfapi::deadlines& limits)
 {
     bool ok = false;
     
@@ -208,7 +185,6 @@ bool login(const bfapi::accinfo& user_info,
         ctx.set_verify_mode(ssl::verify_none);
 
         // These objects perform our I/O
-        tcp::resolver resolver(ioc);
         beast::ssl_stream<beast::tcp_stream> stream(ioc, ctx);
 
         // Set SNI Hostname (many hosts need this to handshake successfully)
@@ -218,14 +194,13 @@ bool login(const bfapi::accinfo& user_info,
             throw beast::system_error{ec};
         }
 
-        // Look up the domain name
-        auto const results = resolver.resolve(login_host, port);
-
-        // Make the connection on the IP address we get from a lookup
-        beast::get_lowest_layer(stream).connect(results);
-
-        // Perform the SSL handshake
-        stream.handshake(ssl::stream_base::client);   
+        // Look up the domain name (cached), connect and perform the SSL handshake - each step is bounded by limits.connect
+        beast::error_code ec = bfapi::shared_endpoints()->connect(ioc, beast::get_lowest_layer(stream), login_host, port, limits.connect);
+        ec = ec ? ec : timed_io::handshake(ioc, stream, limits.connect);
+        if (ec)
+        {
+            throw beast::system_error{ec};
+        }
                 
         // Create HTTP login request
         http::request<http::string_body> req{http::verb::post, target, http_version};                
@@ -238,9 +213,6 @@ bool login(const bfapi::accinfo& user_info,
         req.body() = "username=" + user_info.username + "&password=" + user_info.password;
         req.prepare_payload();                    
 
-        // Send the HTTP request to the remote host
-        http::write(stream, req);
-
         // This buffer is used for reading and must be persisted
         beast::flat_buffer buffer;
 
@@ -251,8 +223,12 @@ bool login(const bfapi::accinfo& user_info,
         //http::response<http::dynamic_body> res;
         http::response<http::string_body> res;
 
-        // Receive the HTTP response
-        http::read(stream, buffer, res);
+        // Send the HTTP request to the remote host and receive the response before the request deadline
+        ec = timed_io::request(ioc, stream, req, buffer, res, limits.request);
+        if (ec)
+        {
+            throw beast::system_error{ec};
+        }
                         
         std::string bf_login_status = "";
         if (res.result_int() == 200)
@@ -301,21 +277,14 @@ bool login(const bfapi::accinfo& user_info,
             std::cout << res.body() << std::endl;
         }        
                 
-        // Gracefully close the stream
-        beast::error_code ec;
-        stream.shutdown(ec);
-        if(ec == net::error::eof)
-        {
-            // Rationale:
-            // http://stackoverflow.com/questions/25587403/boost-asio-ssl-async-shutdown-always-finishes-with-an-error
-            ec = {};
-        }
-        if(ec)
-        {
-            throw beast::system_error{ec};
-        }
+        // Close the stream. Shutdown errors (eof, stream truncated or a timeout when the
+        // server never answers close_notify) are not treated as failures since the
+        // response has already been received, as in post_json().
+        // http://stackoverflow.com/questions/25587403/boost-asio-ssl-async-shutdown-always-finishes-with-an-error
+        beast::get_lowest_layer(stream).expires_after(limits.connect);
+        stream.async_shutdown(timed_io::completion{&ec});
+        timed_io::run(ioc);
         
-        // If we get here then the connection is closed gracefully
         // If we have assigned a value to the session token, then login was a success
         ok = session_token.size() > 0;
     }
@@ -27,18 +27,54 @@
 
 #include <string>
 #include <vector>
+#include <chrono>
+#include <memory>
 #include "orders.hpp"
 
 namespace bfapi {
     
+    class request_governor;
+    enum class request_priority;
+    
     const std::string bf_host = "api.betfair.com";                                                     // Host          
-    const std::string place_orders_endpoint = "/exchange/betting/rest/v1.0/placeOrders/";              // endpoint for placeOrders
-    const std::string list_event_types_endpoint = "/exchange/betting/rest/v1.0/listEventTypes/";       // endpoint for listEventTypes
+    // Betting API REST endpoint paths as compile time constants, used by the operation traits in operations.hpp
+    namespace paths {
+        constexpr const char* place_orders = "/exchange/betting/rest/v1.0/placeOrders/";
+        constexpr const char* cancel_orders = "/exchange/betting/rest/v1.0/cancelOrders/";
+        constexpr const char* replace_orders = "/exchange/betting/rest/v1.0/replaceOrders/";
+        constexpr const char* list_event_types = "/exchange/betting/rest/v1.0/listEventTypes/";
+        constexpr const char* list_market_book = "/exchange/betting/rest/v1.0/listMarketBook/";
+        constexpr const char* list_runner_book = "/exchange/betting/rest/v1.0/listRunnerBook/";
+        constexpr const char* list_market_catalogue = "/exchange/betting/rest/v1.0/listMarketCatalogue/";
+        constexpr const char* list_current_orders = "/exchange/betting/rest/v1.0/listCurrentOrders/";
+        constexpr const char* list_cleared_orders = "/exchange/betting/rest/v1.0/listClearedOrders/";
+    } // end of namespace bfapi::paths
+
+    const std::string place_orders_endpoint = paths::place_orders;                      // endpoint for placeOrders
+    const std::string cancel_orders_endpoint = paths::cancel_orders;                    // endpoint for cancelOrders
+    const std::string replace_orders_endpoint = paths::replace_orders;                  // endpoint for replaceOrders
+    const std::string list_event_types_endpoint = paths::list_event_types;              // endpoint for listEventTypes
+    const std::string list_market_book_endpoint = paths::list_market_book;              // endpoint for listMarketBook
+    const std::string list_runner_book_endpoint = paths::list_runner_book;              // endpoint for listRunnerBook
+    const std::string list_market_catalogue_endpoint = paths::list_market_catalogue;    // endpoint for listMarketCatalogue
+    const std::string list_current_orders_endpoint = paths::list_current_orders;        // endpoint for listCurrentOrders
+    const std::string list_cleared_orders_endpoint = paths::list_cleared_orders;        // endpoint for listClearedOrders
+    const std::string betting_jsonrpc_endpoint = "/exchange/betting/json-rpc/v1";                      // endpoint for JSON-RPC betting calls
     
     
     const std::string port = "443";   // HTTPS port    
     const int http_version = 11;      // HTTP 1.1
     
+    // Deadlines applied to network operations. A stalled connect, handshake or
+    // request fails with a timeout error instead of blocking forever.
+    struct deadlines {
+        std::chrono::milliseconds connect;    // Applied separately to connecting (DNS lookup, re-probe, TCP connect race) and TLS handshake
+        std::chrono::milliseconds request;    // Writing the request and reading the complete response
+
+        deadlines() : connect(5000), request(10000) {}
+        deadlines(std::chrono::milliseconds c, std::chrono::milliseconds r) : connect(c), request(r) {}
+    };
+
     struct accinfo {
         std::string username;
         std::string password;
@@ -51,13 +87,45 @@ namespace bfapi {
     bool extract_user_credentials(const std::string& filename, bfapi::accinfo& ainfo);
     bool login(const bfapi::accinfo& user_info,
                std::string& session_token, 
-               std::string& error);                  
+               std::string& error,
+               const bfapi::deadlines& limits = bfapi::deadlines());
                                            
+    // One shot placeOrders: operations::call<operations::place_orders>() on a new
+    // connection that is closed again afterwards. bf_status is the report status.
+    // Defined in operations.cpp, so connection.cpp and operations.cpp must be linked.
     bool placeOrders(const bfapi::accinfo& user_info,
                      const std::string& session_token,
                      std::string& bf_status,
                      std::string& error,
-                     const bfapi::orders::place_limit_orders_request& request);
+                     const bfapi::orders::place_limit_orders_request& request,
+                     const bfapi::deadlines& limits = bfapi::deadlines(),
+                     const std::shared_ptr<bfapi::request_governor>& governor = nullptr);
+
+    // Send a JSON body to an endpoint on bf_host and return the raw HTTP status and response body.
+    // With a governor the request waits for a token first (failing without being sent if none
+    // comes in time) and the response is reported to it, as for an api_connection.
+    bool post_json(const bfapi::accinfo& user_info,
+                   const std::string& session_token,
+                   const std::string& endpoint,
+                   const std::string& body,
+                   int& http_status,
+                   std::string& response_body,
+                   std::string& error,
+                   const bfapi::deadlines& limits = bfapi::deadlines(),
+                   const std::shared_ptr<bfapi::request_governor>& governor = nullptr);
+
+    // As above with the governor priority given rather than taken from the endpoint
+    // (e.g. order priority for a JSON-RPC batch holding placeOrders calls)
+    bool post_json(const bfapi::accinfo& user_info,
+                   const std::string& session_token,
+                   const std::string& endpoint,
+                   const std::string& body,
+                   int& http_status,
+                   std::string& response_body,
+                   std::string& error,
+                   const bfapi::deadlines& limits,
+                   const std::shared_ptr<bfapi::request_governor>& governor,
+                   bfapi::request_priority priority);
     
 } // end of namespace bfapi
 
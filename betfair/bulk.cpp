@@ -0,0 +1,517 @@
+#include "bulk.hpp"
+#include "operations.hpp"
+#include "rate_limiter.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <cstdio>
+
+namespace bfapi {
+namespace bulk {
+
+namespace {
+
+struct task {
+    time_window window;
+    int from_record;
+    int attempts;
+
+    task() : from_record(0), attempts(0) {}
+    task(const time_window& w, int record) : window(w), from_record(record), attempts(0) {}
+};
+
+enum class outcome { done, next_page, split, retry, truncated };
+
+struct task_result {
+    outcome result;
+    int next_record;
+    std::string error;
+
+    task_result() : result(outcome::retry), next_record(0) {}
+};
+
+typedef std::function<task_result(const task&)> task_function;
+
+//==============================================================================
+std::string date_range_json(const time_window& w)
+{
+    // The API treats both ends as inclusive so finish just short of the next window
+    return "{\"from\":\"" + to_iso8601(w.from) + "\",\"to\":\"" + to_iso8601(w.to - 1, 999) + "\"}";
+}
+
+//==============================================================================
+void queue_window(const time_window& w, bulk_progress& progress, std::deque<task>& work, bulk_stats& stats)
+{
+    if (progress.is_complete(w))
+    {
+        ++stats.windows_skipped;
+        return;
+    }
+    if (progress.is_split(w))
+    {
+        const std::time_t mid = w.from + (w.to - w.from) / 2;
+        queue_window(time_window(w.from, mid), progress, work, stats);
+        queue_window(time_window(mid, w.to), progress, work, stats);
+        return;
+    }
+    work.push_back(task(w, progress.next_record(w)));
+}
+
+//==============================================================================
+bool run_tasks(bfapi::connection_pool& pool,
+               std::time_t from,
+               std::time_t to,
+               const bulk_options& options,
+               bulk_progress& progress,
+               const task_function& fn,
+               bulk_stats& stats,
+               std::string& error)
+{
+    error = "";
+    stats = bulk_stats();
+    if (false == options.checkpoint_file.empty())
+    {
+        std::ifstream exists(options.checkpoint_file);
+        if (exists.good() && false == progress.load(options.checkpoint_file, error))
+        {
+            return false;
+        }
+    }
+
+    std::deque<task> work;
+    for (const time_window& w : split_range(from, to, options.window_seconds))
+    {
+        queue_window(w, progress, work, stats);
+    }
+
+    // The workers run on the pool's threads. One that only starts once the work
+    // is done (every thread was busy) finds finished set and returns at once, so
+    // only the shared state has to outlive this call.
+    struct shared_state {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::size_t active;
+        bool finished;
+
+        shared_state() : active(0), finished(false) {}
+    };
+    auto const state = std::make_shared<shared_state>();
+    std::mutex& mtx = state->mtx;
+    std::condition_variable& cv = state->cv;
+    std::size_t in_flight = 0;
+    std::vector<std::string> errors;
+    std::string checkpoint_error;
+
+    auto checkpoint = [&]()
+    {
+        std::string save_error;
+        if (false == options.checkpoint_file.empty() && false == progress.save(options.checkpoint_file, save_error))
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            ++stats.checkpoint_failures;
+            if (checkpoint_error.empty())
+            {
+                checkpoint_error = save_error;
+            }
+        }
+    };
+
+    auto worker = [&]()
+    {
+        for (;;)
+        {
+            task t;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&] { return false == work.empty() || in_flight == 0; });
+                if (work.empty())
+                {
+                    return;
+                }
+                t = work.front();
+                work.pop_front();
+                ++in_flight;
+            }
+
+            const task_result r = fn(t);
+            std::vector<task> follow_on;
+            switch (r.result)
+            {
+            case outcome::done:
+                progress.mark_complete(t.window);
+                checkpoint();
+                break;
+            case outcome::next_page:
+                progress.set_next_record(t.window, r.next_record);
+                checkpoint();
+                follow_on.push_back(task(t.window, r.next_record));
+                break;
+            case outcome::split:
+            {
+                progress.mark_split(t.window);
+                checkpoint();
+                const std::time_t mid = t.window.from + (t.window.to - t.window.from) / 2;
+                follow_on.push_back(task(time_window(t.window.from, mid), 0));
+                follow_on.push_back(task(time_window(mid, t.window.to), 0));
+                break;
+            }
+            case outcome::retry:
+                if (t.attempts + 1 < options.max_attempts)
+                {
+                    // Back off before trying this window again
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100 << std::min(t.attempts, 6)));
+                    ++t.attempts;
+                    follow_on.push_back(t);
+                }
+                break;
+            case outcome::truncated:
+                // Left incomplete in the progress; fetching again would give the same page
+                break;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                ++stats.requests;
+                if (r.result == outcome::retry)
+                {
+                    ++stats.failed_requests;
+                    if (follow_on.empty())
+                    {
+                        ++stats.windows_failed;
+                        errors.push_back(r.error);
+                    }
+                }
+                if (r.result == outcome::truncated)
+                {
+                    ++stats.windows_truncated;
+                    errors.push_back(r.error);
+                }
+                stats.windows_completed += (r.result == outcome::done) ? 1 : 0;
+                stats.windows_split += (r.result == outcome::split) ? 1 : 0;
+                work.insert(work.end(), follow_on.begin(), follow_on.end());
+                --in_flight;
+            }
+            cv.notify_all();
+        }
+    };
+
+    auto pool_worker = [state, &worker]()
+    {
+        {
+            std::lock_guard<std::mutex> lock(state->mtx);
+            if (state->finished)
+            {
+                return;
+            }
+            ++state->active;
+        }
+        worker();
+        std::lock_guard<std::mutex> lock(state->mtx);
+        --state->active;
+        state->cv.notify_all();
+    };
+
+    const std::size_t thread_count = std::max<std::size_t>(1, options.concurrency);
+    for (std::size_t i = 1; i < thread_count; ++i)
+    {
+        pool.run(pool_worker);
+    }
+    worker();
+    {
+        // worker() only returns once nothing is queued or in flight
+        std::unique_lock<std::mutex> lock(mtx);
+        state->finished = true;
+        cv.wait(lock, [&] { return state->active == 0; });
+    }
+
+    if (false == errors.empty())
+    {
+        error = "bfapi::bulk " + std::to_string(errors.size()) + " window(s) failed, first error: " + errors.front();
+        return false;
+    }
+    if (false == checkpoint_error.empty())
+    {
+        // The data was fetched but a restart would repeat work
+        error = "bfapi::bulk " + std::to_string(stats.checkpoint_failures) + " checkpoint save(s) failed, first error: " + checkpoint_error;
+        return false;
+    }
+    return true;
+}
+
+} // end of anonymous namespace
+
+//==============================================================================
+std::vector<time_window> split_range(std::time_t from, std::time_t to, std::time_t window_seconds)
+{
+    std::vector<time_window> windows;
+    const std::time_t step = window_seconds > 0 ? window_seconds : (to - from);
+    for (std::time_t t = from; t < to; t += step)
+    {
+        windows.push_back(time_window(t, std::min(to, t + step)));
+    }
+    return windows;
+}
+
+//==============================================================================
+bool bulk_progress::is_complete(const time_window& w) const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return complete.count(w.key()) > 0;
+}
+
+//==============================================================================
+bool bulk_progress::is_split(const time_window& w) const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return split.count(w.key()) > 0;
+}
+
+//==============================================================================
+int bulk_progress::next_record(const time_window& w) const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    auto const it = next.find(w.key());
+    return it == next.end() ? 0 : it->second;
+}
+
+//==============================================================================
+void bulk_progress::mark_complete(const time_window& w)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    next.erase(w.key());
+    complete.insert(w.key());
+}
+
+//==============================================================================
+void bulk_progress::mark_split(const time_window& w)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    split.insert(w.key());
+}
+
+//==============================================================================
+void bulk_progress::set_next_record(const time_window& w, int record)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    next[w.key()] = record;
+}
+
+//==============================================================================
+bool bulk_progress::save(const std::string& filename, std::string& error) const
+{
+    // Write to a temporary file and rename so a crash never leaves a partial
+    // checkpoint. The lock is held until the rename so that concurrent saves
+    // cannot rewrite the temporary file while it is being renamed.
+    const std::string tmp = filename + ".tmp";
+    std::lock_guard<std::mutex> lock(mtx);
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (false == out.good())
+        {
+            error = "bfapi::bulk::bulk_progress::save() unable to open " + tmp;
+            return false;
+        }
+        for (const std::string& k : complete)
+        {
+            out << "done " << k << "\n";
+        }
+        for (const std::string& k : split)
+        {
+            out << "split " << k << "\n";
+        }
+        for (const auto& n : next)
+        {
+            out << "next " << n.first << " " << n.second << "\n";
+        }
+        out.close();
+        if (out.fail())
+        {
+            error = "bfapi::bulk::bulk_progress::save() unable to write " + tmp;
+            return false;
+        }
+    }
+    if (std::rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        error = "bfapi::bulk::bulk_progress::save() unable to rename " + tmp;
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool bulk_progress::load(const std::string& filename, std::string& error)
+{
+    std::ifstream in(filename);
+    if (false == in.good())
+    {
+        error = "bfapi::bulk::bulk_progress::load() unable to open " + filename;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream ss(line);
+        std::string kind;
+        std::string key;
+        ss >> kind >> key;
+        if (kind == "done")
+        {
+            complete.insert(key);
+        }
+        else if (kind == "split")
+        {
+            split.insert(key);
+        }
+        else if (kind == "next")
+        {
+            int record = 0;
+            ss >> record;
+            next[key] = record;
+        }
+    }
+    return true;
+}
+
+//==============================================================================
+void bulk_progress::clear()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    complete.clear();
+    split.clear();
+    next.clear();
+}
+
+//==============================================================================
+bool fetch_cleared_orders(bfapi::connection_pool& pool,
+                          const cleared_orders_query& query,
+                          const bulk_options& options,
+                          bulk_progress& progress,
+                          const cleared_orders_sink& sink,
+                          bulk_stats& stats,
+                          std::string& error)
+{
+    stats = bulk_stats();
+    rate_limiter limiter(options.max_requests_per_second);
+    std::mutex sink_mtx;
+    const int page_size = std::max(1, std::min(options.page_size, 1000));
+
+    bfapi::operations::list_cleared_orders_request base;
+    base.bet_status = query.bet_status;
+    base.event_type_ids = query.event_type_ids;
+    base.market_ids = query.market_ids;
+    base.record_count = page_size;
+
+    auto fn = [&](const task& t)
+    {
+        task_result r;
+        bfapi::operations::list_cleared_orders_request request = base;
+        // The API treats both ends as inclusive so finish just short of the next window
+        request.settled_from = to_iso8601(t.window.from);
+        request.settled_to = to_iso8601(t.window.to - 1, 999);
+        request.from_record = t.from_record;
+        limiter.acquire();
+        bfapi::arena a;
+        bfapi::responses::cleared_order_summary_report page;
+        if (false == bfapi::operations::call<bfapi::operations::list_cleared_orders>(pool, request, page, a, r.error))
+        {
+            return r;
+        }
+        {
+            std::lock_guard<std::mutex> lock(sink_mtx);
+            stats.records += page.cleared_orders.size();
+            if (sink && false == page.cleared_orders.empty())
+            {
+                sink(page.cleared_orders);
+            }
+        }
+        r.next_record = t.from_record + static_cast<int>(page.cleared_orders.size());
+        r.result = (page.more_available && false == page.cleared_orders.empty()) ? outcome::next_page : outcome::done;
+        return r;
+    };
+
+    // stats.records is accumulated by the task function so keep it over the reset in run_tasks
+    bulk_stats run_stats;
+    const bool ok = run_tasks(pool, query.settled_from, query.settled_to, options, progress, fn, run_stats, error);
+    run_stats.records = stats.records;
+    stats = run_stats;
+    return ok;
+}
+
+//==============================================================================
+bool fetch_market_catalogue(bfapi::connection_pool& pool,
+                            const catalogue_query& query,
+                            const bulk_options& options,
+                            bulk_progress& progress,
+                            const catalogue_sink& sink,
+                            bulk_stats& stats,
+                            std::string& error)
+{
+    stats = bulk_stats();
+    rate_limiter limiter(options.max_requests_per_second);
+    std::mutex sink_mtx;
+
+    // The request weight (maxResults times the projection weight) must stay within the operation's limit
+    typedef bfapi::operations::list_market_catalogue operation;
+    bfapi::operations::list_market_catalogue_request base;
+    base.market_projection = query.market_projection;
+    base.sort = "FIRST_TO_START";
+    base.max_results = 1;
+    const int weight = operation::weight(base);
+    int max_results = std::max(1, std::min(options.page_size, 1000));
+    if (weight > 0)
+    {
+        max_results = std::min(max_results, operation::max_weight / weight);
+    }
+    base.max_results = max_results;
+
+    auto fn = [&](const task& t)
+    {
+        task_result r;
+        bfapi::operations::list_market_catalogue_request request = base;
+        request.filter_json = query.filter_json + (query.filter_json.empty() ? "" : ",") +
+                              "\"marketStartTime\":" + date_range_json(t.window);
+        limiter.acquire();
+        bfapi::arena a;
+        std::vector<bfapi::responses::market_catalogue> page;
+        if (false == bfapi::operations::call<operation>(pool, request, page, a, r.error))
+        {
+            return r;
+        }
+        if (static_cast<int>(page.size()) >= max_results)
+        {
+            // Probably truncated - discard and fetch the two halves instead, unless
+            // the window is already too short to split
+            r.result = (t.window.to - t.window.from) > 1 ? outcome::split : outcome::truncated;
+            if (r.result == outcome::truncated)
+            {
+                r.error = "bfapi::bulk::fetch_market_catalogue() error: " + std::to_string(page.size()) +
+                          " markets start at " + to_iso8601(t.window.from) + ", more may exist beyond maxResults";
+            }
+            return r;
+        }
+        {
+            std::lock_guard<std::mutex> lock(sink_mtx);
+            stats.records += page.size();
+            if (sink && false == page.empty())
+            {
+                sink(page);
+            }
+        }
+        r.result = outcome::done;
+        return r;
+    };
+
+    bulk_stats run_stats;
+    const bool ok = run_tasks(pool, query.start_from, query.start_to, options, progress, fn, run_stats, error);
+    run_stats.records = stats.records;
+    stats = run_stats;
+    return ok;
+}
+
+} // end of namespace bfapi::bulk
+} // end of namespace bfapi
@@ -0,0 +1,152 @@
+//==============================================================================
+//
+// Parallel bulk retrieval for listClearedOrders and listMarketCatalogue.
+//
+// Both operations can return far more records than fit in a single response.
+// listClearedOrders pages with fromRecord/recordCount while listMarketCatalogue
+// simply truncates at maxResults. The requested date range is split into time
+// windows which are fetched concurrently over a connection_pool, with the
+// workers running on threads kept by the pool (see connection_pool::run()):
+//
+//   - cleared orders are paged sequentially within each window until the
+//     response no longer reports moreAvailable
+//   - a catalogue window that comes back full is assumed to be truncated and
+//     is bisected and fetched again. A full page for a window of one second
+//     cannot be bisected; it is not passed to the sink, the window is counted
+//     in bulk_stats::windows_truncated and the fetch reports an error (narrow
+//     the filter, e.g. by eventTypeIds or venues, to fetch those markets)
+//
+// Parsed records are handed to a sink as each page arrives. Progress is
+// recorded per window so an interrupted fetch can be resumed from where it
+// stopped, optionally via a checkpoint file.
+//
+//==============================================================================
+#ifndef BFAPI_BULK_HPP
+#define BFAPI_BULK_HPP
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <mutex>
+#include <ctime>
+#include <functional>
+#include <cstdint>
+#include "connection.hpp"
+#include "dates.hpp"
+#include "responses.hpp"
+
+namespace bfapi {
+namespace bulk {
+
+struct time_window {
+	std::time_t from;   // inclusive
+	std::time_t to;     // exclusive
+
+	time_window() : from(0), to(0) {}
+	time_window(std::time_t f, std::time_t t) : from(f), to(t) {}
+	std::string key() const { return std::to_string(from) + "-" + std::to_string(to); }
+};
+
+// Split [from, to) into consecutive windows of at most window_seconds
+std::vector<time_window> split_range(std::time_t from, std::time_t to, std::time_t window_seconds);
+
+// Betfair date format, e.g. 2024-01-31T14:30:00.000Z (see dates.hpp)
+using bfapi::dates::to_iso8601;
+using bfapi::dates::from_iso8601;
+
+struct bulk_options {
+	std::size_t concurrency;            // Maximum requests in flight (bounded additionally by the pool)
+	double max_requests_per_second;     // Request rate ceiling across all workers, 0 = unlimited
+	std::time_t window_seconds;         // Initial time window size
+	int page_size;                      // recordCount / maxResults (capped by API limits)
+	int max_attempts;                   // Attempts per request before the window is abandoned
+	std::string checkpoint_file;        // If not empty progress is loaded from and saved to this file
+
+	bulk_options() : concurrency(4), max_requests_per_second(5.0), window_seconds(6 * 3600),
+	                 page_size(1000), max_attempts(3) {}
+};
+
+// Record of completed work so that a fetch can be resumed. Thread safe.
+class bulk_progress {
+public:
+	bool is_complete(const time_window& w) const;
+	bool is_split(const time_window& w) const;
+	int next_record(const time_window& w) const;
+
+	void mark_complete(const time_window& w);
+	void mark_split(const time_window& w);
+	void set_next_record(const time_window& w, int record);
+
+	bool save(const std::string& filename, std::string& error) const;
+	bool load(const std::string& filename, std::string& error);
+	void clear();
+
+private:
+	std::set<std::string> complete;
+	std::set<std::string> split;
+	std::map<std::string, int> next;
+	mutable std::mutex mtx;
+};
+
+struct bulk_stats {
+	std::uint64_t requests;
+	std::uint64_t failed_requests;
+	std::uint64_t records;
+	std::uint64_t windows_completed;
+	std::uint64_t windows_skipped;      // Already complete in the supplied progress
+	std::uint64_t windows_split;
+	std::uint64_t windows_failed;
+	std::uint64_t windows_truncated;    // Catalogue windows still full at one second (the fetch then reports an error)
+	std::uint64_t checkpoint_failures;  // Progress saves that failed (the fetch then reports an error)
+
+	bulk_stats() : requests(0), failed_requests(0), records(0), windows_completed(0),
+	               windows_skipped(0), windows_split(0), windows_failed(0), windows_truncated(0),
+	               checkpoint_failures(0) {}
+};
+
+struct cleared_orders_query {
+	std::string bet_status;                 // SETTLED, VOIDED, LAPSED or CANCELLED
+	std::vector<std::string> event_type_ids;
+	std::vector<std::string> market_ids;
+	std::time_t settled_from;
+	std::time_t settled_to;
+
+	cleared_orders_query() : bet_status("SETTLED"), settled_from(0), settled_to(0) {}
+};
+
+struct catalogue_query {
+	std::string filter_json;                // Additional MarketFilter members, e.g. "\"eventTypeIds\":[\"7\"]"
+	std::vector<std::string> market_projection;
+	std::time_t start_from;
+	std::time_t start_to;
+
+	catalogue_query() : market_projection({"EVENT", "MARKET_START_TIME", "RUNNER_DESCRIPTION"}), start_from(0), start_to(0) {}
+};
+
+typedef std::function<void(const std::vector<bfapi::responses::cleared_order>&)> cleared_orders_sink;
+typedef std::function<void(const std::vector<bfapi::responses::market_catalogue>&)> catalogue_sink;
+
+// Each sink call receives one page and calls are serialised. Returns false if
+// any window could not be fetched; progress then records everything that was
+// delivered so calling again with the same progress resumes the fetch.
+bool fetch_cleared_orders(bfapi::connection_pool& pool,
+                          const cleared_orders_query& query,
+                          const bulk_options& options,
+                          bulk_progress& progress,
+                          const cleared_orders_sink& sink,
+                          bulk_stats& stats,
+                          std::string& error);
+
+bool fetch_market_catalogue(bfapi::connection_pool& pool,
+                            const catalogue_query& query,
+                            const bulk_options& options,
+                            bulk_progress& progress,
+                            const catalogue_sink& sink,
+                            bulk_stats& stats,
+                            std::string& error);
+
+} // end of namespace bfapi::bulk
+} // end of namespace bfapi
+
+#endif
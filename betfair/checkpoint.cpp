@@ -0,0 +1,674 @@
+#include "checkpoint.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using clock_type = std::chrono::steady_clock;
+
+namespace bfapi {
+namespace checkpoint {
+
+namespace {
+
+const char file_magic[8] = {'B', 'F', 'A', 'P', 'I', 'C', 'K', 'P'};
+const std::size_t field_alignment = 8;
+
+struct file_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::int64_t captured;
+    std::uint64_t market_count;
+    std::uint64_t order_count;
+    std::uint64_t payload_bytes;
+    std::uint64_t checksum;
+};
+
+static_assert(sizeof(file_header) % field_alignment == 0, "Header must keep the payload aligned");
+
+//==============================================================================
+std::size_t padded(std::size_t n)
+{
+    return (n + field_alignment - 1) & ~(field_alignment - 1);
+}
+
+//==============================================================================
+std::uint64_t fnv1a(const char* p, std::size_t n)
+{
+    std::uint64_t h = 14695981039346656037ULL;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        h ^= static_cast<unsigned char>(p[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+//==============================================================================
+// Appends to a buffer that is reused between snapshots, so nothing is
+// allocated once it has grown to fit.
+class encoder {
+public:
+    explicit encoder(std::vector<char>& b) : buffer(b) {}
+
+    void bytes(const void* p, std::size_t n)
+    {
+        // Grows zero filled, which also writes the padding
+        const std::size_t at = buffer.size();
+        buffer.resize(at + padded(n));
+        if (n > 0)
+        {
+            std::memcpy(buffer.data() + at, p, n);
+        }
+    }
+
+    template<class T>
+    void value(const T& v)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values are copied");
+        bytes(&v, sizeof(T));
+    }
+
+    void string(const std::string& s)
+    {
+        value(static_cast<std::uint64_t>(s.size()));
+        bytes(s.data(), s.size());
+    }
+
+    template<class T>
+    void array(const std::vector<T>& v)
+    {
+        value(static_cast<std::uint64_t>(v.size()));
+        bytes(v.data(), v.size() * sizeof(T));
+    }
+
+private:
+    std::vector<char>& buffer;
+};
+
+//==============================================================================
+// Reads from the mapped file. Every read is bounds checked; after the first
+// failure all further reads fail.
+class decoder {
+public:
+    decoder(const char* begin, const char* e) : p(begin), end(e), ok(true) {}
+
+    const char* take(std::size_t n)
+    {
+        if (false == ok || static_cast<std::size_t>(end - p) < padded(n))
+        {
+            ok = false;
+            return nullptr;
+        }
+        const char* q = p;
+        p += padded(n);
+        return q;
+    }
+
+    template<class T>
+    bool value(T& v)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Only plain values are copied");
+        const char* q = take(sizeof(T));
+        if (nullptr == q)
+        {
+            return false;
+        }
+        std::memcpy(&v, q, sizeof(T));
+        return true;
+    }
+
+    bool string(std::string& s)
+    {
+        std::uint64_t n = 0;
+        const char* q = value(n) && n <= static_cast<std::uint64_t>(end - p) ? take(n) : nullptr;
+        if (nullptr == q)
+        {
+            ok = false;
+            return false;
+        }
+        s.assign(q, n);
+        return true;
+    }
+
+    template<class T>
+    bool array(std::vector<T>& v)
+    {
+        std::uint64_t n = 0;
+        const char* q = value(n) && n <= static_cast<std::uint64_t>(end - p) / sizeof(T) ? take(n * sizeof(T)) : nullptr;
+        if (nullptr == q)
+        {
+            ok = false;
+            return false;
+        }
+        // Fields are 8 byte aligned in a page aligned map, so the structs can be read in place
+        const T* first = reinterpret_cast<const T*>(q);
+        v.assign(first, first + n);
+        return true;
+    }
+
+    bool good() const { return ok; }
+    bool at_end() const { return p == end; }
+
+private:
+    const char* p;
+    const char* const end;
+    bool ok;
+};
+
+//==============================================================================
+void save_order(encoder& e, const bfapi::responses::current_order& o)
+{
+    e.string(o.bet_id);
+    e.string(o.market_id);
+    e.value(o.selection_id);
+    e.value(o.handicap);
+    e.value(o.price);
+    e.value(o.size);
+    e.value(o.bsp_liability);
+    e.string(o.side);
+    e.string(o.status);
+    e.string(o.persistence_type);
+    e.string(o.order_type);
+    e.string(o.placed_date);
+    e.string(o.matched_date);
+    e.value(o.average_price_matched);
+    e.value(o.size_matched);
+    e.value(o.size_remaining);
+    e.value(o.size_lapsed);
+    e.value(o.size_cancelled);
+    e.value(o.size_voided);
+    e.string(o.customer_order_ref);
+}
+
+//==============================================================================
+bool load_order(decoder& d, bfapi::responses::current_order& o)
+{
+    d.string(o.bet_id);
+    d.string(o.market_id);
+    d.value(o.selection_id);
+    d.value(o.handicap);
+    d.value(o.price);
+    d.value(o.size);
+    d.value(o.bsp_liability);
+    d.string(o.side);
+    d.string(o.status);
+    d.string(o.persistence_type);
+    d.string(o.order_type);
+    d.string(o.placed_date);
+    d.string(o.matched_date);
+    d.value(o.average_price_matched);
+    d.value(o.size_matched);
+    d.value(o.size_remaining);
+    d.value(o.size_lapsed);
+    d.value(o.size_cancelled);
+    d.value(o.size_voided);
+    d.string(o.customer_order_ref);
+    return d.good();
+}
+
+//==============================================================================
+void append_clocks(std::string& json, const stream_clocks& clocks)
+{
+    // Clocks are opaque tokens from the stream and need no escaping
+    if (false == clocks.initial_clk.empty())
+    {
+        json += ",\"initialClk\":\"" + clocks.initial_clk + "\"";
+    }
+    if (false == clocks.clk.empty())
+    {
+        json += ",\"clk\":\"" + clocks.clk + "\"";
+    }
+}
+
+//==============================================================================
+double elapsed_us(clock_type::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(clock_type::now() - start).count();
+}
+
+} // end of anonymous namespace
+
+//==============================================================================
+struct access {
+    template<class Encoder>
+    static void save(Encoder& e, const bfapi::stream::market_cache& m)
+    {
+        e.string(m.market_id);
+        e.value(m.pt);
+        e.value(m.tv);
+        const bfapi::stream::market_definition& def = m.definition;
+        e.string(def.status);
+        e.value(static_cast<std::uint8_t>(def.inplay));
+        e.value(static_cast<std::uint8_t>(def.complete));
+        e.value(static_cast<std::int32_t>(def.bet_delay));
+        e.value(def.version);
+        e.string(def.market_type);
+        e.string(def.event_id);
+        e.string(def.event_type_id);
+        e.string(def.market_time);
+        e.value(static_cast<std::uint64_t>(def.runners.size()));
+        for (const bfapi::stream::runner_definition& r : def.runners)
+        {
+            e.value(r.id);
+            e.value(r.hc);
+            e.string(r.status);
+            e.value(static_cast<std::int32_t>(r.sort_priority));
+        }
+        e.value(static_cast<std::uint64_t>(m.runners.size()));
+        for (const auto& r : m.runners)
+        {
+            e.value(r.id);
+            e.value(r.hc);
+            e.value(r.ltp);
+            e.value(r.tv);
+            e.value(r.spn);
+            e.value(r.spf);
+            e.array(r.atb);
+            e.array(r.atl);
+            e.array(r.trd);
+            e.array(r.spb);
+            e.array(r.spl);
+            e.array(r.batb);
+            e.array(r.batl);
+            e.array(r.bdatb);
+            e.array(r.bdatl);
+        }
+    }
+
+    template<class Decoder>
+    static bool load(Decoder& d, bfapi::stream::market_cache& m)
+    {
+        d.string(m.market_id);
+        d.value(m.pt);
+        d.value(m.tv);
+        bfapi::stream::market_definition& def = m.definition;
+        std::uint8_t inplay = 0;
+        std::uint8_t complete = 0;
+        std::int32_t bet_delay = 0;
+        d.string(def.status);
+        d.value(inplay);
+        d.value(complete);
+        d.value(bet_delay);
+        d.value(def.version);
+        d.string(def.market_type);
+        d.string(def.event_id);
+        d.string(def.event_type_id);
+        d.string(def.market_time);
+        def.inplay = 0 != inplay;
+        def.complete = 0 != complete;
+        def.bet_delay = bet_delay;
+        std::uint64_t count = 0;
+        if (false == d.value(count))
+        {
+            return false;
+        }
+        def.runners.clear();
+        for (std::uint64_t i = 0; i < count && d.good(); ++i)
+        {
+            std::int32_t sort_priority = 0;
+            def.runners.emplace_back();
+            bfapi::stream::runner_definition& r = def.runners.back();
+            d.value(r.id);
+            d.value(r.hc);
+            d.string(r.status);
+            d.value(sort_priority);
+            r.sort_priority = sort_priority;
+        }
+        if (false == d.value(count))
+        {
+            return false;
+        }
+        m.runners.clear();
+        for (std::uint64_t i = 0; i < count && d.good(); ++i)
+        {
+            std::int64_t id = 0;
+            double hc = 0.0;
+            d.value(id);
+            d.value(hc);
+            m.runners.emplace_back(id, hc);
+            auto& r = m.runners.back();
+            d.value(r.ltp);
+            d.value(r.tv);
+            d.value(r.spn);
+            d.value(r.spf);
+            d.array(r.atb);
+            d.array(r.atl);
+            d.array(r.trd);
+            d.array(r.spb);
+            d.array(r.spl);
+            d.array(r.batb);
+            d.array(r.batl);
+            d.array(r.bdatb);
+            d.array(r.bdatl);
+        }
+        return d.good();
+    }
+};
+
+//==============================================================================
+void stream_clocks::update(const bfapi::stream::market_change_message& msg)
+{
+    if (false == msg.initial_clk.empty())
+    {
+        initial_clk = msg.initial_clk;
+    }
+    if (false == msg.clk.empty())
+    {
+        clk = msg.clk;
+    }
+}
+
+//==============================================================================
+checkpointer::checkpointer(const std::string& p, clock_type::duration i) :
+    path(p), interval(i), last_capture(clock_type::now()), next(0), queued(-1), writing(-1), stopping(false)
+{
+    thread = std::thread(&checkpointer::writer, this);
+}
+
+//==============================================================================
+checkpointer::~checkpointer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    thread.join();
+}
+
+//==============================================================================
+bool checkpointer::due() const
+{
+    return clock_type::now() - last_capture >= interval;
+}
+
+//==============================================================================
+void checkpointer::capture(const std::vector<const bfapi::stream::market_cache*>& markets,
+                           const std::vector<bfapi::responses::current_order>& orders,
+                           const stream_clocks& market_stream, const stream_clocks& order_stream)
+{
+    const clock_type::time_point start = clock_type::now();
+    int b = 0;
+    {
+        // Take back a capture that is still waiting: this one is newer
+        std::lock_guard<std::mutex> lock(mtx);
+        if (-1 != queued)
+        {
+            b = queued;
+            queued = -1;
+            ++counters.superseded;
+        }
+        else
+        {
+            b = (writing == next) ? 1 - next : next;
+        }
+    }
+
+    std::vector<char>& buffer = buffers[b];
+    buffer.clear();
+    file_header header;
+    std::memcpy(header.magic, file_magic, sizeof(file_magic));
+    header.version = format_version;
+    header.reserved = 0;
+    header.captured = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    header.market_count = markets.size();
+    header.order_count = orders.size();
+    header.payload_bytes = 0;
+    header.checksum = 0;    // Both filled in by the writer thread
+    encoder e(buffer);
+    e.value(header);
+    e.string(market_stream.initial_clk);
+    e.string(market_stream.clk);
+    e.string(order_stream.initial_clk);
+    e.string(order_stream.clk);
+    for (const bfapi::stream::market_cache* m : markets)
+    {
+        access::save(e, *m);
+    }
+    for (const bfapi::responses::current_order& o : orders)
+    {
+        save_order(e, o);
+    }
+    last_capture = clock_type::now();
+
+    const double us = elapsed_us(start);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        queued = b;
+        next = 1 - b;
+        ++counters.captured;
+        counters.last_capture_us = us;
+        counters.max_capture_us = std::max(counters.max_capture_us, us);
+    }
+    cv.notify_all();
+}
+
+//==============================================================================
+void checkpointer::writer()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;)
+    {
+        cv.wait(lock, [this] { return stopping || -1 != queued; });
+        if (-1 == queued)
+        {
+            break;
+        }
+        writing = queued;
+        queued = -1;
+        lock.unlock();
+
+        const clock_type::time_point start = clock_type::now();
+        std::string error;
+        const bool ok = write_file(buffers[writing], error);
+        const double ms = elapsed_us(start) / 1000.0;
+
+        lock.lock();
+        if (ok)
+        {
+            ++counters.written;
+            counters.last_bytes = buffers[writing].size();
+            counters.last_write_ms = ms;
+            counters.max_write_ms = std::max(counters.max_write_ms, ms);
+            error_message.clear();
+        }
+        else
+        {
+            ++counters.failed;
+            error_message = error;
+        }
+        writing = -1;
+        cv.notify_all();
+    }
+}
+
+//==============================================================================
+bool checkpointer::write_file(const std::vector<char>& buffer, std::string& error)
+{
+    // The header was reserved by capture(); the buffer belongs to this thread until it is written
+    char* data = const_cast<char*>(buffer.data());
+    file_header header;
+    std::memcpy(&header, data, sizeof(header));
+    header.payload_bytes = buffer.size() - sizeof(header);
+    header.checksum = fnv1a(data + sizeof(header), header.payload_bytes);
+    std::memcpy(data, &header, sizeof(header));
+
+    const std::string tmp = path + ".tmp";
+    const int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        error = "bfapi::checkpoint::checkpointer error: Cannot create " + tmp + ": " + std::string(std::strerror(errno));
+        return false;
+    }
+    std::size_t done = 0;
+    while (done < buffer.size())
+    {
+        const ssize_t n = ::write(fd, data + done, buffer.size() - done);
+        if (n < 0 && EINTR == errno)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            error = "bfapi::checkpoint::checkpointer error: Cannot write " + tmp + ": " + std::string(std::strerror(errno));
+            ::close(fd);
+            return false;
+        }
+        done += n;
+    }
+    if (::fdatasync(fd) != 0)
+    {
+        error = "bfapi::checkpoint::checkpointer error: fdatasync failed: " + std::string(std::strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    ::close(fd);
+    if (::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        error = "bfapi::checkpoint::checkpointer error: Cannot rename " + tmp + ": " + std::string(std::strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool checkpointer::flush(std::string& error)
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return -1 == queued && -1 == writing; });
+    error = error_message;
+    return error.empty();
+}
+
+//==============================================================================
+checkpoint_stats checkpointer::stats() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return counters;
+}
+
+//==============================================================================
+std::string checkpointer::last_error() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return error_message;
+}
+
+//==============================================================================
+bool restore(const std::string& path, restored_state& state, std::string& error)
+{
+    error = "";
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "bfapi::checkpoint::restore() error: Cannot open " + path + ": " + std::string(std::strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(file_header))
+    {
+        error = "bfapi::checkpoint::restore() error: " + path + " is too small to be a checkpoint";
+        ::close(fd);
+        return false;
+    }
+    const std::size_t size = st.st_size;
+    void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    ::close(fd);    // The mapping stays valid
+    if (MAP_FAILED == p)
+    {
+        error = "bfapi::checkpoint::restore() error: mmap failed: " + std::string(std::strerror(errno));
+        return false;
+    }
+    const char* data = static_cast<const char*>(p);
+
+    file_header header;
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, file_magic, sizeof(file_magic)) != 0)
+    {
+        error = "bfapi::checkpoint::restore() error: " + path + " is not a checkpoint";
+    }
+    else if (header.version != format_version)
+    {
+        error = "bfapi::checkpoint::restore() error: Unsupported checkpoint version " + std::to_string(header.version);
+    }
+    else if (header.payload_bytes != size - sizeof(header) ||
+             header.checksum != fnv1a(data + sizeof(header), header.payload_bytes))
+    {
+        error = "bfapi::checkpoint::restore() error: " + path + " is truncated or corrupt";
+    }
+
+    restored_state restored;
+    if (error.empty())
+    {
+        decoder d(data + sizeof(header), data + size);
+        d.string(restored.market_stream.initial_clk);
+        d.string(restored.market_stream.clk);
+        d.string(restored.order_stream.initial_clk);
+        d.string(restored.order_stream.clk);
+        restored.captured = std::chrono::system_clock::time_point(std::chrono::milliseconds(header.captured));
+        // Counts come from the file, so grow as records are read rather than reserving up front
+        for (std::uint64_t i = 0; i < header.market_count && d.good(); ++i)
+        {
+            restored.markets.emplace_back();
+            access::load(d, restored.markets.back());
+        }
+        for (std::uint64_t i = 0; i < header.order_count && d.good(); ++i)
+        {
+            restored.orders.emplace_back();
+            load_order(d, restored.orders.back());
+        }
+        if (false == d.good() || false == d.at_end())
+        {
+            error = "bfapi::checkpoint::restore() error: " + path + " does not match its header";
+        }
+    }
+    munmap(p, size);
+
+    if (false == error.empty())
+    {
+        return false;
+    }
+    state = std::move(restored);
+    return true;
+}
+
+//==============================================================================
+std::string market_subscription_json(int id, const stream_clocks& clocks, const std::string& market_filter_json,
+                                     const std::string& market_data_filter_json)
+{
+    std::string json = "{\"op\":\"marketSubscription\",\"id\":" + std::to_string(id);
+    append_clocks(json, clocks);
+    if (false == market_filter_json.empty())
+    {
+        json += ",\"marketFilter\":" + market_filter_json;
+    }
+    if (false == market_data_filter_json.empty())
+    {
+        json += ",\"marketDataFilter\":" + market_data_filter_json;
+    }
+    json += "}";
+    return json;
+}
+
+//==============================================================================
+std::string order_subscription_json(int id, const stream_clocks& clocks, const std::string& order_filter_json)
+{
+    std::string json = "{\"op\":\"orderSubscription\",\"id\":" + std::to_string(id);
+    append_clocks(json, clocks);
+    if (false == order_filter_json.empty())
+    {
+        json += ",\"orderFilter\":" + order_filter_json;
+    }
+    json += "}";
+    return json;
+}
+
+} // end of namespace bfapi::checkpoint
+} // end of namespace bfapi
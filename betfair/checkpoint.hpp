@@ -0,0 +1,171 @@
+//==============================================================================
+//
+// Checkpoint and warm restart of cached market and order state.
+//
+// A checkpointer periodically saves the stream market caches, the current
+// orders and the clocks (initialClk and clk) of the market and order streams
+// to a compact binary snapshot file. On startup restore() maps the file,
+// validates it and rebuilds the caches, and the subscription messages built
+// from the saved clocks resume both streams where they left off: Betfair then
+// sends only the changes since the checkpoint instead of full images (or a
+// full image if the clocks have expired).
+//
+// Taking a snapshot is split in two so that the thread which owns the caches
+// only pays for a memory copy:
+//
+//  - capture()  encodes the caches into one of two reusable buffers on the
+//               calling thread. Once the buffers have grown to fit, nothing is
+//               allocated. The caches can be updated again as soon as it
+//               returns.
+//  - a background writer thread checksums the buffer, writes it to
+//               <path>.tmp, calls fdatasync() and renames it over <path>, so a
+//               crash at any moment leaves either the old or the new snapshot.
+//
+// If a capture is taken while the writer is still busy with the previous one,
+// it is queued and replaces any older queued capture, which is counted as
+// superseded. fork() is not used to take the snapshot as the library runs
+// several threads and a forked child can deadlock on locks held by threads
+// it does not have.
+//
+// The file is in host byte order, every field starting on an 8 byte boundary
+// (zero padded), so that restore() can copy ladders straight out of the map:
+//
+//   header            char magic[8] "BFAPICKP", u32 version, u32 reserved,
+//                     i64 captured (ms since the epoch), u64 market count,
+//                     u64 order count, u64 payload bytes, u64 FNV-1a of payload
+//   clocks            market initialClk, market clk, order initialClk, order clk
+//   markets           market ID, i64 pt, f64 tv, definition (status, u8 inplay,
+//                     u8 complete, i32 bet delay, i64 version, market type,
+//                     event ID, event type ID, market time, u64 runner count,
+//                     then i64 ID, f64 handicap, status, i32 sort priority each),
+//                     u64 runner count, then per runner i64 ID, f64 hc, ltp,
+//                     tv, spn, spf and the ladders atb, atl, trd, spb, spl,
+//                     batb, batl, bdatb, bdatl
+//   orders            the fields of responses::current_order in order
+//
+// Strings are a u64 length and the bytes; ladders are a u64 count and the
+// price_vol or level_price_vol structs as they are in memory.
+//
+//         bfapi::checkpoint::restored_state state;
+//         if (bfapi::checkpoint::restore(path, state, error))
+//         {
+//             send(bfapi::checkpoint::market_subscription_json(1, state.market_stream, filter, data_filter));
+//         }
+//         bfapi::checkpoint::checkpointer cp(path, std::chrono::seconds(30));
+//         ...
+//         clocks.update(message);    // For every stream message
+//         if (cp.due())
+//         {
+//             cp.capture(caches, orders, clocks, order_clocks);
+//         }
+//
+//==============================================================================
+#ifndef BFAPI_CHECKPOINT_HPP
+#define BFAPI_CHECKPOINT_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include "stream.hpp"
+#include "responses.hpp"
+
+namespace bfapi {
+namespace checkpoint {
+
+const std::uint32_t format_version = 1;
+
+// Clocks of one stream subscription
+struct stream_clocks {
+	std::string initial_clk;
+	std::string clk;
+
+	// Keep the latest clocks of a stream message; messages without them leave them unchanged
+	void update(const bfapi::stream::market_change_message& msg);
+	bool empty() const { return initial_clk.empty() && clk.empty(); }
+};
+
+struct checkpoint_stats {
+	std::uint64_t captured;             // Calls to capture()
+	std::uint64_t written;              // Snapshots written to disk
+	std::uint64_t superseded;           // Captures replaced by a later one before being written
+	std::uint64_t failed;               // Failed writes, see last_error()
+	std::uint64_t last_bytes;           // Size of the last snapshot file
+	double last_capture_us;             // Time spent in capture() on the calling thread
+	double max_capture_us;
+	double last_write_ms;               // Checksum, write, fdatasync and rename on the writer thread
+	double max_write_ms;
+
+	checkpoint_stats() : captured(0), written(0), superseded(0), failed(0), last_bytes(0), last_capture_us(0.0),
+	                     max_capture_us(0.0), last_write_ms(0.0), max_write_ms(0.0) {}
+};
+
+class checkpointer {
+public:
+	checkpointer(const std::string& path, std::chrono::steady_clock::duration interval);
+	~checkpointer();    // Writes any queued capture before returning
+
+	checkpointer(const checkpointer&) = delete;
+	checkpointer& operator=(const checkpointer&) = delete;
+
+	// True once interval has passed since the last capture (or construction)
+	bool due() const;
+
+	// Encode a snapshot and queue it for writing. Not thread safe: call it from
+	// the thread that updates the caches.
+	void capture(const std::vector<const bfapi::stream::market_cache*>& markets,
+	             const std::vector<bfapi::responses::current_order>& orders,
+	             const stream_clocks& market_stream, const stream_clocks& order_stream);
+
+	// Wait until every queued capture has been written; false if the last write failed
+	bool flush(std::string& error);
+
+	checkpoint_stats stats() const;
+	std::string last_error() const;
+
+private:
+	void writer();
+	bool write_file(const std::vector<char>& buffer, std::string& error);
+
+	const std::string path;
+	const std::chrono::steady_clock::duration interval;
+	std::chrono::steady_clock::time_point last_capture;
+	std::vector<char> buffers[2];
+	int next;                           // Buffer the next capture() encodes into
+
+	mutable std::mutex mtx;
+	std::condition_variable cv;
+	int queued;                         // Buffer waiting to be written, or -1
+	int writing;                        // Buffer being written, or -1
+	bool stopping;
+	checkpoint_stats counters;
+	std::string error_message;
+	std::thread thread;
+};
+
+struct restored_state {
+	stream_clocks market_stream;
+	stream_clocks order_stream;
+	std::chrono::system_clock::time_point captured;
+	std::vector<bfapi::stream::market_cache> markets;
+	std::vector<bfapi::responses::current_order> orders;
+};
+
+// Map a snapshot file and rebuild the state saved in it. Fails without touching
+// state if the file is missing, truncated, corrupt or of another version.
+bool restore(const std::string& path, restored_state& state, std::string& error);
+
+// Stream API subscription messages that resume from saved clocks (the clocks
+// are left out if empty, which subscribes from scratch). The filters are JSON
+// objects, or empty to leave them out.
+std::string market_subscription_json(int id, const stream_clocks& clocks, const std::string& market_filter_json,
+                                     const std::string& market_data_filter_json);
+std::string order_subscription_json(int id, const stream_clocks& clocks, const std::string& order_filter_json = "");
+
+} // end of namespace bfapi::checkpoint
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,1006 @@
+#include "connection.hpp"
+#include "operations.hpp"
+#include "timed_io.hpp"
+#include <boost/beast/version.hpp>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/ssl/error.hpp>
+#include <algorithm>
+#include <thread>
+#include <tuple>
+#if BFAPI_KTLS_AVAILABLE
+#include <openssl/ssl.h>
+#include <openssl/bio.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <cerrno>
+#endif
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+
+using tcp = net::ip::tcp;
+
+namespace bfapi {
+
+namespace {
+
+typedef http::basic_fields<arena_allocator<char>> arena_fields;
+typedef http::request<http::span_body<const char>, arena_fields> arena_request;
+typedef http::response<http::basic_string_body<char, std::char_traits<char>, arena_allocator<char>>, arena_fields> arena_response;
+
+} // end of anonymous namespace
+
+// Set once a kTLS handshake shows the kernel or cipher cannot offload
+std::atomic<bool> api_connection::ktls_unsupported(false);
+
+//==============================================================================
+api_connection::api_connection(ssl::context& ssl_ctx,
+                               const std::string& key,
+                               const std::string& token,
+                               const std::string& h,
+                               const std::string& p) : ctx(ssl_ctx),
+                                                       appkey(key),
+                                                       session_token(token),
+                                                       host(h),
+                                                       port(p),
+                                                       open(false),
+                                                       last_timed_out(false),
+                                                       cancel_requested(false),
+                                                       request_count(0),
+                                                       generation(0),
+                                                       ktls_ssl(nullptr),
+                                                       ktls_requested(false),
+                                                       ktls(false),
+                                                       selector(shared_endpoints()),
+                                                       last_throttle(throttle_signal::none)
+{
+}
+
+//==============================================================================
+api_connection::~api_connection()
+{
+    close();
+}
+
+//==============================================================================
+bool api_connection::connect(std::string& error)
+{
+    close();
+    error = "";
+    try
+    {
+        if (ktls_requested && false == ktls_unsupported.load())
+        {
+            if (false == connect_ktls(error))
+            {
+                return false;
+            }
+            if (ktls)
+            {
+                buffer.clear();
+                open = true;
+                request_count = 0;
+                last_used = std::chrono::steady_clock::now();
+                return true;
+            }
+            // Fall back to user space TLS below
+        }
+
+        stream.reset(new stream_type(ioc.get_executor(), ctx));
+
+        // asio asks OpenSSL to free its record buffers whenever they are empty, which
+        // costs a malloc and free for every record - keep them for the connection
+        SSL_clear_mode(stream->native_handle(), SSL_MODE_RELEASE_BUFFERS);
+
+        // Set SNI Hostname (many hosts need this to handshake successfully)
+        if(! SSL_set_tlsext_host_name(stream->native_handle(), host.c_str()))
+        {
+            beast::error_code ec{static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()};
+            throw beast::system_error{ec};
+        }
+
+        // Resolution (normally cached), any re-probe and the connect race share the connect deadline
+        beast::error_code ec = selector->connect(ioc, beast::get_lowest_layer(*stream), host, port, limits.connect, &peer);
+        if (ec)
+        {
+            last_timed_out = (ec == beast::error::timeout);
+            throw beast::system_error{ec};
+        }
+
+        // Orders and small market data requests must not wait on Nagle
+        beast::get_lowest_layer(*stream).socket().set_option(tcp::no_delay(true));
+
+        ec = timed_io::handshake(ioc, *stream, limits.connect);
+        if (ec)
+        {
+            last_timed_out = (ec == beast::error::timeout);
+            throw beast::system_error{ec};
+        }
+        buffer.clear();
+        open = true;
+        request_count = 0;
+        last_used = std::chrono::steady_clock::now();
+    }
+    catch(std::exception const& e)
+    {
+        error = std::string("bfapi::api_connection::connect() exception occurred: ") + std::string(e.what());
+        close();
+    }
+    return open;
+}
+
+//==============================================================================
+bool api_connection::connect_ktls(std::string& error)
+{
+#if BFAPI_KTLS_AVAILABLE
+    plain.reset(new socket_type(ioc.get_executor()));
+    beast::error_code ec = selector->connect(ioc, *plain, host, port, limits.connect, &peer);
+    if (ec)
+    {
+        last_timed_out = (ec == beast::error::timeout);
+        error = "bfapi::api_connection::connect() error: " + ec.message();
+        close();
+        return false;
+    }
+    socket_type::socket_type& sock = plain->socket();
+    sock.set_option(tcp::no_delay(true));
+
+    // The handshake is done by OpenSSL directly on the socket (asio's SSL engine
+    // uses memory BIOs which can never be offloaded). TLS 1.3 is excluded since
+    // its post handshake messages cannot be read with plain socket I/O.
+    SSL* ssl = SSL_new(ctx.native_handle());
+    SSL_set_options(ssl, SSL_OP_ENABLE_KTLS);
+    SSL_set_max_proto_version(ssl, TLS1_2_VERSION);
+    SSL_set_tlsext_host_name(ssl, host.c_str());
+    SSL_set_fd(ssl, static_cast<int>(sock.native_handle()));
+
+    // Blocking handshake bounded by socket timeouts instead of tcp_stream expiry
+    const std::chrono::milliseconds ms = limits.connect;
+    struct timeval tv;
+    tv.tv_sec = static_cast<time_t>(ms.count() / 1000);
+    tv.tv_usec = static_cast<suseconds_t>((ms.count() % 1000) * 1000);
+    sock.native_non_blocking(false);
+    ::setsockopt(sock.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ::setsockopt(sock.native_handle(), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    const int rc = SSL_connect(ssl);
+    const int saved_errno = errno;
+    tv.tv_sec = 0;
+    tv.tv_usec = 0;
+    ::setsockopt(sock.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ::setsockopt(sock.native_handle(), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (rc != 1)
+    {
+        last_timed_out = (saved_errno == EAGAIN || saved_errno == EWOULDBLOCK);
+        error = "bfapi::api_connection::connect() kTLS handshake failed: " +
+                (last_timed_out ? std::string("timeout") : std::to_string(SSL_get_error(ssl, rc)));
+        SSL_free(ssl);
+        close();
+        return false;
+    }
+
+    if (BIO_get_ktls_send(SSL_get_wbio(ssl)) && BIO_get_ktls_recv(SSL_get_rbio(ssl)))
+    {
+        // Record encryption now happens in the kernel - keep the SSL object only to free it on close
+        ktls_ssl = ssl;
+        ktls = true;
+        return true;
+    }
+
+    // Kernel (tls module) or negotiated cipher does not support offload. Remember
+    // that so later connections go straight to user space TLS.
+    ktls_unsupported.store(true);
+    SSL_free(ssl);
+    close();
+    return true;
+#else
+    (void)error;
+    ktls_unsupported.store(true);
+    return true;
+#endif
+}
+
+//==============================================================================
+void api_connection::close()
+{
+    if (stream)
+    {
+        // No graceful TLS shutdown - Betfair never completes it (see "Stream truncated" in bfapi.cpp)
+        beast::error_code ec;
+        beast::get_lowest_layer(*stream).socket().shutdown(tcp::socket::shutdown_both, ec);
+        beast::get_lowest_layer(*stream).close();
+        stream.reset();
+    }
+    if (plain)
+    {
+        beast::error_code ec;
+        plain->socket().shutdown(tcp::socket::shutdown_both, ec);
+        plain->close();
+        plain.reset();
+    }
+#if BFAPI_KTLS_AVAILABLE
+    if (ktls_ssl)
+    {
+        SSL_free(ktls_ssl);
+    }
+#endif
+    ktls_ssl = nullptr;
+    ktls = false;
+    open = false;
+    peer.reset();
+}
+
+//==============================================================================
+template<class Request>
+void api_connection::set_headers(Request& req) const
+{
+    req.set(http::field::host, host);
+    req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+    req.set("X-Application", appkey);
+    req.set("X-Authentication", session_token);
+    req.set(http::field::connection, "keep-alive");
+    req.set(http::field::accept, "application/json");
+    req.set(http::field::content_type, "application/json");
+    req.prepare_payload();
+}
+
+//==============================================================================
+template<class Request, class Response, class Allocator>
+api_connection::attempt_result api_connection::exchange(Request& req, Response& res, std::string& error, const Allocator& alloc)
+{
+    set_headers(req);
+
+    bool written = false;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const beast::error_code ec = ktls ? timed_io::request(ioc, *plain, req, buffer, res, limits.request, &written, alloc)
+                                      : timed_io::request(ioc, *stream, req, buffer, res, limits.request, &written, alloc);
+    if (ec)
+    {
+        // The stream is in an unknown state part way through a message so it cannot be reused
+        last_timed_out = (ec == beast::error::timeout);
+        error = std::string("bfapi::api_connection::post() ") + (written ? "read" : "write") + " error: " + ec.message();
+        if (last_timed_out && peer)
+        {
+            selector->record_request(*peer, std::chrono::steady_clock::now() - start, false);
+        }
+        close();
+        return written ? attempt_result::failed_after_write : attempt_result::failed_before_write;
+    }
+
+    ++request_count;
+    last_used = std::chrono::steady_clock::now();
+    if (peer)
+    {
+        selector->record_request(*peer, std::chrono::steady_clock::now() - start, true);
+    }
+    if (false == res.keep_alive())
+    {
+        close();
+    }
+    return attempt_result::ok;
+}
+
+//==============================================================================
+api_connection::attempt_result api_connection::attempt(const std::string& target,
+                                                       const std::string& body,
+                                                       http_result& result,
+                                                       std::string& error)
+{
+    http::request<http::string_body> req{http::verb::post, target, bfapi::http_version};
+    req.body() = body;
+
+    http::response<http::string_body> res;
+    const attempt_result r = exchange(req, res, error, std::allocator<void>());
+    if (r == attempt_result::ok)
+    {
+        result.status = res.result_int();
+        result.body = std::move(res.body());
+    }
+    return r;
+}
+
+//==============================================================================
+api_connection::attempt_result api_connection::attempt(const std::string& target,
+                                                       const char* body,
+                                                       std::size_t body_size,
+                                                       bfapi::arena& a,
+                                                       http_view& result,
+                                                       std::string& error)
+{
+    const arena_allocator<char> alloc(a);
+    arena_request req(http::verb::post, target, bfapi::http_version, beast::span<const char>(body, body_size), alloc);
+
+    // Constructed in the arena and never destroyed: its memory all belongs to the
+    // arena, so the body outlives this call and is reclaimed by arena::release()
+    void* storage = a.allocate(sizeof(arena_response), alignof(arena_response));
+    arena_response* res = new (storage) arena_response(std::piecewise_construct, std::make_tuple(alloc), std::make_tuple(alloc));
+
+    const attempt_result r = exchange(req, *res, error, arena_allocator<void>(a));
+    if (r == attempt_result::ok)
+    {
+        result.status = res->result_int();
+        result.body = res->body().data();
+        result.size = res->body().size();
+    }
+    return r;
+}
+
+//==============================================================================
+template<class Attempt>
+bool api_connection::post_with_retry(Attempt f, std::string& error, bool idempotent)
+{
+    error.clear();
+    ++generation;
+    cancel_requested = false;
+    last_timed_out = false;
+
+    const bool reused = open && request_count > 0;
+    if (false == open && false == connect(error))
+    {
+        return false;
+    }
+    if (cancel_requested)
+    {
+        error = "bfapi::api_connection::post() cancelled";
+        return false;
+    }
+
+    attempt_result r = f();
+    if (r != attempt_result::ok && reused && false == cancel_requested && false == last_timed_out &&
+        (r == attempt_result::failed_before_write || idempotent))
+    {
+        // Most likely the server closed the idle keep-alive connection - try once more on a new one
+        if (false == connect(error))
+        {
+            return false;
+        }
+        r = f();
+    }
+    return r == attempt_result::ok;
+}
+
+//==============================================================================
+bool api_connection::admit(const std::string& target, request_priority priority, std::string& error)
+{
+    last_throttle = throttle_signal::none;
+    if (governor && false == governor->acquire(target, priority))
+    {
+        error = "bfapi::api_connection::post() error: request governor did not admit " + target + " in time";
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+void api_connection::refund(const std::string& target, request_priority priority)
+{
+    if (governor)
+    {
+        governor->refund(target, priority);
+    }
+}
+
+//==============================================================================
+void api_connection::note_response(const std::string& target, int status, const char* body, std::size_t size)
+{
+    if (governor)
+    {
+        last_throttle = governor->record(target, status, body, size);
+    }
+}
+
+//==============================================================================
+bool api_connection::post(const std::string& target,
+                          const std::string& body,
+                          http_result& result,
+                          std::string& error,
+                          bool idempotent)
+{
+    return post(target, body, result, error, idempotent, request_governor::priority_of(target));
+}
+
+//==============================================================================
+bool api_connection::post(const std::string& target,
+                          const std::string& body,
+                          http_result& result,
+                          std::string& error,
+                          bool idempotent,
+                          request_priority priority)
+{
+    result = http_result();
+    if (false == admit(target, priority, error))
+    {
+        return false;
+    }
+    if (false == post_with_retry([&]() { return attempt(target, body, result, error); }, error, idempotent))
+    {
+        return false;
+    }
+    note_response(target, result.status, result.body.data(), result.body.size());
+    return true;
+}
+
+//==============================================================================
+bool api_connection::post(const std::string& target,
+                          const char* body,
+                          std::size_t body_size,
+                          bfapi::arena& a,
+                          http_view& result,
+                          std::string& error,
+                          bool idempotent)
+{
+    result = http_view();
+    if (false == admit(target, request_governor::priority_of(target), error))
+    {
+        return false;
+    }
+    if (false == post_with_retry([&]() { return attempt(target, body, body_size, a, result, error); }, error, idempotent))
+    {
+        return false;
+    }
+    note_response(target, result.status, result.body, result.size);
+    return true;
+}
+
+//==============================================================================
+bool api_connection::post_pipelined(const std::vector<pipelined_request>& requests,
+                                    std::vector<http_result>& results,
+                                    std::string& error)
+{
+    results.assign(requests.size(), http_result());
+    error.clear();
+    ++generation;
+    cancel_requested = false;
+    last_timed_out = false;
+
+    // Indexes into requests of those still to be sent, in order
+    std::vector<std::size_t> pending(requests.size());
+    for (std::size_t i = 0; i < pending.size(); ++i)
+    {
+        pending[i] = i;
+    }
+    std::size_t indeterminate = 0;
+    std::size_t not_admitted = 0;
+    std::string failure;
+    std::string refused;
+
+    // A second round resends what the first left unanswered on a new connection
+    for (int round = 0; round < 2 && false == pending.empty() && false == cancel_requested && false == last_timed_out; ++round)
+    {
+        if (false == open && false == connect(error))
+        {
+            break;
+        }
+
+        // Every write takes a token, so a resent request is admitted again. One not
+        // admitted in time is dropped with those after it, keeping the order they were given in.
+        std::size_t admitted = 0;
+        while (admitted < pending.size() && admit(requests[pending[admitted]].target, request_governor::priority_of(requests[pending[admitted]].target), refused))
+        {
+            ++admitted;
+        }
+        not_admitted += pending.size() - admitted;
+        pending.resize(admitted);
+        if (pending.empty())
+        {
+            break;
+        }
+
+        std::vector<http::request<http::string_body>> reqs;
+        reqs.reserve(pending.size());
+        for (std::size_t i : pending)
+        {
+            reqs.emplace_back(http::verb::post, requests[i].target, bfapi::http_version);
+            reqs.back().body() = requests[i].body;
+            set_headers(reqs.back());
+        }
+
+        std::vector<http::response<http::string_body>> res;
+        std::size_t written = 0;
+        std::size_t answered = 0;
+        const beast::error_code ec = ktls ? timed_io::pipeline(ioc, *plain, reqs, buffer, res, limits.request, written, answered)
+                                          : timed_io::pipeline(ioc, *stream, reqs, buffer, res, limits.request, written, answered);
+        request_count += answered;
+        if (answered > 0)
+        {
+            last_used = std::chrono::steady_clock::now();
+        }
+        for (std::size_t j = 0; j < answered; ++j)
+        {
+            const std::size_t i = pending[j];
+            results[i].status = res[j].result_int();
+            results[i].body = std::move(res[j].body());
+            note_response(requests[i].target, results[i].status, results[i].body.data(), results[i].body.size());
+        }
+        if (ec)
+        {
+            last_timed_out = (ec == beast::error::timeout);
+            failure = "bfapi::api_connection::post_pipelined() error after " + std::to_string(answered) + " of " +
+                      std::to_string(pending.size()) + " responses: " + ec.message();
+        }
+        if (ec || (answered > 0 && false == res[answered - 1].keep_alive()))
+        {
+            close();
+        }
+
+        // Tokens taken for requests that were never written go back to the governor
+        for (std::size_t j = written; j < pending.size(); ++j)
+        {
+            refund(requests[pending[j]].target, request_governor::priority_of(requests[pending[j]].target));
+        }
+
+        // Resend what cannot be duplicated by it: requests never written, and idempotent ones
+        std::vector<std::size_t> unanswered;
+        for (std::size_t j = answered; j < pending.size(); ++j)
+        {
+            if (j >= written || requests[pending[j]].idempotent)
+            {
+                unanswered.push_back(pending[j]);
+            }
+            else
+            {
+                ++indeterminate;
+            }
+        }
+        pending.swap(unanswered);
+    }
+
+    if (indeterminate > 0 || not_admitted > 0 || false == pending.empty())
+    {
+        // A failed reconnect has set error; otherwise report the failure that left requests unanswered
+        if (cancel_requested)
+        {
+            error = "bfapi::api_connection::post_pipelined() cancelled";
+        }
+        else if (error.empty())
+        {
+            error = failure;
+        }
+        if (not_admitted > 0)
+        {
+            error += (error.empty() ? "" : "; ") + refused + " (" + std::to_string(not_admitted) + " requests were not sent)";
+        }
+        if (indeterminate > 0)
+        {
+            error += " (" + std::to_string(indeterminate) + " requests were sent but not answered and may have been processed)";
+        }
+        return false;
+    }
+    error.clear();
+    return true;
+}
+
+//==============================================================================
+bool api_connection::place_orders(const bfapi::orders::place_limit_orders_request& request,
+                                  bfapi::arena& a,
+                                  bfapi::responses::place_execution_report& report,
+                                  std::string& error)
+{
+    return bfapi::operations::call<bfapi::operations::place_orders>(*this, request, report, a, error);
+}
+
+//==============================================================================
+bool api_connection::place_orders(const bfapi::orders::place_orders_request& request,
+                                  bfapi::arena& a,
+                                  bfapi::responses::place_execution_report& report,
+                                  std::string& error)
+{
+    return bfapi::operations::call<bfapi::operations::place_orders>(*this, request, report, a, error);
+}
+
+//==============================================================================
+void api_connection::cancel()
+{
+    // Runs on the thread inside post(), which is the only one running ioc
+    const std::uint64_t g = generation.load();
+    net::post(ioc, [this, g]()
+    {
+        if (g == generation.load() && (stream || plain))
+        {
+            cancel_requested = true;
+            if (plain)
+            {
+                plain->cancel();
+            }
+            else
+            {
+                beast::get_lowest_layer(*stream).cancel();
+            }
+        }
+    });
+}
+
+//==============================================================================
+connection_pool::connection_pool(const bfapi::accinfo& user_info,
+                                 const std::string& token,
+                                 std::size_t max_conn,
+                                 const std::string& h,
+                                 const std::string& p) : ssl_ctx(ssl::context::tlsv12_client),
+                                                         appkey(user_info.appkey),
+                                                         session_token(token),
+                                                         host(h),
+                                                         port(p),
+                                                         max_connections(max_conn > 0 ? max_conn : 1),
+                                                         ktls_requested(false),
+                                                         selector(shared_endpoints()),
+                                                         latency_pos(0)
+{
+    // Verify server certificate
+    ssl_ctx.set_verify_mode(ssl::verify_peer);
+    ssl_ctx.set_default_verify_paths();
+}
+
+//==============================================================================
+connection_pool::~connection_pool()
+{
+    hedgers.stop();
+    workers.stop();
+}
+
+//==============================================================================
+connection_pool::lease connection_pool::acquire()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    cv.wait(lock, [this] { return false == idle.empty() || connections.size() < max_connections; });
+    if (false == idle.empty())
+    {
+        api_connection* conn = idle.back();
+        idle.pop_back();
+        configure(*conn);
+        return lease(*this, conn);
+    }
+    connections.emplace_back(new api_connection(ssl_ctx, appkey, session_token, host, port));
+    configure(*connections.back());
+    return lease(*this, connections.back().get());
+}
+
+//==============================================================================
+std::unique_ptr<connection_pool::lease> connection_pool::try_acquire()
+{
+    std::unique_ptr<lease> result;
+    std::lock_guard<std::mutex> lock(mtx);
+    if (false == idle.empty())
+    {
+        api_connection* conn = idle.back();
+        idle.pop_back();
+        configure(*conn);
+        result.reset(new lease(*this, conn));
+    }
+    else if (connections.size() < max_connections)
+    {
+        connections.emplace_back(new api_connection(ssl_ctx, appkey, session_token, host, port));
+        configure(*connections.back());
+        result.reset(new lease(*this, connections.back().get()));
+    }
+    return result;
+}
+
+//==============================================================================
+void connection_pool::configure(api_connection& conn)
+{
+    // Called with mtx held whenever a connection is handed out
+    conn.set_session_token(session_token);
+    conn.set_deadlines(limits);
+    conn.set_ktls(ktls_requested);
+    conn.set_endpoint_selector(selector);
+    conn.set_governor(governor);
+}
+
+//==============================================================================
+void connection_pool::release(api_connection* conn)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        idle.push_back(conn);
+    }
+    cv.notify_one();
+}
+
+//==============================================================================
+bool connection_pool::post(const std::string& target,
+                           const std::string& body,
+                           http_result& result,
+                           std::string& error,
+                           bool idempotent)
+{
+    lease conn = acquire();
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const bool ok = conn->post(target, body, result, error, idempotent);
+    record(ok, conn->timed_out(), std::chrono::steady_clock::now() - start);
+    return ok;
+}
+
+//==============================================================================
+bool connection_pool::post_pipelined(const std::vector<pipelined_request>& requests,
+                                     std::vector<http_result>& results,
+                                     std::string& error)
+{
+    lease conn = acquire();
+    return conn->post_pipelined(requests, results, error);
+}
+
+//==============================================================================
+bool connection_pool::post_hedged(const std::string& target,
+                                  const std::string& body,
+                                  http_result& result,
+                                  std::string& error,
+                                  const hedge_policy& policy)
+{
+    const std::chrono::steady_clock::duration delay = hedge_delay(policy);
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Shared between this thread (primary request) and the hedge thread.
+    // hedge_conn is only set while the hedge request is in progress.
+    struct race_state {
+        std::mutex m;
+        std::condition_variable cv;
+        bool primary_done;
+        bool hedger_done;
+        bool hedge_sent;
+        int winner;                     // -1 none, 0 primary, 1 hedge
+        api_connection* hedge_conn;
+        http_result hedge_result;
+        std::string hedge_error;
+
+        race_state() : primary_done(false), hedger_done(false), hedge_sent(false), winner(-1), hedge_conn(nullptr) {}
+    } state;
+
+    lease primary = acquire();
+    api_connection* primary_conn = &*primary;
+
+    auto hedge = [&]()
+    {
+        {
+            std::unique_lock<std::mutex> lock(state.m);
+            if (state.cv.wait_until(lock, start + delay, [&state] { return state.primary_done; }))
+            {
+                return;
+            }
+        }
+        std::unique_ptr<lease> second = try_acquire();
+        if (!second)
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(state.m);
+            if (state.primary_done)
+            {
+                return;
+            }
+            state.hedge_sent = true;
+            state.hedge_conn = &**second;
+        }
+        http_result r;
+        std::string e;
+        const bool ok = (*second)->post(target, body, r, e, true);
+        std::lock_guard<std::mutex> lock(state.m);
+        state.hedge_conn = nullptr;
+        state.hedge_error = e;
+        if (ok && state.winner < 0)
+        {
+            state.winner = 1;
+            state.hedge_result = std::move(r);
+            if (false == state.primary_done)
+            {
+                primary_conn->cancel();
+            }
+        }
+    };
+    hedgers.run([&]()
+    {
+        hedge();
+        // Notified with the lock held: state lives on the caller's stack and goes once hedger_done is seen
+        std::lock_guard<std::mutex> lock(state.m);
+        state.hedger_done = true;
+        state.cv.notify_all();
+    }, max_connections);
+
+    http_result r;
+    std::string e;
+    const bool primary_ok = primary->post(target, body, r, e, true);
+    const bool primary_timed_out = primary->timed_out();
+    {
+        std::lock_guard<std::mutex> lock(state.m);
+        state.primary_done = true;
+        if (primary_ok && state.winner < 0)
+        {
+            state.winner = 0;
+            if (state.hedge_conn)
+            {
+                state.hedge_conn->cancel();
+            }
+        }
+    }
+    state.cv.notify_all();
+    {
+        std::unique_lock<std::mutex> lock(state.m);
+        state.cv.wait(lock, [&state] { return state.hedger_done; });
+    }
+
+    bool ok = true;
+    if (state.winner == 0)
+    {
+        result = std::move(r);
+        error = "";
+    }
+    else if (state.winner == 1)
+    {
+        result = std::move(state.hedge_result);
+        error = "";
+    }
+    else
+    {
+        ok = false;
+        result = http_result();
+        error = e.empty() ? state.hedge_error : e;
+    }
+
+    record(ok, false == ok && primary_timed_out, std::chrono::steady_clock::now() - start);
+    std::lock_guard<std::mutex> lock(stats_mtx);
+    ++stats.hedged_requests;
+    if (state.hedge_sent)
+    {
+        ++stats.hedges_sent;
+        stats.hedge_wins += (state.winner == 1) ? 1 : 0;
+        stats.primary_wins += (state.winner == 0) ? 1 : 0;
+    }
+    return ok;
+}
+
+//==============================================================================
+void connection_pool::run(std::function<void()> job)
+{
+    workers.run(std::move(job), max_connections);
+}
+
+//==============================================================================
+void connection_pool::job_threads::run(std::function<void()> job, std::size_t max_threads)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    jobs.push_back(std::move(job));
+    if (jobs.size() > idle && threads.size() < max_threads)
+    {
+        // Every thread is busy with another job; a starting thread counts as idle.
+        // Beyond one per connection the job waits, as it could not get a connection anyway.
+        threads.emplace_back(&job_threads::work, this);
+        ++idle;
+    }
+    cv.notify_one();
+}
+
+//==============================================================================
+void connection_pool::job_threads::work()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;)
+    {
+        cv.wait(lock, [this] { return stopping || false == jobs.empty(); });
+        if (jobs.empty())
+        {
+            return;
+        }
+        std::function<void()> job = std::move(jobs.front());
+        jobs.pop_front();
+        --idle;
+        lock.unlock();
+        job();
+        lock.lock();
+        ++idle;
+    }
+}
+
+//==============================================================================
+void connection_pool::job_threads::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+}
+
+//==============================================================================
+void connection_pool::record(bool ok, bool timed_out, std::chrono::steady_clock::duration latency)
+{
+    const std::size_t max_samples = 256;
+    std::lock_guard<std::mutex> lock(stats_mtx);
+    ++stats.requests;
+    stats.failures += ok ? 0 : 1;
+    stats.timeouts += timed_out ? 1 : 0;
+    if (ok)
+    {
+        if (latencies.size() < max_samples)
+        {
+            latencies.push_back(latency);
+        }
+        else
+        {
+            latencies[latency_pos] = latency;
+            latency_pos = (latency_pos + 1) % max_samples;
+        }
+    }
+}
+
+//==============================================================================
+std::chrono::steady_clock::duration connection_pool::hedge_delay(const hedge_policy& policy) const
+{
+    std::vector<std::chrono::steady_clock::duration> samples;
+    {
+        std::lock_guard<std::mutex> lock(stats_mtx);
+        samples = latencies;
+    }
+    const std::chrono::steady_clock::duration max_delay = policy.max_delay;
+    const std::chrono::steady_clock::duration min_delay = policy.min_delay;
+    if (samples.empty() || samples.size() < policy.min_samples)
+    {
+        return max_delay;
+    }
+    const double p = std::min(1.0, std::max(0.0, policy.percentile));
+    const std::size_t index = std::min(samples.size() - 1, static_cast<std::size_t>(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return std::min(max_delay, std::max(min_delay, samples[index]));
+}
+
+//==============================================================================
+request_stats connection_pool::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(stats_mtx);
+    return stats;
+}
+
+//==============================================================================
+void connection_pool::set_session_token(const std::string& token)
+{
+    // Connections that are currently on loan pick up the new token when they are next acquired
+    std::lock_guard<std::mutex> lock(mtx);
+    session_token = token;
+}
+
+//==============================================================================
+void connection_pool::set_deadlines(const bfapi::deadlines& d)
+{
+    // As with the session token, connections on loan pick this up when next acquired
+    std::lock_guard<std::mutex> lock(mtx);
+    limits = d;
+}
+
+//==============================================================================
+void connection_pool::set_ktls(bool enable)
+{
+    // Applies to connections made after they are next acquired
+    std::lock_guard<std::mutex> lock(mtx);
+    ktls_requested = enable;
+}
+
+//==============================================================================
+void connection_pool::set_endpoint_selector(const std::shared_ptr<endpoint_selector>& s)
+{
+    // Used for connects made after connections are next acquired
+    std::lock_guard<std::mutex> lock(mtx);
+    selector = s;
+}
+
+//==============================================================================
+void connection_pool::set_governor(const std::shared_ptr<request_governor>& g)
+{
+    // Applies to requests made after connections are next acquired
+    std::lock_guard<std::mutex> lock(mtx);
+    governor = g;
+}
+
+//==============================================================================
+std::size_t connection_pool::size() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return connections.size();
+}
+
+} // end of namespace bfapi
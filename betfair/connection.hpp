@@ -0,0 +1,417 @@
+//==============================================================================
+//
+// Persistent (keep-alive) HTTPS connections to the Betfair API host and a
+// bounded pool of them that can be shared between threads.
+//
+// The single shot methods in bfapi.hpp pay for DNS, TCP and TLS setup on every
+// call. An api_connection performs that setup once and then sends any number
+// of requests over the same stream. A connection_pool hands out connections
+// to threads so that several requests can be in flight at the same time.
+//
+// Every network operation is bounded by bfapi::deadlines. Read only calls can
+// additionally be hedged through the pool: if the response has not arrived
+// once the call is slower than a chosen percentile of recent latencies, the
+// same request is sent on a second connection and whichever answers first is
+// used while the other is cancelled.
+//
+// A request can also be made with all of its memory (request fields, response
+// headers and body, asio/beast operation state) taken from a bfapi::arena, as
+// place_orders() does. With a warm connection, arena and report the order
+// path then makes no heap allocations at all.
+//
+// Several requests can also be written back to back on one connection (HTTP/1.1
+// pipelining) with their responses read in order as they arrive, so a burst
+// pays for one round trip rather than one per request.
+//
+// Requests can be paced by a bfapi::request_governor shared by the connections
+// of an account, which adapts its rate to Betfair's throttling responses and
+// lets order requests go ahead of market data.
+//
+// On Linux, connections can optionally hand TLS record encryption to the
+// kernel (kTLS) once the handshake is complete, after which requests are sent
+// with plain socket I/O. This needs the kernel "tls" module and an OpenSSL
+// built with kTLS support; when either is missing connections silently fall
+// back to user space TLS.
+//
+//==============================================================================
+#ifndef BFAPI_CONNECTION_HPP
+#define BFAPI_CONNECTION_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl/stream.hpp>
+#include "bfapi.hpp"
+#include "arena.hpp"
+#include "endpoints.hpp"
+#include "governor.hpp"
+#include "responses.hpp"
+
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define BFAPI_KTLS_AVAILABLE 1
+#else
+#define BFAPI_KTLS_AVAILABLE 0
+#endif
+
+namespace bfapi {
+
+struct http_result {
+	int status;
+	std::string body;
+
+	http_result() : status(0) {}
+};
+
+// Response whose body is held in an arena and is only valid until it is released
+struct http_view {
+	int status;
+	const char* body;
+	std::size_t size;
+
+	http_view() : status(0), body(nullptr), size(0) {}
+};
+
+struct pipelined_request {
+	std::string target;
+	std::string body;
+	bool idempotent;                        // May be resent if the connection fails before it is answered
+
+	pipelined_request(const std::string& t, const std::string& b, bool i = false) : target(t), body(b), idempotent(i) {}
+};
+
+class api_connection {
+public:
+	api_connection(boost::asio::ssl::context& ssl_ctx,
+	               const std::string& appkey,
+	               const std::string& session_token,
+	               const std::string& host = bfapi::bf_host,
+	               const std::string& port = bfapi::port);
+	~api_connection();
+
+	api_connection(const api_connection&) = delete;
+	api_connection& operator=(const api_connection&) = delete;
+
+	// Resolve, connect and perform the TLS handshake
+	bool connect(std::string& error);
+	bool is_open() const { return open; }
+	void close();
+
+	void set_session_token(const std::string& token) { session_token = token; }
+	void set_deadlines(const bfapi::deadlines& d) { limits = d; }
+
+	// Request kernel TLS offload for subsequent connects (opt-in, Linux only)
+	void set_ktls(bool enable) { ktls_requested = enable; }
+	// True while the current connection is using kernel TLS
+	bool ktls_active() const { return ktls; }
+
+	// Selector used to resolve and connect (shared_endpoints() unless set).
+	// Request round trips are reported to it for the address connected to.
+	void set_endpoint_selector(const std::shared_ptr<endpoint_selector>& s) { selector = s; }
+	// Address of the current connection, null when not connected
+	const endpoint_selector::endpoint_ptr& connected_endpoint() const { return peer; }
+
+	// Governor every request waits on (none unless set). A request it does not
+	// admit in time fails without being sent.
+	void set_governor(const std::shared_ptr<request_governor>& g) { governor = g; }
+
+	// POST a JSON body to target and wait for the response. The connection is
+	// (re)opened if required. If the server has dropped an idle keep-alive
+	// connection the request is resent once on a fresh connection, but only
+	// when that cannot duplicate it: either nothing was written or the request
+	// is idempotent (i.e. read only market data calls).
+	bool post(const std::string& target,
+	          const std::string& body,
+	          http_result& result,
+	          std::string& error,
+	          bool idempotent = false);
+
+	// As above with the governor priority given rather than taken from the target
+	// (e.g. order priority for a JSON-RPC batch holding placeOrders calls)
+	bool post(const std::string& target,
+	          const std::string& body,
+	          http_result& result,
+	          std::string& error,
+	          bool idempotent,
+	          request_priority priority);
+
+	// As post() but every allocation for the request and response comes from a,
+	// and result.body points into a until it is released
+	bool post(const std::string& target,
+	          const char* body,
+	          std::size_t body_size,
+	          bfapi::arena& a,
+	          http_view& result,
+	          std::string& error,
+	          bool idempotent = false);
+
+	// Write every request before reading any response (HTTP/1.1 pipelining);
+	// results[i] is the response to requests[i]. If the connection fails or is
+	// closed by the server part way through, the unanswered requests are sent
+	// once more on a new connection, except those already written that are not
+	// idempotent: they may have been processed, so their status is left 0.
+	// With a governor each write of a request takes a token. If one is not
+	// admitted in time it and the requests after it are not sent (status 0).
+	// Returns true only if every request was answered.
+	bool post_pipelined(const std::vector<pipelined_request>& requests,
+	                    std::vector<http_result>& results,
+	                    std::string& error);
+
+	// placeOrders using a for the request body, HTTP messages and I/O state, as
+	// operations::call<operations::place_orders>(). report is filled in place
+	// (see responses::parse_place_execution_report) and a is released before
+	// returning. Fails unless the report status is SUCCESS.
+	bool place_orders(const bfapi::orders::place_limit_orders_request& request,
+	                  bfapi::arena& a,
+	                  bfapi::responses::place_execution_report& report,
+	                  std::string& error);
+	bool place_orders(const bfapi::orders::place_orders_request& request,
+	                  bfapi::arena& a,
+	                  bfapi::responses::place_execution_report& report,
+	                  std::string& error);
+
+	// Number of requests sent since the last (re)connect
+	std::size_t requests_on_connection() const { return request_count; }
+
+	// When the current connection last completed its handshake or a response
+	std::chrono::steady_clock::time_point last_activity() const { return last_used; }
+
+	// True if the last failed operation failed because a deadline expired
+	bool timed_out() const { return last_timed_out; }
+
+	// What the last response said about the request rate (only known with a governor)
+	throttle_signal throttled() const { return last_throttle; }
+
+	// Abort a post() that is in progress on another thread; it fails with
+	// operation_aborted and the connection is closed. Has no effect if no
+	// post() is running when the cancellation is processed. Thread safe.
+	void cancel();
+
+private:
+	// The concrete io_context executor rather than beast's default type erased one,
+	// which allocates a function wrapper each time it runs a completion handler
+	typedef boost::beast::basic_stream<boost::asio::ip::tcp, boost::asio::io_context::executor_type> socket_type;
+	typedef boost::beast::ssl_stream<socket_type> stream_type;
+
+	enum class attempt_result { ok, failed_before_write, failed_after_write };
+
+	attempt_result attempt(const std::string& target, const std::string& body, http_result& result, std::string& error);
+	attempt_result attempt(const std::string& target, const char* body, std::size_t body_size, bfapi::arena& a, http_view& result, std::string& error);
+
+	template<class Request>
+	void set_headers(Request& req) const;
+
+	// Send req and read res, closing the connection on error or if the server will not keep it alive
+	template<class Request, class Response, class Allocator>
+	attempt_result exchange(Request& req, Response& res, std::string& error, const Allocator& alloc);
+
+	// Wait for the governor (if any) before a request and report its response to it
+	bool admit(const std::string& target, request_priority priority, std::string& error);
+	void refund(const std::string& target, request_priority priority);
+	void note_response(const std::string& target, int status, const char* body, std::size_t size);
+
+	// Run f (one attempt) and retry it once on a new connection when that is safe
+	template<class Attempt>
+	bool post_with_retry(Attempt f, std::string& error, bool idempotent);
+
+	// Connect and handshake directly on the socket with kTLS enabled. Returns false
+	// on connection/handshake errors; otherwise ktls says whether offload is active.
+	bool connect_ktls(std::string& error);
+
+	boost::asio::io_context ioc;
+	boost::asio::ssl::context& ctx;
+	std::unique_ptr<stream_type> stream;
+	boost::beast::flat_buffer buffer;
+	std::string appkey;
+	std::string session_token;
+	std::string host;
+	std::string port;
+	bfapi::deadlines limits;
+	bool open;
+	bool last_timed_out;
+	bool cancel_requested;
+	std::size_t request_count;
+	std::chrono::steady_clock::time_point last_used;
+	std::atomic<std::uint64_t> generation;  // Incremented by every post() so a stale cancel() is ignored
+
+	// kTLS mode: the socket is used directly and ktls_ssl only holds the session
+	std::unique_ptr<socket_type> plain;
+	SSL* ktls_ssl;
+	bool ktls_requested;
+	bool ktls;
+	static std::atomic<bool> ktls_unsupported;
+
+	std::shared_ptr<endpoint_selector> selector;
+	endpoint_selector::endpoint_ptr peer;
+
+	std::shared_ptr<request_governor> governor;
+	throttle_signal last_throttle;
+};
+
+struct hedge_policy {
+	double percentile;                      // Hedge once the call is slower than this fraction of recent calls
+	std::chrono::milliseconds min_delay;    // Never hedge sooner than this
+	std::chrono::milliseconds max_delay;    // Upper bound, also used until min_samples latencies are known
+	std::size_t min_samples;
+
+	hedge_policy() : percentile(0.95), min_delay(20), max_delay(500), min_samples(20) {}
+};
+
+struct request_stats {
+	std::uint64_t requests;
+	std::uint64_t failures;
+	std::uint64_t timeouts;
+	std::uint64_t hedged_requests;          // Requests eligible for hedging (post_hedged calls)
+	std::uint64_t hedges_sent;              // Second requests actually sent
+	std::uint64_t hedge_wins;               // The hedge answered first
+	std::uint64_t primary_wins;             // The original request answered first after a hedge was sent
+
+	request_stats() : requests(0), failures(0), timeouts(0), hedged_requests(0), hedges_sent(0), hedge_wins(0), primary_wins(0) {}
+
+	double hedge_rate() const { return hedged_requests > 0 ? static_cast<double>(hedges_sent) / hedged_requests : 0.0; }
+	double hedge_win_rate() const { return hedges_sent > 0 ? static_cast<double>(hedge_wins) / hedges_sent : 0.0; }
+};
+
+class connection_pool {
+public:
+	connection_pool(const bfapi::accinfo& user_info,
+	                const std::string& session_token,
+	                std::size_t max_connections,
+	                const std::string& host = bfapi::bf_host,
+	                const std::string& port = bfapi::port);
+
+	~connection_pool();    // Stops the hedge threads
+
+	connection_pool(const connection_pool&) = delete;
+	connection_pool& operator=(const connection_pool&) = delete;
+
+	// A connection on loan from the pool. It is returned when the lease is destroyed.
+	class lease {
+	public:
+		lease(connection_pool& p, api_connection* c) : pool(&p), conn(c) {}
+		lease(lease&& other) : pool(other.pool), conn(other.conn) { other.conn = nullptr; }
+		~lease() { if (conn) pool->release(conn); }
+
+		lease(const lease&) = delete;
+		lease& operator=(const lease&) = delete;
+
+		api_connection* operator->() const { return conn; }
+		api_connection& operator*() const { return *conn; }
+
+	private:
+		connection_pool* pool;
+		api_connection* conn;
+	};
+
+	// Block until a connection is available. New connections are created lazily
+	// up to max_connections; they are connected on first use.
+	lease acquire();
+
+	// As acquire() but returns null immediately if every connection is on loan
+	std::unique_ptr<lease> try_acquire();
+
+	// Convenience method: acquire a connection, post and release it again
+	bool post(const std::string& target,
+	          const std::string& body,
+	          http_result& result,
+	          std::string& error,
+	          bool idempotent = false);
+
+	// Convenience method: acquire a connection and pipeline requests on it
+	bool post_pipelined(const std::vector<pipelined_request>& requests,
+	                    std::vector<http_result>& results,
+	                    std::string& error);
+
+	// Post a read only (idempotent) request with hedging as described above. A
+	// hedge is only sent if a second connection is immediately available. The
+	// hedges are sent from threads kept by the pool, created as concurrent
+	// post_hedged() calls need them up to one per connection.
+	bool post_hedged(const std::string& target,
+	                 const std::string& body,
+	                 http_result& result,
+	                 std::string& error,
+	                 const hedge_policy& policy = hedge_policy());
+
+	void set_session_token(const std::string& token);
+	void set_deadlines(const bfapi::deadlines& d);
+	void set_ktls(bool enable);
+	void set_endpoint_selector(const std::shared_ptr<endpoint_selector>& s);
+	void set_governor(const std::shared_ptr<request_governor>& g);
+	std::size_t max_size() const { return max_connections; }
+
+	// TLS context of the pool's connections, e.g. to trust another CA
+	boost::asio::ssl::context& tls_context() { return ssl_ctx; }
+	std::size_t size() const;
+
+	request_stats get_stats() const;
+
+	// Count a request made on a leased connection in get_stats() and the hedge
+	// latencies, as post() does for its own requests
+	void record(bool ok, bool timed_out, std::chrono::steady_clock::duration latency);
+
+	// Run job on a thread kept by the pool, e.g. a worker of a bulk fetch. These
+	// threads are separate from the hedge threads and are created as concurrent
+	// jobs need them up to one per connection; further jobs wait for a thread.
+	void run(std::function<void()> job);
+
+private:
+	// Threads kept by the pool running queued jobs, created when a job finds
+	// every thread busy (up to max_threads) and stopped with the pool
+	struct job_threads {
+		std::deque<std::function<void()>> jobs;
+		std::vector<std::thread> threads;
+		std::size_t idle;
+		bool stopping;
+		std::mutex mtx;
+		std::condition_variable cv;
+
+		job_threads() : idle(0), stopping(false) {}
+		void run(std::function<void()> job, std::size_t max_threads);
+		void work();
+		void stop();
+	};
+
+	void configure(api_connection& conn);
+	void release(api_connection* conn);
+	std::chrono::steady_clock::duration hedge_delay(const hedge_policy& policy) const;
+
+	boost::asio::ssl::context ssl_ctx;
+	std::string appkey;
+	std::string session_token;
+	std::string host;
+	std::string port;
+	bfapi::deadlines limits;
+	std::size_t max_connections;
+	bool ktls_requested;
+	std::shared_ptr<endpoint_selector> selector;
+	std::shared_ptr<request_governor> governor;
+	std::vector<std::unique_ptr<api_connection>> connections;
+	std::vector<api_connection*> idle;
+	mutable std::mutex mtx;
+	std::condition_variable cv;
+
+	// Latencies of recent successful requests (ring buffer) used for the hedge delay
+	std::vector<std::chrono::steady_clock::duration> latencies;
+	std::size_t latency_pos;
+	request_stats stats;
+	mutable std::mutex stats_mtx;
+
+	// Threads waiting out hedge delays and sending hedges, and threads for run()
+	job_threads hedgers;
+	job_threads workers;
+};
+
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,106 @@
+//==============================================================================
+//
+// Betfair dates: ISO 8601 in UTC with milliseconds, e.g.
+//
+//         2024-01-31T14:30:00.000Z
+//
+// Header only, so modules that only need to read or write a date do not link
+// the module that happens to define the helpers. Parsing does not allocate
+// and accepts the fraction as optional; the time zone designator is ignored
+// (Betfair always sends Z).
+//
+//==============================================================================
+#ifndef BFAPI_DATES_HPP
+#define BFAPI_DATES_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+
+namespace bfapi {
+namespace dates {
+
+// Days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant's days_from_civil)
+inline std::int64_t days_from_civil(int y, int m, int d)
+{
+	y -= m <= 2;
+	const std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+	const unsigned yoe = static_cast<unsigned>(y - era * 400);
+	const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + static_cast<std::int64_t>(doe) - 719468;
+}
+
+// n decimal digits at p
+inline bool parse_digits(const char* p, int n, int& value)
+{
+	value = 0;
+	for (int i = 0; i < n; ++i)
+	{
+		if (p[i] < '0' || p[i] > '9')
+		{
+			return false;
+		}
+		value = value * 10 + (p[i] - '0');
+	}
+	return true;
+}
+
+// YYYY-MM-DDThh:mm:ss[.mmm] as milliseconds since the epoch
+inline bool parse_iso8601(const char* s, std::size_t n, std::int64_t& ms)
+{
+	int y, mo, d, h, mi, sec, frac = 0;
+	if (n < 19 || s[4] != '-' || s[7] != '-' || s[10] != 'T' || s[13] != ':' || s[16] != ':' ||
+	    false == parse_digits(s, 4, y) || false == parse_digits(s + 5, 2, mo) || false == parse_digits(s + 8, 2, d) ||
+	    false == parse_digits(s + 11, 2, h) || false == parse_digits(s + 14, 2, mi) || false == parse_digits(s + 17, 2, sec) ||
+	    mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || sec > 60)
+	{
+		return false;
+	}
+	if (n >= 23 && '.' == s[19] && false == parse_digits(s + 20, 3, frac))
+	{
+		return false;
+	}
+	ms = ((days_from_civil(y, mo, d) * 24 + h) * 60 + mi) * 60000 + sec * 1000 + frac;
+	return true;
+}
+
+inline bool parse_iso8601(const std::string& s, std::int64_t& ms)
+{
+	return parse_iso8601(s.data(), s.size(), ms);
+}
+
+// As above to whole seconds
+inline bool from_iso8601(const std::string& s, std::time_t& t)
+{
+	std::int64_t ms = 0;
+	if (false == parse_iso8601(s, ms))
+	{
+		return false;
+	}
+	t = static_cast<std::time_t>(ms >= 0 ? ms / 1000 : (ms - 999) / 1000);
+	return true;
+}
+
+inline std::string to_iso8601(std::time_t t, int millis = 0)
+{
+	std::tm tm_utc;
+	gmtime_r(&t, &tm_utc);
+	char buf[64];
+	std::snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+	              tm_utc.tm_year + 1900, tm_utc.tm_mon + 1, tm_utc.tm_mday,
+	              tm_utc.tm_hour, tm_utc.tm_min, tm_utc.tm_sec, millis);
+	return std::string(buf);
+}
+
+// Milliseconds since the epoch
+inline std::string to_iso8601_ms(std::int64_t ms)
+{
+	return to_iso8601(static_cast<std::time_t>(ms / 1000), static_cast<int>(ms % 1000));
+}
+
+} // end of namespace bfapi::dates
+} // end of namespace bfapi
+
+#endif
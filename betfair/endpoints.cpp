@@ -0,0 +1,416 @@
+#include "endpoints.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace net = boost::asio;
+using tcp = net::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+namespace bfapi {
+
+namespace {
+
+//==============================================================================
+double to_us(clock_type::duration d)
+{
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+//==============================================================================
+std::string host_key(const std::string& host, const std::string& port)
+{
+    return host + ":" + port;
+}
+
+} // end of anonymous namespace
+
+//==============================================================================
+endpoint_stats endpoint_selector::endpoint::stats() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return s;
+}
+
+//==============================================================================
+endpoint_selector::endpoint_selector(const endpoint_policy& p, const resolver_function& r) : policy(p),
+                                                                                             resolver(r ? r : resolver_function(system_resolve)),
+                                                                                             resolver_calls(0),
+                                                                                             probe_count(0),
+                                                                                             stopping(false)
+{
+}
+
+//==============================================================================
+endpoint_selector::~endpoint_selector()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    probe_cv.notify_all();
+    if (probe_thread.joinable())
+    {
+        probe_thread.join();
+    }
+}
+
+//==============================================================================
+boost::system::error_code endpoint_selector::system_resolve(const std::string& host,
+                                                            const std::string& port,
+                                                            clock_type::duration timeout,
+                                                            std::vector<tcp::endpoint>& addresses,
+                                                            std::chrono::seconds& ttl)
+{
+    (void)ttl;      // getaddrinfo does not say
+    tcp::resolver::results_type results;
+    const boost::system::error_code ec = timed_io::resolve(host, port, results, timeout);
+    addresses.clear();
+    for (const tcp::resolver::results_type::value_type& r : results)
+    {
+        addresses.push_back(r.endpoint());
+    }
+    return ec;
+}
+
+//==============================================================================
+boost::system::error_code endpoint_selector::resolve(const std::string& host,
+                                                     const std::string& port,
+                                                     clock_type::duration timeout,
+                                                     std::vector<endpoint_ptr>& ordered,
+                                                     clock_type::duration& stagger)
+{
+    const std::string key = host_key(host, port);
+    clock_type::time_point now = clock_type::now();
+    ordered.clear();
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = hosts.find(key);
+        if (hosts.end() != it && now < it->second.expires)
+        {
+            ordered = it->second.endpoints;
+        }
+    }
+
+    if (ordered.empty())
+    {
+        // Resolve without holding the lock; a concurrent resolution of the same host is harmless
+        std::vector<tcp::endpoint> addresses;
+        std::chrono::seconds ttl(0);
+        boost::system::error_code ec = resolver(host, port, timeout, addresses, ttl);
+        now = clock_type::now();
+
+        std::lock_guard<std::mutex> lock(mtx);
+        ++resolver_calls;
+        host_entry& entry = hosts[key];
+        if (ec || addresses.empty())
+        {
+            if (entry.endpoints.empty() || now >= entry.stale_until)
+            {
+                return ec ? ec : boost::system::error_code(net::error::host_not_found);
+            }
+            ordered = entry.endpoints;      // Stale but better than nothing; resolve again next time
+        }
+        else
+        {
+            // Keep what is known about addresses that are still listed
+            std::vector<endpoint_ptr> updated;
+            for (const tcp::endpoint& a : addresses)
+            {
+                auto known = std::find_if(entry.endpoints.begin(), entry.endpoints.end(),
+                                          [&a](const endpoint_ptr& e) { return e->address() == a; });
+                updated.push_back(entry.endpoints.end() != known ? *known : std::make_shared<endpoint>(a));
+            }
+            if (entry.endpoints.empty())
+            {
+                entry.next_probe = now + policy.probe_interval;
+            }
+            entry.endpoints.swap(updated);
+            const std::chrono::seconds lifetime = ttl.count() > 0 ? ttl : policy.default_ttl;
+            entry.expires = now + lifetime;
+            entry.stale_until = entry.expires + policy.stale_for;
+            ordered = entry.endpoints;
+        }
+    }
+
+    // Order by health, then RTT; unmeasured addresses keep the resolver's order
+    // after measured ones. Request RTTs include server time and are not
+    // comparable with connect RTTs, so they are only used when every healthy
+    // address has a recent one.
+    struct ranked {
+        endpoint_ptr e;
+        bool healthy;
+        bool has_request_rtt;
+        double request_us;
+        double connect_us;
+        double stagger_us;
+    };
+    std::vector<ranked> ranking;
+    bool any_healthy = false;
+    for (const endpoint_ptr& e : ordered)
+    {
+        std::lock_guard<std::mutex> lock(e->mtx);
+        ranked r;
+        r.e = e;
+        r.healthy = e->s.healthy;
+        r.has_request_rtt = e->s.request_rtt.samples > 0 && now - e->last_request < policy.request_rtt_max_age;
+        r.request_us = r.has_request_rtt ? e->s.request_rtt.srtt_us : std::numeric_limits<double>::max();
+        r.connect_us = e->s.connect_rtt.samples > 0 ? e->s.connect_rtt.srtt_us : std::numeric_limits<double>::max();
+        r.stagger_us = e->s.connect_rtt.samples > 0 ? e->s.connect_rtt.srtt_us + 4 * e->s.connect_rtt.rttvar_us : 0.0;
+        any_healthy = any_healthy || r.healthy;
+        ranking.push_back(r);
+    }
+    const bool by_request = false == ranking.empty() && std::all_of(ranking.begin(), ranking.end(), [any_healthy](const ranked& r)
+    {
+        return r.has_request_rtt || (any_healthy && false == r.healthy);
+    });
+    std::stable_sort(ranking.begin(), ranking.end(), [by_request](const ranked& a, const ranked& b)
+    {
+        if (a.healthy != b.healthy)
+        {
+            return a.healthy;
+        }
+        return by_request ? a.request_us < b.request_us : a.connect_us < b.connect_us;
+    });
+    for (std::size_t i = 0; i < ranking.size(); ++i)
+    {
+        ordered[i] = ranking[i].e;
+    }
+
+    // Give the best address about as long as it normally takes to connect before trying the next
+    stagger = policy.max_stagger;
+    if (false == ranking.empty() && ranking.front().stagger_us > 0.0)
+    {
+        stagger = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double, std::micro>(ranking.front().stagger_us));
+        stagger = std::max<clock_type::duration>(policy.min_stagger, std::min<clock_type::duration>(policy.max_stagger, stagger));
+    }
+    return boost::system::error_code();
+}
+
+//==============================================================================
+bool endpoint_selector::claim_probe(const std::string& host, const std::string& port)
+{
+    if (policy.probe_interval.count() <= 0)
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = hosts.find(host_key(host, port));
+    const clock_type::time_point now = clock_type::now();
+    if (hosts.end() == it || it->second.endpoints.empty() || now < it->second.next_probe)
+    {
+        return false;
+    }
+    // Only one connection probes; the others go ahead with what is known
+    it->second.next_probe = now + policy.probe_interval;
+    return true;
+}
+
+//==============================================================================
+boost::system::error_code endpoint_selector::prepare(const std::string& host,
+                                                     const std::string& port,
+                                                     clock_type::duration timeout,
+                                                     std::vector<endpoint_ptr>& ordered,
+                                                     std::vector<tcp::endpoint>& candidates,
+                                                     clock_type::duration& stagger)
+{
+    if (claim_probe(host, port))
+    {
+        // Probed in the background so that unresponsive addresses never hold up this connect
+        std::lock_guard<std::mutex> lock(mtx);
+        probe_queue.push_back(probe_job{host, port, timeout});
+        if (false == probe_thread.joinable())
+        {
+            probe_thread = std::thread(&endpoint_selector::run_probes, this);
+        }
+        probe_cv.notify_one();
+    }
+    boost::system::error_code ec = resolve(host, port, timeout, ordered, stagger);
+    candidates.clear();
+    for (const endpoint_ptr& e : ordered)
+    {
+        candidates.push_back(e->address());
+    }
+    return ec;
+}
+
+//==============================================================================
+void endpoint_selector::run_probes()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    for (;;)
+    {
+        probe_cv.wait(lock, [this] { return stopping || false == probe_queue.empty(); });
+        if (stopping)
+        {
+            return;
+        }
+        const probe_job job = probe_queue.front();
+        probe_queue.pop_front();
+        lock.unlock();
+        probe(job.host, job.port, job.timeout);
+        lock.lock();
+    }
+}
+
+//==============================================================================
+boost::system::error_code endpoint_selector::probe(const std::string& host, const std::string& port, clock_type::duration timeout)
+{
+    const clock_type::time_point deadline = clock_type::now() + timeout;
+    std::vector<endpoint_ptr> ordered;
+    clock_type::duration stagger;
+    boost::system::error_code ec = resolve(host, port, timeout, ordered, stagger);
+    if (ec)
+    {
+        return ec;
+    }
+
+    // Connect to every address at once, each attempt bounded by what is left of timeout
+    net::io_context ioc;
+    std::vector<std::unique_ptr<tcp::socket>> sockets;
+    std::vector<timed_io::connect_outcome> outcomes(ordered.size());
+    const clock_type::time_point start = clock_type::now();
+    net::steady_timer timer(ioc, deadline);
+    std::size_t pending = 0;
+    for (std::size_t i = 0; i < ordered.size(); ++i)
+    {
+        sockets.emplace_back(new tcp::socket(ioc));
+        outcomes[i].started = true;
+        ++pending;
+        sockets[i]->async_connect(ordered[i]->address(), [&, i](boost::system::error_code e)
+        {
+            if (e != net::error::operation_aborted)
+            {
+                outcomes[i].completed = true;
+                outcomes[i].ec = e;
+                outcomes[i].elapsed = clock_type::now() - start;
+            }
+            if (0 == --pending)
+            {
+                timer.cancel();
+            }
+        });
+    }
+    timer.async_wait([&](boost::system::error_code e)
+    {
+        if (!e)
+        {
+            for (std::unique_ptr<tcp::socket>& s : sockets)
+            {
+                boost::system::error_code ignored;
+                s->close(ignored);
+            }
+        }
+    });
+    ioc.run();
+
+    // A probe connection is never used, so it does not count towards connects
+    for (std::size_t i = 0; i < ordered.size(); ++i)
+    {
+        record_connect(*ordered[i], outcomes[i].completed && !outcomes[i].ec, outcomes[i].elapsed, false);
+    }
+    std::lock_guard<std::mutex> lock(mtx);
+    ++probe_count;
+    return boost::system::error_code();
+}
+
+//==============================================================================
+void endpoint_selector::record_connect(endpoint& e, bool ok, clock_type::duration elapsed, bool used)
+{
+    std::lock_guard<std::mutex> lock(e.mtx);
+    if (ok)
+    {
+        e.s.connect_rtt.add(to_us(elapsed));
+        e.s.connects += used ? 1 : 0;
+        e.s.consecutive_failures = 0;
+        e.s.healthy = true;
+    }
+    else
+    {
+        ++e.s.failures;
+        ++e.s.consecutive_failures;
+        e.s.healthy = e.s.consecutive_failures < policy.failures_until_unhealthy;
+    }
+}
+
+//==============================================================================
+void endpoint_selector::record_connects(const std::vector<endpoint_ptr>& attempted,
+                                        const std::vector<timed_io::connect_outcome>& outcomes,
+                                        bool timed_out)
+{
+    for (std::size_t i = 0; i < attempted.size() && i < outcomes.size(); ++i)
+    {
+        const timed_io::connect_outcome& o = outcomes[i];
+        if (o.completed)
+        {
+            record_connect(*attempted[i], !o.ec, o.elapsed, true);
+        }
+        else if (o.started && timed_out)
+        {
+            record_connect(*attempted[i], false, o.elapsed, true);
+        }
+        // Attempts cancelled because another address won say nothing about this one
+    }
+}
+
+//==============================================================================
+void endpoint_selector::record_request(endpoint& e, clock_type::duration elapsed, bool ok)
+{
+    std::lock_guard<std::mutex> lock(e.mtx);
+    if (ok)
+    {
+        e.s.request_rtt.add(to_us(elapsed));
+        e.last_request = clock_type::now();
+    }
+    else
+    {
+        ++e.s.failures;
+        ++e.s.consecutive_failures;
+        e.s.healthy = e.s.consecutive_failures < policy.failures_until_unhealthy;
+    }
+}
+
+//==============================================================================
+std::vector<endpoint_stats> endpoint_selector::stats(const std::string& host, const std::string& port) const
+{
+    std::vector<endpoint_stats> result;
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = hosts.find(host_key(host, port));
+    if (hosts.end() != it)
+    {
+        for (const endpoint_ptr& e : it->second.endpoints)
+        {
+            result.push_back(e->stats());
+        }
+    }
+    return result;
+}
+
+//==============================================================================
+std::uint64_t endpoint_selector::resolutions() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return resolver_calls;
+}
+
+//==============================================================================
+std::uint64_t endpoint_selector::probes() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return probe_count;
+}
+
+//==============================================================================
+void endpoint_selector::clear()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    hosts.clear();
+}
+
+//==============================================================================
+std::shared_ptr<endpoint_selector> shared_endpoints()
+{
+    static std::shared_ptr<endpoint_selector> selector = std::make_shared<endpoint_selector>();
+    return selector;
+}
+
+} // end of namespace bfapi
@@ -0,0 +1,245 @@
+//==============================================================================
+//
+// Endpoint selection for connections to the Betfair API hosts.
+//
+// An endpoint_selector sits between a connection and DNS:
+//
+//  - Resolutions are cached per host and port for their TTL. The system
+//    resolver (getaddrinfo) cannot report a TTL, so endpoint_policy supplies
+//    one. If re-resolving fails the expired addresses stay in use for up to
+//    stale_for.
+//  - Every address keeps a smoothed round trip time (as TCP's SRTT, RFC 6298)
+//    of TCP connects, and of requests on connections made to it, which
+//    api_connection reports. Consecutive failures mark an address unhealthy.
+//  - connect() tries the addresses best first: healthy before unhealthy, then
+//    the lowest RTT. Request RTTs include the server's processing time, so
+//    they are only compared when every healthy address has a recent one;
+//    otherwise addresses are ranked on connect RTT. Attempts are raced as in
+//    RFC 8305 ("happy eyeballs"): the next address is tried once a stagger
+//    derived from the best RTT has passed, or immediately when an attempt
+//    fails, and the first to connect wins.
+//  - Every probe_interval a connect schedules a re-probe of the host: a TCP
+//    connect to every address at once, refreshing connect RTTs and health so
+//    that an address that has recovered (or slowed down) is noticed. Probes
+//    run on a background thread of the selector; the connect that schedules
+//    one goes ahead with what is already known and never waits for it.
+//
+// Connections and pools use shared_endpoints() unless given a selector of
+// their own. The resolver can be replaced, e.g. by a stand-in for tests.
+//
+//==============================================================================
+#ifndef BFAPI_ENDPOINTS_HPP
+#define BFAPI_ENDPOINTS_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <boost/asio/ip/tcp.hpp>
+#include "timed_io.hpp"
+
+namespace bfapi {
+
+struct endpoint_policy {
+	std::chrono::seconds default_ttl;           // For resolvers that do not report a TTL
+	std::chrono::seconds stale_for;             // Keep using an expired resolution this long while re-resolving fails
+	std::chrono::seconds probe_interval;        // 0 disables re-probing
+	std::chrono::seconds request_rtt_max_age;   // Request RTTs older than this are ignored for ordering
+	std::chrono::milliseconds min_stagger;
+	std::chrono::milliseconds max_stagger;      // Also used until the best address has a connect RTT
+	unsigned failures_until_unhealthy;
+
+	endpoint_policy() : default_ttl(60), stale_for(600), probe_interval(30), request_rtt_max_age(60),
+	                    min_stagger(10), max_stagger(250), failures_until_unhealthy(2) {}
+};
+
+// Smoothed round trip time as RFC 6298, in microseconds
+struct rtt_estimate {
+	double srtt_us;
+	double rttvar_us;
+	std::uint64_t samples;
+
+	rtt_estimate() : srtt_us(0.0), rttvar_us(0.0), samples(0) {}
+
+	void add(double us)
+	{
+		if (0 == samples++)
+		{
+			srtt_us = us;
+			rttvar_us = us / 2;
+			return;
+		}
+		const double delta = us > srtt_us ? us - srtt_us : srtt_us - us;
+		rttvar_us = 0.75 * rttvar_us + 0.25 * delta;
+		srtt_us = 0.875 * srtt_us + 0.125 * us;
+	}
+};
+
+struct endpoint_stats {
+	boost::asio::ip::tcp::endpoint address;
+	rtt_estimate connect_rtt;
+	rtt_estimate request_rtt;
+	std::uint64_t connects;                 // Connections made to this address (not counting probes)
+	std::uint64_t failures;
+	unsigned consecutive_failures;
+	bool healthy;
+
+	endpoint_stats() : connects(0), failures(0), consecutive_failures(0), healthy(true) {}
+};
+
+class endpoint_selector {
+public:
+	// Resolve host and port within timeout. ttl is 0 on entry; leave it 0 to use the policy's default.
+	typedef std::function<boost::system::error_code(const std::string& host,
+	                                                const std::string& port,
+	                                                std::chrono::steady_clock::duration timeout,
+	                                                std::vector<boost::asio::ip::tcp::endpoint>& addresses,
+	                                                std::chrono::seconds& ttl)> resolver_function;
+
+	// One resolved address. A connection keeps a handle to report request times to it.
+	class endpoint {
+	public:
+		explicit endpoint(const boost::asio::ip::tcp::endpoint& a) { s.address = a; }
+
+		const boost::asio::ip::tcp::endpoint& address() const { return s.address; }
+		endpoint_stats stats() const;
+
+	private:
+		friend class endpoint_selector;
+
+		mutable std::mutex mtx;
+		endpoint_stats s;
+		std::chrono::steady_clock::time_point last_request;
+	};
+	typedef std::shared_ptr<endpoint> endpoint_ptr;
+
+	// An empty resolver uses the system resolver
+	explicit endpoint_selector(const endpoint_policy& policy = endpoint_policy(), const resolver_function& resolver = resolver_function());
+	~endpoint_selector();    // Waits for a probe in progress
+
+	endpoint_selector(const endpoint_selector&) = delete;
+	endpoint_selector& operator=(const endpoint_selector&) = delete;
+
+	// Resolve host (from the cache when possible), schedule a re-probe if due and
+	// connect stream to the best address within timeout. On success connected
+	// (if given) is the address connected to.
+	template<class Executor, class RatePolicy>
+	boost::beast::error_code connect(boost::asio::io_context& ioc,
+	                                 boost::beast::basic_stream<boost::asio::ip::tcp, Executor, RatePolicy>& stream,
+	                                 const std::string& host,
+	                                 const std::string& port,
+	                                 std::chrono::steady_clock::duration timeout,
+	                                 endpoint_ptr* connected = nullptr);
+
+	// Addresses of host, best first, and the stagger to race them with
+	boost::system::error_code resolve(const std::string& host,
+	                                  const std::string& port,
+	                                  std::chrono::steady_clock::duration timeout,
+	                                  std::vector<endpoint_ptr>& ordered,
+	                                  std::chrono::steady_clock::duration& stagger);
+
+	// Connect to every address of host at once to refresh RTTs and health, then disconnect
+	boost::system::error_code probe(const std::string& host, const std::string& port, std::chrono::steady_clock::duration timeout);
+
+	// Round trip of a request on a connection to e; a failed (timed out) request counts against its health
+	void record_request(endpoint& e, std::chrono::steady_clock::duration elapsed, bool ok);
+
+	std::vector<endpoint_stats> stats(const std::string& host, const std::string& port) const;
+	std::uint64_t resolutions() const;      // Calls made to the resolver
+	std::uint64_t probes() const;           // Probes completed
+	void clear();
+
+	static boost::system::error_code system_resolve(const std::string& host,
+	                                                const std::string& port,
+	                                                std::chrono::steady_clock::duration timeout,
+	                                                std::vector<boost::asio::ip::tcp::endpoint>& addresses,
+	                                                std::chrono::seconds& ttl);
+
+private:
+	struct host_entry {
+		std::vector<endpoint_ptr> endpoints;
+		std::chrono::steady_clock::time_point expires;
+		std::chrono::steady_clock::time_point stale_until;
+		std::chrono::steady_clock::time_point next_probe;
+	};
+
+	struct probe_job {
+		std::string host;
+		std::string port;
+		std::chrono::steady_clock::duration timeout;
+	};
+
+	// Prepare a connect: resolve, schedule a probe if due, order the addresses
+	boost::system::error_code prepare(const std::string& host,
+	                                  const std::string& port,
+	                                  std::chrono::steady_clock::duration timeout,
+	                                  std::vector<endpoint_ptr>& ordered,
+	                                  std::vector<boost::asio::ip::tcp::endpoint>& candidates,
+	                                  std::chrono::steady_clock::duration& stagger);
+	bool claim_probe(const std::string& host, const std::string& port);
+	void run_probes();
+	void record_connects(const std::vector<endpoint_ptr>& attempted, const std::vector<timed_io::connect_outcome>& outcomes, bool timed_out);
+	void record_connect(endpoint& e, bool ok, std::chrono::steady_clock::duration elapsed, bool used);
+
+	endpoint_policy policy;
+	resolver_function resolver;
+	mutable std::mutex mtx;
+	std::map<std::string, host_entry> hosts;
+	std::uint64_t resolver_calls;
+	std::uint64_t probe_count;
+
+	// Background probing, started by the first probe that falls due
+	std::deque<probe_job> probe_queue;
+	std::condition_variable probe_cv;
+	bool stopping;
+	std::thread probe_thread;
+};
+
+// Selector shared by every connection that is not given one
+std::shared_ptr<endpoint_selector> shared_endpoints();
+
+//==============================================================================
+template<class Executor, class RatePolicy>
+boost::beast::error_code endpoint_selector::connect(boost::asio::io_context& ioc,
+                                                    boost::beast::basic_stream<boost::asio::ip::tcp, Executor, RatePolicy>& stream,
+                                                    const std::string& host,
+                                                    const std::string& port,
+                                                    std::chrono::steady_clock::duration timeout,
+                                                    endpoint_ptr* connected)
+{
+	const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+	std::vector<endpoint_ptr> ordered;
+	std::vector<boost::asio::ip::tcp::endpoint> candidates;
+	std::chrono::steady_clock::duration stagger;
+	boost::beast::error_code ec = prepare(host, port, timeout, ordered, candidates, stagger);
+	if (ec)
+	{
+		return ec;
+	}
+	const std::chrono::steady_clock::duration remaining = deadline - std::chrono::steady_clock::now();
+	if (remaining <= std::chrono::steady_clock::duration::zero())
+	{
+		return boost::beast::error::timeout;
+	}
+
+	std::vector<timed_io::connect_outcome> outcomes;
+	std::size_t winner = 0;
+	ec = timed_io::race_connect(ioc, stream, candidates, stagger, remaining, outcomes, winner);
+	record_connects(ordered, outcomes, ec == boost::beast::error::timeout);
+	if (!ec && connected)
+	{
+		*connected = ordered[winner];
+	}
+	return ec;
+}
+
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,290 @@
+#include "governor.hpp"
+#include "bfapi.hpp"
+#include <algorithm>
+
+using clock_type = std::chrono::steady_clock;
+
+namespace bfapi {
+
+namespace {
+
+//==============================================================================
+template<std::size_t N>
+bool contains(const char* body, std::size_t size, const char (&literal)[N])
+{
+    const char* end = body + size;
+    return body && std::search(body, end, literal, literal + N - 1) != end;
+}
+
+//==============================================================================
+double to_ms(clock_type::duration d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+} // end of anonymous namespace
+
+//==============================================================================
+request_governor::request_governor(const governor_policy& p) : policy(p), orders_waiting(0)
+{
+    init(account, policy.account_rate);
+}
+
+//==============================================================================
+void request_governor::init(bucket& b, double rate) const
+{
+    b.rate = rate > 0.0 ? std::max(policy.min_rate, std::min(policy.max_rate, rate)) : 0.0;
+    b.capacity = std::max(policy.burst, 1.0 + policy.order_reserve);
+    b.tokens = b.capacity;
+    b.last = clock_type::now();
+    b.last_decrease = clock_type::time_point();
+    b.slow_start = policy.slow_start;
+}
+
+//==============================================================================
+request_governor::bucket& request_governor::operation(const std::string& target)
+{
+    // Called with mtx held. Looking up a known operation does not allocate.
+    auto it = operations.find(target);
+    if (operations.end() == it)
+    {
+        it = operations.emplace(target, bucket()).first;
+        init(it->second, policy.operation_rate);
+        // Not part of init(): set_rate() must not reset the queue of an operation in use
+        for (std::size_t p = 0; p < 2; ++p)
+        {
+            it->second.next_ticket[p] = 0;
+            it->second.serving[p] = 0;
+        }
+    }
+    return it->second;
+}
+
+//==============================================================================
+void request_governor::refill(bucket& b, clock_type::time_point now) const
+{
+    const std::chrono::duration<double> elapsed = now - b.last;
+    b.last = now;
+    if (b.rate > 0.0)
+    {
+        b.tokens = std::min(b.capacity, b.tokens + elapsed.count() * b.rate);
+    }
+}
+
+//==============================================================================
+clock_type::duration request_governor::time_until(const bucket& b, double n) const
+{
+    if (b.rate <= 0.0 || b.tokens >= n)
+    {
+        return clock_type::duration::zero();
+    }
+    const std::chrono::duration<double> wait((n - b.tokens) / b.rate);
+    // Round up so the bucket really has n tokens when the waiter wakes
+    return std::chrono::duration_cast<clock_type::duration>(wait) + clock_type::duration(1);
+}
+
+//==============================================================================
+void request_governor::increase(bucket& b) const
+{
+    if (b.rate > 0.0)
+    {
+        b.rate = std::min(policy.max_rate, b.rate + (b.slow_start ? 1.0 : policy.increase / b.rate));
+    }
+}
+
+//==============================================================================
+void request_governor::decrease(bucket& b, clock_type::time_point now) const
+{
+    ++b.stats.throttled;
+    if (b.rate <= 0.0 || now - b.last_decrease < policy.decrease_holdoff)
+    {
+        return;
+    }
+    b.rate = std::max(policy.min_rate, b.rate * policy.decrease);
+    b.tokens = std::min(b.tokens, 0.0);
+    b.last_decrease = now;
+    b.slow_start = false;
+    ++b.stats.decreases;
+}
+
+//==============================================================================
+bool request_governor::acquire(const std::string& target, request_priority priority)
+{
+    const bool is_order = (priority == request_priority::order);
+    const std::size_t p = static_cast<std::size_t>(priority);
+    const double needed = 1.0 + (is_order ? 0.0 : policy.order_reserve);
+    const clock_type::time_point start = clock_type::now();
+    const clock_type::time_point deadline = start + policy.max_queue_delay;
+
+    std::unique_lock<std::mutex> lock(mtx);
+    bucket& op = operation(target);
+    const std::uint64_t ticket = op.next_ticket[p]++;
+    orders_waiting += is_order ? 1 : 0;
+    bool granted = false;
+    for (;;)
+    {
+        const clock_type::time_point now = clock_type::now();
+        if (ticket != op.serving[p])
+        {
+            // Deadlines are in ticket order, so only the first in line ever times out
+            cv.wait(lock);
+            continue;
+        }
+        refill(account, now);
+        refill(op, now);
+        const bool behind_orders = false == is_order && orders_waiting > 0;
+        const clock_type::duration wait = std::max(time_until(account, needed), time_until(op, needed));
+        if (false == behind_orders && wait == clock_type::duration::zero())
+        {
+            const double waited_ms = to_ms(now - start);
+            for (bucket* b : {&account, &op})
+            {
+                b->tokens -= b->rate > 0.0 ? 1.0 : 0.0;
+                ++b->stats.granted[p];
+                b->stats.total_wait_ms[p] += waited_ms;
+                b->stats.max_wait_ms[p] = std::max(b->stats.max_wait_ms[p], waited_ms);
+            }
+            granted = true;
+            break;
+        }
+        if (now >= deadline)
+        {
+            ++account.stats.rejected[p];
+            ++op.stats.rejected[p];
+            break;
+        }
+        // Data requests held back by an order request are woken when it is served
+        cv.wait_until(lock, behind_orders ? deadline : std::min(deadline, now + wait));
+    }
+    ++op.serving[p];
+    orders_waiting -= is_order ? 1 : 0;
+    lock.unlock();
+    cv.notify_all();
+    return granted;
+}
+
+//==============================================================================
+void request_governor::refund(const std::string& target, request_priority priority)
+{
+    const std::size_t p = static_cast<std::size_t>(priority);
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        bucket& op = operation(target);
+        for (bucket* b : {&account, &op})
+        {
+            b->tokens = std::min(b->capacity, b->tokens + (b->rate > 0.0 ? 1.0 : 0.0));
+            b->stats.granted[p] -= b->stats.granted[p] > 0 ? 1 : 0;
+        }
+    }
+    cv.notify_all();
+}
+
+//==============================================================================
+throttle_signal request_governor::classify(int status, const char* body, std::size_t size)
+{
+    // Betfair reports its API errors with HTTP 400 (and JSON-RPC errors inside a
+    // 200 response, which are not looked for here)
+    if (200 == status)
+    {
+        return throttle_signal::none;
+    }
+    if (429 == status || 503 == status)
+    {
+        return throttle_signal::http_status;
+    }
+    if (contains(body, size, "TOO_MANY_REQUESTS"))
+    {
+        return throttle_signal::too_many_requests;
+    }
+    if (contains(body, size, "TOO_MUCH_DATA"))
+    {
+        return throttle_signal::too_much_data;
+    }
+    return throttle_signal::none;
+}
+
+//==============================================================================
+throttle_signal request_governor::record(const std::string& target, int status, const char* body, std::size_t size)
+{
+    const throttle_signal signal = classify(status, body, size);
+    std::lock_guard<std::mutex> lock(mtx);
+    bucket& op = operation(target);
+    switch (signal)
+    {
+    case throttle_signal::none:
+        // Other errors (bad requests, expired sessions) say nothing about the rate
+        if (200 == status)
+        {
+            increase(account);
+            increase(op);
+        }
+        break;
+    case throttle_signal::too_much_data:
+        decrease(op, clock_type::now());
+        break;
+    case throttle_signal::too_many_requests:
+    case throttle_signal::http_status:
+        decrease(account, clock_type::now());
+        decrease(op, clock_type::now());
+        break;
+    }
+    return signal;
+}
+
+//==============================================================================
+request_priority request_governor::priority_of(const std::string& target)
+{
+    if (target == bfapi::place_orders_endpoint ||
+        target == bfapi::cancel_orders_endpoint ||
+        target == bfapi::replace_orders_endpoint)
+    {
+        return request_priority::order;
+    }
+    return request_priority::data;
+}
+
+//==============================================================================
+void request_governor::set_rate(const std::string& target, double requests_per_second)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    init(operation(target), requests_per_second);
+}
+
+//==============================================================================
+governor_stats request_governor::account_stats() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    governor_stats s = account.stats;
+    s.rate = account.rate;
+    return s;
+}
+
+//==============================================================================
+governor_stats request_governor::stats(const std::string& target) const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    governor_stats s;
+    auto it = operations.find(target);
+    if (operations.end() != it)
+    {
+        s = it->second.stats;
+        s.rate = it->second.rate;
+    }
+    return s;
+}
+
+//==============================================================================
+std::map<std::string, governor_stats> request_governor::all_stats() const
+{
+    std::map<std::string, governor_stats> result;
+    std::lock_guard<std::mutex> lock(mtx);
+    for (const auto& op : operations)
+    {
+        governor_stats& s = result[op.first];
+        s = op.second.stats;
+        s.rate = op.second.rate;
+    }
+    return result;
+}
+
+} // end of namespace bfapi
@@ -0,0 +1,154 @@
+//==============================================================================
+//
+// Adaptive request rate governor for one Betfair account.
+//
+// Betfair answers requests that come too fast with errors rather than
+// queueing them: TOO_MANY_REQUESTS and TOO_MUCH_DATA (APINGException error
+// codes, sent with HTTP 400), or HTTP 429/503 from the front end. Retrying
+// straight away only makes the throttling worse.
+//
+// A request_governor sits in front of every request made through the
+// api_connections (and pools) it is given, and of one shot post_json() calls
+// that are passed it:
+//
+//  - Each request takes a token from the account bucket and from the bucket
+//    of its operation (the endpoint path, e.g. placeOrders or listMarketBook),
+//    waiting for both if necessary.
+//  - The rate of each bucket adapts by AIMD, as TCP's congestion window does.
+//    Until a bucket is first throttled it is in slow start and every
+//    successful response adds one request per second to its rate, doubling it
+//    about every second. After that every successful response adds
+//    increase / rate, i.e. about increase requests per second for each second
+//    of traffic. A throttling
+//    response multiplies it by decrease and empties the bucket. Responses to
+//    requests that were already in flight when the rate was cut do not cut it
+//    again for decrease_holdoff.
+//  - Order operations (placeOrders, cancelOrders, replaceOrders) are served
+//    before market data. Data requests wait while an order request is
+//    waiting, and never take the last order_reserve tokens of a bucket, so an
+//    order arriving after a burst of polling still finds a token. Requests of
+//    the same priority to the same operation are served first come, first
+//    served. Each operation has its own queue, so a request waiting for its
+//    operation's bucket (e.g. after TOO_MUCH_DATA) does not hold up other
+//    operations.
+//
+// A request that cannot get a token within max_queue_delay fails without
+// being sent.
+//
+//==============================================================================
+#ifndef BFAPI_GOVERNOR_HPP
+#define BFAPI_GOVERNOR_HPP
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+
+namespace bfapi {
+
+enum class request_priority { order, data };
+
+// What a response says about the request rate
+enum class throttle_signal {
+	none,
+	too_much_data,          // The operation's data limits - cuts its rate only
+	too_many_requests,      // TOO_MANY_REQUESTS error code - cuts the account and operation rates
+	http_status             // HTTP 429 or 503 - cuts the account and operation rates
+};
+
+struct governor_policy {
+	double account_rate;                    // Starting rate in requests per second; 0 (or less) disables a bucket
+	double operation_rate;                  // Starting rate for each operation not given one with set_rate()
+	double min_rate;
+	double max_rate;
+	double burst;                           // Requests that may be sent back to back after an idle period
+	double increase;                        // Additive increase, requests per second per second of traffic
+	bool slow_start;                        // Grow exponentially until first throttled
+	double decrease;                        // Multiplicative decrease on a throttling response
+	double order_reserve;                   // Tokens of each bucket only order requests may take
+	std::chrono::milliseconds decrease_holdoff;
+	std::chrono::milliseconds max_queue_delay;
+
+	governor_policy() : account_rate(20.0), operation_rate(20.0), min_rate(1.0), max_rate(200.0), burst(5.0),
+	                    increase(2.0), slow_start(true), decrease(0.5), order_reserve(1.0), decrease_holdoff(500), max_queue_delay(2000) {}
+};
+
+struct governor_stats {
+	double rate;                            // Current rate, requests per second
+	std::uint64_t granted[2];               // Indexed by request_priority
+	std::uint64_t rejected[2];              // Waited longer than max_queue_delay
+	std::uint64_t throttled;                // Throttling responses
+	std::uint64_t decreases;                // Rate cuts (throttled less those within decrease_holdoff)
+	double max_wait_ms[2];
+	double total_wait_ms[2];
+
+	governor_stats() : rate(0.0), granted{0, 0}, rejected{0, 0}, throttled(0), decreases(0), max_wait_ms{0.0, 0.0}, total_wait_ms{0.0, 0.0} {}
+};
+
+class request_governor {
+public:
+	explicit request_governor(const governor_policy& policy = governor_policy());
+
+	request_governor(const request_governor&) = delete;
+	request_governor& operator=(const request_governor&) = delete;
+
+	// Wait for a token for a request to target. Returns false if none became
+	// available within max_queue_delay, in which case the request must not be sent.
+	bool acquire(const std::string& target, request_priority priority);
+	bool acquire(const std::string& target) { return acquire(target, priority_of(target)); }
+
+	// Give back the token of a request that was admitted but never sent
+	void refund(const std::string& target, request_priority priority);
+	void refund(const std::string& target) { refund(target, priority_of(target)); }
+
+	// Adapt the rates to the response to a request made with a token for target
+	throttle_signal record(const std::string& target, int status, const char* body, std::size_t size);
+
+	// Order operations are order priority; everything else is data
+	static request_priority priority_of(const std::string& target);
+
+	// Classify a response (only non-200 responses can be throttling)
+	static throttle_signal classify(int status, const char* body, std::size_t size);
+
+	// Fix the starting rate of an operation (it still adapts between min_rate and max_rate)
+	void set_rate(const std::string& target, double requests_per_second);
+
+	governor_stats account_stats() const;
+	governor_stats stats(const std::string& target) const;
+	std::map<std::string, governor_stats> all_stats() const;
+
+private:
+	struct bucket {
+		double rate;
+		double capacity;
+		double tokens;
+		std::chrono::steady_clock::time_point last;
+		std::chrono::steady_clock::time_point last_decrease;
+		bool slow_start;
+		governor_stats stats;
+		// Tickets per request_priority of requests to an operation: the waiter holding serving[p] is next
+		std::uint64_t next_ticket[2];
+		std::uint64_t serving[2];
+	};
+
+	void init(bucket& b, double rate) const;
+	bucket& operation(const std::string& target);
+	void refill(bucket& b, std::chrono::steady_clock::time_point now) const;
+	// Time until b has n tokens (zero if it already has)
+	std::chrono::steady_clock::duration time_until(const bucket& b, double n) const;
+	void increase(bucket& b) const;
+	void decrease(bucket& b, std::chrono::steady_clock::time_point now) const;
+
+	governor_policy policy;
+	bucket account;
+	std::map<std::string, bucket, std::less<>> operations;
+	std::size_t orders_waiting;             // Order requests in acquire(), which data requests wait behind
+	mutable std::mutex mtx;
+	std::condition_variable cv;
+};
+
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,1430 @@
+#include "historical.hpp"
+#include "json_scan.hpp"
+#include "ticks.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <bzlib.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bfapi {
+namespace historical {
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+typedef bfapi::json::scanner json_scanner;
+using bfapi::json::key_is;
+
+const std::size_t read_chunk = 1 << 20;         // Compressed bytes read per call
+const std::size_t text_chunk = 4 << 20;         // Decompressed bytes handled at a time
+
+//==============================================================================
+std::uint64_t elapsed_ns(clock_type::time_point since)
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - since).count());
+}
+
+//==============================================================================
+bool ends_with(const std::string& s, const std::string& suffix)
+{
+    return s.size() >= suffix.size() && 0 == s.compare(s.size() - suffix.size(), suffix.size(), suffix);
+}
+
+//==============================================================================
+source_type type_of(const std::string& name)
+{
+    if (ends_with(name, ".bz2"))
+    {
+        return source_type::bz2;
+    }
+    if (ends_with(name, ".bfc"))
+    {
+        return source_type::columnar;
+    }
+    return source_type::plain;
+}
+
+//==============================================================================
+bool parse_price_vols(json_scanner& js, std::vector<bfapi::stream::price_vol>& out)
+{
+    out.clear();
+    if (js.null_value())
+    {
+        return true;
+    }
+    return js.array([&]()
+    {
+        bfapi::stream::price_vol pv;
+        bool ok = js.consume('[') && js.number(pv.price) && js.consume(',') && js.number(pv.size) && js.consume(']');
+        out.push_back(pv);
+        return ok;
+    });
+}
+
+//==============================================================================
+bool parse_level_price_vols(json_scanner& js, std::vector<bfapi::stream::level_price_vol>& out)
+{
+    out.clear();
+    if (js.null_value())
+    {
+        return true;
+    }
+    return js.array([&]()
+    {
+        bfapi::stream::level_price_vol lpv;
+        std::int64_t level = 0;
+        bool ok = js.consume('[') && js.integer(level) && js.consume(',') && js.number(lpv.price) && js.consume(',') &&
+                  js.number(lpv.size) && js.consume(']');
+        lpv.level = static_cast<int>(level);
+        out.push_back(lpv);
+        return ok;
+    });
+}
+
+//==============================================================================
+bool parse_runner_change(json_scanner& js, bfapi::stream::runner_change& rc)
+{
+    return js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "id"))
+        {
+            return js.integer(rc.id);
+        }
+        if (key_is(k, n, "atb"))
+        {
+            return parse_price_vols(js, rc.atb);
+        }
+        if (key_is(k, n, "atl"))
+        {
+            return parse_price_vols(js, rc.atl);
+        }
+        if (key_is(k, n, "trd"))
+        {
+            return parse_price_vols(js, rc.trd);
+        }
+        if (key_is(k, n, "ltp"))
+        {
+            rc.has_ltp = true;
+            return js.number(rc.ltp);
+        }
+        if (key_is(k, n, "tv"))
+        {
+            rc.has_tv = true;
+            return js.number(rc.tv);
+        }
+        if (key_is(k, n, "batb"))
+        {
+            return parse_level_price_vols(js, rc.batb);
+        }
+        if (key_is(k, n, "batl"))
+        {
+            return parse_level_price_vols(js, rc.batl);
+        }
+        if (key_is(k, n, "bdatb"))
+        {
+            return parse_level_price_vols(js, rc.bdatb);
+        }
+        if (key_is(k, n, "bdatl"))
+        {
+            return parse_level_price_vols(js, rc.bdatl);
+        }
+        if (key_is(k, n, "spb"))
+        {
+            return parse_price_vols(js, rc.spb);
+        }
+        if (key_is(k, n, "spl"))
+        {
+            return parse_price_vols(js, rc.spl);
+        }
+        if (key_is(k, n, "spn"))
+        {
+            rc.has_spn = true;
+            return js.number(rc.spn);
+        }
+        if (key_is(k, n, "spf"))
+        {
+            rc.has_spf = true;
+            return js.number(rc.spf);
+        }
+        if (key_is(k, n, "hc"))
+        {
+            return js.number(rc.hc);
+        }
+        return js.skip_value();
+    });
+}
+
+//==============================================================================
+bool parse_runner_definition(json_scanner& js, bfapi::stream::runner_definition& rd)
+{
+    return js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "id"))
+        {
+            return js.integer(rd.id);
+        }
+        if (key_is(k, n, "status"))
+        {
+            return js.string(rd.status);
+        }
+        if (key_is(k, n, "sortPriority"))
+        {
+            std::int64_t v = 0;
+            const bool ok = js.integer(v);
+            rd.sort_priority = static_cast<int>(v);
+            return ok;
+        }
+        if (key_is(k, n, "hc"))
+        {
+            return js.number(rd.hc);
+        }
+        return js.skip_value();
+    });
+}
+
+//==============================================================================
+bool parse_market_definition(json_scanner& js, bfapi::stream::market_definition& md)
+{
+    return js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "status"))
+        {
+            return js.string(md.status);
+        }
+        if (key_is(k, n, "inPlay"))
+        {
+            return js.boolean(md.inplay);
+        }
+        if (key_is(k, n, "complete"))
+        {
+            return js.boolean(md.complete);
+        }
+        if (key_is(k, n, "betDelay"))
+        {
+            std::int64_t v = 0;
+            const bool ok = js.integer(v);
+            md.bet_delay = static_cast<int>(v);
+            return ok;
+        }
+        if (key_is(k, n, "version"))
+        {
+            return js.integer(md.version);
+        }
+        if (key_is(k, n, "marketType"))
+        {
+            return js.string(md.market_type);
+        }
+        if (key_is(k, n, "eventId"))
+        {
+            return js.string(md.event_id);
+        }
+        if (key_is(k, n, "eventTypeId"))
+        {
+            return js.string(md.event_type_id);
+        }
+        if (key_is(k, n, "marketTime"))
+        {
+            return js.string(md.market_time);
+        }
+        if (key_is(k, n, "runners"))
+        {
+            md.runners.clear();
+            return js.array([&]()
+            {
+                md.runners.push_back(bfapi::stream::runner_definition());
+                return parse_runner_definition(js, md.runners.back());
+            });
+        }
+        return js.skip_value();
+    });
+}
+
+//==============================================================================
+bool parse_market_change(json_scanner& js, bfapi::stream::market_change& mc)
+{
+    return js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "id"))
+        {
+            return js.string(mc.id);
+        }
+        if (key_is(k, n, "rc"))
+        {
+            return js.array([&]()
+            {
+                mc.rc.push_back(bfapi::stream::runner_change());
+                return parse_runner_change(js, mc.rc.back());
+            });
+        }
+        if (key_is(k, n, "img"))
+        {
+            return js.boolean(mc.img);
+        }
+        if (key_is(k, n, "tv"))
+        {
+            mc.has_tv = true;
+            return js.number(mc.tv);
+        }
+        if (key_is(k, n, "marketDefinition"))
+        {
+            mc.has_definition = true;
+            return parse_market_definition(js, mc.definition);
+        }
+        return js.skip_value();
+    });
+}
+
+//==============================================================================
+bool read_at(int fd, std::uint64_t offset, char* buf, std::size_t n, std::string& error)
+{
+    std::size_t done = 0;
+    while (done < n)
+    {
+        const ssize_t r = pread(fd, buf + done, n - done, static_cast<off_t>(offset + done));
+        if (r <= 0)
+        {
+            error = "read failed: " + std::string(r == 0 ? "unexpected end of file" : std::strerror(errno));
+            return false;
+        }
+        done += static_cast<std::size_t>(r);
+    }
+    return true;
+}
+
+//==============================================================================
+// Tar header number: octal text, or base 256 if the top bit of the first byte is set
+std::uint64_t tar_number(const char* field, std::size_t n)
+{
+    std::uint64_t v = 0;
+    if (static_cast<unsigned char>(field[0]) & 0x80)
+    {
+        for (std::size_t i = 1; i < n; ++i)
+        {
+            v = (v << 8) | static_cast<unsigned char>(field[i]);
+        }
+        return v;
+    }
+    for (std::size_t i = 0; i < n && field[i]; ++i)
+    {
+        if (field[i] >= '0' && field[i] <= '7')
+        {
+            v = v * 8 + (field[i] - '0');
+        }
+    }
+    return v;
+}
+
+//==============================================================================
+bool list_tar(const std::string& path, std::vector<source>& sources, std::string& error)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "unable to open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    const std::uint64_t file_size = static_cast<std::uint64_t>(st.st_size);
+
+    std::uint64_t offset = 0;
+    std::string long_name = "";
+    char header[512];
+    bool ok = true;
+    while (offset + 512 <= file_size)
+    {
+        if (false == read_at(fd, offset, header, sizeof(header), error))
+        {
+            ok = false;
+            break;
+        }
+        if (header[0] == '\0')
+        {
+            break;      // End of archive
+        }
+        const std::uint64_t size = tar_number(header + 124, 12);
+        const char type = header[156];
+        const std::uint64_t data = offset + 512;
+        offset = data + (size + 511) / 512 * 512;
+
+        if (type == 'L')
+        {
+            // GNU long name: the data block holds the name of the next entry
+            std::vector<char> name(size);
+            if (false == read_at(fd, data, name.data(), size, error))
+            {
+                ok = false;
+                break;
+            }
+            long_name.assign(name.data(), strnlen(name.data(), size));
+            continue;
+        }
+        if (type == 'x')
+        {
+            // pax extended header: only the path record is used
+            std::vector<char> records(size);
+            if (false == read_at(fd, data, records.data(), size, error))
+            {
+                ok = false;
+                break;
+            }
+            const std::string text(records.begin(), records.end());
+            const std::size_t pos = text.find(" path=");
+            if (pos != std::string::npos)
+            {
+                const std::size_t nl = text.find('\n', pos);
+                long_name = text.substr(pos + 6, nl == std::string::npos ? std::string::npos : nl - pos - 6);
+            }
+            continue;
+        }
+        if (type != '0' && type != '\0')
+        {
+            long_name.clear();
+            continue;   // Directories, links and global headers
+        }
+
+        source s;
+        s.path = path;
+        if (false == long_name.empty())
+        {
+            s.name = long_name;
+            long_name.clear();
+        }
+        else
+        {
+            const std::string name(header, strnlen(header, 100));
+            const std::string prefix(header + 345, strnlen(header + 345, 155));
+            s.name = (0 == std::memcmp(header + 257, "ustar", 5) && false == prefix.empty()) ? prefix + "/" + name : name;
+        }
+        s.offset = data;
+        s.size = size;
+        s.type = type_of(s.name);
+        if (size > 0)
+        {
+            sources.push_back(s);
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+//==============================================================================
+bool list_path(const std::string& path, std::vector<source>& sources, std::string& error)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        error = "unable to open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    if (S_ISDIR(st.st_mode))
+    {
+        DIR* dir = opendir(path.c_str());
+        if (nullptr == dir)
+        {
+            error = "unable to open directory " + path + ": " + std::strerror(errno);
+            return false;
+        }
+        std::vector<std::string> entries;
+        while (struct dirent* entry = readdir(dir))
+        {
+            const std::string name = entry->d_name;
+            if (name != "." && name != "..")
+            {
+                entries.push_back(path + "/" + name);
+            }
+        }
+        closedir(dir);
+        std::sort(entries.begin(), entries.end());
+        for (const std::string& entry : entries)
+        {
+            if (false == list_path(entry, sources, error))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (ends_with(path, ".tar"))
+    {
+        return list_tar(path, sources, error);
+    }
+    source s;
+    s.path = path;
+    s.name = path;
+    s.offset = 0;
+    s.size = static_cast<std::uint64_t>(st.st_size);
+    s.type = type_of(path);
+    sources.push_back(s);
+    return true;
+}
+
+//==============================================================================
+// Splits decompressed text into lines and parses them, carrying partial lines between chunks
+class line_parser {
+public:
+    line_parser(const std::function<void(const bfapi::stream::market_change_message&)>& f, ingest_stats& s)
+        : on_message(f), stats(s), used(0), buffer(text_chunk) {}
+
+    // Space for the next block of text
+    char* space() { return buffer.data() + used; }
+    std::size_t space_left() const { return buffer.size() - used; }
+
+    // n bytes have been written at space()
+    void commit(std::size_t n, bool final)
+    {
+        stats.text_bytes += n;
+        used += n;
+        if (used < buffer.size() && false == final)
+        {
+            return;
+        }
+        const clock_type::time_point start = clock_type::now();
+        std::size_t consumed = split_lines(buffer.data(), used, [&](const char* b, const char* e) { parse(b, e); });
+        if (final && consumed < used)
+        {
+            parse(buffer.data() + consumed, buffer.data() + used);
+            consumed = used;
+        }
+        std::memmove(buffer.data(), buffer.data() + consumed, used - consumed);
+        used -= consumed;
+        if (used == buffer.size())
+        {
+            buffer.resize(buffer.size() * 2);   // A single line longer than the buffer
+        }
+        stats.parse_ns += elapsed_ns(start);
+    }
+
+    const std::string& first_error() const { return error; }
+
+private:
+    void parse(const char* b, const char* e)
+    {
+        ++stats.lines;
+        std::string line_error = "";
+        if (false == parse_message(b, e, msg, line_error))
+        {
+            ++stats.parse_errors;
+            if (error.empty())
+            {
+                error = line_error;
+            }
+            return;
+        }
+        if (msg.op == "mcm")
+        {
+            ++stats.messages;
+            stats.market_changes += msg.mc.size();
+            for (const bfapi::stream::market_change& mc : msg.mc)
+            {
+                stats.runner_changes += mc.rc.size();
+            }
+            on_message(msg);
+        }
+    }
+
+    const std::function<void(const bfapi::stream::market_change_message&)>& on_message;
+    ingest_stats& stats;
+    std::size_t used;
+    std::vector<char> buffer;
+    bfapi::stream::market_change_message msg;
+    std::string error;
+};
+
+//==============================================================================
+bool process_source(const source& src,
+                    const std::function<void(const bfapi::stream::market_change_message&)>& on_message,
+                    ingest_stats& stats,
+                    std::string& error)
+{
+    ++stats.sources;
+    stats.input_bytes += src.size;
+    if (src.type == source_type::columnar)
+    {
+        const int fd = open(src.path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            error = "unable to open " + src.path + ": " + std::strerror(errno);
+            return false;
+        }
+        std::vector<char> data(src.size);
+        const bool read_ok = read_at(fd, src.offset, data.data(), data.size(), error);
+        close(fd);
+        columnar_reader reader;
+        if (false == read_ok || false == reader.load(std::move(data), error))
+        {
+            error = src.name + ": " + error;
+            return false;
+        }
+        const clock_type::time_point start = clock_type::now();
+        reader.replay([&](const bfapi::stream::market_change_message& msg)
+        {
+            ++stats.messages;
+            stats.market_changes += msg.mc.size();
+            for (const bfapi::stream::market_change& mc : msg.mc)
+            {
+                stats.runner_changes += mc.rc.size();
+            }
+            on_message(msg);
+        });
+        stats.parse_ns += elapsed_ns(start);
+        return true;
+    }
+
+    const int fd = open(src.path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "unable to open " + src.path + ": " + std::strerror(errno);
+        return false;
+    }
+    line_parser lines(on_message, stats);
+    std::vector<char> input(src.type == source_type::bz2 ? read_chunk : 0);
+    std::uint64_t position = 0;
+    bool ok = true;
+
+    if (src.type == source_type::plain)
+    {
+        // Read straight into the line buffer
+        while (ok && position < src.size)
+        {
+            const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(lines.space_left(), src.size - position));
+            ok = read_at(fd, src.offset + position, lines.space(), n, error);
+            position += n;
+            if (ok)
+            {
+                lines.commit(n, position == src.size);
+            }
+        }
+    }
+    else
+    {
+        bz_stream bz;
+        std::memset(&bz, 0, sizeof(bz));
+        int rc = BZ2_bzDecompressInit(&bz, 0, 0);
+        bool stream_open = (rc == BZ_OK);
+        ok = stream_open;
+        while (ok)
+        {
+            if (0 == bz.avail_in && position < src.size)
+            {
+                const std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(input.size(), src.size - position));
+                ok = read_at(fd, src.offset + position, input.data(), n, error);
+                position += n;
+                bz.next_in = input.data();
+                bz.avail_in = static_cast<unsigned>(n);
+            }
+            if (false == ok)
+            {
+                break;
+            }
+            if (0 == bz.avail_in && position >= src.size && false == stream_open)
+            {
+                lines.commit(0, true);
+                break;
+            }
+            if (false == stream_open)
+            {
+                // Concatenated bz2 streams (as written by parallel compressors)
+                rc = BZ2_bzDecompressInit(&bz, 0, 0);
+                stream_open = (rc == BZ_OK);
+                if (false == stream_open)
+                {
+                    break;
+                }
+            }
+            const clock_type::time_point start = clock_type::now();
+            bz.next_out = lines.space();
+            bz.avail_out = static_cast<unsigned>(std::min<std::size_t>(lines.space_left(), std::numeric_limits<unsigned>::max()));
+            const unsigned before = bz.avail_out;
+            rc = BZ2_bzDecompress(&bz);
+            stats.decompress_ns += elapsed_ns(start);
+            const std::size_t produced = before - bz.avail_out;
+            if (rc == BZ_STREAM_END)
+            {
+                BZ2_bzDecompressEnd(&bz);
+                stream_open = false;
+                const bool last = (0 == bz.avail_in && position >= src.size);
+                lines.commit(produced, last);
+                if (last)
+                {
+                    break;
+                }
+            }
+            else if (rc != BZ_OK)
+            {
+                error = "bz2 error " + std::to_string(rc);
+                ok = false;
+            }
+            else if (0 == produced && 0 == bz.avail_in && position >= src.size)
+            {
+                error = "truncated bz2 data";
+                ok = false;
+            }
+            else
+            {
+                lines.commit(produced, false);
+            }
+        }
+        if (stream_open)
+        {
+            BZ2_bzDecompressEnd(&bz);
+        }
+        if (false == ok && error.empty())
+        {
+            error = "bz2 initialisation failed";
+        }
+    }
+    close(fd);
+    if (false == ok)
+    {
+        error = src.name + ": " + error;
+        return false;
+    }
+    if (false == lines.first_error().empty())
+    {
+        error = src.name + ": " + lines.first_error();
+    }
+    return true;
+}
+
+//==============================================================================
+// Run task over every source on threads. task reports failures through its error argument.
+bool run_sources(const std::vector<std::string>& paths,
+                 std::size_t threads,
+                 const std::function<bool(const source&, ingest_stats&, std::string&)>& task,
+                 ingest_stats& stats,
+                 std::string& error,
+                 const std::string& caller)
+{
+    error = "";
+    stats = ingest_stats();
+    const clock_type::time_point start = clock_type::now();
+    std::vector<source> sources;
+    if (false == list_sources(paths, sources, error))
+    {
+        return false;
+    }
+    if (0 == threads)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min(threads, std::max<std::size_t>(1, sources.size()));
+
+    // Largest first so one big file does not finish long after the rest
+    std::vector<std::size_t> order(sources.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return sources[a].size > sources[b].size; });
+
+    std::atomic<std::size_t> next(0);
+    std::mutex mtx;
+    bool failed = false;
+    std::string warning = "";
+    auto worker = [&]()
+    {
+        ingest_stats local;
+        for (;;)
+        {
+            const std::size_t n = next++;
+            if (n >= order.size())
+            {
+                break;
+            }
+            std::string task_error = "";
+            bool ok = false;
+            try
+            {
+                ok = task(sources[order[n]], local, task_error);
+            }
+            catch(std::exception const& e)
+            {
+                task_error = sources[order[n]].name + ": " + std::string(e.what());
+            }
+            if (false == task_error.empty())
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (false == ok && false == failed)
+                {
+                    failed = true;
+                    error = caller + " error: " + task_error;
+                }
+                else if (ok && warning.empty())
+                {
+                    warning = caller + " parse error: " + task_error;
+                }
+            }
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        stats.add(local);
+    };
+
+    std::vector<std::thread> pool;
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        pool.emplace_back(worker);
+    }
+    for (std::thread& t : pool)
+    {
+        t.join();
+    }
+    stats.elapsed_ns = elapsed_ns(start);
+    if (false == failed && false == warning.empty())
+    {
+        error = warning;
+    }
+    return false == failed;
+}
+
+//==============================================================================
+void append_bytes(std::vector<char>& out, const void* data, std::size_t bytes)
+{
+    const char* p = static_cast<const char*>(data);
+    out.insert(out.end(), p, p + bytes);
+}
+
+//==============================================================================
+template<class T>
+void append_column(std::vector<char>& out, const std::vector<T>& column)
+{
+    append_bytes(out, column.data(), column.size() * sizeof(T));
+    out.resize((out.size() + 7) / 8 * 8, 0);
+}
+
+// Walks the sections of a loaded columnar file
+class section_cursor {
+public:
+    section_cursor(const char* b, std::size_t n) : base(b), size(n), offset(0), ok(true) {}
+
+    template<class T>
+    const T* column(std::uint64_t count)
+    {
+        const std::uint64_t bytes = count * sizeof(T);
+        if (false == ok || bytes / sizeof(T) != count || offset + bytes > size)
+        {
+            ok = false;
+            return nullptr;
+        }
+        const T* p = reinterpret_cast<const T*>(base + offset);
+        offset = (offset + bytes + 7) / 8 * 8;
+        return p;
+    }
+
+    bool valid() const { return ok; }
+
+private:
+    const char* base;
+    std::size_t size;
+    std::uint64_t offset;
+    bool ok;
+};
+
+} // end of anonymous namespace
+
+//==============================================================================
+bool parse_message(const char* begin, const char* end, bfapi::stream::market_change_message& msg, std::string& error)
+{
+    error = "";
+    msg.op.clear();
+    msg.initial_clk.clear();
+    msg.clk.clear();
+    msg.pt = 0;
+    msg.mc.clear();
+    json_scanner js(begin, end);
+    const bool ok = js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "op"))
+        {
+            return js.string(msg.op);
+        }
+        if (key_is(k, n, "pt"))
+        {
+            return js.integer(msg.pt);
+        }
+        if (key_is(k, n, "clk"))
+        {
+            return js.string(msg.clk);
+        }
+        if (key_is(k, n, "initialClk"))
+        {
+            return js.string(msg.initial_clk);
+        }
+        if (key_is(k, n, "mc"))
+        {
+            if (js.null_value())
+            {
+                return true;
+            }
+            return js.array([&]()
+            {
+                msg.mc.push_back(bfapi::stream::market_change());
+                return parse_market_change(js, msg.mc.back());
+            });
+        }
+        return js.skip_value();
+    });
+    if (false == ok || false == js.at_end())
+    {
+        error = "bfapi::historical::parse_message() error: Invalid JSON at offset " + std::to_string(js.offset(begin));
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_message(const std::string& line, bfapi::stream::market_change_message& msg, std::string& error)
+{
+    return parse_message(line.data(), line.data() + line.size(), msg, error);
+}
+
+//==============================================================================
+bool list_sources(const std::vector<std::string>& paths, std::vector<source>& sources, std::string& error)
+{
+    error = "";
+    sources.clear();
+    for (const std::string& path : paths)
+    {
+        if (false == list_path(path, sources, error))
+        {
+            error = "bfapi::historical::list_sources() error: " + error;
+            return false;
+        }
+    }
+    return true;
+}
+
+//==============================================================================
+void ingest_stats::add(const ingest_stats& other)
+{
+    sources += other.sources;
+    input_bytes += other.input_bytes;
+    text_bytes += other.text_bytes;
+    lines += other.lines;
+    messages += other.messages;
+    market_changes += other.market_changes;
+    runner_changes += other.runner_changes;
+    parse_errors += other.parse_errors;
+    decompress_ns += other.decompress_ns;
+    parse_ns += other.parse_ns;
+}
+
+//==============================================================================
+bool ingest(const std::vector<std::string>& paths,
+            std::size_t threads,
+            const message_handler& handler,
+            ingest_stats& stats,
+            std::string& error)
+{
+    return run_sources(paths, threads, [&](const source& src, ingest_stats& local, std::string& task_error)
+    {
+        return process_source(src, [&](const bfapi::stream::market_change_message& msg)
+        {
+            if (handler)
+            {
+                handler(src, msg);
+            }
+        }, local, task_error);
+    }, stats, error, "bfapi::historical::ingest()");
+}
+
+//==============================================================================
+bool convert_to_columnar(const std::vector<std::string>& paths,
+                         const std::string& output_dir,
+                         std::size_t threads,
+                         ingest_stats& stats,
+                         std::string& error)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(output_dir, ec);
+    if (ec)
+    {
+        stats = ingest_stats();
+        error = "bfapi::historical::convert_to_columnar() error: Unable to create " + output_dir + " (" + ec.message() + ")";
+        return false;
+    }
+    return run_sources(paths, threads, [&](const source& src, ingest_stats& local, std::string& task_error)
+    {
+        columnar_writer writer;
+        if (false == process_source(src, [&](const bfapi::stream::market_change_message& msg) { writer.add(msg); }, local, task_error))
+        {
+            return false;
+        }
+        std::string name = src.name.substr(src.name.find_last_of('/') == std::string::npos ? 0 : src.name.find_last_of('/') + 1);
+        if (ends_with(name, ".bz2"))
+        {
+            name.resize(name.size() - 4);
+        }
+        std::string write_error = "";
+        if (false == writer.write(output_dir + "/" + name + ".bfc", write_error))
+        {
+            task_error = write_error;
+            return false;
+        }
+        return true;
+    }, stats, error, "bfapi::historical::convert_to_columnar()");
+}
+
+//==============================================================================
+columnar_writer::columnar_writer()
+{
+}
+
+//==============================================================================
+std::uint16_t columnar_writer::intern(const std::string& s)
+{
+    // Few distinct strings per market so a linear search is cheapest
+    for (std::size_t i = 0; i < strings.size(); ++i)
+    {
+        if (strings[i] == s)
+        {
+            return static_cast<std::uint16_t>(i);
+        }
+    }
+    if (strings.size() >= 0xFFFF)
+    {
+        throw std::runtime_error("too many distinct strings for the columnar format");
+    }
+    strings.push_back(s);
+    return static_cast<std::uint16_t>(strings.size() - 1);
+}
+
+//==============================================================================
+std::uint16_t columnar_writer::runner_key(std::int64_t id, double hc)
+{
+    for (std::size_t i = 0; i < key_id.size(); ++i)
+    {
+        if (key_id[i] == id && key_hc[i] == hc)
+        {
+            return static_cast<std::uint16_t>(i);
+        }
+    }
+    if (key_id.size() >= 0xFFFF)
+    {
+        throw std::runtime_error("too many runners for the columnar format");
+    }
+    key_id.push_back(id);
+    key_hc.push_back(hc);
+    return static_cast<std::uint16_t>(key_id.size() - 1);
+}
+
+//==============================================================================
+void columnar_writer::add_row(std::uint16_t runner, column_field field, int level, double price, double size)
+{
+    row_runner.push_back(runner);
+    row_field.push_back(static_cast<std::uint8_t>(field));
+    row_level.push_back(static_cast<std::uint8_t>(level));
+    row_size.push_back(size);
+    if (field == column_field::none || field == column_field::tv || field == column_field::spn || field == column_field::spf)
+    {
+        row_tick.push_back(0);      // No price
+        return;
+    }
+    const int tick = bfapi::ticks::price_to_tick(price);
+    if (tick >= 0 && bfapi::ticks::tick_to_price(tick) == price)
+    {
+        row_tick.push_back(static_cast<std::uint16_t>(tick));
+    }
+    else
+    {
+        row_tick.push_back(no_tick);
+        exact_price.push_back(price);
+    }
+}
+
+//==============================================================================
+void columnar_writer::add(const bfapi::stream::market_change_message& msg)
+{
+    bool first = true;
+    for (const bfapi::stream::market_change& mc : msg.mc)
+    {
+        const std::size_t rows_before = row_runner.size();
+        std::uint8_t flags = first ? change_new_message : 0;
+        flags |= mc.img ? change_img : 0;
+        flags |= mc.has_tv ? change_has_tv : 0;
+        flags |= mc.has_definition ? change_has_definition : 0;
+        first = false;
+
+        if (mc.has_definition)
+        {
+            const bfapi::stream::market_definition& md = mc.definition;
+            def_change.push_back(static_cast<std::uint32_t>(change_pt.size()));
+            def_version.push_back(md.version);
+            def_bet_delay.push_back(md.bet_delay);
+            def_runner_count.push_back(static_cast<std::uint32_t>(md.runners.size()));
+            def_status.push_back(intern(md.status));
+            def_market_type.push_back(intern(md.market_type));
+            def_event_id.push_back(intern(md.event_id));
+            def_event_type_id.push_back(intern(md.event_type_id));
+            def_market_time.push_back(intern(md.market_time));
+            def_inplay.push_back(md.inplay ? 1 : 0);
+            def_complete.push_back(md.complete ? 1 : 0);
+            for (const bfapi::stream::runner_definition& rd : md.runners)
+            {
+                rdef_id.push_back(rd.id);
+                rdef_hc.push_back(rd.hc);
+                rdef_sort_priority.push_back(rd.sort_priority);
+                rdef_status.push_back(intern(rd.status));
+            }
+        }
+
+        int previous_key = -1;
+        for (const bfapi::stream::runner_change& rc : mc.rc)
+        {
+            const std::uint16_t key = runner_key(rc.id, rc.hc);
+            const std::size_t runner_start = row_runner.size();
+            // A none row starts a runner change that would otherwise merge with the previous one
+            if (key == previous_key)
+            {
+                add_row(key, column_field::none, 0, 0.0, 0.0);
+            }
+            for (const bfapi::stream::price_vol& pv : rc.atb) { add_row(key, column_field::atb, 0, pv.price, pv.size); }
+            for (const bfapi::stream::price_vol& pv : rc.atl) { add_row(key, column_field::atl, 0, pv.price, pv.size); }
+            for (const bfapi::stream::price_vol& pv : rc.trd) { add_row(key, column_field::trd, 0, pv.price, pv.size); }
+            for (const bfapi::stream::price_vol& pv : rc.spb) { add_row(key, column_field::spb, 0, pv.price, pv.size); }
+            for (const bfapi::stream::price_vol& pv : rc.spl) { add_row(key, column_field::spl, 0, pv.price, pv.size); }
+            for (const bfapi::stream::level_price_vol& l : rc.batb) { add_row(key, column_field::batb, l.level, l.price, l.size); }
+            for (const bfapi::stream::level_price_vol& l : rc.batl) { add_row(key, column_field::batl, l.level, l.price, l.size); }
+            for (const bfapi::stream::level_price_vol& l : rc.bdatb) { add_row(key, column_field::bdatb, l.level, l.price, l.size); }
+            for (const bfapi::stream::level_price_vol& l : rc.bdatl) { add_row(key, column_field::bdatl, l.level, l.price, l.size); }
+            if (rc.has_ltp) { add_row(key, column_field::ltp, 0, rc.ltp, 0.0); }
+            if (rc.has_tv) { add_row(key, column_field::tv, 0, 0.0, rc.tv); }
+            if (rc.has_spn) { add_row(key, column_field::spn, 0, 0.0, rc.spn); }
+            if (rc.has_spf) { add_row(key, column_field::spf, 0, 0.0, rc.spf); }
+            // A runner change without fields still needs a row
+            if (row_runner.size() == runner_start)
+            {
+                add_row(key, column_field::none, 0, 0.0, 0.0);
+            }
+            previous_key = key;
+        }
+
+        change_pt.push_back(msg.pt);
+        change_tv.push_back(mc.tv);
+        change_rows.push_back(static_cast<std::uint32_t>(row_runner.size() - rows_before));
+        change_market.push_back(intern(mc.id));
+        change_flags.push_back(flags);
+    }
+}
+
+//==============================================================================
+bool columnar_writer::write(const std::string& filename, std::string& error) const
+{
+    error = "";
+    std::vector<char> strings_section;
+    for (const std::string& s : strings)
+    {
+        const std::uint32_t n = static_cast<std::uint32_t>(s.size());
+        append_bytes(strings_section, &n, sizeof(n));
+        append_bytes(strings_section, s.data(), s.size());
+    }
+
+    columnar_header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, columnar_magic, sizeof(h.magic));
+    h.version = columnar_version;
+    h.strings = strings.size();
+    h.string_bytes = strings_section.size();
+    h.runner_keys = key_id.size();
+    h.changes = change_pt.size();
+    h.rows = row_runner.size();
+    h.exact_prices = exact_price.size();
+    h.definitions = def_change.size();
+    h.runner_definitions = rdef_id.size();
+
+    std::vector<char> out;
+    append_bytes(out, &h, sizeof(h));
+    out.resize((out.size() + 7) / 8 * 8, 0);
+    append_column(out, strings_section);
+    append_column(out, key_id);
+    append_column(out, key_hc);
+    append_column(out, change_pt);
+    append_column(out, change_tv);
+    append_column(out, change_rows);
+    append_column(out, change_market);
+    append_column(out, change_flags);
+    append_column(out, row_runner);
+    append_column(out, row_field);
+    append_column(out, row_level);
+    append_column(out, row_tick);
+    append_column(out, row_size);
+    append_column(out, exact_price);
+    append_column(out, def_change);
+    append_column(out, def_version);
+    append_column(out, def_bet_delay);
+    append_column(out, def_runner_count);
+    append_column(out, def_status);
+    append_column(out, def_market_type);
+    append_column(out, def_event_id);
+    append_column(out, def_event_type_id);
+    append_column(out, def_market_time);
+    append_column(out, def_inplay);
+    append_column(out, def_complete);
+    append_column(out, rdef_id);
+    append_column(out, rdef_hc);
+    append_column(out, rdef_sort_priority);
+    append_column(out, rdef_status);
+
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (false == file.is_open())
+    {
+        error = "bfapi::historical::columnar_writer::write() error: Unable to open " + filename;
+        return false;
+    }
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+    if (false == file.good())
+    {
+        error = "bfapi::historical::columnar_writer::write() error: Write to " + filename + " failed";
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+columnar_reader::columnar_reader() : hdr(nullptr)
+{
+}
+
+//==============================================================================
+bool columnar_reader::load(const std::string& filename, std::string& error)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (false == file.is_open())
+    {
+        error = "bfapi::historical::columnar_reader::load() error: Unable to open " + filename;
+        return false;
+    }
+    std::vector<char> data(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(data.data(), static_cast<std::streamsize>(data.size()));
+    if (false == file.good())
+    {
+        error = "bfapi::historical::columnar_reader::load() error: Read from " + filename + " failed";
+        return false;
+    }
+    return load(std::move(data), error);
+}
+
+//==============================================================================
+bool columnar_reader::load(std::vector<char>&& data, std::string& error)
+{
+    error = "";
+    buffer = std::move(data);
+    strings.clear();
+    hdr = nullptr;
+
+    section_cursor cursor(buffer.data(), buffer.size());
+    const columnar_header* h = cursor.column<columnar_header>(1);
+    if (nullptr == h || 0 != std::memcmp(h->magic, columnar_magic, sizeof(h->magic)) || h->version != columnar_version)
+    {
+        error = "bfapi::historical::columnar_reader::load() error: Not a columnar file of version " + std::to_string(columnar_version);
+        return false;
+    }
+    const char* string_data = cursor.column<char>(h->string_bytes);
+    k_id = cursor.column<std::int64_t>(h->runner_keys);
+    k_hc = cursor.column<double>(h->runner_keys);
+    c_pt = cursor.column<std::int64_t>(h->changes);
+    c_tv = cursor.column<double>(h->changes);
+    c_rows = cursor.column<std::uint32_t>(h->changes);
+    c_market = cursor.column<std::uint16_t>(h->changes);
+    c_flags = cursor.column<std::uint8_t>(h->changes);
+    r_runner = cursor.column<std::uint16_t>(h->rows);
+    r_field = cursor.column<std::uint8_t>(h->rows);
+    r_level = cursor.column<std::uint8_t>(h->rows);
+    r_tick = cursor.column<std::uint16_t>(h->rows);
+    r_size = cursor.column<double>(h->rows);
+    x_price = cursor.column<double>(h->exact_prices);
+    d_change = cursor.column<std::uint32_t>(h->definitions);
+    d_version = cursor.column<std::int64_t>(h->definitions);
+    d_bet_delay = cursor.column<std::int32_t>(h->definitions);
+    d_runner_count = cursor.column<std::uint32_t>(h->definitions);
+    d_status = cursor.column<std::uint16_t>(h->definitions);
+    d_market_type = cursor.column<std::uint16_t>(h->definitions);
+    d_event_id = cursor.column<std::uint16_t>(h->definitions);
+    d_event_type_id = cursor.column<std::uint16_t>(h->definitions);
+    d_market_time = cursor.column<std::uint16_t>(h->definitions);
+    d_inplay = cursor.column<std::uint8_t>(h->definitions);
+    d_complete = cursor.column<std::uint8_t>(h->definitions);
+    rd_id = cursor.column<std::int64_t>(h->runner_definitions);
+    rd_hc = cursor.column<double>(h->runner_definitions);
+    rd_sort_priority = cursor.column<std::int32_t>(h->runner_definitions);
+    rd_status = cursor.column<std::uint16_t>(h->runner_definitions);
+    if (false == cursor.valid())
+    {
+        error = "bfapi::historical::columnar_reader::load() error: File is truncated";
+        return false;
+    }
+
+    // Decode the string table and check every index refers into it
+    std::size_t pos = 0;
+    for (std::uint64_t i = 0; i < h->strings; ++i)
+    {
+        std::uint32_t n = 0;
+        if (pos + sizeof(n) > h->string_bytes)
+        {
+            error = "bfapi::historical::columnar_reader::load() error: Corrupt string table";
+            return false;
+        }
+        std::memcpy(&n, string_data + pos, sizeof(n));
+        pos += sizeof(n);
+        if (pos + n > h->string_bytes)
+        {
+            error = "bfapi::historical::columnar_reader::load() error: Corrupt string table";
+            return false;
+        }
+        strings.push_back(std::string(string_data + pos, n));
+        pos += n;
+    }
+    std::uint64_t total_rows = 0;
+    std::uint64_t runner_defs = 0;
+    bool valid = true;
+    for (std::uint64_t i = 0; i < h->changes; ++i)
+    {
+        total_rows += c_rows[i];
+        valid = valid && c_market[i] < strings.size();
+    }
+    for (std::uint64_t i = 0; i < h->rows; ++i)
+    {
+        valid = valid && r_runner[i] < h->runner_keys && r_field[i] <= static_cast<std::uint8_t>(column_field::spf);
+    }
+    for (std::uint64_t i = 0; i < h->definitions; ++i)
+    {
+        runner_defs += d_runner_count[i];
+        valid = valid && d_change[i] < h->changes && d_status[i] < strings.size() && d_market_type[i] < strings.size() &&
+                d_event_id[i] < strings.size() && d_event_type_id[i] < strings.size() && d_market_time[i] < strings.size();
+    }
+    for (std::uint64_t i = 0; i < h->runner_definitions; ++i)
+    {
+        valid = valid && rd_status[i] < strings.size();
+    }
+    std::uint64_t exact = 0;
+    for (std::uint64_t i = 0; i < h->rows; ++i)
+    {
+        exact += (r_tick[i] == no_tick) ? 1 : 0;
+        valid = valid && (r_tick[i] == no_tick || r_tick[i] < bfapi::ticks::tick_count);
+    }
+    if (false == valid || total_rows != h->rows || runner_defs != h->runner_definitions || exact != h->exact_prices)
+    {
+        error = "bfapi::historical::columnar_reader::load() error: Inconsistent columns";
+        return false;
+    }
+    hdr = h;
+    return true;
+}
+
+//==============================================================================
+void columnar_reader::replay(const std::function<void(const bfapi::stream::market_change_message&)>& handler) const
+{
+    if (nullptr == hdr)
+    {
+        return;
+    }
+    // Prices of the ladder, looked up by tick
+    std::vector<double> tick_prices(bfapi::ticks::tick_count);
+    for (int t = 0; t < bfapi::ticks::tick_count; ++t)
+    {
+        tick_prices[t] = bfapi::ticks::tick_to_price(t);
+    }
+
+    bfapi::stream::market_change_message msg;
+    std::uint64_t row = 0;
+    std::uint64_t exact = 0;
+    std::uint64_t def = 0;
+    std::uint64_t rdef = 0;
+    for (std::uint64_t c = 0; c < hdr->changes; ++c)
+    {
+        if ((c_flags[c] & change_new_message) && c > 0)
+        {
+            handler(msg);
+        }
+        if ((c_flags[c] & change_new_message) || 0 == c)
+        {
+            msg.op = "mcm";
+            msg.pt = c_pt[c];
+            msg.mc.clear();
+        }
+        msg.mc.push_back(bfapi::stream::market_change());
+        bfapi::stream::market_change& mc = msg.mc.back();
+        mc.id = strings[c_market[c]];
+        mc.img = (c_flags[c] & change_img) != 0;
+        mc.has_tv = (c_flags[c] & change_has_tv) != 0;
+        mc.tv = c_tv[c];
+        if (def < hdr->definitions && d_change[def] == c)
+        {
+            mc.has_definition = true;
+            bfapi::stream::market_definition& md = mc.definition;
+            md.status = strings[d_status[def]];
+            md.inplay = d_inplay[def] != 0;
+            md.complete = d_complete[def] != 0;
+            md.bet_delay = d_bet_delay[def];
+            md.version = d_version[def];
+            md.market_type = strings[d_market_type[def]];
+            md.event_id = strings[d_event_id[def]];
+            md.event_type_id = strings[d_event_type_id[def]];
+            md.market_time = strings[d_market_time[def]];
+            for (std::uint32_t i = 0; i < d_runner_count[def]; ++i, ++rdef)
+            {
+                bfapi::stream::runner_definition rd;
+                rd.id = rd_id[rdef];
+                rd.hc = rd_hc[rdef];
+                rd.sort_priority = rd_sort_priority[rdef];
+                rd.status = strings[rd_status[rdef]];
+                md.runners.push_back(rd);
+            }
+            ++def;
+        }
+
+        const std::uint64_t last = row + c_rows[c];
+        bfapi::stream::runner_change* rc = nullptr;
+        for (; row < last; ++row)
+        {
+            const std::uint16_t key = r_runner[row];
+            const column_field field = static_cast<column_field>(r_field[row]);
+            if (nullptr == rc || r_runner[row - 1] != key || field == column_field::none)
+            {
+                mc.rc.push_back(bfapi::stream::runner_change());
+                rc = &mc.rc.back();
+                rc->id = k_id[key];
+                rc->hc = k_hc[key];
+            }
+            const double price = (r_tick[row] == no_tick) ? x_price[exact++] : tick_prices[r_tick[row]];
+            const double size = r_size[row];
+            switch (field)
+            {
+                case column_field::atb: rc->atb.push_back(bfapi::stream::price_vol(price, size)); break;
+                case column_field::atl: rc->atl.push_back(bfapi::stream::price_vol(price, size)); break;
+                case column_field::trd: rc->trd.push_back(bfapi::stream::price_vol(price, size)); break;
+                case column_field::spb: rc->spb.push_back(bfapi::stream::price_vol(price, size)); break;
+                case column_field::spl: rc->spl.push_back(bfapi::stream::price_vol(price, size)); break;
+                case column_field::batb: rc->batb.push_back(bfapi::stream::level_price_vol(r_level[row], price, size)); break;
+                case column_field::batl: rc->batl.push_back(bfapi::stream::level_price_vol(r_level[row], price, size)); break;
+                case column_field::bdatb: rc->bdatb.push_back(bfapi::stream::level_price_vol(r_level[row], price, size)); break;
+                case column_field::bdatl: rc->bdatl.push_back(bfapi::stream::level_price_vol(r_level[row], price, size)); break;
+                case column_field::ltp: rc->has_ltp = true; rc->ltp = price; break;
+                case column_field::tv: rc->has_tv = true; rc->tv = size; break;
+                case column_field::spn: rc->has_spn = true; rc->spn = size; break;
+                case column_field::spf: rc->has_spf = true; rc->spf = size; break;
+                default: break;
+            }
+        }
+    }
+    if (hdr->changes > 0)
+    {
+        handler(msg);
+    }
+}
+
+} // end of namespace bfapi::historical
+} // end of namespace bfapi
@@ -0,0 +1,290 @@
+//==============================================================================
+//
+// Ingest of Betfair historical data files. See "Historical Data":
+//
+// https://historicdata.betfair.com/#/help
+//
+// Purchased data is delivered as a tar of bz2 files, one per market, each
+// holding one stream MarketChangeMessage (see stream.hpp) per line. Sources
+// may be given as .tar files, .bz2 files, uncompressed files, directories
+// (searched recursively) or columnar files written by convert_to_columnar().
+//
+// ingest() processes the sources on a pool of threads, one source at a time
+// per thread, so the messages of each market arrive in file order while many
+// markets are decompressed and parsed at once. Lines are found with memchr(),
+// which the C library vectorises, and parsed straight into the stream types
+// by a single pass scanner without building a JSON DOM; fields that are not
+// kept are skipped without being decoded.
+//
+// bz2 decompression costs far more than parsing (tens of MB/s of output per
+// core against hundreds for the parser), so data that will be replayed
+// repeatedly is best converted once to the columnar format below, which is
+// read back with a single read() and no text parsing.
+//
+// Columnar format (.bfc), host byte order, every section 8 byte aligned:
+//
+//   columnar_header
+//   strings             u32 length + bytes, for each string
+//   runner keys         i64 selection IDs, f64 handicaps
+//   changes             i64 pt, f64 tv, u32 row count, u16 market (string), u8 flags
+//   rows                u16 runner key, u8 field, u8 level, u16 tick, f64 size
+//   exact prices        f64 price of each row whose price is not on the ladder (tick = no_tick)
+//   definitions         u32 change, i64 version, i32 bet delay, u32 runner count,
+//                       u16 status, market type, event ID, event type ID, market time
+//                       (strings), u8 inplay, u8 complete
+//   runner definitions  i64 ID, f64 handicap, i32 sort priority, u16 status (string)
+//
+// Each change is one MarketChange; consecutive rows with the same runner key
+// form one RunnerChange. Only the fields of stream.hpp are stored, apart from
+// clk which is only needed to resume a live stream.
+//
+//==============================================================================
+#ifndef BFAPI_HISTORICAL_HPP
+#define BFAPI_HISTORICAL_HPP
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include "stream.hpp"
+
+namespace bfapi {
+namespace historical {
+
+// Parse one line of stream JSON. Unknown fields are skipped; messages other than
+// "mcm" are parsed for op, initialClk, clk and pt only.
+bool parse_message(const char* begin, const char* end, bfapi::stream::market_change_message& msg, std::string& error);
+bool parse_message(const std::string& line, bfapi::stream::market_change_message& msg, std::string& error);
+
+// Call f(begin, end) for every complete line in [data, data + size), without the
+// line ending. Returns the number of bytes consumed, i.e. up to the last newline.
+template<class F>
+std::size_t split_lines(const char* data, std::size_t size, F f)
+{
+	const char* p = data;
+	const char* const end = data + size;
+	for (;;)
+	{
+		const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+		if (nullptr == nl)
+		{
+			break;
+		}
+		const char* line_end = (nl > p && nl[-1] == '\r') ? nl - 1 : nl;
+		if (line_end > p)
+		{
+			f(p, line_end);
+		}
+		p = nl + 1;
+	}
+	return p - data;
+}
+
+enum class source_type { plain, bz2, columnar };
+
+struct source {
+	std::string path;                   // File on disk
+	std::string name;                   // Member name within a tar, otherwise the path
+	std::uint64_t offset;               // Start of the data within path
+	std::uint64_t size;
+	source_type type;
+
+	source() : offset(0), size(0), type(source_type::plain) {}
+};
+
+// Expand paths into individual sources (tar members, directory contents)
+bool list_sources(const std::vector<std::string>& paths, std::vector<source>& sources, std::string& error);
+
+struct ingest_stats {
+	std::uint64_t sources;
+	std::uint64_t input_bytes;          // Bytes read from disk
+	std::uint64_t text_bytes;           // Decompressed JSON
+	std::uint64_t lines;
+	std::uint64_t messages;             // Market change messages parsed or replayed
+	std::uint64_t market_changes;
+	std::uint64_t runner_changes;
+	std::uint64_t parse_errors;
+	std::uint64_t decompress_ns;        // Summed over threads
+	std::uint64_t parse_ns;             // Summed over threads, including the handler
+	std::uint64_t elapsed_ns;
+
+	ingest_stats() : sources(0), input_bytes(0), text_bytes(0), lines(0), messages(0), market_changes(0),
+	                 runner_changes(0), parse_errors(0), decompress_ns(0), parse_ns(0), elapsed_ns(0) {}
+
+	void add(const ingest_stats& other);
+	double text_mb_per_second() const { return elapsed_ns > 0 ? text_bytes / 1e6 / (elapsed_ns / 1e9) : 0.0; }
+	double parse_mb_per_core_second() const { return parse_ns > 0 ? text_bytes / 1e6 / (parse_ns / 1e9) : 0.0; }
+	double messages_per_second() const { return elapsed_ns > 0 ? messages / (elapsed_ns / 1e9) : 0.0; }
+};
+
+// Called for every message, in file order within a source. Different sources are
+// processed concurrently so the handler must be thread safe.
+typedef std::function<void(const source&, const bfapi::stream::market_change_message&)> message_handler;
+
+// Decompress and parse every source using threads (0 = one per hardware thread).
+// Lines that fail to parse are counted in parse_errors and skipped; the first
+// such error is reported through error although the call still returns true.
+bool ingest(const std::vector<std::string>& paths,
+            std::size_t threads,
+            const message_handler& handler,
+            ingest_stats& stats,
+            std::string& error);
+
+// Read each source once and write it to output_dir as <name>.bfc (the name
+// without directories or a .bz2 extension). output_dir is created if missing.
+bool convert_to_columnar(const std::vector<std::string>& paths,
+                         const std::string& output_dir,
+                         std::size_t threads,
+                         ingest_stats& stats,
+                         std::string& error);
+
+const char columnar_magic[8] = {'B', 'F', 'A', 'P', 'I', 'C', 'O', 'L'};
+const std::uint32_t columnar_version = 1;
+const std::uint16_t no_tick = 0xFFFF;
+
+enum class column_field : std::uint8_t {
+	none = 0,           // Runner change without fields
+	atb, atl, trd, spb, spl,
+	batb, batl, bdatb, bdatl,
+	ltp, tv, spn, spf
+};
+
+// Flags of a change
+const std::uint8_t change_new_message = 1;      // First market change of a message
+const std::uint8_t change_img = 2;
+const std::uint8_t change_has_tv = 4;
+const std::uint8_t change_has_definition = 8;
+
+struct columnar_header {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t reserved;
+	std::uint64_t strings;
+	std::uint64_t string_bytes;         // Size of the strings section before padding
+	std::uint64_t runner_keys;
+	std::uint64_t changes;
+	std::uint64_t rows;
+	std::uint64_t exact_prices;
+	std::uint64_t definitions;
+	std::uint64_t runner_definitions;
+};
+
+// Accumulates messages in column form and writes them out
+class columnar_writer {
+public:
+	columnar_writer();
+
+	void add(const bfapi::stream::market_change_message& msg);
+	bool write(const std::string& filename, std::string& error) const;
+
+	std::size_t change_count() const { return change_pt.size(); }
+	std::size_t row_count() const { return row_runner.size(); }
+
+private:
+	std::uint16_t intern(const std::string& s);
+	std::uint16_t runner_key(std::int64_t id, double hc);
+	void add_row(std::uint16_t runner, column_field field, int level, double price, double size);
+
+	std::vector<std::string> strings;
+	std::vector<std::int64_t> key_id;
+	std::vector<double> key_hc;
+
+	std::vector<std::int64_t> change_pt;
+	std::vector<double> change_tv;
+	std::vector<std::uint32_t> change_rows;
+	std::vector<std::uint16_t> change_market;
+	std::vector<std::uint8_t> change_flags;
+
+	std::vector<std::uint16_t> row_runner;
+	std::vector<std::uint8_t> row_field;
+	std::vector<std::uint8_t> row_level;
+	std::vector<std::uint16_t> row_tick;
+	std::vector<double> row_size;
+	std::vector<double> exact_price;
+
+	std::vector<std::uint32_t> def_change;
+	std::vector<std::int64_t> def_version;
+	std::vector<std::int32_t> def_bet_delay;
+	std::vector<std::uint32_t> def_runner_count;
+	std::vector<std::uint16_t> def_status;
+	std::vector<std::uint16_t> def_market_type;
+	std::vector<std::uint16_t> def_event_id;
+	std::vector<std::uint16_t> def_event_type_id;
+	std::vector<std::uint16_t> def_market_time;
+	std::vector<std::uint8_t> def_inplay;
+	std::vector<std::uint8_t> def_complete;
+
+	std::vector<std::int64_t> rdef_id;
+	std::vector<double> rdef_hc;
+	std::vector<std::int32_t> rdef_sort_priority;
+	std::vector<std::uint16_t> rdef_status;
+};
+
+// A columnar file loaded into memory with direct access to its columns
+class columnar_reader {
+public:
+	columnar_reader();
+
+	bool load(const std::string& filename, std::string& error);
+	// Load from a buffer holding a complete file (e.g. a tar member)
+	bool load(std::vector<char>&& data, std::string& error);
+
+	// Rebuild the original messages in order
+	void replay(const std::function<void(const bfapi::stream::market_change_message&)>& handler) const;
+
+	const columnar_header& header() const { return *hdr; }
+	const std::string& string_at(std::uint16_t index) const { return strings[index]; }
+
+	// Column access, each array has header() count entries
+	const std::int64_t* change_pt() const { return c_pt; }
+	const double* change_tv() const { return c_tv; }
+	const std::uint32_t* change_rows() const { return c_rows; }
+	const std::uint16_t* change_market() const { return c_market; }
+	const std::uint8_t* change_flags() const { return c_flags; }
+	const std::uint16_t* row_runner() const { return r_runner; }
+	const std::uint8_t* row_field() const { return r_field; }
+	const std::uint8_t* row_level() const { return r_level; }
+	const std::uint16_t* row_tick() const { return r_tick; }
+	const double* row_size() const { return r_size; }
+	const std::int64_t* runner_id() const { return k_id; }
+	const double* runner_hc() const { return k_hc; }
+
+private:
+	std::vector<char> buffer;
+	std::vector<std::string> strings;
+	const columnar_header* hdr;
+	const std::int64_t* k_id;
+	const double* k_hc;
+	const std::int64_t* c_pt;
+	const double* c_tv;
+	const std::uint32_t* c_rows;
+	const std::uint16_t* c_market;
+	const std::uint8_t* c_flags;
+	const std::uint16_t* r_runner;
+	const std::uint8_t* r_field;
+	const std::uint8_t* r_level;
+	const std::uint16_t* r_tick;
+	const double* r_size;
+	const double* x_price;
+	const std::uint32_t* d_change;
+	const std::int64_t* d_version;
+	const std::int32_t* d_bet_delay;
+	const std::uint32_t* d_runner_count;
+	const std::uint16_t* d_status;
+	const std::uint16_t* d_market_type;
+	const std::uint16_t* d_event_id;
+	const std::uint16_t* d_event_type_id;
+	const std::uint16_t* d_market_time;
+	const std::uint8_t* d_inplay;
+	const std::uint8_t* d_complete;
+	const std::int64_t* rd_id;
+	const double* rd_hc;
+	const std::int32_t* rd_sort_priority;
+	const std::uint16_t* rd_status;
+};
+
+} // end of namespace bfapi::historical
+} // end of namespace bfapi
+
+#endif
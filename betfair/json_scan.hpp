@@ -0,0 +1,412 @@
+//==============================================================================
+//
+// Single pass JSON scanner used where building a property_tree DOM would cost
+// more than the work done with the result: historical stream files and the
+// responses on the order path.
+//
+// Values are read straight into the caller's variables and anything not
+// wanted is skipped without being decoded. Nothing is allocated except by
+// string(), which reuses the capacity of the string it is given.
+//
+//==============================================================================
+#ifndef BFAPI_JSON_SCAN_HPP
+#define BFAPI_JSON_SCAN_HPP
+
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace bfapi {
+namespace json {
+
+// True if the key [key, key + n) equals a string literal
+template<std::size_t N>
+inline bool key_is(const char* key, std::size_t n, const char (&literal)[N])
+{
+	return n == N - 1 && 0 == std::memcmp(key, literal, N - 1);
+}
+
+// Powers of ten that are exact in a double
+const double exact_powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                               1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+class scanner {
+public:
+	scanner(const char* b, const char* e) : p(b), end(e) {}
+
+	bool at_end() { ws(); return p >= end; }
+
+	bool consume(char c)
+	{
+		ws();
+		if (p < end && *p == c)
+		{
+			++p;
+			return true;
+		}
+		return false;
+	}
+
+	// Object keys are plain ASCII in stream messages so are returned in place
+	bool key(const char*& k, std::size_t& n)
+	{
+		ws();
+		if (p >= end || *p != '"')
+		{
+			return false;
+		}
+		++p;
+		const char* q = static_cast<const char*>(std::memchr(p, '"', end - p));
+		if (nullptr == q)
+		{
+			return false;
+		}
+		k = p;
+		n = q - p;
+		p = q + 1;
+		return consume(':');
+	}
+
+	bool string(std::string& s)
+	{
+		ws();
+		if (p >= end || *p != '"')
+		{
+			return false;
+		}
+		++p;
+		s.clear();
+		for (;;)
+		{
+			const char* q = p;
+			while (q < end && *q != '"' && *q != '\\')
+			{
+				++q;
+			}
+			s.append(p, q);
+			if (q >= end)
+			{
+				return false;
+			}
+			p = q + 1;
+			if (*q == '"')
+			{
+				return true;
+			}
+			if (p >= end)
+			{
+				return false;
+			}
+			const char esc = *p++;
+			switch (esc)
+			{
+				case 'b': s.push_back('\b'); break;
+				case 'f': s.push_back('\f'); break;
+				case 'n': s.push_back('\n'); break;
+				case 'r': s.push_back('\r'); break;
+				case 't': s.push_back('\t'); break;
+				case 'u':
+				{
+					if (end - p < 4)
+					{
+						return false;
+					}
+					const unsigned cp = static_cast<unsigned>(std::strtoul(std::string(p, p + 4).c_str(), nullptr, 16));
+					p += 4;
+					// Surrogate pairs are not expected in market data and are kept as two code points
+					if (cp < 0x80)
+					{
+						s.push_back(static_cast<char>(cp));
+					}
+					else if (cp < 0x800)
+					{
+						s.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+						s.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+					}
+					else
+					{
+						s.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+						s.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+						s.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+					}
+					break;
+				}
+				default: s.push_back(esc); break;
+			}
+		}
+	}
+
+	bool skip_string()
+	{
+		ws();
+		if (p >= end || *p != '"')
+		{
+			return false;
+		}
+		++p;
+		for (;;)
+		{
+			const char* q = static_cast<const char*>(std::memchr(p, '"', end - p));
+			if (nullptr == q)
+			{
+				return false;
+			}
+			// The quote is escaped if preceded by an odd number of backslashes
+			const char* b = q;
+			while (b > p && b[-1] == '\\')
+			{
+				--b;
+			}
+			p = q + 1;
+			if (0 == ((q - b) & 1))
+			{
+				return true;
+			}
+		}
+	}
+
+	bool number(double& d)
+	{
+		ws();
+		if (p < end && *p == '"')
+		{
+			// Starting prices may be published as "NaN" or "Infinity"
+			std::string s;
+			if (false == string(s))
+			{
+				return false;
+			}
+			d = (s == "Infinity") ? std::numeric_limits<double>::infinity() :
+				(s == "-Infinity") ? -std::numeric_limits<double>::infinity() : std::numeric_limits<double>::quiet_NaN();
+			return true;
+		}
+		const char* start = p;
+		const bool negative = (p < end && *p == '-');
+		if (negative)
+		{
+			++p;
+		}
+		std::uint64_t mantissa = 0;
+		int digits = 0;
+		int fraction = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			mantissa = mantissa * 10 + (*p++ - '0');
+			++digits;
+		}
+		if (p < end && *p == '.')
+		{
+			++p;
+			while (p < end && *p >= '0' && *p <= '9')
+			{
+				mantissa = mantissa * 10 + (*p++ - '0');
+				++digits;
+				++fraction;
+			}
+		}
+		if (0 == digits)
+		{
+			return false;
+		}
+		const bool exponent = (p < end && (*p == 'e' || *p == 'E'));
+		if (false == exponent && digits <= 19 && mantissa < (1ULL << 53) && fraction <= 22)
+		{
+			// Both operands are exact so the division is correctly rounded, as strtod would be
+			d = static_cast<double>(mantissa) / exact_powers[fraction];
+			d = negative ? -d : d;
+			return true;
+		}
+		if (exponent)
+		{
+			++p;
+			if (p < end && (*p == '+' || *p == '-'))
+			{
+				++p;
+			}
+			while (p < end && *p >= '0' && *p <= '9')
+			{
+				++p;
+			}
+		}
+		char buf[64];
+		const std::size_t n = std::min<std::size_t>(p - start, sizeof(buf) - 1);
+		std::memcpy(buf, start, n);
+		buf[n] = '\0';
+		d = std::strtod(buf, nullptr);
+		return true;
+	}
+
+	bool integer(std::int64_t& v)
+	{
+		double d = 0.0;
+		ws();
+		const char* start = p;
+		bool negative = (p < end && *p == '-');
+		if (negative)
+		{
+			++p;
+		}
+		std::int64_t value = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+		{
+			value = value * 10 + (*p++ - '0');
+		}
+		if (p == start || (p < end && (*p == '.' || *p == 'e' || *p == 'E')))
+		{
+			p = start;
+			if (false == number(d))
+			{
+				return false;
+			}
+			v = static_cast<std::int64_t>(d);
+			return true;
+		}
+		v = negative ? -value : value;
+		return true;
+	}
+
+	bool boolean(bool& b)
+	{
+		ws();
+		if (end - p >= 4 && 0 == std::memcmp(p, "true", 4))
+		{
+			p += 4;
+			b = true;
+			return true;
+		}
+		if (end - p >= 5 && 0 == std::memcmp(p, "false", 5))
+		{
+			p += 5;
+			b = false;
+			return true;
+		}
+		return false;
+	}
+
+	bool skip_value()
+	{
+		ws();
+		if (p >= end)
+		{
+			return false;
+		}
+		if (*p == '"')
+		{
+			return skip_string();
+		}
+		if (*p == '{' || *p == '[')
+		{
+			int depth = 0;
+			while (p < end)
+			{
+				const char c = *p;
+				if (c == '"')
+				{
+					if (false == skip_string())
+					{
+						return false;
+					}
+					continue;
+				}
+				++p;
+				if (c == '{' || c == '[')
+				{
+					++depth;
+				}
+				else if ((c == '}' || c == ']') && 0 == --depth)
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+		// Number, true, false or null
+		const char* start = p;
+		while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ')
+		{
+			++p;
+		}
+		return p > start;
+	}
+
+	// f(key, length) must consume the value
+	template<class F>
+	bool object(F f)
+	{
+		if (false == consume('{'))
+		{
+			return false;
+		}
+		if (consume('}'))
+		{
+			return true;
+		}
+		do
+		{
+			const char* k = nullptr;
+			std::size_t n = 0;
+			if (false == key(k, n) || false == f(k, n))
+			{
+				return false;
+			}
+		}
+		while (consume(','));
+		return consume('}');
+	}
+
+	// f() must consume one element
+	template<class F>
+	bool array(F f)
+	{
+		if (false == consume('['))
+		{
+			return false;
+		}
+		if (consume(']'))
+		{
+			return true;
+		}
+		do
+		{
+			if (false == f())
+			{
+				return false;
+			}
+		}
+		while (consume(','));
+		return consume(']');
+	}
+
+	bool null_value()
+	{
+		ws();
+		if (end - p >= 4 && 0 == std::memcmp(p, "null", 4))
+		{
+			p += 4;
+			return true;
+		}
+		return false;
+	}
+
+	std::size_t offset(const char* begin) const { return p - begin; }
+
+private:
+	void ws()
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+		{
+			++p;
+		}
+	}
+
+	const char* p;
+	const char* end;
+};
+
+} // end of namespace bfapi::json
+} // end of namespace bfapi
+
+#endif
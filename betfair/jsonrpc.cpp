@@ -0,0 +1,285 @@
+#include "jsonrpc.hpp"
+#include "connection.hpp"
+#include <boost/property_tree/json_parser.hpp>
+#include <sstream>
+
+using boost::property_tree::ptree;
+
+namespace bfapi {
+namespace jsonrpc {
+
+//==============================================================================
+int batch::add(const std::string& operation, const std::string& params_json)
+{
+    const int id = next_id++;
+    call c;
+    c.id = id;
+    c.method = betting_method_prefix + operation;
+    c.params = params_json.empty() ? "{}" : params_json;
+    calls.push_back(c);
+    return id;
+}
+
+//==============================================================================
+int batch::add_place_orders(const bfapi::orders::place_limit_orders_request& request, std::string& error)
+{
+    error = "";
+    return request.validate(error) ? add("placeOrders", request.as_json_string()) : -1;
+}
+
+//==============================================================================
+int batch::add_place_orders(const bfapi::orders::place_orders_request& request, std::string& error)
+{
+    error = "";
+    return request.validate(error) ? add("placeOrders", request.as_json_string()) : -1;
+}
+
+//==============================================================================
+int batch::add_list_market_book(const std::vector<std::string>& market_ids,
+                                const std::string& price_projection_json)
+{
+    std::string params = "{\"marketIds\":[";
+    for (const std::string& mid : market_ids)
+    {
+        params += "\"" + mid + "\",";
+    }
+    if (false == market_ids.empty())
+    {
+        params.pop_back();
+    }
+    params += "]";
+    if (false == price_projection_json.empty())
+    {
+        params += ",\"priceProjection\":" + price_projection_json;
+    }
+    params += "}";
+    return add("listMarketBook", params);
+}
+
+//==============================================================================
+void batch::clear()
+{
+    calls.clear();
+    results.clear();
+    errors.clear();
+}
+
+//==============================================================================
+std::string batch::as_json_string() const
+{
+    std::string body = "[";
+    for (const call& c : calls)
+    {
+        body += "{\"jsonrpc\":\"2.0\",\"method\":\"" + c.method + "\",\"params\":" + c.params + ",\"id\":" + std::to_string(c.id) + "},";
+    }
+    if (false == calls.empty())
+    {
+        body.pop_back();
+    }
+    body += "]";
+    return body;
+}
+
+//==============================================================================
+bool batch::start_send(std::string& error)
+{
+    error = "";
+    results.clear();
+    errors.clear();
+    if (calls.empty())
+    {
+        error = "bfapi::jsonrpc::batch::send() error: batch is empty";
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool batch::read_only() const
+{
+    for (const call& c : calls)
+    {
+        if (c.method.compare(betting_method_prefix.size(), 4, "list") != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//==============================================================================
+bfapi::request_priority batch::priority() const
+{
+    for (const call& c : calls)
+    {
+        const std::string operation = c.method.substr(betting_method_prefix.size());
+        if (operation == "placeOrders" || operation == "cancelOrders" || operation == "replaceOrders")
+        {
+            return bfapi::request_priority::order;
+        }
+    }
+    return bfapi::request_priority::data;
+}
+
+//==============================================================================
+bool batch::send(bfapi::api_connection& conn, std::string& error)
+{
+    if (false == start_send(error))
+    {
+        return false;
+    }
+
+    bfapi::http_result result;
+    if (false == conn.post(bfapi::betting_jsonrpc_endpoint, as_json_string(), result, error, read_only(), priority()))
+    {
+        return false;
+    }
+    if (result.status != 200)
+    {
+        error = "bfapi::jsonrpc::batch::send() error: HTTPS response error " + std::to_string(result.status);
+        return false;
+    }
+    return parse_response(result.body, error);
+}
+
+//==============================================================================
+bool batch::send(const bfapi::accinfo& user_info,
+                 const std::string& session_token,
+                 std::string& error,
+                 const std::shared_ptr<bfapi::request_governor>& governor)
+{
+    if (false == start_send(error))
+    {
+        return false;
+    }
+
+    int http_status = 0;
+    std::string response_body;
+    if (false == bfapi::post_json(user_info, session_token, bfapi::betting_jsonrpc_endpoint,
+                                  as_json_string(), http_status, response_body, error,
+                                  bfapi::deadlines(), governor, priority()))
+    {
+        return false;
+    }
+    return parse_response(response_body, error);
+}
+
+//==============================================================================
+bool batch::parse_response(const std::string& body, std::string& error)
+{
+    error = "";
+    results.clear();
+    errors.clear();
+
+    ptree pt;
+    try
+    {
+        std::stringstream ss;
+        ss << body;
+        read_json(ss, pt);
+    }
+    catch(std::exception const& e)
+    {
+        error = std::string("bfapi::jsonrpc::batch::parse_response() exception occurred: ") + std::string(e.what());
+        return false;
+    }
+
+    // A batch normally returns an array but a request level failure can come back as a single object
+    std::vector<const ptree*> elements;
+    if (pt.count("id") > 0 || pt.count("error") > 0)
+    {
+        elements.push_back(&pt);
+    }
+    else
+    {
+        for (const ptree::value_type& v : pt)
+        {
+            elements.push_back(&v.second);
+        }
+    }
+
+    for (const ptree* e : elements)
+    {
+        auto const id = e->get_optional<int>("id");
+        auto const err = e->get_child_optional("error");
+        if (false == static_cast<bool>(id))
+        {
+            if (err)
+            {
+                error = "bfapi::jsonrpc::batch::parse_response() error: request failed with \"" + err->get<std::string>("message", "") + "\"";
+                return false;
+            }
+            continue;
+        }
+        if (err)
+        {
+            // APINGException details are more useful than the generic JSON-RPC message
+            std::string code = err->get<std::string>("data.APINGException.errorCode", "");
+            if (code.empty())
+            {
+                code = err->get<std::string>("message", "UNKNOWN");
+            }
+            errors[*id] = code;
+            continue;
+        }
+        auto const res = e->get_child_optional("result");
+        if (res)
+        {
+            results[*id] = *res;
+        }
+        else
+        {
+            errors[*id] = "NO_RESULT";
+        }
+    }
+    return true;
+}
+
+//==============================================================================
+bool batch::get_result(int id, ptree& result, std::string& error) const
+{
+    error = "";
+    auto const e = errors.find(id);
+    if (e != errors.end())
+    {
+        error = "bfapi::jsonrpc::batch call " + std::to_string(id) + " failed: " + e->second;
+        return false;
+    }
+    auto const r = results.find(id);
+    if (r == results.end())
+    {
+        error = "bfapi::jsonrpc::batch call " + std::to_string(id) + " has no result";
+        return false;
+    }
+    result = r->second;
+    return true;
+}
+
+//==============================================================================
+bool batch::get_place_orders_result(int id,
+                                    bfapi::responses::place_execution_report& report,
+                                    std::string& error) const
+{
+    ptree result;
+    if (false == get_result(id, result, error))
+    {
+        return false;
+    }
+    return bfapi::responses::parse_place_execution_report(result, report, error);
+}
+
+//==============================================================================
+bool batch::get_market_book_result(int id,
+                                   std::vector<bfapi::responses::market_book>& books,
+                                   std::string& error) const
+{
+    ptree result;
+    if (false == get_result(id, result, error))
+    {
+        return false;
+    }
+    return bfapi::responses::parse_market_books(result, books, error);
+}
+
+} // end of namespace bfapi::jsonrpc
+} // end of namespace bfapi
@@ -0,0 +1,121 @@
+//==============================================================================
+//
+// JSON-RPC batching for the Betfair betting API.
+//
+// The REST endpoints in bfapi.hpp require one HTTP round trip per operation.
+// The JSON-RPC endpoint accepts an array of calls in a single POST, each tagged
+// with an "id" that is echoed back in the corresponding element of the response
+// array. A batch collects several (possibly different) operations, sends them
+// in one request and then makes the results available by id, e.g.
+//
+//         bfapi::jsonrpc::batch b;
+//         const int po1 = b.add_place_orders(request_market_1, error);
+//         const int po2 = b.add_place_orders(request_market_2, error);
+//         const int mb  = b.add_list_market_book({"1.209995594"});
+//         if (b.send(*pool.acquire(), error))
+//         {
+//             bfapi::responses::place_execution_report report;
+//             b.get_place_orders_result(po1, report, error);
+//             ...
+//         }
+//
+// A batch can be sent on a keep-alive api_connection (e.g. one leased from a
+// connection_pool) so that it does not pay for a new TCP connection and TLS
+// handshake, or as a one shot request with the accinfo overload of send().
+//
+// Details of the JSON-RPC protocol as used by Betfair can be found here:
+//
+// https://docs.developer.betfair.com/display/1smk3cen4v3lu3yomq5qye0ni/Making+a+JSON-RPC+API+Call
+//==============================================================================
+#ifndef BFAPI_JSONRPC_HPP
+#define BFAPI_JSONRPC_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <boost/property_tree/ptree.hpp>
+#include "bfapi.hpp"
+#include "orders.hpp"
+#include "responses.hpp"
+
+namespace bfapi {
+
+class api_connection;
+
+namespace jsonrpc {
+
+const std::string betting_method_prefix = "SportsAPING/v1.0/";
+const std::string default_price_projection = "{\"priceData\":[\"EX_BEST_OFFERS\"]}";
+
+class batch {
+public:
+	batch() : next_id(1) {}
+
+	// Append a call to the batch and return the id that identifies its result.
+	// operation is the bare operation name (e.g. "listEventTypes") and params_json
+	// the JSON object that would have been sent as the REST request body.
+	int add(const std::string& operation, const std::string& params_json);
+
+	// Return -1 and set error without adding a request that fails validate(),
+	// e.g. for an over long customerOrderRef
+	int add_place_orders(const bfapi::orders::place_limit_orders_request& request, std::string& error);
+	int add_place_orders(const bfapi::orders::place_orders_request& request, std::string& error);
+	int add_list_market_book(const std::vector<std::string>& market_ids,
+	                         const std::string& price_projection_json = default_price_projection);
+
+	std::size_t size() const { return calls.size(); }
+	bool empty() const { return calls.empty(); }
+	void clear();
+
+	// JSON array holding every call in the batch
+	std::string as_json_string() const;
+
+	// Send the whole batch in a single HTTP request on conn and demultiplex the
+	// response. If conn has to be reopened part way through, the batch is only
+	// resent when every call in it is read only (list...). A batch holding a
+	// placeOrders, cancelOrders or replaceOrders call waits for a governor as
+	// an order does, otherwise as market data.
+	bool send(bfapi::api_connection& conn, std::string& error);
+
+	// As above on a new connection that is closed again afterwards, waiting
+	// for governor (if given) as post_json() does
+	bool send(const bfapi::accinfo& user_info,
+	          const std::string& session_token,
+	          std::string& error,
+	          const std::shared_ptr<bfapi::request_governor>& governor = nullptr);
+
+	// Demultiplex a JSON-RPC response body (array or single object) into per-id results.
+	// Exposed separately from send() so that results can be processed from any transport.
+	bool parse_response(const std::string& body, std::string& error);
+
+	// Access results after a successful send()/parse_response(). Each method returns
+	// false and sets error if the call with the given id failed or has no result.
+	bool get_result(int id, boost::property_tree::ptree& result, std::string& error) const;
+	bool get_place_orders_result(int id, bfapi::responses::place_execution_report& report, std::string& error) const;
+	bool get_market_book_result(int id, std::vector<bfapi::responses::market_book>& books, std::string& error) const;
+
+private:
+	struct call {
+		int id;
+		std::string method;
+		std::string params;
+	};
+
+	// Clear previous results; false (with error set) if there is nothing to send
+	bool start_send(std::string& error);
+	// True if no call in the batch can change state on the exchange
+	bool read_only() const;
+	// Order priority if the batch holds an order operation
+	bfapi::request_priority priority() const;
+
+	int next_id;
+	std::vector<call> calls;
+	std::map<int, boost::property_tree::ptree> results;
+	std::map<int, std::string> errors;
+};
+
+} // end of namespace bfapi::jsonrpc
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,56 @@
+#include "operations.hpp"
+#include <algorithm>
+
+namespace bfapi {
+namespace operations {
+
+//==============================================================================
+std::string response_error(const char* name, const http_view& response, throttle_signal throttled)
+{
+    std::string error = std::string("bfapi::operations::call<") + name + ">() error: HTTPS response error " + std::to_string(response.status);
+
+    // Betfair reports API errors as an APINGException with an errorCode, e.g. TOO_MUCH_DATA or INVALID_SESSION_INFORMATION
+    static const char key[] = "\"errorCode\":\"";
+    const char* end = response.body + response.size;
+    const char* p = response.body ? std::search(response.body, end, key, key + sizeof(key) - 1) : end;
+    if (p != end)
+    {
+        p += sizeof(key) - 1;
+        const char* q = std::find(p, end, '"');
+        error += " (" + std::string(p, q) + ")";
+    }
+    if (throttled != throttle_signal::none)
+    {
+        error += " (throttled, the governor has reduced the request rate)";
+    }
+    return error;
+}
+
+} // end of namespace bfapi::operations
+
+//==============================================================================
+bool placeOrders(const bfapi::accinfo& user_info,
+                 const std::string& session_token,
+                 std::string& bf_status,
+                 std::string& error,
+                 const bfapi::orders::place_limit_orders_request& request,
+                 const bfapi::deadlines& limits,
+                 const std::shared_ptr<bfapi::request_governor>& governor)
+{
+    // Same TLS settings as a connection_pool; the connection is closed when it goes out of scope
+    boost::asio::ssl::context ctx(boost::asio::ssl::context::tlsv12_client);
+    ctx.set_verify_mode(boost::asio::ssl::verify_peer);
+    ctx.set_default_verify_paths();
+
+    api_connection conn(ctx, user_info.appkey, session_token);
+    conn.set_deadlines(limits);
+    conn.set_governor(governor);
+
+    bfapi::arena a;
+    bfapi::responses::place_execution_report report;
+    const bool ok = operations::call<operations::place_orders>(conn, request, report, a, error);
+    bf_status = report.status;
+    return ok;
+}
+
+} // end of namespace bfapi
@@ -0,0 +1,476 @@
+//==============================================================================
+//
+// Typed Betfair betting API operations.
+//
+// Each operation is described at compile time by a trait: its name and REST
+// endpoint path, the request and response types, whether it is idempotent,
+// how its request weight is counted against Betfair's limit and how its
+// response is parsed. One generic call<Op>() sends any of them over an
+// api_connection using the arena path of api_connection::post(): the request
+// is serialised straight into the arena, the response body is read into it
+// and parsed in a single pass (responses.hpp) into a response object that is
+// reused from call to call. With a warm connection, arena and response,
+// repeating a call of the same shape makes no heap allocations.
+//
+//         bfapi::arena a;
+//         bfapi::operations::list_market_book_request request;
+//         request.market_ids.push_back("1.209995594");
+//         std::vector<bfapi::responses::market_book> books;
+//         bfapi::operations::call<bfapi::operations::list_market_book>(conn, request, books, a, error);
+//
+// A connection_pool can be used through a lease, e.g. call<Op>(*pool.acquire(), ...),
+// or passed to call<Op>() directly, which leases a connection for the call.
+//
+// Adding an operation only needs its request type (with an append_json()
+// member writing the JSON body), a response type with a char range parser and
+// a trait. Weights follow "Market Data Request Limits":
+//
+// https://docs.developer.betfair.com/display/1smk3cen4v3lu3yomq5qye0ni/Market+Data+Request+Limits
+//
+//==============================================================================
+#ifndef BFAPI_OPERATIONS_HPP
+#define BFAPI_OPERATIONS_HPP
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include "bfapi.hpp"
+#include "arena.hpp"
+#include "connection.hpp"
+#include "orders.hpp"
+#include "polling.hpp"
+#include "responses.hpp"
+
+namespace bfapi {
+namespace operations {
+
+// Append ["a","b",...]
+template<class String>
+void append_string_array(String& out, const std::vector<std::string>& values)
+{
+	out.push_back('[');
+	for (std::size_t i = 0; i < values.size(); ++i)
+	{
+		out.append(i > 0 ? ",\"" : "\"");
+		out.append(values[i].data(), values[i].size());
+		out.push_back('"');
+	}
+	out.push_back(']');
+}
+
+// Append ,"name":"value" if value is not empty
+template<class String>
+void append_optional_string(String& out, const char* name, const std::string& value)
+{
+	if (false == value.empty())
+	{
+		out.append(",\"");
+		out.append(name);
+		out.append("\":\"");
+		out.append(value.data(), value.size());
+		out.push_back('"');
+	}
+}
+
+// Append ,"name":["a",...] if values is not empty
+template<class String>
+void append_optional_array(String& out, const char* name, const std::vector<std::string>& values)
+{
+	if (false == values.empty())
+	{
+		out.append(",\"");
+		out.append(name);
+		out.append("\":");
+		append_string_array(out, values);
+	}
+}
+
+// MarketFilter members are given as raw JSON, e.g. "\"eventTypeIds\":[\"7\"],\"marketCountries\":[\"GB\"]"
+struct list_event_types_request {
+	std::string filter_json;
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		out.append("{\"filter\":{");
+		out.append(filter_json.data(), filter_json.size());
+		out.append("}}");
+	}
+};
+
+struct list_market_catalogue_request {
+	std::string filter_json;
+	std::vector<std::string> market_projection;     // e.g. EVENT, MARKET_START_TIME, RUNNER_DESCRIPTION
+	std::string sort;                               // e.g. FIRST_TO_START, empty for the API default
+	int max_results;
+
+	list_market_catalogue_request() : max_results(100) {}
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		out.append("{\"filter\":{");
+		out.append(filter_json.data(), filter_json.size());
+		out.append("},\"marketProjection\":");
+		append_string_array(out, market_projection);
+		append_optional_string(out, "sort", sort);
+		out.append(",\"maxResults\":");
+		bfapi::orders::append_number(out, static_cast<std::int64_t>(max_results));
+		out.push_back('}');
+	}
+};
+
+struct list_market_book_request {
+	std::vector<std::string> market_ids;
+	bfapi::polling::price_projection projection;
+	std::string order_projection;                   // ALL, EXECUTABLE or EXECUTION_COMPLETE; empty for none
+	std::string match_projection;                   // NO_ROLLUP, ROLLED_UP_BY_PRICE or ROLLED_UP_BY_AVG_PRICE; empty for none
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		out.append("{\"marketIds\":");
+		append_string_array(out, market_ids);
+		out.append(",\"priceProjection\":");
+		projection.append_json(out);
+		append_optional_string(out, "orderProjection", order_projection);
+		append_optional_string(out, "matchProjection", match_projection);
+		out.push_back('}');
+	}
+};
+
+struct list_runner_book_request {
+	std::string market_id;
+	std::int64_t selection_id;
+	bfapi::polling::price_projection projection;
+	std::string order_projection;
+	std::string match_projection;
+
+	list_runner_book_request() : selection_id(0) {}
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		out.append("{\"marketId\":\"");
+		out.append(market_id.data(), market_id.size());
+		out.append("\",\"selectionId\":");
+		bfapi::orders::append_number(out, selection_id);
+		out.append(",\"priceProjection\":");
+		projection.append_json(out);
+		append_optional_string(out, "orderProjection", order_projection);
+		append_optional_string(out, "matchProjection", match_projection);
+		out.push_back('}');
+	}
+};
+
+struct list_current_orders_request {
+	std::vector<std::string> bet_ids;               // Empty for all
+	std::vector<std::string> market_ids;            // Empty for all
+	std::string order_projection;                   // ALL, EXECUTABLE or EXECUTION_COMPLETE; empty for ALL
+	int from_record;
+	int record_count;                               // 0 for the API maximum of 1000
+
+	list_current_orders_request() : from_record(0), record_count(0) {}
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		out.append("{\"fromRecord\":");
+		bfapi::orders::append_number(out, static_cast<std::int64_t>(from_record));
+		if (record_count > 0)
+		{
+			out.append(",\"recordCount\":");
+			bfapi::orders::append_number(out, static_cast<std::int64_t>(record_count));
+		}
+		append_optional_array(out, "betIds", bet_ids);
+		append_optional_array(out, "marketIds", market_ids);
+		append_optional_string(out, "orderProjection", order_projection);
+		out.push_back('}');
+	}
+};
+
+struct list_cleared_orders_request {
+	std::string bet_status;                         // SETTLED, VOIDED, LAPSED or CANCELLED
+	std::vector<std::string> event_type_ids;
+	std::vector<std::string> market_ids;
+	std::vector<std::string> bet_ids;
+	std::string settled_from;                       // ISO 8601, empty for no lower bound
+	std::string settled_to;                         // ISO 8601, empty for no upper bound
+	int from_record;
+	int record_count;                               // 0 for the API maximum of 1000
+
+	list_cleared_orders_request() : bet_status("SETTLED"), from_record(0), record_count(0) {}
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		out.append("{\"betStatus\":\"");
+		out.append(bet_status.data(), bet_status.size());
+		out.push_back('"');
+		append_optional_array(out, "eventTypeIds", event_type_ids);
+		append_optional_array(out, "marketIds", market_ids);
+		append_optional_array(out, "betIds", bet_ids);
+		if (false == settled_from.empty() || false == settled_to.empty())
+		{
+			out.append(",\"settledDateRange\":{");
+			if (false == settled_from.empty())
+			{
+				out.append("\"from\":\"");
+				out.append(settled_from.data(), settled_from.size());
+				out.push_back('"');
+			}
+			if (false == settled_to.empty())
+			{
+				out.append(settled_from.empty() ? "\"to\":\"" : ",\"to\":\"");
+				out.append(settled_to.data(), settled_to.size());
+				out.push_back('"');
+			}
+			out.push_back('}');
+		}
+		out.append(",\"fromRecord\":");
+		bfapi::orders::append_number(out, static_cast<std::int64_t>(from_record));
+		if (record_count > 0)
+		{
+			out.append(",\"recordCount\":");
+			bfapi::orders::append_number(out, static_cast<std::int64_t>(record_count));
+		}
+		out.push_back('}');
+	}
+};
+
+//------------------------------------------------------------------------------
+// Operation traits
+
+struct list_event_types {
+	typedef list_event_types_request request_type;
+	typedef std::vector<bfapi::responses::event_type_result> response_type;
+	static constexpr const char* name = "listEventTypes";
+	static constexpr const char* path = bfapi::paths::list_event_types;
+	static constexpr bool idempotent = true;
+	static constexpr int max_weight = bfapi::polling::max_request_weight;
+
+	static int weight(const request_type&) { return 0; }
+	static bool parse(const char* b, const char* e, response_type& r, std::string& error) { return bfapi::responses::parse_event_type_results(b, e, r, error); }
+};
+
+struct list_market_catalogue {
+	typedef list_market_catalogue_request request_type;
+	typedef std::vector<bfapi::responses::market_catalogue> response_type;
+	static constexpr const char* name = "listMarketCatalogue";
+	static constexpr const char* path = bfapi::paths::list_market_catalogue;
+	static constexpr bool idempotent = true;
+	static constexpr int max_weight = bfapi::polling::max_request_weight;
+
+	// maxResults times the projection weight (MARKET_DESCRIPTION and RUNNER_METADATA count 1 each)
+	static int weight(const request_type& r)
+	{
+		int w = 0;
+		for (const std::string& p : r.market_projection)
+		{
+			w += (p == "MARKET_DESCRIPTION" || p == "RUNNER_METADATA") ? 1 : 0;
+		}
+		return w * r.max_results;
+	}
+	static bool parse(const char* b, const char* e, response_type& r, std::string& error) { return bfapi::responses::parse_market_catalogues(b, e, r, error); }
+};
+
+struct list_market_book {
+	typedef list_market_book_request request_type;
+	typedef std::vector<bfapi::responses::market_book> response_type;
+	static constexpr const char* name = "listMarketBook";
+	static constexpr const char* path = bfapi::paths::list_market_book;
+	static constexpr bool idempotent = true;
+	static constexpr int max_weight = bfapi::polling::max_request_weight;
+
+	static int weight(const request_type& r) { return static_cast<int>(r.market_ids.size()) * r.projection.weight(); }
+	static bool parse(const char* b, const char* e, response_type& r, std::string& error) { return bfapi::responses::parse_market_books(b, e, r, error); }
+};
+
+struct list_runner_book {
+	typedef list_runner_book_request request_type;
+	typedef std::vector<bfapi::responses::market_book> response_type;
+	static constexpr const char* name = "listRunnerBook";
+	static constexpr const char* path = bfapi::paths::list_runner_book;
+	static constexpr bool idempotent = true;
+	static constexpr int max_weight = bfapi::polling::max_request_weight;
+
+	static int weight(const request_type& r) { return r.projection.weight(); }
+	static bool parse(const char* b, const char* e, response_type& r, std::string& error) { return bfapi::responses::parse_market_books(b, e, r, error); }
+};
+
+struct list_current_orders {
+	typedef list_current_orders_request request_type;
+	typedef bfapi::responses::current_order_summary_report response_type;
+	static constexpr const char* name = "listCurrentOrders";
+	static constexpr const char* path = bfapi::paths::list_current_orders;
+	static constexpr bool idempotent = true;
+	static constexpr int max_weight = 1000;
+
+	// Not weighted; the limit is on recordCount
+	static int weight(const request_type& r) { return r.record_count; }
+	static bool parse(const char* b, const char* e, response_type& r, std::string& error) { return bfapi::responses::parse_current_orders(b, e, r, error); }
+};
+
+struct list_cleared_orders {
+	typedef list_cleared_orders_request request_type;
+	typedef bfapi::responses::cleared_order_summary_report response_type;
+	static constexpr const char* name = "listClearedOrders";
+	static constexpr const char* path = bfapi::paths::list_cleared_orders;
+	static constexpr bool idempotent = true;
+	static constexpr int max_weight = 1000;
+
+	static int weight(const request_type& r) { return r.record_count; }
+	static bool parse(const char* b, const char* e, response_type& r, std::string& error) { return bfapi::responses::parse_cleared_orders(b, e, r, error); }
+};
+
+// Error text for an execution report whose status is not SUCCESS
+template<class Report>
+bool check_report(const char* name, const Report& r, std::string& error)
+{
+	if (r.status != "SUCCESS")
+	{
+		error = std::string("bfapi::operations::call<") + name + ">() error: Response \"status\" = " + r.status +
+		        ", \"errorCode\" = " + r.error_code;
+		return false;
+	}
+	return true;
+}
+
+// Order operations are never resent once they may have reached the exchange.
+// Their weight is the number of instructions, limited per request. A report
+// whose status is not SUCCESS fails the call; it is still filled in so the
+// instruction reports can be inspected.
+struct place_orders {
+	typedef bfapi::orders::place_orders_request request_type;
+	typedef bfapi::responses::place_execution_report response_type;
+	static constexpr const char* name = "placeOrders";
+	static constexpr const char* path = bfapi::paths::place_orders;
+	static constexpr bool idempotent = false;
+	static constexpr int max_weight = 200;
+
+	static int weight(const request_type& r) { return static_cast<int>(r.instructions.size()); }
+	static int weight(const bfapi::orders::place_limit_orders_request& r) { return static_cast<int>(r.instructions_list.size()); }
+	static bool parse(const char* b, const char* e, response_type& r, std::string& error)
+	{
+		return bfapi::responses::parse_place_execution_report(b, e, r, error) && check_report(name, r, error);
+	}
+};
+
+struct cancel_orders {
+	typedef bfapi::orders::cancel_orders_request request_type;
+	typedef bfapi::responses::cancel_execution_report response_type;
+	static constexpr const char* name = "cancelOrders";
+	static constexpr const char* path = bfapi::paths::cancel_orders;
+	static constexpr bool idempotent = false;
+	static constexpr int max_weight = 60;
+
+	static int weight(const request_type& r) { return static_cast<int>(r.instructions_list.size()); }
+	static bool parse(const char* b, const char* e, response_type& r, std::string& error)
+	{
+		return bfapi::responses::parse_cancel_execution_report(b, e, r, error) && check_report(name, r, error);
+	}
+};
+
+struct replace_orders {
+	typedef bfapi::orders::replace_orders_request request_type;
+	typedef bfapi::responses::replace_execution_report response_type;
+	static constexpr const char* name = "replaceOrders";
+	static constexpr const char* path = bfapi::paths::replace_orders;
+	static constexpr bool idempotent = false;
+	static constexpr int max_weight = 60;
+
+	static int weight(const request_type& r) { return static_cast<int>(r.instructions_list.size()); }
+	static bool parse(const char* b, const char* e, response_type& r, std::string& error)
+	{
+		return bfapi::responses::parse_replace_execution_report(b, e, r, error) && check_report(name, r, error);
+	}
+};
+
+//------------------------------------------------------------------------------
+
+// Op's path as the std::string taken by api_connection and the governor, built on first use
+template<class Op>
+const std::string& target()
+{
+	static const std::string t(Op::path);
+	return t;
+}
+
+// False (with error set) if request must not be sent. Requests are valid
+// unless an overload below says otherwise.
+template<class Request>
+bool validate(const Request&, std::string&) { return true; }
+inline bool validate(const bfapi::orders::place_orders_request& r, std::string& error) { return r.validate(error); }
+inline bool validate(const bfapi::orders::place_limit_orders_request& r, std::string& error) { return r.validate(error); }
+
+// Error text for a response other than HTTP 200, with the APINGException error code if there is one
+std::string response_error(const char* name, const http_view& response, throttle_signal throttled);
+
+// Send request and parse the response into response. a is released before returning.
+// A request that is invalid (e.g. an over long customerOrderRef) or heavier
+// than Op::max_weight fails without being sent. request is an
+// Op::request_type or another request Op can weigh (placeOrders also takes a
+// place_limit_orders_request).
+template<class Op, class Request>
+bool call(api_connection& conn,
+          const Request& request,
+          typename Op::response_type& response,
+          bfapi::arena& a,
+          std::string& error)
+{
+	struct release_guard {
+		bfapi::arena& a;
+		~release_guard() { a.release(); }
+	} guard{a};
+
+	error.clear();
+	if (false == validate(request, error))
+	{
+		return false;
+	}
+	const int weight = Op::weight(request);
+	if (weight > Op::max_weight)
+	{
+		error = std::string("bfapi::operations::call<") + Op::name + ">() error: request weight " + std::to_string(weight) +
+		        " exceeds the limit of " + std::to_string(Op::max_weight);
+		return false;
+	}
+
+	arena_string body{arena_allocator<char>(a)};
+	body.reserve(512);
+	request.append_json(body);
+
+	http_view result;
+	if (false == conn.post(target<Op>(), body.data(), body.size(), a, result, error, Op::idempotent))
+	{
+		return false;
+	}
+	if (result.status != 200)
+	{
+		error = response_error(Op::name, result, conn.throttled());
+		return false;
+	}
+	return Op::parse(result.body, result.body + result.size, response, error);
+}
+
+// As above on a connection leased from pool for the call, which is counted in
+// pool.get_stats() as connection_pool::post() requests are
+template<class Op, class Request>
+bool call(connection_pool& pool,
+          const Request& request,
+          typename Op::response_type& response,
+          bfapi::arena& a,
+          std::string& error)
+{
+	connection_pool::lease conn = pool.acquire();
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	const bool ok = call<Op>(*conn, request, response, a, error);
+	pool.record(ok, conn->timed_out(), std::chrono::steady_clock::now() - start);
+	return ok;
+}
+
+} // end of namespace bfapi::operations
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,456 @@
+#include "order_trace.hpp"
+#include "dates.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+namespace bfapi {
+namespace order_trace {
+
+namespace {
+
+//==============================================================================
+std::int64_t wall_now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+//==============================================================================
+std::int64_t bet_id_value(const std::string& bet_id)
+{
+    return bet_id.empty() ? 0 : std::strtoll(bet_id.c_str(), nullptr, 10);
+}
+
+//==============================================================================
+double percentile_us(const std::vector<std::int64_t>& sorted, double p)
+{
+    std::size_t rank = static_cast<std::size_t>(p * sorted.size() + 0.999999);
+    rank = std::max<std::size_t>(1, std::min(rank, sorted.size()));
+    return sorted[rank - 1] / 1000.0;
+}
+
+} // end of anonymous namespace
+
+//==============================================================================
+const char* interval_name(interval i)
+{
+    switch (i)
+    {
+    case interval::ack:        return "ack";
+    case interval::placed:     return "placed";
+    case interval::executable: return "executable";
+    case interval::first_fill: return "first_fill";
+    case interval::final_fill: return "final_fill";
+    }
+    return "";
+}
+
+//==============================================================================
+event_ring::event_ring(std::size_t capacity) : mask(0), head(0), tail(0)
+{
+    std::size_t n = 2;
+    while (n < capacity)
+    {
+        n <<= 1;
+    }
+    mask = n - 1;
+    slots.reset(new slot[n]);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+//==============================================================================
+bool event_ring::push(const event& e)
+{
+    std::size_t pos = head.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        slot& s = slots[pos & mask];
+        const std::size_t seq = s.sequence.load(std::memory_order_acquire);
+        const std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+        if (0 == diff)
+        {
+            // Slot is free for this position - claim it
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                s.e = e;
+                s.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (diff < 0)
+        {
+            return false;   // Full: the consumer has not freed this slot yet
+        }
+        else
+        {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+//==============================================================================
+bool event_ring::pop(event& e)
+{
+    const std::size_t pos = tail.load(std::memory_order_relaxed);
+    slot& s = slots[pos & mask];
+    if (s.sequence.load(std::memory_order_acquire) != pos + 1)
+    {
+        return false;
+    }
+    e = s.e;
+    s.sequence.store(pos + mask + 1, std::memory_order_release);
+    tail.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+//==============================================================================
+tracer::tracer(std::size_t capacity) : ring(capacity), dropped_events(0), open_timeout(3600), sample_limit(10000),
+                                       rng_state(0x9e3779b97f4a7c15ULL), unmatched_events(0)
+{
+}
+
+//==============================================================================
+void tracer::set_sample_limit(std::size_t limit)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    sample_limit = std::max<std::size_t>(1, limit);
+}
+
+//==============================================================================
+std::int64_t tracer::steady_now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//==============================================================================
+std::uint16_t tracer::market_type_id(const std::string& market_type)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    for (std::size_t i = 0; i < market_types.size(); ++i)
+    {
+        if (market_types[i] == market_type)
+        {
+            return static_cast<std::uint16_t>(i);
+        }
+    }
+    market_types.push_back(market_type);
+    samples.resize(market_types.size() * interval_count);
+    return static_cast<std::uint16_t>(market_types.size() - 1);
+}
+
+//==============================================================================
+void tracer::push(const event& e)
+{
+    if (false == ring.push(e))
+    {
+        dropped_events.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+//==============================================================================
+void tracer::submit(const bfapi::orders::customer_order_ref& co_ref, std::uint16_t market_type)
+{
+    event e = event();
+    e.type = event_type::submit;
+    e.market_type = market_type;
+    e.steady_ns = steady_now();
+    e.wall_ms = wall_now_ms();
+    e.co_ref = co_ref;
+    push(e);
+}
+
+//==============================================================================
+void tracer::submit(const bfapi::orders::place_limit_orders_request& request, std::uint16_t market_type)
+{
+    // One timestamp for the whole request, which is sent as one message
+    event e = event();
+    e.type = event_type::submit;
+    e.market_type = market_type;
+    e.steady_ns = steady_now();
+    e.wall_ms = wall_now_ms();
+    for (const bfapi::orders::limit_order_instruction& instruction : request.instructions_list)
+    {
+        e.co_ref = instruction.co_ref;
+        push(e);
+    }
+}
+
+//==============================================================================
+void tracer::submit(const bfapi::orders::place_orders_request& request, std::uint16_t market_type)
+{
+    event e = event();
+    e.type = event_type::submit;
+    e.market_type = market_type;
+    e.steady_ns = steady_now();
+    e.wall_ms = wall_now_ms();
+    for (std::size_t i = 0; i < request.instructions.size(); ++i)
+    {
+        e.co_ref = request.instructions.co_ref(i);
+        push(e);
+    }
+}
+
+//==============================================================================
+void tracer::acknowledged(const bfapi::responses::place_execution_report& report)
+{
+    const std::int64_t now = steady_now();
+    for (const bfapi::responses::instruction_report& ir : report.instruction_reports)
+    {
+        acknowledged(ir, now);
+    }
+}
+
+//==============================================================================
+void tracer::acknowledged(const bfapi::responses::instruction_report& report, std::int64_t steady_ns)
+{
+    event e = event();
+    e.type = event_type::ack;
+    e.steady_ns = steady_ns;
+    e.bet_id = bet_id_value(report.bet_id);
+    e.co_ref = report.customer_order_ref;
+    if (false == bfapi::dates::parse_iso8601(report.placed_date, e.wall_ms))
+    {
+        e.wall_ms = 0;
+    }
+    push(e);
+}
+
+//==============================================================================
+void tracer::order_update(const std::string& bet_id, const bfapi::orders::customer_order_ref& co_ref, bool executable, double size_matched)
+{
+    event e = event();
+    e.type = event_type::update;
+    e.executable = executable;
+    e.steady_ns = steady_now();
+    e.bet_id = bet_id_value(bet_id);
+    e.size_matched = size_matched;
+    e.co_ref = co_ref;
+    push(e);
+}
+
+//==============================================================================
+std::size_t tracer::collect()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    std::size_t n = 0;
+    event e;
+    while (ring.pop(e))
+    {
+        apply(e);
+        ++n;
+    }
+
+    const std::int64_t cutoff = steady_now() - std::chrono::duration_cast<std::chrono::nanoseconds>(open_timeout).count();
+    for (auto it = open.begin(); it != open.end();)
+    {
+        if (it->second.last_ns < cutoff)
+        {
+            ref_by_bet.erase(it->second.bet_id);
+            it = open.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    return n;
+}
+
+//==============================================================================
+void tracer::apply(const event& e)
+{
+    if (event_type::submit == e.type)
+    {
+        if (false == e.co_ref.empty() && e.market_type < market_types.size())
+        {
+            trace_record& r = open[e.co_ref.str()];
+            r = trace_record();
+            r.market_type = e.market_type;
+            r.submit_ns = e.steady_ns;
+            r.submit_wall_ms = e.wall_ms;
+            r.last_ns = e.steady_ns;
+        }
+        return;
+    }
+
+    // Find the order by customerOrderRef, else by betId
+    std::string key = e.co_ref.str();
+    auto it = key.empty() ? open.end() : open.find(key);
+    if (open.end() == it && 0 != e.bet_id)
+    {
+        auto b = ref_by_bet.find(e.bet_id);
+        if (ref_by_bet.end() != b)
+        {
+            key = b->second;
+            it = open.find(key);
+        }
+    }
+    if (open.end() == it)
+    {
+        ++unmatched_events;
+        return;
+    }
+
+    trace_record& r = it->second;
+    r.last_ns = e.steady_ns;
+    if (0 != e.bet_id && 0 == r.bet_id)
+    {
+        r.bet_id = e.bet_id;
+        ref_by_bet[e.bet_id] = key;
+    }
+
+    if (event_type::ack == e.type)
+    {
+        sample(r, interval::ack, e.steady_ns - r.submit_ns);
+        if (0 != e.wall_ms)
+        {
+            sample(r, interval::placed, (e.wall_ms - r.submit_wall_ms) * 1000000);
+        }
+        return;
+    }
+
+    if (e.executable)
+    {
+        sample(r, interval::executable, e.steady_ns - r.submit_ns);
+    }
+    if (e.size_matched > 0.0)
+    {
+        sample(r, interval::first_fill, e.steady_ns - r.submit_ns);
+    }
+    if (false == e.executable)
+    {
+        // EXECUTION_COMPLETE: fully matched, or cancelled / lapsed with what was matched so far
+        if (e.size_matched > 0.0)
+        {
+            sample(r, interval::final_fill, e.steady_ns - r.submit_ns);
+        }
+        retire(key);
+    }
+}
+
+//==============================================================================
+void tracer::sample(trace_record& r, interval i, std::int64_t ns)
+{
+    const std::size_t k = static_cast<std::size_t>(i);
+    if (false == r.seen[k])
+    {
+        r.seen[k] = true;
+        sample_set& set = samples[r.market_type * interval_count + k];
+        set.max_ns = (0 == set.seen) ? ns : std::max(set.max_ns, ns);
+        ++set.seen;
+        if (set.kept.size() > sample_limit)
+        {
+            set.kept.resize(sample_limit);
+        }
+        if (set.kept.size() < sample_limit)
+        {
+            set.kept.push_back(ns);
+            return;
+        }
+
+        // Keep the n-th sample with probability limit / n (Vitter's algorithm R)
+        rng_state ^= rng_state << 13;
+        rng_state ^= rng_state >> 7;
+        rng_state ^= rng_state << 17;
+        const std::uint64_t slot = rng_state % set.seen;
+        if (slot < set.kept.size())
+        {
+            set.kept[static_cast<std::size_t>(slot)] = ns;
+        }
+    }
+}
+
+//==============================================================================
+void tracer::retire(const std::string& co_ref)
+{
+    auto it = open.find(co_ref);
+    if (open.end() != it)
+    {
+        ref_by_bet.erase(it->second.bet_id);
+        open.erase(it);
+    }
+}
+
+//==============================================================================
+std::vector<summary> tracer::summaries()
+{
+    collect();
+    std::lock_guard<std::mutex> lock(mtx);
+    std::vector<summary> result;
+    std::vector<std::int64_t> sorted;
+    for (std::size_t m = 0; m < market_types.size(); ++m)
+    {
+        for (std::size_t k = 0; k < interval_count; ++k)
+        {
+            const sample_set& set = samples[m * interval_count + k];
+            sorted = set.kept;
+            if (sorted.empty())
+            {
+                continue;
+            }
+            std::sort(sorted.begin(), sorted.end());
+            summary s;
+            s.market_type = market_types[m];
+            s.measured = static_cast<interval>(k);
+            s.count = static_cast<std::size_t>(set.seen);
+            s.p50_us = percentile_us(sorted, 0.50);
+            s.p90_us = percentile_us(sorted, 0.90);
+            s.p99_us = percentile_us(sorted, 0.99);
+            s.max_us = set.max_ns / 1000.0;
+            result.push_back(s);
+        }
+    }
+    return result;
+}
+
+//==============================================================================
+std::string tracer::summary_table()
+{
+    std::string table = "market type          interval        count      p50 us      p90 us      p99 us      max us\n";
+    char line[160];
+    for (const summary& s : summaries())
+    {
+        std::snprintf(line, sizeof(line), "%-20s %-12s %8zu %11.1f %11.1f %11.1f %11.1f\n", s.market_type.c_str(),
+                      interval_name(s.measured), s.count, s.p50_us, s.p90_us, s.p99_us, s.max_us);
+        table += line;
+    }
+    return table;
+}
+
+//==============================================================================
+std::size_t tracer::open_orders() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return open.size();
+}
+
+//==============================================================================
+std::uint64_t tracer::unmatched() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return unmatched_events;
+}
+
+//==============================================================================
+void tracer::reset()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    event e;
+    while (ring.pop(e))
+    {
+    }
+    open.clear();
+    ref_by_bet.clear();
+    for (sample_set& s : samples)
+    {
+        s = sample_set();
+    }
+    unmatched_events = 0;
+    dropped_events.store(0);
+}
+
+} // end of namespace bfapi::order_trace
+} // end of namespace bfapi
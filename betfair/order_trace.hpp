@@ -0,0 +1,192 @@
+//==============================================================================
+//
+// End to end latency of orders, from the moment a placeOrders request is sent
+// to the moment the order is fully matched. For every traced order the tracer
+// joins:
+//
+//  - submit      placeOrders about to be written (steady and system clock)
+//  - ack         HTTP response (PlaceExecutionReport) received
+//  - placed      placedDate reported by the exchange, on the exchange clock
+//  - executable  first order stream update showing the order as EXECUTABLE
+//  - first fill  first order stream update with a matched size
+//  - final fill  order stream update showing it EXECUTION_COMPLETE
+//
+// With async placement (see place_bet2.cpp) the ack only says the request was
+// accepted and carries no betId, so the later events are what matter.
+//
+// Orders are joined by customerOrderRef and, once it is known, by betId, so
+// each traced order needs a unique customerOrderRef. Recording an event takes
+// a monotonic timestamp and pushes it into a fixed size lock-free ring; no
+// lock is taken and nothing is allocated on the order path. If the ring is
+// full the event is dropped and counted. collect() (or summaries()) drains
+// the ring on another thread, joins the events and keeps latency samples per
+// market type so percentiles can be exported. At most sample_limit samples are
+// kept per market type and interval (a uniform reservoir of all those seen),
+// so a tracer left running does not grow; counts and maxima cover every order.
+//
+// The "placed" interval compares the exchange clock with the local system
+// clock, to the millisecond, and includes any offset between them; the other
+// intervals are monotonic.
+//
+//         bfapi::order_trace::tracer trace;
+//         const std::uint16_t win = trace.market_type_id("WIN");
+//         trace.submit(request, win);
+//         conn.place_orders(request, a, report, error);
+//         trace.acknowledged(report);
+//         ...
+//         trace.order_update(bet_id, co_ref, executable, size_matched);    // From the order stream
+//         std::cout << trace.summary_table();
+//
+//==============================================================================
+#ifndef BFAPI_ORDER_TRACE_HPP
+#define BFAPI_ORDER_TRACE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include "orders.hpp"
+#include "responses.hpp"
+
+namespace bfapi {
+namespace order_trace {
+
+enum class event_type : std::uint8_t { submit, ack, update };
+
+// Intervals measured from submit
+enum class interval : std::uint8_t { ack, placed, executable, first_fill, final_fill };
+const std::size_t interval_count = 5;
+const char* interval_name(interval i);
+
+struct event {
+	event_type type;
+	bool executable;                    // update: order status EXECUTABLE rather than EXECUTION_COMPLETE
+	std::uint16_t market_type;          // submit only
+	std::int64_t steady_ns;             // Monotonic time the event was recorded
+	std::int64_t wall_ms;               // submit: system clock, ack: placedDate (0 if absent)
+	std::int64_t bet_id;                // 0 if not known
+	double size_matched;                // update only
+	bfapi::orders::customer_order_ref co_ref;
+};
+
+// Bounded multi-producer ring with one consumer (Vyukov's sequenced slots)
+class event_ring {
+public:
+	explicit event_ring(std::size_t capacity);
+
+	// Returns false, without blocking, if the ring is full
+	bool push(const event& e);
+	bool pop(event& e);
+
+	std::size_t capacity() const { return mask + 1; }
+
+private:
+	struct slot {
+		std::atomic<std::size_t> sequence;
+		event e;
+	};
+
+	std::unique_ptr<slot[]> slots;
+	std::size_t mask;
+	alignas(64) std::atomic<std::size_t> head;      // Next slot to write
+	alignas(64) std::atomic<std::size_t> tail;      // Next slot to read
+};
+
+struct summary {
+	std::string market_type;
+	interval measured;
+	std::size_t count;                  // Orders measured; percentiles are from at most sample_limit of them
+	double p50_us;
+	double p90_us;
+	double p99_us;
+	double max_us;
+
+	summary() : measured(interval::ack), count(0), p50_us(0.0), p90_us(0.0), p99_us(0.0), max_us(0.0) {}
+};
+
+class tracer {
+public:
+	// capacity is rounded up to a power of two
+	explicit tracer(std::size_t capacity = 65536);
+
+	// Register a market type (e.g. "WIN", "MATCH_ODDS") once, before its orders are traced
+	std::uint16_t market_type_id(const std::string& market_type);
+
+	// Order path - lock-free and allocation free, safe from any thread
+	void submit(const bfapi::orders::customer_order_ref& co_ref, std::uint16_t market_type);
+	void submit(const bfapi::orders::place_limit_orders_request& request, std::uint16_t market_type);
+	void submit(const bfapi::orders::place_orders_request& request, std::uint16_t market_type);
+	void acknowledged(const bfapi::responses::place_execution_report& report);
+	void acknowledged(const bfapi::responses::instruction_report& report, std::int64_t steady_ns);
+
+	// An order stream update (OrderChangeMessage "uo" entry: id, rfo, status and sm).
+	// executable is false once the status is EXECUTION_COMPLETE. Either key may be empty.
+	void order_update(const std::string& bet_id, const bfapi::orders::customer_order_ref& co_ref, bool executable, double size_matched);
+
+	// Events dropped because the ring was full
+	std::uint64_t dropped() const { return dropped_events.load(std::memory_order_relaxed); }
+
+	// Consumer side - one thread at a time. Drain the ring and join the events;
+	// returns the number of events processed. Open orders not seen for longer
+	// than open_timeout are forgotten.
+	std::size_t collect();
+	std::vector<summary> summaries();
+	std::string summary_table();
+
+	std::size_t open_orders() const;
+	std::uint64_t unmatched() const;    // Events for orders that were never submitted through the tracer
+	void reset();
+	void set_open_timeout(std::chrono::seconds timeout) { open_timeout = timeout; }
+	// Samples kept per market type and interval (default 10000); takes effect as new samples arrive
+	void set_sample_limit(std::size_t limit);
+
+	static std::int64_t steady_now();
+
+private:
+	struct trace_record {
+		std::uint16_t market_type;
+		std::int64_t submit_ns;
+		std::int64_t submit_wall_ms;
+		std::int64_t last_ns;
+		std::int64_t bet_id;
+		bool seen[interval_count];
+
+		trace_record() : market_type(0), submit_ns(0), submit_wall_ms(0), last_ns(0), bet_id(0), seen() {}
+	};
+
+	// Reservoir of latency samples for one market type and interval
+	struct sample_set {
+		std::vector<std::int64_t> kept;     // Nanoseconds
+		std::uint64_t seen;
+		std::int64_t max_ns;
+
+		sample_set() : seen(0), max_ns(0) {}
+	};
+
+	void push(const event& e);
+	void apply(const event& e);
+	void sample(trace_record& r, interval i, std::int64_t ns);
+	void retire(const std::string& co_ref);
+
+	event_ring ring;
+	std::atomic<std::uint64_t> dropped_events;
+	std::chrono::seconds open_timeout;
+
+	mutable std::mutex mtx;             // Consumer state and market type names, never taken on the order path
+	std::vector<std::string> market_types;
+	std::unordered_map<std::string, trace_record> open;
+	std::unordered_map<std::int64_t, std::string> ref_by_bet;
+	std::vector<sample_set> samples;    // [market type * interval_count + interval]
+	std::size_t sample_limit;
+	std::uint64_t rng_state;            // Reservoir replacement (xorshift64)
+	std::uint64_t unmatched_events;
+};
+
+} // end of namespace bfapi::order_trace
+} // end of namespace bfapi
+
+#endif
@@ -4,51 +4,418 @@
 #ifndef BFAPI_ORDERS_HPP
 #define BFAPI_ORDERS_HPP
 #include <string>
+#include <vector>
+#include <utility>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
 
 namespace bfapi {
 namespace orders {
+
+// Append numbers to any string type (std::string, arena_string) without temporaries.
+// Prices and sizes use the same "%f" format as std::to_string.
+template<class String>
+void append_number(String& out, double value)
+{
+	char buf[64];
+	const int n = std::snprintf(buf, sizeof(buf), "%f", value);
+	out.append(buf, static_cast<std::size_t>(n));
+}
+
+template<class String>
+void append_number(String& out, std::int64_t value)
+{
+	char buf[24];
+	const int n = std::snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(value));
+	out.append(buf, static_cast<std::size_t>(n));
+}
     
-struct order_instruction {
-	// Base class for order instruction
-	
-	std::int64_t selection_id;
-	bool lay_side;	
+// Betfair's customerOrderRef (at most 32 characters) held inline, so that
+// instructions are trivially copyable and never touch the heap. A longer
+// reference is not truncated, which could give two orders the same one: it is
+// held empty and marked invalid, and requests containing it are rejected
+// before they are sent (see validate() on the request types).
+class customer_order_ref {
+public:
+	static const std::size_t max_length = 32;
+
+	customer_order_ref() : length(0), too_long(false) { text[0] = '\0'; }
+	customer_order_ref(const char* s) { assign(s, std::strlen(s)); }
+	customer_order_ref(const char* s, std::size_t n) { assign(s, n); }
+	customer_order_ref(const std::string& s) { assign(s.data(), s.size()); }
+
+	void assign(const char* s, std::size_t n)
+	{
+		too_long = n > max_length;
+		length = static_cast<std::uint8_t>(too_long ? 0 : n);
+		std::memcpy(text, s, length);
+		text[length] = '\0';
+	}
+
+	bool valid() const { return false == too_long; }
 
-	virtual std::string as_json_string() const = 0;
+	const char* data() const { return text; }
+	const char* c_str() const { return text; }
+	std::size_t size() const { return length; }
+	bool empty() const { return 0 == length; }
+	std::string str() const { return std::string(text, length); }
 
-	order_instruction(const std::int64_t& id, const bool lay) : selection_id(id), lay_side(lay) {}
+	bool operator==(const customer_order_ref& other) const
+	{
+		return length == other.length && too_long == other.too_long && 0 == std::memcmp(text, other.text, length);
+	}
+	bool operator!=(const customer_order_ref& other) const { return false == (*this == other); }
 
+private:
+	char text[max_length + 1];
+	std::uint8_t length;
+	bool too_long;
 };
-    
-struct limit_order_instruction : public order_instruction {
+
+// Error text for instruction i of a request, whose customerOrderRef was too long
+inline std::string co_ref_error(std::size_t i)
+{
+	return "bfapi::orders error: instruction " + std::to_string(i) + " has a customerOrderRef longer than " +
+	       std::to_string(customer_order_ref::max_length) + " characters";
+}
+
+enum class order_type : std::uint8_t { limit, limit_on_close, market_on_close };
+
+// Write one PlaceInstruction. amount is the size of a LIMIT order or the liability
+// of a LIMIT_ON_CLOSE / MARKET_ON_CLOSE order; price is unused for MARKET_ON_CLOSE.
+template<class String>
+void append_instruction_json(String& out,
+                             std::int64_t selection_id,
+                             bool lay_side,
+                             order_type type,
+                             double amount,
+                             double price,
+                             bool persist,
+                             const customer_order_ref& co_ref)
+{
+	out.append("{\"selectionId\":");
+	append_number(out, selection_id);
+	out.append(lay_side ? ",\"side\":\"LAY\"" : ",\"side\":\"BACK\"");
+	switch (type)
+	{
+	case order_type::limit:
+		out.append(",\"orderType\":\"LIMIT\",\"limitOrder\":{\"size\":");
+		append_number(out, amount);
+		out.append(",\"price\":");
+		append_number(out, price);
+		out.append(persist ? ",\"persistenceType\":\"PERSIST\"}" : ",\"persistenceType\":\"LAPSE\"}");
+		break;
+	case order_type::limit_on_close:
+		out.append(",\"orderType\":\"LIMIT_ON_CLOSE\",\"limitOnCloseOrder\":{\"liability\":");
+		append_number(out, amount);
+		out.append(",\"price\":");
+		append_number(out, price);
+		out.push_back('}');
+		break;
+	case order_type::market_on_close:
+		out.append(",\"orderType\":\"MARKET_ON_CLOSE\",\"marketOnCloseOrder\":{\"liability\":");
+		append_number(out, amount);
+		out.push_back('}');
+		break;
+	}
+	if (false == co_ref.empty())
+	{
+		out.append(",\"customerOrderRef\":\"");
+		out.append(co_ref.data(), co_ref.size());
+		out.push_back('"');
+	}
+	out.push_back('}');
+}
+
+struct limit_order_instruction {
 	
+	std::int64_t selection_id;
 	double size;
 	double price;
+	bool lay_side;
 	bool persist;
-	std::string co_ref_string;
+	customer_order_ref co_ref;
 
-	virtual std::string as_json_string() const
+	std::string as_json_string() const
 	{
-		// Ugly string dump but will suffice for the time being to test things
-		std::string data = "{\"selectionId\":" + std::to_string(selection_id) + ",\"side\":\"" + (lay_side ? "LAY" : "BACK") + "\",\"orderType\":\"LIMIT\"";
-		data += (",\"limitOrder\":{\"size\":" + std::to_string(size) + ",\"price\":" + std::to_string(price));
-		data += (",\"persistenceType\":\"" + std::string(persist ? "PERSIST" : "LAPSE") + "\"}");
-		data += (co_ref_string.empty() ? "" : (",\"customerOrderRef\":\"" + co_ref_string + "\"") + "}");
+		std::string data;
+		append_json(data);
 		return data;
 	}
 
+	template<class String>
+	void append_json(String& out) const
+	{
+		append_instruction_json(out, selection_id, lay_side, order_type::limit, size, price, persist, co_ref);
+	}
+
 	limit_order_instruction(const std::int64_t& id, 
 							const bool lay,
 							const double& stake,
 							const double& odds,
 							const bool persist_order,
-							const std::string& coref) : order_instruction(id,lay), size(stake), price(odds), persist(persist_order), co_ref_string(coref) {}
+							const customer_order_ref& coref) : selection_id(id), size(stake), price(odds), lay_side(lay), persist(persist_order), co_ref(coref) {}
 
 	// Example of a order instruction
 	// "{\"selectionId\":50198,\"side\":\"LAY\",\"orderType\":\"LIMIT\",\"limitOrder\":{\"size\":2.0,\"price\":1.01,\"persistenceType\":\"LAPSE\"}}";
 };
 
+struct limit_order {
+	double size;
+	double price;
+	bool persist;
+};
+
+struct limit_on_close_order {
+	double liability;
+	double price;
+};
+
+struct market_on_close_order {
+	double liability;
+};
+
+// Any PlaceInstruction as a tagged variant: type says which member of the union is set
+struct place_instruction {
+	std::int64_t selection_id;
+	order_type type;
+	bool lay_side;
+	union {
+		limit_order limit;
+		limit_on_close_order limit_on_close;
+		market_on_close_order market_on_close;
+	};
+	customer_order_ref co_ref;
+
+	place_instruction() : selection_id(0), type(order_type::limit), lay_side(false), limit{0.0, 0.0, false} {}
+	place_instruction(const limit_order_instruction& i) : selection_id(i.selection_id), type(order_type::limit), lay_side(i.lay_side),
+	                                                      limit{i.size, i.price, i.persist}, co_ref(i.co_ref) {}
+
+	static place_instruction make_limit(std::int64_t id, bool lay, double size, double price, bool persist, const customer_order_ref& coref = customer_order_ref())
+	{
+		place_instruction i;
+		i.selection_id = id;
+		i.lay_side = lay;
+		i.type = order_type::limit;
+		i.limit = limit_order{size, price, persist};
+		i.co_ref = coref;
+		return i;
+	}
+
+	static place_instruction make_limit_on_close(std::int64_t id, bool lay, double liability, double price, const customer_order_ref& coref = customer_order_ref())
+	{
+		place_instruction i;
+		i.selection_id = id;
+		i.lay_side = lay;
+		i.type = order_type::limit_on_close;
+		i.limit_on_close = limit_on_close_order{liability, price};
+		i.co_ref = coref;
+		return i;
+	}
+
+	static place_instruction make_market_on_close(std::int64_t id, bool lay, double liability, const customer_order_ref& coref = customer_order_ref())
+	{
+		place_instruction i;
+		i.selection_id = id;
+		i.lay_side = lay;
+		i.type = order_type::market_on_close;
+		i.market_on_close = market_on_close_order{liability};
+		i.co_ref = coref;
+		return i;
+	}
+
+	// Size of a LIMIT order, liability otherwise
+	double amount() const
+	{
+		switch (type)
+		{
+		case order_type::limit:           return limit.size;
+		case order_type::limit_on_close:  return limit_on_close.liability;
+		case order_type::market_on_close: return market_on_close.liability;
+		}
+		return 0.0;
+	}
+
+	// 0 for MARKET_ON_CLOSE
+	double price() const
+	{
+		return order_type::limit == type ? limit.price : (order_type::limit_on_close == type ? limit_on_close.price : 0.0);
+	}
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		append_instruction_json(out, selection_id, lay_side, type, amount(), price(), order_type::limit == type && limit.persist, co_ref);
+	}
+};
+
+static_assert(std::is_trivially_copyable<place_instruction>::value, "place_instruction must stay a plain value type");
+
+// Instructions of any order type stored column by column, so serialising or
+// scanning a batch walks a few contiguous arrays instead of whole objects.
+// Columns grow together; reserve() once and emplace without reallocating.
+class place_instruction_batch {
+public:
+	place_instruction_batch() {}
+	explicit place_instruction_batch(std::size_t capacity) { reserve(capacity); }
+	place_instruction_batch(const std::vector<place_instruction>& list)
+	{
+		reserve(list.size());
+		for (const place_instruction& i : list)
+		{
+			push_back(i);
+		}
+	}
+	place_instruction_batch(const std::vector<limit_order_instruction>& list)
+	{
+		reserve(list.size());
+		for (const limit_order_instruction& i : list)
+		{
+			emplace_limit(i.selection_id, i.lay_side, i.size, i.price, i.persist, i.co_ref);
+		}
+	}
+
+	void reserve(std::size_t n)
+	{
+		selection_ids.reserve(n);
+		types.reserve(n);
+		flags.reserve(n);
+		amounts.reserve(n);
+		prices.reserve(n);
+		co_refs.reserve(n);
+	}
+
+	void clear()
+	{
+		selection_ids.clear();
+		types.clear();
+		flags.clear();
+		amounts.clear();
+		prices.clear();
+		co_refs.clear();
+	}
+
+	std::size_t size() const { return selection_ids.size(); }
+	bool empty() const { return selection_ids.empty(); }
+
+	void emplace_limit(std::int64_t id, bool lay, double size, double price, bool persist, const customer_order_ref& coref = customer_order_ref())
+	{
+		append(id, order_type::limit, lay, persist, size, price, coref);
+	}
+
+	void emplace_limit_on_close(std::int64_t id, bool lay, double liability, double price, const customer_order_ref& coref = customer_order_ref())
+	{
+		append(id, order_type::limit_on_close, lay, false, liability, price, coref);
+	}
+
+	void emplace_market_on_close(std::int64_t id, bool lay, double liability, const customer_order_ref& coref = customer_order_ref())
+	{
+		append(id, order_type::market_on_close, lay, false, liability, 0.0, coref);
+	}
+
+	void push_back(const place_instruction& i)
+	{
+		append(i.selection_id, i.type, i.lay_side, order_type::limit == i.type && i.limit.persist, i.amount(), i.price(), i.co_ref);
+	}
+
+	// Column accessors
+	std::int64_t selection_id(std::size_t i) const { return selection_ids[i]; }
+	order_type type(std::size_t i) const { return types[i]; }
+	bool lay_side(std::size_t i) const { return 0 != (flags[i] & lay_flag); }
+	bool persist(std::size_t i) const { return 0 != (flags[i] & persist_flag); }
+	double amount(std::size_t i) const { return amounts[i]; }
+	double price(std::size_t i) const { return prices[i]; }
+	const customer_order_ref& co_ref(std::size_t i) const { return co_refs[i]; }
+
+	// Rebuild instruction i as a variant
+	place_instruction operator[](std::size_t i) const
+	{
+		switch (types[i])
+		{
+		case order_type::limit_on_close:  return place_instruction::make_limit_on_close(selection_ids[i], lay_side(i), amounts[i], prices[i], co_refs[i]);
+		case order_type::market_on_close: return place_instruction::make_market_on_close(selection_ids[i], lay_side(i), amounts[i], co_refs[i]);
+		default:                          return place_instruction::make_limit(selection_ids[i], lay_side(i), amounts[i], prices[i], persist(i), co_refs[i]);
+		}
+	}
+
+	template<class String>
+	void append_json(String& out, std::size_t i) const
+	{
+		append_instruction_json(out, selection_ids[i], lay_side(i), types[i], amounts[i], prices[i], persist(i), co_refs[i]);
+	}
+
+private:
+	static const std::uint8_t lay_flag = 1;
+	static const std::uint8_t persist_flag = 2;
+
+	void append(std::int64_t id, order_type type, bool lay, bool persist, double amount, double price, const customer_order_ref& coref)
+	{
+		selection_ids.push_back(id);
+		types.push_back(type);
+		flags.push_back(static_cast<std::uint8_t>((lay ? lay_flag : 0) | (persist ? persist_flag : 0)));
+		amounts.push_back(amount);
+		prices.push_back(price);
+		co_refs.push_back(coref);
+	}
+
+	std::vector<std::int64_t> selection_ids;
+	std::vector<order_type> types;
+	std::vector<std::uint8_t> flags;
+	std::vector<double> amounts;        // Size for LIMIT, liability for the on-close types
+	std::vector<double> prices;         // 0 for MARKET_ON_CLOSE
+	std::vector<customer_order_ref> co_refs;
+};
+
+// placeOrders for instructions of any order type
+struct place_orders_request {
+	std::string market_id;
+	bool async_placement;
+	place_instruction_batch instructions;
+
+	std::string as_json_string() const
+	{
+		std::string request_body;
+		append_json(request_body);
+		return request_body;
+	}
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		out.append("{\"marketId\":\"");
+		out.append(market_id.data(), market_id.size());
+		out.append("\",\"instructions\":[");
+		for (std::size_t i = 0; i < instructions.size(); ++i)
+		{
+			if (i > 0)
+			{
+				out.push_back(',');
+			}
+			instructions.append_json(out, i);
+		}
+		out.append(async_placement ? "],\"async\":true}" : "]}");
+	}
+
+	// False (with error set) if the request must not be sent
+	bool validate(std::string& error) const
+	{
+		for (std::size_t i = 0; i < instructions.size(); ++i)
+		{
+			if (false == instructions.co_ref(i).valid())
+			{
+				error = co_ref_error(i);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	place_orders_request(std::string mid, bool async, place_instruction_batch&& batch) : market_id(std::move(mid)), async_placement(async), instructions(std::move(batch)) {}
+	place_orders_request(std::string mid, bool async, const place_instruction_batch& batch) : market_id(std::move(mid)), async_placement(async), instructions(batch) {}
+};
+
 struct place_limit_orders_request {
 	std::string market_id;
 	bool async_placement;
@@ -56,24 +423,160 @@ struct place_limit_orders_request {
 	
 	std::string as_json_string() const
 	{
-		std::string request_body = "{\"marketId\":\"" + market_id + "\",\"instructions\":[";
-        for (const orders::limit_order_instruction& instruction : instructions_list)
-        {	
-			request_body += instruction.as_json_string() + ",";
-		}		
-		request_body.pop_back();		
-		if (async_placement)
+		std::string request_body;
+		append_json(request_body);
+		return request_body;
+	}
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		out.append("{\"marketId\":\"");
+		out.append(market_id.data(), market_id.size());
+		out.append("\",\"instructions\":[");
+		for (std::size_t i = 0; i < instructions_list.size(); ++i)
 		{
-			request_body += "],\"async\":true}";
+			if (i > 0)
+			{
+				out.push_back(',');
+			}
+			instructions_list[i].append_json(out);
 		}
-		else
+		out.append(async_placement ? "],\"async\":true}" : "]}");
+	}
+
+	// False (with error set) if the request must not be sent
+	bool validate(std::string& error) const
+	{
+		for (std::size_t i = 0; i < instructions_list.size(); ++i)
 		{
-			request_body += "]}";
-		}		
-		return request_body;		
+			if (false == instructions_list[i].co_ref.valid())
+			{
+				error = co_ref_error(i);
+				return false;
+			}
+		}
+		return true;
 	}
 	
 	place_limit_orders_request(const std::string& mid, bool async, const std::vector<limit_order_instruction>& bets) : market_id(mid),async_placement(async),instructions_list(bets) {}
+	place_limit_orders_request(const std::string& mid, bool async, std::vector<limit_order_instruction>&& bets) : market_id(mid),async_placement(async),instructions_list(std::move(bets)) {}
+};
+
+struct cancel_instruction {
+	std::string bet_id;
+	double size_reduction;	// Amount of the unmatched stake to cancel, 0 cancels all of it
+
+	std::string as_json_string() const
+	{
+		std::string data;
+		append_json(data);
+		return data;
+	}
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		out.append("{\"betId\":\"");
+		out.append(bet_id.data(), bet_id.size());
+		out.push_back('"');
+		if (size_reduction > 0.0)
+		{
+			out.append(",\"sizeReduction\":");
+			append_number(out, size_reduction);
+		}
+		out.push_back('}');
+	}
+
+	cancel_instruction(const std::string& id, const double& reduction = 0.0) : bet_id(id), size_reduction(reduction) {}
+};
+
+struct cancel_orders_request {
+	std::string market_id;
+	std::vector<cancel_instruction> instructions_list;
+
+	std::string as_json_string() const
+	{
+		std::string request_body;
+		append_json(request_body);
+		return request_body;
+	}
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		out.append("{\"marketId\":\"");
+		out.append(market_id.data(), market_id.size());
+		out.append("\",\"instructions\":[");
+		for (std::size_t i = 0; i < instructions_list.size(); ++i)
+		{
+			if (i > 0)
+			{
+				out.push_back(',');
+			}
+			instructions_list[i].append_json(out);
+		}
+		out.append("]}");
+	}
+
+	cancel_orders_request(const std::string& mid, const std::vector<cancel_instruction>& cancels) : market_id(mid), instructions_list(cancels) {}
+};
+
+struct replace_instruction {
+	// Cancels the unmatched part of a bet and places the same stake at a new price
+	std::string bet_id;
+	double new_price;
+
+	std::string as_json_string() const
+	{
+		std::string data;
+		append_json(data);
+		return data;
+	}
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		out.append("{\"betId\":\"");
+		out.append(bet_id.data(), bet_id.size());
+		out.append("\",\"newPrice\":");
+		append_number(out, new_price);
+		out.push_back('}');
+	}
+
+	replace_instruction(const std::string& id, const double& price) : bet_id(id), new_price(price) {}
+};
+
+struct replace_orders_request {
+	std::string market_id;
+	bool async_placement;
+	std::vector<replace_instruction> instructions_list;
+
+	std::string as_json_string() const
+	{
+		std::string request_body;
+		append_json(request_body);
+		return request_body;
+	}
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		out.append("{\"marketId\":\"");
+		out.append(market_id.data(), market_id.size());
+		out.append("\",\"instructions\":[");
+		for (std::size_t i = 0; i < instructions_list.size(); ++i)
+		{
+			if (i > 0)
+			{
+				out.push_back(',');
+			}
+			instructions_list[i].append_json(out);
+		}
+		out.append(async_placement ? "],\"async\":true}" : "]}");
+	}
+
+	replace_orders_request(const std::string& mid, bool async, const std::vector<replace_instruction>& replacements) : market_id(mid), async_placement(async), instructions_list(replacements) {}
 };
     
 } // end of namespace bfapi::orders
@@ -0,0 +1,353 @@
+#include "polling.hpp"
+#include "operations.hpp"
+#include <algorithm>
+
+namespace bfapi {
+namespace polling {
+
+//==============================================================================
+int price_projection::weight() const
+{
+    // Weights from the Betfair "Market Data Request Limits" documentation. The
+    // EX_TRADED combinations are cheaper than the sum of their parts.
+    int w = 0;
+    int best = 5;
+    if (ex_best_offers && best_prices_depth > 3)
+    {
+        // Weight scales with requested depth beyond the default of 3 (rounded up)
+        best = (best * best_prices_depth + 2) / 3;
+    }
+    if (ex_all_offers && ex_traded)
+    {
+        w += 32;
+    }
+    else if (ex_best_offers && ex_traded)
+    {
+        w += best + 15;
+    }
+    else
+    {
+        w += ex_all_offers ? 17 : 0;
+        w += ex_traded ? 17 : 0;
+        w += (ex_best_offers && false == ex_all_offers) ? best : 0;
+    }
+    w += sp_available ? 3 : 0;
+    w += sp_traded ? 7 : 0;
+    return w > 0 ? w : 2;
+}
+
+//==============================================================================
+std::string price_projection::as_json_string() const
+{
+    std::string data;
+    append_json(data);
+    return data;
+}
+
+//==============================================================================
+std::string planned_request::as_json_string() const
+{
+    std::string data = "{\"marketIds\":[";
+    for (const std::string& mid : market_ids)
+    {
+        data += "\"" + mid + "\",";
+    }
+    if (false == market_ids.empty())
+    {
+        data.pop_back();
+    }
+    data += "],\"priceProjection\":" + projection.as_json_string() + "}";
+    return data;
+}
+
+//==============================================================================
+std::vector<planned_request> plan_requests(const std::map<std::string, price_projection>& markets,
+                                           int max_weight)
+{
+    // Group markets by projection (the JSON form is a convenient exact key)
+    std::map<std::string, std::vector<std::string>> groups;
+    std::map<std::string, price_projection> projections;
+    for (const auto& m : markets)
+    {
+        const std::string key = m.second.as_json_string();
+        groups[key].push_back(m.first);
+        projections[key] = m.second;
+    }
+
+    std::vector<planned_request> plan;
+    for (const auto& g : groups)
+    {
+        const price_projection& projection = projections[g.first];
+        const int w = projection.weight();
+        const std::size_t per_request = std::max(1, max_weight / w);
+        for (std::size_t i = 0; i < g.second.size(); i += per_request)
+        {
+            planned_request req;
+            req.projection = projection;
+            const std::size_t end = std::min(g.second.size(), i + per_request);
+            req.market_ids.assign(g.second.begin() + i, g.second.begin() + end);
+            req.weight = static_cast<int>(req.market_ids.size()) * w;
+            plan.push_back(req);
+        }
+    }
+    return plan;
+}
+
+//==============================================================================
+bool diff_market_book(const bfapi::responses::market_book& previous,
+                      const bfapi::responses::market_book& current,
+                      book_update& update)
+{
+    update = book_update();
+    update.market_id = current.market_id;
+    update.book = current;
+    update.book.runners.clear();
+
+    update.market_changed = previous.status != current.status ||
+                            previous.inplay != current.inplay ||
+                            previous.version != current.version ||
+                            previous.total_matched != current.total_matched ||
+                            previous.total_available != current.total_available;
+
+    for (const bfapi::responses::runner_book& r : current.runners)
+    {
+        auto const prev = std::find_if(previous.runners.begin(), previous.runners.end(),
+                                       [&r](const bfapi::responses::runner_book& p) { return p.selection_id == r.selection_id && p.handicap == r.handicap; });
+        if (prev == previous.runners.end() ||
+            prev->status != r.status ||
+            prev->last_price_traded != r.last_price_traded ||
+            prev->total_matched != r.total_matched ||
+            prev->available_to_back.size() != r.available_to_back.size() ||
+            prev->available_to_lay.size() != r.available_to_lay.size() ||
+            prev->traded_volume.size() != r.traded_volume.size() ||
+            false == std::equal(r.available_to_back.begin(), r.available_to_back.end(), prev->available_to_back.begin(),
+                                [](const bfapi::responses::price_size& a, const bfapi::responses::price_size& b) { return a.price == b.price && a.size == b.size; }) ||
+            false == std::equal(r.available_to_lay.begin(), r.available_to_lay.end(), prev->available_to_lay.begin(),
+                                [](const bfapi::responses::price_size& a, const bfapi::responses::price_size& b) { return a.price == b.price && a.size == b.size; }) ||
+            false == std::equal(r.traded_volume.begin(), r.traded_volume.end(), prev->traded_volume.begin(),
+                                [](const bfapi::responses::price_size& a, const bfapi::responses::price_size& b) { return a.price == b.price && a.size == b.size; }))
+        {
+            update.book.runners.push_back(r);
+        }
+    }
+    return update.market_changed || false == update.book.runners.empty();
+}
+
+//==============================================================================
+market_book_poller::market_book_poller(bfapi::connection_pool& p,
+                                       std::size_t c,
+                                       int w) : pool(p),
+                                                concurrency(c > 0 ? c : 1),
+                                                max_weight(w > 0 ? w : max_request_weight),
+                                                in_flight(0),
+                                                cycle_handler(nullptr),
+                                                stopping(false)
+{
+}
+
+//==============================================================================
+market_book_poller::~market_book_poller()
+{
+    {
+        std::lock_guard<std::mutex> lock(work_mtx);
+        stopping = true;
+    }
+    work_cv.notify_all();
+    for (std::thread& t : workers)
+    {
+        t.join();
+    }
+}
+
+//==============================================================================
+void market_book_poller::add_market(const std::string& market_id, const price_projection& projection)
+{
+    std::lock_guard<std::mutex> lock(markets_mtx);
+    markets[market_id] = projection;
+}
+
+//==============================================================================
+void market_book_poller::remove_market(const std::string& market_id)
+{
+    {
+        std::lock_guard<std::mutex> lock(markets_mtx);
+        markets.erase(market_id);
+    }
+    std::lock_guard<std::mutex> lock(books_mtx);
+    books.erase(market_id);
+}
+
+//==============================================================================
+std::size_t market_book_poller::market_count() const
+{
+    std::lock_guard<std::mutex> lock(markets_mtx);
+    return markets.size();
+}
+
+//==============================================================================
+void market_book_poller::process_books(const std::vector<bfapi::responses::market_book>& received,
+                                       const update_handler& handler)
+{
+    std::vector<book_update> updates;
+    {
+        std::lock_guard<std::mutex> lock(books_mtx);
+        stats.books_received += received.size();
+        for (const bfapi::responses::market_book& book : received)
+        {
+            auto it = books.find(book.market_id);
+            book_update update;
+            if (it == books.end())
+            {
+                update.market_id = book.market_id;
+                update.book = book;
+                update.first_image = true;
+                update.market_changed = true;
+                books[book.market_id] = book;
+                updates.push_back(update);
+            }
+            else if (diff_market_book(it->second, book, update))
+            {
+                it->second = book;
+                updates.push_back(update);
+            }
+        }
+        for (const book_update& u : updates)
+        {
+            ++stats.updates_emitted;
+            stats.runners_emitted += u.book.runners.size();
+        }
+    }
+    if (handler)
+    {
+        std::lock_guard<std::mutex> lock(handler_mtx);
+        for (const book_update& u : updates)
+        {
+            handler(u);
+        }
+    }
+}
+
+//==============================================================================
+void market_book_poller::work()
+{
+    // Reused for every request this worker sends, across cycles
+    bfapi::arena a;
+    bfapi::operations::list_market_book_request request;
+    std::vector<bfapi::responses::market_book> received;
+    std::unique_lock<std::mutex> lock(work_mtx);
+    for (;;)
+    {
+        work_cv.wait(lock, [this] { return stopping || false == cycle_work.empty(); });
+        if (cycle_work.empty())
+        {
+            return;
+        }
+        const planned_request req = cycle_work.front();
+        cycle_work.pop_front();
+        ++in_flight;
+        const update_handler& handler = *cycle_handler;
+        lock.unlock();
+
+        request.market_ids.assign(req.market_ids.begin(), req.market_ids.end());
+        request.projection = req.projection;
+        std::string req_error;
+        bool ok = bfapi::operations::call<bfapi::operations::list_market_book>(pool, request, received, a, req_error);
+        std::vector<planned_request> retry;
+        if (ok)
+        {
+            process_books(received, handler);
+        }
+        else if (req_error.find("TOO_MUCH_DATA") != std::string::npos && req.market_ids.size() > 1)
+        {
+            // Our weight estimate was too optimistic for this request (the APINGException
+            // error code is part of the call<>() error) - halve it
+            const std::size_t half = req.market_ids.size() / 2;
+            planned_request first = req;
+            planned_request second = req;
+            first.market_ids.assign(req.market_ids.begin(), req.market_ids.begin() + half);
+            second.market_ids.assign(req.market_ids.begin() + half, req.market_ids.end());
+            first.weight = req.weight * static_cast<int>(first.market_ids.size()) / static_cast<int>(req.market_ids.size());
+            second.weight = req.weight - first.weight;
+            retry.push_back(first);
+            retry.push_back(second);
+        }
+
+        {
+            std::lock_guard<std::mutex> stats_lock(books_mtx);
+            ++stats.requests;
+            stats.failed_requests += (ok || false == retry.empty()) ? 0 : 1;
+            stats.too_much_data_splits += retry.empty() ? 0 : 1;
+        }
+        lock.lock();
+        if (false == ok && retry.empty())
+        {
+            cycle_errors.push_back(req_error);
+        }
+        cycle_work.insert(cycle_work.end(), retry.begin(), retry.end());
+        --in_flight;
+        work_cv.notify_all();
+    }
+}
+
+//==============================================================================
+bool market_book_poller::poll_once(const update_handler& handler, std::string& error)
+{
+    error = "";
+    std::lock_guard<std::mutex> poll_lock(poll_mtx);
+    std::vector<planned_request> plan;
+    {
+        std::lock_guard<std::mutex> lock(markets_mtx);
+        plan = plan_requests(markets, max_weight);
+    }
+    {
+        std::lock_guard<std::mutex> lock(books_mtx);
+        ++stats.cycles;
+    }
+    if (plan.empty())
+    {
+        return true;
+    }
+
+    std::unique_lock<std::mutex> lock(work_mtx);
+    while (workers.size() < concurrency)
+    {
+        workers.emplace_back(&market_book_poller::work, this);
+    }
+    cycle_work.assign(plan.begin(), plan.end());
+    cycle_errors.clear();
+    cycle_handler = &handler;
+    work_cv.notify_all();
+    // A split request may still be queued by a worker while anything is in flight
+    work_cv.wait(lock, [this] { return cycle_work.empty() && in_flight == 0; });
+    cycle_handler = nullptr;
+
+    if (false == cycle_errors.empty())
+    {
+        error = "bfapi::polling::market_book_poller::poll_once() " + std::to_string(cycle_errors.size()) + " request(s) failed, first error: " + cycle_errors.front();
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool market_book_poller::last_book(const std::string& market_id, bfapi::responses::market_book& book) const
+{
+    std::lock_guard<std::mutex> lock(books_mtx);
+    auto const it = books.find(market_id);
+    if (it == books.end())
+    {
+        return false;
+    }
+    book = it->second;
+    return true;
+}
+
+//==============================================================================
+poll_stats market_book_poller::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(books_mtx);
+    return stats;
+}
+
+} // end of namespace bfapi::polling
+} // end of namespace bfapi
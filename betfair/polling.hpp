@@ -0,0 +1,194 @@
+//==============================================================================
+//
+// Weight aware listMarketBook polling with change detection.
+//
+// Betfair limits the amount of data returned by each listMarketBook request:
+// every market costs a weight determined by the requested price projection
+// and the sum for a single request must not exceed 200, otherwise the call
+// fails with TOO_MUCH_DATA. See "Market Data Request Limits":
+//
+// https://docs.developer.betfair.com/display/1smk3cen4v3lu3yomq5qye0ni/Market+Data+Request+Limits
+//
+// The poller packs the markets it is given into as few requests as the limit
+// allows, sends them concurrently over a connection_pool and compares each
+// returned book against the previous one so that callers only see the runners
+// that actually changed.
+//
+//==============================================================================
+#ifndef BFAPI_POLLING_HPP
+#define BFAPI_POLLING_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+#include "connection.hpp"
+#include "responses.hpp"
+
+namespace bfapi {
+namespace polling {
+
+const int max_request_weight = 200;
+
+struct price_projection {
+	bool sp_available;
+	bool sp_traded;
+	bool ex_best_offers;
+	bool ex_all_offers;
+	bool ex_traded;
+	int best_prices_depth;      // 0 = API default of 3
+	bool virtualise;
+
+	price_projection() : sp_available(false), sp_traded(false), ex_best_offers(true), ex_all_offers(false),
+	                     ex_traded(false), best_prices_depth(0), virtualise(false) {}
+
+	// Request weight of a single market with this projection
+	int weight() const;
+	std::string as_json_string() const;
+
+	template<class String>
+	void append_json(String& out) const
+	{
+		bool first = true;
+		auto field = [&](bool set, const char* name)
+		{
+			if (set)
+			{
+				out.append(first ? "\"" : ",\"");
+				out.append(name);
+				out.push_back('"');
+				first = false;
+			}
+		};
+		out.append("{\"priceData\":[");
+		field(sp_available, "SP_AVAILABLE");
+		field(sp_traded, "SP_TRADED");
+		field(ex_best_offers, "EX_BEST_OFFERS");
+		field(ex_all_offers, "EX_ALL_OFFERS");
+		field(ex_traded, "EX_TRADED");
+		out.push_back(']');
+		if (ex_best_offers && best_prices_depth > 0)
+		{
+			out.append(",\"exBestOffersOverrides\":{\"bestPricesDepth\":");
+			bfapi::orders::append_number(out, static_cast<std::int64_t>(best_prices_depth));
+			out.push_back('}');
+		}
+		if (virtualise)
+		{
+			out.append(",\"virtualise\":true");
+		}
+		out.push_back('}');
+	}
+};
+
+struct planned_request {
+	std::vector<std::string> market_ids;
+	price_projection projection;
+	int weight;
+
+	planned_request() : weight(0) {}
+
+	// Body for the listMarketBook REST endpoint
+	std::string as_json_string() const;
+};
+
+// Pack markets into listMarketBook requests. Markets sharing a projection are
+// grouped and each request is filled up to max_weight. A market whose weight
+// alone exceeds max_weight still gets its own request.
+std::vector<planned_request> plan_requests(const std::map<std::string, price_projection>& markets,
+                                           int max_weight = max_request_weight);
+
+struct book_update {
+	std::string market_id;
+	bool first_image;                   // No previous book for this market
+	bool market_changed;                // Market level fields (status, inplay, version, totals) differ
+	bfapi::responses::market_book book; // Market level fields of the new book; runners holds only changed runners
+
+	book_update() : first_image(false), market_changed(false) {}
+};
+
+// Compare a new book against the previous one for the same market. Returns
+// true if anything changed, in which case update is populated.
+bool diff_market_book(const bfapi::responses::market_book& previous,
+                      const bfapi::responses::market_book& current,
+                      book_update& update);
+
+struct poll_stats {
+	std::uint64_t cycles;
+	std::uint64_t requests;
+	std::uint64_t failed_requests;
+	std::uint64_t too_much_data_splits;
+	std::uint64_t books_received;
+	std::uint64_t updates_emitted;
+	std::uint64_t runners_emitted;
+
+	poll_stats() : cycles(0), requests(0), failed_requests(0), too_much_data_splits(0),
+	               books_received(0), updates_emitted(0), runners_emitted(0) {}
+};
+
+class market_book_poller {
+public:
+	typedef std::function<void(const book_update&)> update_handler;
+
+	// concurrency is the maximum number of requests in flight; the pool should hold at least that many connections.
+	// The poller keeps that many worker threads (started by the first poll_once()) until it is destroyed.
+	market_book_poller(bfapi::connection_pool& pool,
+	                   std::size_t concurrency,
+	                   int max_weight = max_request_weight);
+	~market_book_poller();
+
+	market_book_poller(const market_book_poller&) = delete;
+	market_book_poller& operator=(const market_book_poller&) = delete;
+
+	void add_market(const std::string& market_id, const price_projection& projection = price_projection());
+	void remove_market(const std::string& market_id);
+	std::size_t market_count() const;
+
+	// Plan and send one round of requests covering every market and call handler
+	// (serialised, from the worker threads) for each market that changed. A request
+	// rejected with TOO_MUCH_DATA is split in two and retried. Returns false with
+	// error set if any request ultimately failed; books from the others are still delivered.
+	// Concurrent calls are serialised.
+	bool poll_once(const update_handler& handler, std::string& error);
+
+	// Latest complete book received for a market
+	bool last_book(const std::string& market_id, bfapi::responses::market_book& book) const;
+
+	poll_stats get_stats() const;
+
+private:
+	void process_books(const std::vector<bfapi::responses::market_book>& books, const update_handler& handler);
+	void work();
+
+	bfapi::connection_pool& pool;
+	std::size_t concurrency;
+	int max_weight;
+
+	std::map<std::string, price_projection> markets;
+	std::map<std::string, bfapi::responses::market_book> books;
+	poll_stats stats;
+	mutable std::mutex markets_mtx;
+	mutable std::mutex books_mtx;
+	std::mutex handler_mtx;
+
+	// Current cycle, shared with the worker threads under work_mtx
+	std::mutex poll_mtx;
+	std::vector<std::thread> workers;
+	std::deque<planned_request> cycle_work;
+	std::size_t in_flight;
+	std::vector<std::string> cycle_errors;
+	const update_handler* cycle_handler;
+	bool stopping;
+	std::mutex work_mtx;
+	std::condition_variable work_cv;    // Work queued, a request finished or stopping
+};
+
+} // end of namespace bfapi::polling
+} // end of namespace bfapi
+
+#endif
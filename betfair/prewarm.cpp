@@ -0,0 +1,273 @@
+#include "prewarm.hpp"
+#include "dates.hpp"
+#include <algorithm>
+#include <iterator>
+#include <memory>
+
+using clock_type = std::chrono::steady_clock;
+using wall_clock = std::chrono::system_clock;
+
+namespace bfapi {
+
+namespace {
+
+//==============================================================================
+double to_ms(clock_type::duration d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+} // end of anonymous namespace
+
+//==============================================================================
+connection_prewarmer::connection_prewarmer(connection_pool& p, const prewarm_policy& pol) : pool(p), policy(pol), order_sequence(0), stopping(false)
+{
+}
+
+//==============================================================================
+connection_prewarmer::~connection_prewarmer()
+{
+    stop();
+}
+
+//==============================================================================
+void connection_prewarmer::schedule(const std::string& market_id, wall_clock::time_point start)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    markets[market_id] = start;
+}
+
+//==============================================================================
+std::size_t connection_prewarmer::schedule(const std::vector<bfapi::responses::market_catalogue>& catalogue)
+{
+    std::size_t count = 0;
+    for (const bfapi::responses::market_catalogue& m : catalogue)
+    {
+        std::time_t t = 0;
+        if (false == m.market_start_time.empty() && bfapi::dates::from_iso8601(m.market_start_time, t))
+        {
+            schedule(m.market_id, wall_clock::from_time_t(t));
+            ++count;
+        }
+    }
+    return count;
+}
+
+//==============================================================================
+void connection_prewarmer::unschedule(const std::string& market_id)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    markets.erase(market_id);
+    ordered.erase(market_id);
+}
+
+//==============================================================================
+void connection_prewarmer::start()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    if (false == thread.joinable())
+    {
+        stopping = false;
+        thread = std::thread(&connection_prewarmer::run, this);
+    }
+}
+
+//==============================================================================
+void connection_prewarmer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stopping = true;
+    }
+    cv.notify_all();
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+//==============================================================================
+void connection_prewarmer::run()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    while (false == stopping)
+    {
+        lock.unlock();
+        tick(wall_clock::now());
+        lock.lock();
+        cv.wait_for(lock, policy.tick_interval, [this] { return stopping; });
+    }
+}
+
+//==============================================================================
+std::size_t connection_prewarmer::target_locked(wall_clock::time_point now) const
+{
+    std::size_t in_window = 0;
+    for (const auto& m : markets)
+    {
+        if (now >= m.second - policy.lead_time && now <= m.second + policy.hold_time)
+        {
+            ++in_window;
+        }
+    }
+    const std::size_t wanted = policy.min_connections + in_window * policy.connections_per_market;
+    return std::min(wanted, std::min(policy.max_connections, pool.max_size()));
+}
+
+//==============================================================================
+std::size_t connection_prewarmer::target(wall_clock::time_point now) const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return target_locked(now);
+}
+
+//==============================================================================
+bool connection_prewarmer::is_warm(const api_connection& conn, clock_type::time_point now) const
+{
+    return conn.is_open() && now - conn.last_activity() < policy.max_idle;
+}
+
+//==============================================================================
+void connection_prewarmer::warm_up(api_connection& conn)
+{
+    const clock_type::time_point now = clock_type::now();
+    if (conn.is_open() && false == is_warm(conn, now))
+    {
+        // Probably dropped by the server already: reopen rather than find out with a request
+        conn.close();
+        std::lock_guard<std::mutex> lock(mtx);
+        ++counters.stale_closed;
+    }
+    std::string error;
+    if (false == conn.is_open())
+    {
+        const bool ok = conn.connect(error);
+        const double ms = to_ms(clock_type::now() - now);
+        std::lock_guard<std::mutex> lock(mtx);
+        if (ok)
+        {
+            ++counters.connects;
+            counters.total_connect_ms += ms;
+            counters.max_connect_ms = std::max(counters.max_connect_ms, ms);
+        }
+        else
+        {
+            ++counters.connect_failures;
+        }
+    }
+    else if (now - conn.last_activity() >= policy.keep_alive_interval)
+    {
+        // Read only, so post() may resend it on a new connection if this one was dropped
+        http_result result;
+        const bool ok = conn.post(policy.keep_alive_target, policy.keep_alive_body, result, error, true) && 200 == result.status;
+        std::lock_guard<std::mutex> lock(mtx);
+        ++counters.keep_alives;
+        counters.keep_alive_failures += ok ? 0 : 1;
+    }
+}
+
+//==============================================================================
+void connection_prewarmer::tick(wall_clock::time_point now)
+{
+    std::size_t wanted = 0;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto it = markets.begin(); markets.end() != it; )
+        {
+            // Only the start time goes; a recorded first order stays until unschedule()
+            it = (now > it->second + policy.hold_time) ? markets.erase(it) : std::next(it);
+        }
+        wanted = target_locked(now);
+    }
+
+    // Borrow up to wanted connections at once (so they are distinct), hand back
+    // at once those that need nothing and then work through the others
+    std::vector<std::unique_ptr<connection_pool::lease>> leases;
+    while (leases.size() < wanted)
+    {
+        std::unique_ptr<connection_pool::lease> l = pool.try_acquire();
+        if (nullptr == l)
+        {
+            break;    // The rest are in use, which keeps them warm
+        }
+        leases.push_back(std::move(l));
+    }
+    const clock_type::time_point checked = clock_type::now();
+    std::size_t warm = wanted - leases.size();    // Connections on loan count as warm
+    for (std::unique_ptr<connection_pool::lease>& l : leases)
+    {
+        if (is_warm(**l, checked) && checked - (*l)->last_activity() < policy.keep_alive_interval)
+        {
+            l.reset();
+            ++warm;
+        }
+    }
+    for (std::unique_ptr<connection_pool::lease>& l : leases)
+    {
+        if (l)
+        {
+            warm_up(**l);
+            warm += (*l)->is_open() ? 1 : 0;
+            l.reset();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    counters.target = wanted;
+    counters.warm = warm;
+}
+
+//==============================================================================
+connection_pool::lease connection_prewarmer::acquire_for_order(const std::string& market_id)
+{
+    connection_pool::lease conn = pool.acquire();
+    const bool warm = is_warm(*conn, clock_type::now());
+    if (conn->is_open() && false == warm)
+    {
+        // A dropped connection would fail the order without a retry; reconnect instead
+        conn->close();
+    }
+
+    std::lock_guard<std::mutex> lock(mtx);
+    ++counters.orders;
+    counters.warm_orders += warm ? 1 : 0;
+    if (false == ordered.insert(std::make_pair(market_id, order_sequence + 1)).second)
+    {
+        return conn;
+    }
+    ordered_oldest.push_back(std::make_pair(++order_sequence, market_id));
+    while (ordered_oldest.size() > policy.max_first_orders)
+    {
+        auto const it = ordered.find(ordered_oldest.front().second);
+        if (ordered.end() != it && it->second == ordered_oldest.front().first)
+        {
+            ordered.erase(it);
+        }
+        ordered_oldest.pop_front();
+    }
+
+    first_order_record record;
+    record.market_id = market_id;
+    record.warm = warm;
+    auto const it = markets.find(market_id);
+    if (markets.end() != it)
+    {
+        record.scheduled = true;
+        record.ms_from_start = std::chrono::duration<double, std::milli>(wall_clock::now() - it->second).count();
+    }
+    counters.first_orders.push_back(record);
+    if (counters.first_orders.size() > policy.max_first_orders)
+    {
+        counters.first_orders.erase(counters.first_orders.begin());
+    }
+    return conn;
+}
+
+//==============================================================================
+prewarm_stats connection_prewarmer::stats() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return counters;
+}
+
+} // end of namespace bfapi
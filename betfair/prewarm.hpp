@@ -0,0 +1,156 @@
+//==============================================================================
+//
+// Connection pre-warming ahead of market start times.
+//
+// Connections in a connection_pool are opened on first use, so the first order
+// after a quiet spell pays for DNS, TCP and TLS setup, and servers and load
+// balancers drop keep-alive connections that stay idle. Both tend to happen at
+// the worst moment: the first order at the off of a market.
+//
+// A connection_prewarmer is given the markets that will be traded and their
+// start times (typically from listMarketCatalogue with MARKET_START_TIME). From
+// lead_time before each start until hold_time after it, it keeps
+// connections_per_market open connections per market in the pool (plus
+// min_connections at all times, up to max_connections and the pool size). On
+// each tick it opens and handshakes any that are closed, and sends a cheap
+// keep-alive request on any that have been idle for keep_alive_interval.
+//
+// Orders should take their connection through acquire_for_order(), which
+// records whether the connection was already open (warm). The first order of
+// each market is kept in the stats so it can be checked that the off found a
+// warm connection; a market keeps counting as ordered until it is unscheduled,
+// and the max_first_orders most recent are kept. A connection idle for longer
+// than max_idle is assumed to have been dropped by the server: it is closed
+// and reopened rather than used, and counts as cold.
+//
+//         bfapi::connection_prewarmer warmer(pool);
+//         warmer.schedule(catalogue);     // listMarketCatalogue result
+//         warmer.start();
+//         ...
+//         bfapi::connection_pool::lease conn = warmer.acquire_for_order(market_id);
+//         conn->place_orders(request, a, report, error);
+//
+//==============================================================================
+#ifndef BFAPI_PREWARM_HPP
+#define BFAPI_PREWARM_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <utility>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include "connection.hpp"
+#include "responses.hpp"
+
+namespace bfapi {
+
+struct prewarm_policy {
+	std::chrono::milliseconds lead_time;            // Warm connections this long before a market starts
+	std::chrono::milliseconds hold_time;            // and keep them warm this long after it
+	std::size_t connections_per_market;             // Warm connections wanted per market in its window
+	std::size_t min_connections;                    // Warm connections wanted at all times
+	std::size_t max_connections;                    // Upper bound (the pool size is one too)
+	std::chrono::milliseconds keep_alive_interval;  // Send a keep-alive on a connection idle this long
+	std::chrono::milliseconds max_idle;             // Treat a connection idle this long as dropped by the server
+	std::chrono::milliseconds tick_interval;        // How often the background thread runs tick()
+	std::string keep_alive_target;                  // Cheap read only request used as keep-alive
+	std::string keep_alive_body;
+	std::size_t max_first_orders;                   // First orders kept in the stats and markets remembered as ordered (oldest dropped)
+
+	prewarm_policy() : lead_time(std::chrono::minutes(2)), hold_time(std::chrono::minutes(10)), connections_per_market(1),
+	                   min_connections(0), max_connections(8), keep_alive_interval(std::chrono::seconds(20)),
+	                   max_idle(std::chrono::seconds(60)), tick_interval(std::chrono::seconds(1)),
+	                   keep_alive_target(bfapi::list_event_types_endpoint),
+	                   keep_alive_body("{\"filter\":{\"eventTypeIds\":[\"7\"]}}"), max_first_orders(1000) {}
+};
+
+struct first_order_record {
+	std::string market_id;
+	bool warm;                                      // The connection was open and not idle for max_idle
+	bool scheduled;                                 // The market was scheduled
+	double ms_from_start;                           // Order time less market start, negative before the off (0 if not scheduled)
+
+	first_order_record() : warm(false), scheduled(false), ms_from_start(0.0) {}
+};
+
+struct prewarm_stats {
+	std::uint64_t connects;                         // Connections opened by tick()
+	std::uint64_t connect_failures;
+	double total_connect_ms;                        // Setup time taken off the order path
+	double max_connect_ms;
+	std::uint64_t keep_alives;
+	std::uint64_t keep_alive_failures;
+	std::uint64_t stale_closed;                     // Connections idle for max_idle, closed to be reopened
+	std::size_t target;                             // Warm connections wanted at the last tick
+	std::size_t warm;                               // Warm connections after the last tick
+	std::uint64_t orders;                           // acquire_for_order() calls
+	std::uint64_t warm_orders;                      // of which found a warm connection
+	std::vector<first_order_record> first_orders;   // The first order of each market, at most max_first_orders
+
+	prewarm_stats() : connects(0), connect_failures(0), total_connect_ms(0.0), max_connect_ms(0.0), keep_alives(0),
+	                  keep_alive_failures(0), stale_closed(0), target(0), warm(0), orders(0), warm_orders(0) {}
+};
+
+class connection_prewarmer {
+public:
+	connection_prewarmer(connection_pool& pool, const prewarm_policy& policy = prewarm_policy());
+	~connection_prewarmer();    // Stops the background thread
+
+	connection_prewarmer(const connection_prewarmer&) = delete;
+	connection_prewarmer& operator=(const connection_prewarmer&) = delete;
+
+	// Warm connections for a market starting at start (rescheduling it if already known)
+	void schedule(const std::string& market_id, std::chrono::system_clock::time_point start);
+	// Schedule every market of a listMarketCatalogue result that has a start
+	// time; returns the number of markets scheduled
+	std::size_t schedule(const std::vector<bfapi::responses::market_catalogue>& catalogue);
+	// Forget a market, including its first order, so the next order on it is recorded again
+	void unschedule(const std::string& market_id);
+
+	// Run tick() every tick_interval on a background thread until stop()
+	void start();
+	void stop();
+
+	// One pass at time now: stop warming markets whose window has passed, then open
+	// connections up to the target and keep idle ones alive. Connections are
+	// borrowed from the pool only while they are being checked or set up.
+	void tick(std::chrono::system_clock::time_point now);
+
+	// Warm connections wanted at time now
+	std::size_t target(std::chrono::system_clock::time_point now) const;
+
+	// Acquire a connection for an order on market_id and record whether it was warm
+	connection_pool::lease acquire_for_order(const std::string& market_id);
+
+	prewarm_stats stats() const;
+
+private:
+	std::size_t target_locked(std::chrono::system_clock::time_point now) const;
+	bool is_warm(const api_connection& conn, std::chrono::steady_clock::time_point now) const;
+	void warm_up(api_connection& conn);
+	void run();
+
+	connection_pool& pool;
+	const prewarm_policy policy;
+
+	mutable std::mutex mtx;
+	std::condition_variable cv;
+	std::map<std::string, std::chrono::system_clock::time_point> markets;   // Start times
+	// Markets with a recorded first order, with the sequence number of that order,
+	// and those orders oldest first (stale entries, for markets since unscheduled, are skipped)
+	std::map<std::string, std::uint64_t> ordered;
+	std::deque<std::pair<std::uint64_t, std::string>> ordered_oldest;
+	std::uint64_t order_sequence;
+	prewarm_stats counters;
+	bool stopping;
+	std::thread thread;
+};
+
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,84 @@
+//==============================================================================
+//
+// Simple thread safe token bucket used to keep a stream of requests under a
+// fixed requests-per-second ceiling.
+//
+//==============================================================================
+#ifndef BFAPI_RATE_LIMITER_HPP
+#define BFAPI_RATE_LIMITER_HPP
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+
+namespace bfapi {
+
+class rate_limiter {
+public:
+	// A rate of zero (or less) disables limiting. burst is the number of requests
+	// that may be sent back to back after an idle period.
+	rate_limiter(double requests_per_second, double burst = 1.0) : rate(requests_per_second),
+	                                                              capacity(std::max(1.0, burst)),
+	                                                              tokens(std::max(1.0, burst)),
+	                                                              last(std::chrono::steady_clock::now()) {}
+
+	// Block until a request may be sent
+	void acquire()
+	{
+		if (rate <= 0.0)
+		{
+			return;
+		}
+		std::chrono::duration<double> wait(0.0);
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			refill();
+			tokens -= 1.0;
+			if (tokens < 0.0)
+			{
+				// Reserve the token now and sleep until it would have been available
+				wait = std::chrono::duration<double>(-tokens / rate);
+			}
+		}
+		if (wait.count() > 0.0)
+		{
+			std::this_thread::sleep_for(wait);
+		}
+	}
+
+	void set_rate(double requests_per_second)
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		refill();
+		rate = requests_per_second;
+	}
+
+	double get_rate() const
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		return rate;
+	}
+
+private:
+	void refill()
+	{
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		const std::chrono::duration<double> elapsed = now - last;
+		last = now;
+		if (rate > 0.0)
+		{
+			tokens = std::min(capacity, tokens + elapsed.count() * rate);
+		}
+	}
+
+	double rate;
+	double capacity;
+	double tokens;
+	std::chrono::steady_clock::time_point last;
+	mutable std::mutex mtx;
+};
+
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,1128 @@
+#include "responses.hpp"
+#include "json_scan.hpp"
+#include <boost/property_tree/json_parser.hpp>
+#include <sstream>
+
+using boost::property_tree::ptree;
+
+namespace bfapi {
+namespace responses {
+
+namespace {
+
+//==============================================================================
+void parse_price_sizes(const ptree& pt, const std::string& key, std::vector<price_size>& out)
+{
+    out.clear();
+    auto const child = pt.get_child_optional(key);
+    if (child)
+    {
+        for (const ptree::value_type& v : *child)
+        {
+            out.emplace_back(v.second.get<double>("price", 0.0), v.second.get<double>("size", 0.0));
+        }
+    }
+}
+
+//==============================================================================
+bool read_json_string(const std::string& json, ptree& pt, std::string& error)
+{
+    try
+    {
+        std::stringstream ss;
+        ss << json;
+        read_json(ss, pt);
+    }
+    catch(std::exception const& e)
+    {
+        error = std::string("bfapi::responses JSON parse error: ") + std::string(e.what());
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+void parse_place_instruction_report(const ptree& pt, instruction_report& ir)
+{
+    ir.status                = pt.get<std::string>("status", "");
+    ir.error_code            = pt.get<std::string>("errorCode", "");
+    ir.order_status          = pt.get<std::string>("orderStatus", "");
+    ir.bet_id                = pt.get<std::string>("betId", "");
+    ir.placed_date           = pt.get<std::string>("placedDate", "");
+    ir.average_price_matched = pt.get<double>("averagePriceMatched", 0.0);
+    ir.size_matched          = pt.get<double>("sizeMatched", 0.0);
+    ir.selection_id          = pt.get<std::int64_t>("instruction.selectionId", 0);
+    ir.customer_order_ref    = pt.get<std::string>("instruction.customerOrderRef", "");
+}
+
+//==============================================================================
+void parse_cancel_instruction_report(const ptree& pt, cancel_instruction_report& cr)
+{
+    cr.status         = pt.get<std::string>("status", "");
+    cr.error_code     = pt.get<std::string>("errorCode", "");
+    cr.bet_id         = pt.get<std::string>("instruction.betId", "");
+    cr.size_reduction = pt.get<double>("instruction.sizeReduction", 0.0);
+    cr.cancelled_date = pt.get<std::string>("cancelledDate", "");
+    cr.size_cancelled = pt.get<double>("sizeCancelled", 0.0);
+}
+
+//==============================================================================
+// String value, or cleared if the value is anything else (e.g. null)
+bool scan_string(bfapi::json::scanner& js, std::string& s)
+{
+    if (js.string(s))
+    {
+        return true;
+    }
+    s.clear();
+    return js.skip_value();
+}
+
+//==============================================================================
+// Reset a report for reuse without giving up the capacity of its strings
+void clear_instruction_report(instruction_report& ir)
+{
+    ir.status.clear();
+    ir.error_code.clear();
+    ir.order_status.clear();
+    ir.bet_id.clear();
+    ir.placed_date.clear();
+    ir.customer_order_ref.clear();
+    ir.selection_id = 0;
+    ir.average_price_matched = 0.0;
+    ir.size_matched = 0.0;
+}
+
+//==============================================================================
+bool scan_place_instruction_report(bfapi::json::scanner& js, instruction_report& ir)
+{
+    using bfapi::json::key_is;
+    return js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "status")) return scan_string(js, ir.status);
+        if (key_is(k, n, "errorCode")) return scan_string(js, ir.error_code);
+        if (key_is(k, n, "orderStatus")) return scan_string(js, ir.order_status);
+        if (key_is(k, n, "betId")) return scan_string(js, ir.bet_id);
+        if (key_is(k, n, "placedDate")) return scan_string(js, ir.placed_date);
+        if (key_is(k, n, "averagePriceMatched")) return js.number(ir.average_price_matched);
+        if (key_is(k, n, "sizeMatched")) return js.number(ir.size_matched);
+        if (key_is(k, n, "instruction"))
+        {
+            return js.object([&](const char* ik, std::size_t in)
+            {
+                if (key_is(ik, in, "selectionId")) return js.integer(ir.selection_id);
+                if (key_is(ik, in, "customerOrderRef")) return scan_string(js, ir.customer_order_ref);
+                return js.skip_value();
+            });
+        }
+        return js.skip_value();
+    });
+}
+
+//==============================================================================
+// Number, or zero if the value is null
+bool scan_number(bfapi::json::scanner& js, double& d)
+{
+    if (js.number(d))
+    {
+        return true;
+    }
+    d = 0.0;
+    return js.null_value();
+}
+
+//==============================================================================
+bool scan_integer(bfapi::json::scanner& js, std::int64_t& v)
+{
+    if (js.integer(v))
+    {
+        return true;
+    }
+    v = 0;
+    return js.null_value();
+}
+
+//==============================================================================
+bool scan_integer(bfapi::json::scanner& js, int& v)
+{
+    std::int64_t i = 0;
+    const bool ok = scan_integer(js, i);
+    v = static_cast<int>(i);
+    return ok;
+}
+
+//==============================================================================
+bool scan_boolean(bfapi::json::scanner& js, bool& b)
+{
+    if (js.boolean(b))
+    {
+        return true;
+    }
+    b = false;
+    return js.null_value();
+}
+
+//==============================================================================
+// Scan a JSON array into v with f(js, element), overwriting existing elements
+// and trimming the rest so that their capacity is kept for the next response
+template<class T, class F>
+bool scan_array(bfapi::json::scanner& js, std::vector<T>& v, F f)
+{
+    std::size_t count = 0;
+    const bool ok = js.array([&]()
+    {
+        if (count == v.size())
+        {
+            v.emplace_back();
+        }
+        return f(v[count++]);
+    });
+    v.resize(count);
+    return ok || js.null_value();
+}
+
+//==============================================================================
+bool malformed(const char* function, const bfapi::json::scanner& js, const char* begin, std::string& error)
+{
+    error = std::string("bfapi::responses::") + function + "() error: Malformed JSON at offset " + std::to_string(js.offset(begin));
+    return false;
+}
+
+//==============================================================================
+bool scan_cancel_instruction_report(bfapi::json::scanner& js, cancel_instruction_report& cr)
+{
+    using bfapi::json::key_is;
+    cr.status.clear();
+    cr.error_code.clear();
+    cr.bet_id.clear();
+    cr.cancelled_date.clear();
+    cr.size_reduction = 0.0;
+    cr.size_cancelled = 0.0;
+    return js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "status")) return scan_string(js, cr.status);
+        if (key_is(k, n, "errorCode")) return scan_string(js, cr.error_code);
+        if (key_is(k, n, "cancelledDate")) return scan_string(js, cr.cancelled_date);
+        if (key_is(k, n, "sizeCancelled")) return scan_number(js, cr.size_cancelled);
+        if (key_is(k, n, "instruction"))
+        {
+            return js.object([&](const char* ik, std::size_t in)
+            {
+                if (key_is(ik, in, "betId")) return scan_string(js, cr.bet_id);
+                if (key_is(ik, in, "sizeReduction")) return scan_number(js, cr.size_reduction);
+                return js.skip_value();
+            });
+        }
+        return js.skip_value();
+    });
+}
+
+//==============================================================================
+bool scan_replace_instruction_report(bfapi::json::scanner& js, replace_instruction_report& rr)
+{
+    using bfapi::json::key_is;
+    rr.status.clear();
+    rr.error_code.clear();
+    bool cancelled = false;
+    bool placed = false;
+    const bool ok = js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "status")) return scan_string(js, rr.status);
+        if (key_is(k, n, "errorCode")) return scan_string(js, rr.error_code);
+        if (key_is(k, n, "cancelInstructionReport"))
+        {
+            cancelled = true;
+            return scan_cancel_instruction_report(js, rr.cancel_report);
+        }
+        if (key_is(k, n, "placeInstructionReport"))
+        {
+            placed = true;
+            clear_instruction_report(rr.place_report);
+            return scan_place_instruction_report(js, rr.place_report);
+        }
+        return js.skip_value();
+    });
+    if (false == cancelled)
+    {
+        rr.cancel_report = cancel_instruction_report();
+    }
+    if (false == placed)
+    {
+        clear_instruction_report(rr.place_report);
+    }
+    return ok;
+}
+
+//==============================================================================
+// ladders of {"price":p,"size":s}
+bool scan_price_sizes(bfapi::json::scanner& js, std::vector<price_size>& ladder)
+{
+    using bfapi::json::key_is;
+    return scan_array(js, ladder, [&](price_size& ps)
+    {
+        ps = price_size();
+        return js.object([&](const char* k, std::size_t n)
+        {
+            if (key_is(k, n, "price")) return scan_number(js, ps.price);
+            if (key_is(k, n, "size")) return scan_number(js, ps.size);
+            return js.skip_value();
+        });
+    });
+}
+
+//==============================================================================
+bool scan_runner_book(bfapi::json::scanner& js, runner_book& rb)
+{
+    using bfapi::json::key_is;
+    rb.selection_id = 0;
+    rb.handicap = 0.0;
+    rb.status.clear();
+    rb.last_price_traded = 0.0;
+    rb.total_matched = 0.0;
+    // Plain values, so clearing keeps the capacity
+    rb.available_to_back.clear();
+    rb.available_to_lay.clear();
+    rb.traded_volume.clear();
+    return js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "selectionId")) return scan_integer(js, rb.selection_id);
+        if (key_is(k, n, "handicap")) return scan_number(js, rb.handicap);
+        if (key_is(k, n, "status")) return scan_string(js, rb.status);
+        if (key_is(k, n, "lastPriceTraded")) return scan_number(js, rb.last_price_traded);
+        if (key_is(k, n, "totalMatched")) return scan_number(js, rb.total_matched);
+        if (key_is(k, n, "ex"))
+        {
+            return js.object([&](const char* ek, std::size_t en)
+            {
+                if (key_is(ek, en, "availableToBack")) return scan_price_sizes(js, rb.available_to_back);
+                if (key_is(ek, en, "availableToLay")) return scan_price_sizes(js, rb.available_to_lay);
+                if (key_is(ek, en, "tradedVolume")) return scan_price_sizes(js, rb.traded_volume);
+                return js.skip_value();
+            });
+        }
+        return js.skip_value();
+    });
+}
+
+//==============================================================================
+bool scan_market_book(bfapi::json::scanner& js, market_book& book)
+{
+    using bfapi::json::key_is;
+    book.market_id.clear();
+    book.status.clear();
+    book.is_market_data_delayed = false;
+    book.inplay = false;
+    book.version = 0;
+    book.total_matched = 0.0;
+    book.total_available = 0.0;
+    bool runners = false;
+    const bool ok = js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "marketId")) return scan_string(js, book.market_id);
+        if (key_is(k, n, "status")) return scan_string(js, book.status);
+        if (key_is(k, n, "isMarketDataDelayed")) return scan_boolean(js, book.is_market_data_delayed);
+        if (key_is(k, n, "inplay")) return scan_boolean(js, book.inplay);
+        if (key_is(k, n, "version")) return scan_integer(js, book.version);
+        if (key_is(k, n, "totalMatched")) return scan_number(js, book.total_matched);
+        if (key_is(k, n, "totalAvailable")) return scan_number(js, book.total_available);
+        if (key_is(k, n, "runners"))
+        {
+            runners = true;
+            return scan_array(js, book.runners, [&](runner_book& rb) { return scan_runner_book(js, rb); });
+        }
+        return js.skip_value();
+    });
+    if (false == runners)
+    {
+        book.runners.clear();
+    }
+    return ok;
+}
+
+//==============================================================================
+// {"id":"..","name":".."} as found in eventType, competition and event
+bool scan_id_name(bfapi::json::scanner& js, std::string& id, std::string& name)
+{
+    using bfapi::json::key_is;
+    return js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "id")) return scan_string(js, id);
+        if (key_is(k, n, "name")) return scan_string(js, name);
+        return js.skip_value();
+    });
+}
+
+//==============================================================================
+bool scan_market_catalogue(bfapi::json::scanner& js, market_catalogue& mc)
+{
+    using bfapi::json::key_is;
+    for (std::string* s : {&mc.market_id, &mc.market_name, &mc.market_start_time, &mc.market_type, &mc.event_type_id,
+                           &mc.event_type_name, &mc.competition_id, &mc.competition_name, &mc.event_id, &mc.event_name,
+                           &mc.country_code, &mc.venue})
+    {
+        s->clear();
+    }
+    mc.total_matched = 0.0;
+    bool runners = false;
+    const bool ok = js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "marketId")) return scan_string(js, mc.market_id);
+        if (key_is(k, n, "marketName")) return scan_string(js, mc.market_name);
+        if (key_is(k, n, "marketStartTime")) return scan_string(js, mc.market_start_time);
+        if (key_is(k, n, "totalMatched")) return scan_number(js, mc.total_matched);
+        if (key_is(k, n, "eventType")) return scan_id_name(js, mc.event_type_id, mc.event_type_name);
+        if (key_is(k, n, "competition")) return scan_id_name(js, mc.competition_id, mc.competition_name);
+        if (key_is(k, n, "description"))
+        {
+            return js.object([&](const char* dk, std::size_t dn)
+            {
+                return key_is(dk, dn, "marketType") ? scan_string(js, mc.market_type) : js.skip_value();
+            });
+        }
+        if (key_is(k, n, "event"))
+        {
+            return js.object([&](const char* ek, std::size_t en)
+            {
+                if (key_is(ek, en, "id")) return scan_string(js, mc.event_id);
+                if (key_is(ek, en, "name")) return scan_string(js, mc.event_name);
+                if (key_is(ek, en, "countryCode")) return scan_string(js, mc.country_code);
+                if (key_is(ek, en, "venue")) return scan_string(js, mc.venue);
+                return js.skip_value();
+            });
+        }
+        if (key_is(k, n, "runners"))
+        {
+            runners = true;
+            return scan_array(js, mc.runners, [&](runner_catalogue& rc)
+            {
+                rc.selection_id = 0;
+                rc.runner_name.clear();
+                rc.handicap = 0.0;
+                rc.sort_priority = 0;
+                return js.object([&](const char* rk, std::size_t rn)
+                {
+                    if (key_is(rk, rn, "selectionId")) return scan_integer(js, rc.selection_id);
+                    if (key_is(rk, rn, "runnerName")) return scan_string(js, rc.runner_name);
+                    if (key_is(rk, rn, "handicap")) return scan_number(js, rc.handicap);
+                    if (key_is(rk, rn, "sortPriority")) return scan_integer(js, rc.sort_priority);
+                    return js.skip_value();
+                });
+            });
+        }
+        return js.skip_value();
+    });
+    if (false == runners)
+    {
+        mc.runners.clear();
+    }
+    return ok;
+}
+
+//==============================================================================
+bool scan_current_order(bfapi::json::scanner& js, current_order& co)
+{
+    using bfapi::json::key_is;
+    for (std::string* s : {&co.bet_id, &co.market_id, &co.side, &co.status, &co.persistence_type, &co.order_type,
+                           &co.placed_date, &co.matched_date, &co.customer_order_ref})
+    {
+        s->clear();
+    }
+    co.selection_id = 0;
+    for (double* d : {&co.handicap, &co.price, &co.size, &co.bsp_liability, &co.average_price_matched, &co.size_matched,
+                      &co.size_remaining, &co.size_lapsed, &co.size_cancelled, &co.size_voided})
+    {
+        *d = 0.0;
+    }
+    return js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "betId")) return scan_string(js, co.bet_id);
+        if (key_is(k, n, "marketId")) return scan_string(js, co.market_id);
+        if (key_is(k, n, "selectionId")) return scan_integer(js, co.selection_id);
+        if (key_is(k, n, "handicap")) return scan_number(js, co.handicap);
+        if (key_is(k, n, "priceSize"))
+        {
+            return js.object([&](const char* pk, std::size_t pn)
+            {
+                if (key_is(pk, pn, "price")) return scan_number(js, co.price);
+                if (key_is(pk, pn, "size")) return scan_number(js, co.size);
+                return js.skip_value();
+            });
+        }
+        if (key_is(k, n, "bspLiability")) return scan_number(js, co.bsp_liability);
+        if (key_is(k, n, "side")) return scan_string(js, co.side);
+        if (key_is(k, n, "status")) return scan_string(js, co.status);
+        if (key_is(k, n, "persistenceType")) return scan_string(js, co.persistence_type);
+        if (key_is(k, n, "orderType")) return scan_string(js, co.order_type);
+        if (key_is(k, n, "placedDate")) return scan_string(js, co.placed_date);
+        if (key_is(k, n, "matchedDate")) return scan_string(js, co.matched_date);
+        if (key_is(k, n, "averagePriceMatched")) return scan_number(js, co.average_price_matched);
+        if (key_is(k, n, "sizeMatched")) return scan_number(js, co.size_matched);
+        if (key_is(k, n, "sizeRemaining")) return scan_number(js, co.size_remaining);
+        if (key_is(k, n, "sizeLapsed")) return scan_number(js, co.size_lapsed);
+        if (key_is(k, n, "sizeCancelled")) return scan_number(js, co.size_cancelled);
+        if (key_is(k, n, "sizeVoided")) return scan_number(js, co.size_voided);
+        if (key_is(k, n, "customerOrderRef")) return scan_string(js, co.customer_order_ref);
+        return js.skip_value();
+    });
+}
+
+//==============================================================================
+bool scan_cleared_order(bfapi::json::scanner& js, cleared_order& co)
+{
+    using bfapi::json::key_is;
+    for (std::string* s : {&co.event_type_id, &co.event_id, &co.market_id, &co.bet_id, &co.placed_date, &co.settled_date,
+                           &co.last_matched_date, &co.persistence_type, &co.order_type, &co.side, &co.bet_outcome,
+                           &co.customer_order_ref})
+    {
+        s->clear();
+    }
+    co.selection_id = 0;
+    for (double* d : {&co.handicap, &co.price_requested, &co.price_matched, &co.size_settled, &co.size_cancelled,
+                      &co.profit, &co.commission})
+    {
+        *d = 0.0;
+    }
+    co.bet_count = 0;
+    co.price_reduced = false;
+    return js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "eventTypeId")) return scan_string(js, co.event_type_id);
+        if (key_is(k, n, "eventId")) return scan_string(js, co.event_id);
+        if (key_is(k, n, "marketId")) return scan_string(js, co.market_id);
+        if (key_is(k, n, "selectionId")) return scan_integer(js, co.selection_id);
+        if (key_is(k, n, "handicap")) return scan_number(js, co.handicap);
+        if (key_is(k, n, "betId")) return scan_string(js, co.bet_id);
+        if (key_is(k, n, "placedDate")) return scan_string(js, co.placed_date);
+        if (key_is(k, n, "settledDate")) return scan_string(js, co.settled_date);
+        if (key_is(k, n, "lastMatchedDate")) return scan_string(js, co.last_matched_date);
+        if (key_is(k, n, "persistenceType")) return scan_string(js, co.persistence_type);
+        if (key_is(k, n, "orderType")) return scan_string(js, co.order_type);
+        if (key_is(k, n, "side")) return scan_string(js, co.side);
+        if (key_is(k, n, "betOutcome")) return scan_string(js, co.bet_outcome);
+        if (key_is(k, n, "customerOrderRef")) return scan_string(js, co.customer_order_ref);
+        if (key_is(k, n, "priceRequested")) return scan_number(js, co.price_requested);
+        if (key_is(k, n, "priceMatched")) return scan_number(js, co.price_matched);
+        if (key_is(k, n, "sizeSettled")) return scan_number(js, co.size_settled);
+        if (key_is(k, n, "sizeCancelled")) return scan_number(js, co.size_cancelled);
+        if (key_is(k, n, "profit")) return scan_number(js, co.profit);
+        if (key_is(k, n, "commission")) return scan_number(js, co.commission);
+        if (key_is(k, n, "betCount")) return scan_integer(js, co.bet_count);
+        if (key_is(k, n, "priceReduced")) return scan_boolean(js, co.price_reduced);
+        return js.skip_value();
+    });
+}
+
+} // end of anonymous namespace
+
+//==============================================================================
+bool parse_place_execution_report(const ptree& pt,
+                                  place_execution_report& report,
+                                  std::string& error)
+{
+    error = "";
+    report = place_execution_report();
+    try
+    {
+        report.status      = pt.get<std::string>("status", "");
+        report.error_code  = pt.get<std::string>("errorCode", "");
+        report.market_id   = pt.get<std::string>("marketId", "");
+        report.customer_ref = pt.get<std::string>("customerRef", "");
+
+        auto const reports = pt.get_child_optional("instructionReports");
+        if (reports)
+        {
+            for (const ptree::value_type& v : *reports)
+            {
+                instruction_report ir;
+                parse_place_instruction_report(v.second, ir);
+                report.instruction_reports.push_back(ir);
+            }
+        }
+    }
+    catch(std::exception const& e)
+    {
+        error = std::string("bfapi::responses::parse_place_execution_report() exception occurred: ") + std::string(e.what());
+        return false;
+    }
+    if (report.status.empty())
+    {
+        error = "bfapi::responses::parse_place_execution_report() error: Response missing \"status\" field!";
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_market_books(const ptree& pt,
+                        std::vector<market_book>& books,
+                        std::string& error)
+{
+    error = "";
+    books.clear();
+    try
+    {
+        // listMarketBook returns a JSON array so every child has an empty key
+        for (const ptree::value_type& m : pt)
+        {
+            market_book book;
+            book.market_id              = m.second.get<std::string>("marketId", "");
+            book.status                 = m.second.get<std::string>("status", "");
+            book.is_market_data_delayed = m.second.get<bool>("isMarketDataDelayed", false);
+            book.inplay                 = m.second.get<bool>("inplay", false);
+            book.version                = m.second.get<std::int64_t>("version", 0);
+            book.total_matched          = m.second.get<double>("totalMatched", 0.0);
+            book.total_available        = m.second.get<double>("totalAvailable", 0.0);
+
+            auto const runners = m.second.get_child_optional("runners");
+            if (runners)
+            {
+                for (const ptree::value_type& r : *runners)
+                {
+                    runner_book rb;
+                    rb.selection_id      = r.second.get<std::int64_t>("selectionId", 0);
+                    rb.handicap          = r.second.get<double>("handicap", 0.0);
+                    rb.status            = r.second.get<std::string>("status", "");
+                    rb.last_price_traded = r.second.get<double>("lastPriceTraded", 0.0);
+                    rb.total_matched     = r.second.get<double>("totalMatched", 0.0);
+                    parse_price_sizes(r.second, "ex.availableToBack", rb.available_to_back);
+                    parse_price_sizes(r.second, "ex.availableToLay", rb.available_to_lay);
+                    parse_price_sizes(r.second, "ex.tradedVolume", rb.traded_volume);
+                    book.runners.push_back(rb);
+                }
+            }
+            if (book.market_id.empty())
+            {
+                error = "bfapi::responses::parse_market_books() error: Market book missing \"marketId\" field!";
+                return false;
+            }
+            books.push_back(book);
+        }
+    }
+    catch(std::exception const& e)
+    {
+        error = std::string("bfapi::responses::parse_market_books() exception occurred: ") + std::string(e.what());
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_cancel_execution_report(const ptree& pt,
+                                   cancel_execution_report& report,
+                                   std::string& error)
+{
+    error = "";
+    report = cancel_execution_report();
+    try
+    {
+        report.status       = pt.get<std::string>("status", "");
+        report.error_code   = pt.get<std::string>("errorCode", "");
+        report.market_id    = pt.get<std::string>("marketId", "");
+        report.customer_ref = pt.get<std::string>("customerRef", "");
+
+        auto const reports = pt.get_child_optional("instructionReports");
+        if (reports)
+        {
+            for (const ptree::value_type& v : *reports)
+            {
+                cancel_instruction_report cr;
+                parse_cancel_instruction_report(v.second, cr);
+                report.instruction_reports.push_back(cr);
+            }
+        }
+    }
+    catch(std::exception const& e)
+    {
+        error = std::string("bfapi::responses::parse_cancel_execution_report() exception occurred: ") + std::string(e.what());
+        return false;
+    }
+    if (report.status.empty())
+    {
+        error = "bfapi::responses::parse_cancel_execution_report() error: Response missing \"status\" field!";
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_replace_execution_report(const ptree& pt,
+                                    replace_execution_report& report,
+                                    std::string& error)
+{
+    error = "";
+    report = replace_execution_report();
+    try
+    {
+        report.status       = pt.get<std::string>("status", "");
+        report.error_code   = pt.get<std::string>("errorCode", "");
+        report.market_id    = pt.get<std::string>("marketId", "");
+        report.customer_ref = pt.get<std::string>("customerRef", "");
+
+        auto const reports = pt.get_child_optional("instructionReports");
+        if (reports)
+        {
+            for (const ptree::value_type& v : *reports)
+            {
+                replace_instruction_report rr;
+                rr.status     = v.second.get<std::string>("status", "");
+                rr.error_code = v.second.get<std::string>("errorCode", "");
+                auto const cancel = v.second.get_child_optional("cancelInstructionReport");
+                if (cancel)
+                {
+                    parse_cancel_instruction_report(*cancel, rr.cancel_report);
+                }
+                auto const place = v.second.get_child_optional("placeInstructionReport");
+                if (place)
+                {
+                    parse_place_instruction_report(*place, rr.place_report);
+                }
+                report.instruction_reports.push_back(rr);
+            }
+        }
+    }
+    catch(std::exception const& e)
+    {
+        error = std::string("bfapi::responses::parse_replace_execution_report() exception occurred: ") + std::string(e.what());
+        return false;
+    }
+    if (report.status.empty())
+    {
+        error = "bfapi::responses::parse_replace_execution_report() error: Response missing \"status\" field!";
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_place_execution_report(const std::string& json,
+                                  place_execution_report& report,
+                                  std::string& error)
+{
+    ptree pt;
+    if (false == read_json_string(json, pt, error))
+    {
+        return false;
+    }
+    return parse_place_execution_report(pt, report, error);
+}
+
+//==============================================================================
+bool parse_place_execution_report(const char* begin,
+                                  const char* end,
+                                  place_execution_report& report,
+                                  std::string& error)
+{
+    using bfapi::json::key_is;
+    error.clear();
+    report.status.clear();
+    report.error_code.clear();
+    report.market_id.clear();
+    report.customer_ref.clear();
+
+    // Existing instruction reports are overwritten in place and only trimmed at the end
+    std::size_t count = 0;
+    bfapi::json::scanner js(begin, end);
+    const bool ok = js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "status")) return scan_string(js, report.status);
+        if (key_is(k, n, "errorCode")) return scan_string(js, report.error_code);
+        if (key_is(k, n, "marketId")) return scan_string(js, report.market_id);
+        if (key_is(k, n, "customerRef")) return scan_string(js, report.customer_ref);
+        if (key_is(k, n, "instructionReports"))
+        {
+            return js.array([&]()
+            {
+                if (count == report.instruction_reports.size())
+                {
+                    report.instruction_reports.push_back(instruction_report());
+                }
+                instruction_report& ir = report.instruction_reports[count++];
+                clear_instruction_report(ir);
+                return scan_place_instruction_report(js, ir);
+            });
+        }
+        return js.skip_value();
+    });
+    report.instruction_reports.resize(count);
+    if (false == ok)
+    {
+        error = "bfapi::responses::parse_place_execution_report() error: Malformed JSON at offset " + std::to_string(js.offset(begin));
+        return false;
+    }
+    if (report.status.empty())
+    {
+        error = "bfapi::responses::parse_place_execution_report() error: Response missing \"status\" field!";
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_market_books(const std::string& json,
+                        std::vector<market_book>& books,
+                        std::string& error)
+{
+    ptree pt;
+    if (false == read_json_string(json, pt, error))
+    {
+        return false;
+    }
+    return parse_market_books(pt, books, error);
+}
+
+//==============================================================================
+bool parse_cancel_execution_report(const std::string& json,
+                                   cancel_execution_report& report,
+                                   std::string& error)
+{
+    ptree pt;
+    if (false == read_json_string(json, pt, error))
+    {
+        return false;
+    }
+    return parse_cancel_execution_report(pt, report, error);
+}
+
+//==============================================================================
+bool parse_replace_execution_report(const std::string& json,
+                                    replace_execution_report& report,
+                                    std::string& error)
+{
+    ptree pt;
+    if (false == read_json_string(json, pt, error))
+    {
+        return false;
+    }
+    return parse_replace_execution_report(pt, report, error);
+}
+
+//==============================================================================
+bool parse_cleared_orders(const std::string& json,
+                          std::vector<cleared_order>& orders,
+                          bool& more_available,
+                          std::string& error)
+{
+    orders.clear();
+    more_available = false;
+    ptree pt;
+    if (false == read_json_string(json, pt, error))
+    {
+        return false;
+    }
+    try
+    {
+        more_available = pt.get<bool>("moreAvailable", false);
+        auto const cleared = pt.get_child_optional("clearedOrders");
+        if (cleared)
+        {
+            for (const ptree::value_type& v : *cleared)
+            {
+                cleared_order co;
+                co.event_type_id      = v.second.get<std::string>("eventTypeId", "");
+                co.event_id           = v.second.get<std::string>("eventId", "");
+                co.market_id          = v.second.get<std::string>("marketId", "");
+                co.selection_id       = v.second.get<std::int64_t>("selectionId", 0);
+                co.handicap           = v.second.get<double>("handicap", 0.0);
+                co.bet_id             = v.second.get<std::string>("betId", "");
+                co.placed_date        = v.second.get<std::string>("placedDate", "");
+                co.settled_date       = v.second.get<std::string>("settledDate", "");
+                co.last_matched_date  = v.second.get<std::string>("lastMatchedDate", "");
+                co.persistence_type   = v.second.get<std::string>("persistenceType", "");
+                co.order_type         = v.second.get<std::string>("orderType", "");
+                co.side               = v.second.get<std::string>("side", "");
+                co.bet_outcome        = v.second.get<std::string>("betOutcome", "");
+                co.customer_order_ref = v.second.get<std::string>("customerOrderRef", "");
+                co.price_requested    = v.second.get<double>("priceRequested", 0.0);
+                co.price_matched      = v.second.get<double>("priceMatched", 0.0);
+                co.size_settled       = v.second.get<double>("sizeSettled", 0.0);
+                co.size_cancelled     = v.second.get<double>("sizeCancelled", 0.0);
+                co.profit             = v.second.get<double>("profit", 0.0);
+                co.commission         = v.second.get<double>("commission", 0.0);
+                co.bet_count          = v.second.get<int>("betCount", 0);
+                co.price_reduced      = v.second.get<bool>("priceReduced", false);
+                orders.push_back(co);
+            }
+        }
+    }
+    catch(std::exception const& e)
+    {
+        error = std::string("bfapi::responses::parse_cleared_orders() exception occurred: ") + std::string(e.what());
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_market_catalogues(const std::string& json,
+                             std::vector<market_catalogue>& catalogues,
+                             std::string& error)
+{
+    catalogues.clear();
+    ptree pt;
+    if (false == read_json_string(json, pt, error))
+    {
+        return false;
+    }
+    try
+    {
+        for (const ptree::value_type& m : pt)
+        {
+            market_catalogue mc;
+            mc.market_id         = m.second.get<std::string>("marketId", "");
+            mc.market_name       = m.second.get<std::string>("marketName", "");
+            mc.market_start_time = m.second.get<std::string>("marketStartTime", "");
+            mc.market_type       = m.second.get<std::string>("description.marketType", "");
+            mc.total_matched     = m.second.get<double>("totalMatched", 0.0);
+            mc.event_type_id     = m.second.get<std::string>("eventType.id", "");
+            mc.event_type_name   = m.second.get<std::string>("eventType.name", "");
+            mc.competition_id    = m.second.get<std::string>("competition.id", "");
+            mc.competition_name  = m.second.get<std::string>("competition.name", "");
+            mc.event_id          = m.second.get<std::string>("event.id", "");
+            mc.event_name        = m.second.get<std::string>("event.name", "");
+            mc.country_code      = m.second.get<std::string>("event.countryCode", "");
+            mc.venue             = m.second.get<std::string>("event.venue", "");
+
+            auto const runners = m.second.get_child_optional("runners");
+            if (runners)
+            {
+                for (const ptree::value_type& r : *runners)
+                {
+                    runner_catalogue rc;
+                    rc.selection_id  = r.second.get<std::int64_t>("selectionId", 0);
+                    rc.runner_name   = r.second.get<std::string>("runnerName", "");
+                    rc.handicap      = r.second.get<double>("handicap", 0.0);
+                    rc.sort_priority = r.second.get<int>("sortPriority", 0);
+                    mc.runners.push_back(rc);
+                }
+            }
+            catalogues.push_back(mc);
+        }
+    }
+    catch(std::exception const& e)
+    {
+        error = std::string("bfapi::responses::parse_market_catalogues() exception occurred: ") + std::string(e.what());
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_cancel_execution_report(const char* begin,
+                                   const char* end,
+                                   cancel_execution_report& report,
+                                   std::string& error)
+{
+    using bfapi::json::key_is;
+    error.clear();
+    report.status.clear();
+    report.error_code.clear();
+    report.market_id.clear();
+    report.customer_ref.clear();
+
+    bool reports = false;
+    bfapi::json::scanner js(begin, end);
+    const bool ok = js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "status")) return scan_string(js, report.status);
+        if (key_is(k, n, "errorCode")) return scan_string(js, report.error_code);
+        if (key_is(k, n, "marketId")) return scan_string(js, report.market_id);
+        if (key_is(k, n, "customerRef")) return scan_string(js, report.customer_ref);
+        if (key_is(k, n, "instructionReports"))
+        {
+            reports = true;
+            return scan_array(js, report.instruction_reports, [&](cancel_instruction_report& cr) { return scan_cancel_instruction_report(js, cr); });
+        }
+        return js.skip_value();
+    });
+    if (false == reports)
+    {
+        report.instruction_reports.clear();
+    }
+    if (false == ok)
+    {
+        return malformed("parse_cancel_execution_report", js, begin, error);
+    }
+    if (report.status.empty())
+    {
+        error = "bfapi::responses::parse_cancel_execution_report() error: Response missing \"status\" field!";
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_replace_execution_report(const char* begin,
+                                    const char* end,
+                                    replace_execution_report& report,
+                                    std::string& error)
+{
+    using bfapi::json::key_is;
+    error.clear();
+    report.status.clear();
+    report.error_code.clear();
+    report.market_id.clear();
+    report.customer_ref.clear();
+
+    bool reports = false;
+    bfapi::json::scanner js(begin, end);
+    const bool ok = js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "status")) return scan_string(js, report.status);
+        if (key_is(k, n, "errorCode")) return scan_string(js, report.error_code);
+        if (key_is(k, n, "marketId")) return scan_string(js, report.market_id);
+        if (key_is(k, n, "customerRef")) return scan_string(js, report.customer_ref);
+        if (key_is(k, n, "instructionReports"))
+        {
+            reports = true;
+            return scan_array(js, report.instruction_reports, [&](replace_instruction_report& rr) { return scan_replace_instruction_report(js, rr); });
+        }
+        return js.skip_value();
+    });
+    if (false == reports)
+    {
+        report.instruction_reports.clear();
+    }
+    if (false == ok)
+    {
+        return malformed("parse_replace_execution_report", js, begin, error);
+    }
+    if (report.status.empty())
+    {
+        error = "bfapi::responses::parse_replace_execution_report() error: Response missing \"status\" field!";
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_market_books(const char* begin,
+                        const char* end,
+                        std::vector<market_book>& books,
+                        std::string& error)
+{
+    error.clear();
+    bfapi::json::scanner js(begin, end);
+    if (false == scan_array(js, books, [&](market_book& book) { return scan_market_book(js, book); }))
+    {
+        return malformed("parse_market_books", js, begin, error);
+    }
+    for (const market_book& book : books)
+    {
+        if (book.market_id.empty())
+        {
+            error = "bfapi::responses::parse_market_books() error: Market book missing \"marketId\" field!";
+            return false;
+        }
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_market_catalogues(const char* begin,
+                             const char* end,
+                             std::vector<market_catalogue>& catalogues,
+                             std::string& error)
+{
+    error.clear();
+    bfapi::json::scanner js(begin, end);
+    if (false == scan_array(js, catalogues, [&](market_catalogue& mc) { return scan_market_catalogue(js, mc); }))
+    {
+        return malformed("parse_market_catalogues", js, begin, error);
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_event_type_results(const char* begin,
+                              const char* end,
+                              std::vector<event_type_result>& results,
+                              std::string& error)
+{
+    using bfapi::json::key_is;
+    error.clear();
+    bfapi::json::scanner js(begin, end);
+    const bool ok = scan_array(js, results, [&](event_type_result& r)
+    {
+        r.event_type_id.clear();
+        r.event_type_name.clear();
+        r.market_count = 0;
+        return js.object([&](const char* k, std::size_t n)
+        {
+            if (key_is(k, n, "eventType")) return scan_id_name(js, r.event_type_id, r.event_type_name);
+            if (key_is(k, n, "marketCount")) return scan_integer(js, r.market_count);
+            return js.skip_value();
+        });
+    });
+    if (false == ok)
+    {
+        return malformed("parse_event_type_results", js, begin, error);
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_current_orders(const char* begin,
+                          const char* end,
+                          current_order_summary_report& report,
+                          std::string& error)
+{
+    using bfapi::json::key_is;
+    error.clear();
+    report.more_available = false;
+    bool orders = false;
+    bfapi::json::scanner js(begin, end);
+    const bool ok = js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "moreAvailable")) return scan_boolean(js, report.more_available);
+        if (key_is(k, n, "currentOrders"))
+        {
+            orders = true;
+            return scan_array(js, report.current_orders, [&](current_order& co) { return scan_current_order(js, co); });
+        }
+        return js.skip_value();
+    });
+    if (false == orders)
+    {
+        report.current_orders.clear();
+    }
+    if (false == ok)
+    {
+        return malformed("parse_current_orders", js, begin, error);
+    }
+    return true;
+}
+
+//==============================================================================
+bool parse_cleared_orders(const char* begin,
+                          const char* end,
+                          cleared_order_summary_report& report,
+                          std::string& error)
+{
+    using bfapi::json::key_is;
+    error.clear();
+    report.more_available = false;
+    bool orders = false;
+    bfapi::json::scanner js(begin, end);
+    const bool ok = js.object([&](const char* k, std::size_t n)
+    {
+        if (key_is(k, n, "moreAvailable")) return scan_boolean(js, report.more_available);
+        if (key_is(k, n, "clearedOrders"))
+        {
+            orders = true;
+            return scan_array(js, report.cleared_orders, [&](cleared_order& co) { return scan_cleared_order(js, co); });
+        }
+        return js.skip_value();
+    });
+    if (false == orders)
+    {
+        report.cleared_orders.clear();
+    }
+    if (false == ok)
+    {
+        return malformed("parse_cleared_orders", js, begin, error);
+    }
+    return true;
+}
+
+} // end of namespace bfapi::responses
+} // end of namespace bfapi
@@ -0,0 +1,253 @@
+//==============================================================================
+//
+// Typed representations of Betfair API responses along with methods to
+// populate them from the JSON returned by the API.
+//
+// Field names follow the Betfair API reference documentation:
+//
+// https://docs.developer.betfair.com/display/1smk3cen4v3lu3yomq5qye0ni/Betting+Type+Definitions
+//
+//==============================================================================
+#ifndef BFAPI_RESPONSES_HPP
+#define BFAPI_RESPONSES_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <boost/property_tree/ptree.hpp>
+
+namespace bfapi {
+namespace responses {
+
+struct price_size {
+	double price;
+	double size;
+
+	price_size() : price(0.0), size(0.0) {}
+	price_size(const double& p, const double& s) : price(p), size(s) {}
+};
+
+struct instruction_report {
+	// PlaceInstructionReport
+	std::string status;                 // SUCCESS, FAILURE or TIMEOUT
+	std::string error_code;
+	std::string order_status;           // PENDING, EXECUTION_COMPLETE, EXECUTABLE or EXPIRED
+	std::string bet_id;
+	std::string placed_date;
+	std::string customer_order_ref;     // Taken from the instruction that generated the report
+	std::int64_t selection_id;
+	double average_price_matched;
+	double size_matched;
+
+	instruction_report() : selection_id(0), average_price_matched(0.0), size_matched(0.0) {}
+};
+
+struct place_execution_report {
+	std::string status;                 // SUCCESS, FAILURE, PROCESSED_WITH_ERRORS or TIMEOUT
+	std::string error_code;
+	std::string market_id;
+	std::string customer_ref;
+	std::vector<instruction_report> instruction_reports;
+};
+
+struct cancel_instruction_report {
+	std::string status;                 // SUCCESS, FAILURE or TIMEOUT
+	std::string error_code;
+	std::string bet_id;                 // Taken from the instruction that generated the report
+	std::string cancelled_date;
+	double size_reduction;              // Requested reduction, 0 if the whole bet was to be cancelled
+	double size_cancelled;
+
+	cancel_instruction_report() : size_reduction(0.0), size_cancelled(0.0) {}
+};
+
+struct cancel_execution_report {
+	std::string status;
+	std::string error_code;
+	std::string market_id;
+	std::string customer_ref;
+	std::vector<cancel_instruction_report> instruction_reports;
+};
+
+struct replace_instruction_report {
+	std::string status;
+	std::string error_code;
+	cancel_instruction_report cancel_report;
+	instruction_report place_report;
+};
+
+struct replace_execution_report {
+	std::string status;
+	std::string error_code;
+	std::string market_id;
+	std::string customer_ref;
+	std::vector<replace_instruction_report> instruction_reports;
+};
+
+struct runner_book {
+	std::int64_t selection_id;
+	double handicap;
+	std::string status;
+	double last_price_traded;
+	double total_matched;
+	std::vector<price_size> available_to_back;
+	std::vector<price_size> available_to_lay;
+	std::vector<price_size> traded_volume;
+
+	runner_book() : selection_id(0), handicap(0.0), last_price_traded(0.0), total_matched(0.0) {}
+};
+
+struct market_book {
+	std::string market_id;
+	std::string status;
+	bool is_market_data_delayed;
+	bool inplay;
+	std::int64_t version;
+	double total_matched;
+	double total_available;
+	std::vector<runner_book> runners;
+
+	market_book() : is_market_data_delayed(false), inplay(false), version(0), total_matched(0.0), total_available(0.0) {}
+};
+
+struct cleared_order {
+	// ClearedOrderSummary
+	std::string event_type_id;
+	std::string event_id;
+	std::string market_id;
+	std::int64_t selection_id;
+	double handicap;
+	std::string bet_id;
+	std::string placed_date;
+	std::string settled_date;
+	std::string last_matched_date;
+	std::string persistence_type;
+	std::string order_type;
+	std::string side;
+	std::string bet_outcome;
+	std::string customer_order_ref;
+	double price_requested;
+	double price_matched;
+	double size_settled;
+	double size_cancelled;
+	double profit;
+	double commission;
+	int bet_count;
+	bool price_reduced;
+
+	cleared_order() : selection_id(0), handicap(0.0), price_requested(0.0), price_matched(0.0), size_settled(0.0),
+	                  size_cancelled(0.0), profit(0.0), commission(0.0), bet_count(0), price_reduced(false) {}
+};
+
+struct runner_catalogue {
+	std::int64_t selection_id;
+	std::string runner_name;
+	double handicap;
+	int sort_priority;
+
+	runner_catalogue() : selection_id(0), handicap(0.0), sort_priority(0) {}
+};
+
+struct market_catalogue {
+	std::string market_id;
+	std::string market_name;
+	std::string market_start_time;
+	std::string market_type;
+	std::string event_type_id;
+	std::string event_type_name;
+	std::string competition_id;
+	std::string competition_name;
+	std::string event_id;
+	std::string event_name;
+	std::string country_code;
+	std::string venue;
+	double total_matched;
+	std::vector<runner_catalogue> runners;
+
+	market_catalogue() : total_matched(0.0) {}
+};
+
+struct event_type_result {
+	std::string event_type_id;
+	std::string event_type_name;
+	int market_count;
+
+	event_type_result() : market_count(0) {}
+};
+
+struct current_order {
+	// CurrentOrderSummary
+	std::string bet_id;
+	std::string market_id;
+	std::int64_t selection_id;
+	double handicap;
+	double price;                       // priceSize.price
+	double size;                        // priceSize.size
+	double bsp_liability;
+	std::string side;
+	std::string status;                 // EXECUTABLE or EXECUTION_COMPLETE
+	std::string persistence_type;
+	std::string order_type;
+	std::string placed_date;
+	std::string matched_date;
+	double average_price_matched;
+	double size_matched;
+	double size_remaining;
+	double size_lapsed;
+	double size_cancelled;
+	double size_voided;
+	std::string customer_order_ref;
+
+	current_order() : selection_id(0), handicap(0.0), price(0.0), size(0.0), bsp_liability(0.0), average_price_matched(0.0),
+	                  size_matched(0.0), size_remaining(0.0), size_lapsed(0.0), size_cancelled(0.0), size_voided(0.0) {}
+};
+
+struct current_order_summary_report {
+	std::vector<current_order> current_orders;
+	bool more_available;
+
+	current_order_summary_report() : more_available(false) {}
+};
+
+struct cleared_order_summary_report {
+	std::vector<cleared_order> cleared_orders;
+	bool more_available;
+
+	cleared_order_summary_report() : more_available(false) {}
+};
+
+// Populate typed responses from an already parsed property tree (e.g. the "result" member of a JSON-RPC response)
+bool parse_place_execution_report(const boost::property_tree::ptree& pt, place_execution_report& report, std::string& error);
+bool parse_market_books(const boost::property_tree::ptree& pt, std::vector<market_book>& books, std::string& error);
+bool parse_cancel_execution_report(const boost::property_tree::ptree& pt, cancel_execution_report& report, std::string& error);
+bool parse_replace_execution_report(const boost::property_tree::ptree& pt, replace_execution_report& report, std::string& error);
+
+// Populate typed responses from the raw JSON body of a REST response
+bool parse_place_execution_report(const std::string& json, place_execution_report& report, std::string& error);
+bool parse_market_books(const std::string& json, std::vector<market_book>& books, std::string& error);
+bool parse_cancel_execution_report(const std::string& json, cancel_execution_report& report, std::string& error);
+bool parse_replace_execution_report(const std::string& json, replace_execution_report& report, std::string& error);
+
+// placeOrders response parsed without a property tree. report is updated in place,
+// reusing the capacity of its strings and instruction_reports, so parsing a response
+// no larger than the previous one into the same report allocates nothing.
+bool parse_place_execution_report(const char* begin, const char* end, place_execution_report& report, std::string& error);
+
+// The other responses parsed the same way: results are overwritten in place and
+// the vectors trimmed, so repeating a call of the same shape allocates nothing
+bool parse_cancel_execution_report(const char* begin, const char* end, cancel_execution_report& report, std::string& error);
+bool parse_replace_execution_report(const char* begin, const char* end, replace_execution_report& report, std::string& error);
+bool parse_market_books(const char* begin, const char* end, std::vector<market_book>& books, std::string& error);
+bool parse_market_catalogues(const char* begin, const char* end, std::vector<market_catalogue>& catalogues, std::string& error);
+bool parse_event_type_results(const char* begin, const char* end, std::vector<event_type_result>& results, std::string& error);
+bool parse_current_orders(const char* begin, const char* end, current_order_summary_report& report, std::string& error);
+bool parse_cleared_orders(const char* begin, const char* end, cleared_order_summary_report& report, std::string& error);
+
+// ClearedOrderSummaryReport - more_available is set if further records exist beyond the requested page
+bool parse_cleared_orders(const std::string& json, std::vector<cleared_order>& orders, bool& more_available, std::string& error);
+bool parse_market_catalogues(const std::string& json, std::vector<market_catalogue>& catalogues, std::string& error);
+
+} // end of namespace bfapi::responses
+} // end of namespace bfapi
+
+#endif
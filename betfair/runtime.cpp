@@ -0,0 +1,680 @@
+#include "runtime.hpp"
+#include "operations.hpp"
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace bfapi {
+namespace runtime {
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+//==============================================================================
+std::uint64_t elapsed_ns(clock_type::time_point since, clock_type::time_point now)
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - since).count());
+}
+
+//==============================================================================
+void merge_runners(std::vector<bfapi::responses::runner_book>& dest, const std::vector<bfapi::responses::runner_book>& changed)
+{
+    for (const bfapi::responses::runner_book& r : changed)
+    {
+        auto it = std::find_if(dest.begin(), dest.end(),
+                               [&r](const bfapi::responses::runner_book& d) { return d.selection_id == r.selection_id && d.handicap == r.handicap; });
+        if (it == dest.end())
+        {
+            dest.push_back(r);
+        }
+        else
+        {
+            *it = r;
+        }
+    }
+}
+
+//==============================================================================
+void copy_market_fields(bfapi::responses::market_book& dest, const bfapi::responses::market_book& src)
+{
+    dest.market_id = src.market_id;
+    dest.status = src.status;
+    dest.is_market_data_delayed = src.is_market_data_delayed;
+    dest.inplay = src.inplay;
+    dest.version = src.version;
+    dest.total_matched = src.total_matched;
+    dest.total_available = src.total_available;
+}
+
+//==============================================================================
+// Fold a later update into one that has not been delivered yet
+void coalesce_update(bfapi::polling::book_update& waiting, const bfapi::polling::book_update& later)
+{
+    if (later.first_image)
+    {
+        waiting.book = later.book;
+        waiting.first_image = true;
+    }
+    else
+    {
+        copy_market_fields(waiting.book, later.book);
+        merge_runners(waiting.book.runners, later.book.runners);
+    }
+    waiting.market_changed = waiting.market_changed || later.market_changed;
+}
+
+//==============================================================================
+void update_max(std::atomic<std::uint64_t>& target, std::uint64_t value)
+{
+    std::uint64_t current = target.load(std::memory_order_relaxed);
+    while (value > current && false == target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+} // end of anonymous namespace
+
+//==============================================================================
+const std::string& order_intent::market_id() const
+{
+    switch (type)
+    {
+        case intent_type::cancel:
+            return cancel.market_id;
+        case intent_type::replace:
+            return replace.market_id;
+        default:
+            return place.market_id;
+    }
+}
+
+//==============================================================================
+order_executor live_executor(bfapi::connection_pool& pool)
+{
+    return [&pool](const order_intent& intent, order_event& event) -> bool
+    {
+        // One arena per submission thread, reused for every intent it sends. Order
+        // operations are not idempotent so are never retried after the request was written.
+        thread_local bfapi::arena a;
+        switch (intent.type)
+        {
+            case intent_type::cancel:
+                return bfapi::operations::call<bfapi::operations::cancel_orders>(pool, intent.cancel, event.cancel_report, a, event.error);
+            case intent_type::replace:
+                return bfapi::operations::call<bfapi::operations::replace_orders>(pool, intent.replace, event.replace_report, a, event.error);
+            default:
+                return bfapi::operations::call<bfapi::operations::place_orders>(pool, intent.place, event.place_report, a, event.error);
+        }
+    };
+}
+
+//==============================================================================
+std::uint64_t market_context::place(const bfapi::orders::place_limit_orders_request& request)
+{
+    return runtime.submit(*this, order_intent(request));
+}
+
+//==============================================================================
+std::uint64_t market_context::place(const bfapi::orders::place_orders_request& request)
+{
+    return runtime.submit(*this, order_intent(request));
+}
+
+//==============================================================================
+std::uint64_t market_context::cancel(const bfapi::orders::cancel_orders_request& request)
+{
+    return runtime.submit(*this, order_intent(request));
+}
+
+//==============================================================================
+std::uint64_t market_context::replace(const bfapi::orders::replace_orders_request& request)
+{
+    return runtime.submit(*this, order_intent(request));
+}
+
+//==============================================================================
+strategy_runtime::strategy_runtime(const strategy_factory& f,
+                                   const order_executor& e,
+                                   std::size_t worker_count,
+                                   std::size_t submitters_count) : factory(f),
+                                                                   executor(e),
+                                                                   submit_threads(submitters_count),
+                                                                   pin_threads(false),
+                                                                   batch_limit(64),
+                                                                   coalesce(true),
+                                                                   next_home(0),
+                                                                   running(false),
+                                                                   stopping(false),
+                                                                   pending(0),
+                                                                   steal_generation(0),
+                                                                   next_intent(1),
+                                                                   updates_posted(0),
+                                                                   updates_coalesced(0),
+                                                                   order_events(0),
+                                                                   intents_submitted(0),
+                                                                   intents_failed(0),
+                                                                   callback_errors(0)
+{
+    if (0 == worker_count)
+    {
+        worker_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (std::size_t i = 0; i < worker_count; ++i)
+    {
+        workers.emplace_back(new worker());
+    }
+}
+
+//==============================================================================
+strategy_runtime::~strategy_runtime()
+{
+    stop();
+}
+
+//==============================================================================
+bool strategy_runtime::start(std::string& error)
+{
+    error = "";
+    if (running)
+    {
+        return true;
+    }
+    try
+    {
+        stopping = false;
+        for (std::size_t i = 0; i < workers.size(); ++i)
+        {
+            workers[i]->thread = std::thread(&strategy_runtime::run_worker, this, i);
+#ifdef __linux__
+            if (pin_threads)
+            {
+                const unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(i % cpus, &set);
+                if (pthread_setaffinity_np(workers[i]->thread.native_handle(), sizeof(set), &set) != 0)
+                {
+                    record_error("bfapi::runtime::strategy_runtime::start() warning: Unable to pin worker " + std::to_string(i));
+                }
+            }
+#endif
+        }
+        for (std::size_t i = 0; i < submit_threads; ++i)
+        {
+            submitters.emplace_back(&strategy_runtime::run_submitter, this);
+        }
+        running = true;
+    }
+    catch(std::exception const& e)
+    {
+        error = std::string("bfapi::runtime::strategy_runtime::start() exception occurred: ") + std::string(e.what());
+        running = true;
+        stop();
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+void strategy_runtime::stop()
+{
+    if (false == running)
+    {
+        return;
+    }
+
+    // Strategies may keep submitting while the backlog drains, so wait for quiet
+    while (pending.load() > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    stopping = true;
+    for (std::unique_ptr<worker>& w : workers)
+    {
+        std::lock_guard<std::mutex> lock(w->mtx);
+        w->cv.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(submit_mtx);
+        submit_cv.notify_all();
+    }
+    for (std::unique_ptr<worker>& w : workers)
+    {
+        if (w->thread.joinable())
+        {
+            w->thread.join();
+        }
+    }
+    for (std::thread& t : submitters)
+    {
+        t.join();
+    }
+    submitters.clear();
+    running = false;
+}
+
+//==============================================================================
+bool strategy_runtime::add_market(const std::string& market_id)
+{
+    return nullptr != find_or_add(market_id);
+}
+
+//==============================================================================
+void strategy_runtime::post(const bfapi::polling::book_update& update)
+{
+    market_slot* slot = find_or_add(update.market_id);
+    if (nullptr == slot)
+    {
+        return;
+    }
+    ++updates_posted;
+    market_event event;
+    event.is_update = true;
+    event.update = update;
+    event.posted = clock_type::now();
+    dispatch(*slot, std::move(event));
+}
+
+//==============================================================================
+void strategy_runtime::post(const bfapi::responses::market_book& book)
+{
+    bfapi::polling::book_update update;
+    update.market_id = book.market_id;
+    update.first_image = true;
+    update.market_changed = true;
+    update.book = book;
+    post(update);
+}
+
+//==============================================================================
+bfapi::polling::market_book_poller::update_handler strategy_runtime::update_handler()
+{
+    return [this](const bfapi::polling::book_update& update) { post(update); };
+}
+
+//==============================================================================
+std::size_t strategy_runtime::market_count() const
+{
+    std::lock_guard<std::mutex> lock(markets_mtx);
+    return markets.size();
+}
+
+//==============================================================================
+runtime_stats strategy_runtime::get_stats() const
+{
+    runtime_stats stats;
+    stats.markets = market_count();
+    stats.updates_posted = updates_posted;
+    stats.updates_coalesced = updates_coalesced;
+    stats.order_events = order_events;
+    stats.intents_submitted = intents_submitted;
+    stats.intents_failed = intents_failed;
+    stats.callback_errors = callback_errors;
+    for (const worker_stats& ws : get_worker_stats())
+    {
+        stats.total.events += ws.events;
+        stats.total.batches += ws.batches;
+        stats.total.steals += ws.steals;
+        stats.total.busy_ns += ws.busy_ns;
+        stats.total.latency_total_ns += ws.latency_total_ns;
+        stats.total.latency_max_ns = std::max(stats.total.latency_max_ns, ws.latency_max_ns);
+    }
+    return stats;
+}
+
+//==============================================================================
+std::vector<worker_stats> strategy_runtime::get_worker_stats() const
+{
+    std::vector<worker_stats> result;
+    for (const std::unique_ptr<worker>& w : workers)
+    {
+        worker_stats ws;
+        ws.events = w->events;
+        ws.batches = w->batches;
+        ws.steals = w->steals;
+        ws.busy_ns = w->busy_ns;
+        ws.latency_total_ns = w->latency_total_ns;
+        ws.latency_max_ns = w->latency_max_ns;
+        result.push_back(ws);
+    }
+    return result;
+}
+
+//==============================================================================
+std::string strategy_runtime::last_error() const
+{
+    std::lock_guard<std::mutex> lock(error_mtx);
+    return error_text;
+}
+
+//==============================================================================
+strategy_runtime::market_slot* strategy_runtime::find_or_add(const std::string& market_id)
+{
+    std::lock_guard<std::mutex> lock(markets_mtx);
+    auto it = markets.find(market_id);
+    if (it != markets.end())
+    {
+        return it->second.get();
+    }
+
+    std::unique_ptr<strategy> strat;
+    try
+    {
+        strat = factory ? factory(market_id) : std::unique_ptr<strategy>();
+    }
+    catch(std::exception const& e)
+    {
+        ++callback_errors;
+        record_error(std::string("bfapi::runtime::strategy_runtime factory exception occurred (market ") + market_id + "): " + std::string(e.what()));
+    }
+
+    // A market without a strategy is remembered with a null slot so its updates are dropped cheaply
+    if (nullptr == strat)
+    {
+        markets[market_id] = std::unique_ptr<market_slot>();
+        return nullptr;
+    }
+    std::unique_ptr<market_slot> slot(new market_slot(*this, market_id, next_home));
+    slot->strat = std::move(strat);
+    next_home = (next_home + 1) % workers.size();
+    market_slot* result = slot.get();
+    markets[market_id] = std::move(slot);
+    return result;
+}
+
+//==============================================================================
+void strategy_runtime::dispatch(market_slot& slot, market_event&& event)
+{
+    bool schedule = false;
+    std::size_t home = 0;
+    {
+        std::lock_guard<std::mutex> lock(slot.mtx);
+        if (coalesce && event.is_update && false == slot.inbox.empty() && slot.inbox.back().is_update)
+        {
+            // The waiting update keeps its posted time so latency reflects the oldest data
+            coalesce_update(slot.inbox.back().update, event.update);
+            ++updates_coalesced;
+            return;
+        }
+        slot.inbox.push_back(std::move(event));
+        ++pending;
+        if (false == slot.scheduled)
+        {
+            slot.scheduled = true;
+            schedule = true;
+            home = slot.home;
+        }
+    }
+    if (schedule)
+    {
+        enqueue(home, &slot);
+    }
+}
+
+//==============================================================================
+void strategy_runtime::enqueue(std::size_t index, market_slot* slot)
+{
+    worker& w = *workers[index];
+    std::size_t depth = 0;
+    bool wake = false;
+    {
+        std::lock_guard<std::mutex> lock(w.mtx);
+        w.ready.push_back(slot);
+        depth = w.ready.size();
+        w.queued.store(depth, std::memory_order_relaxed);
+        wake = w.idle.load(std::memory_order_relaxed);
+    }
+    if (wake)
+    {
+        w.cv.notify_one();
+    }
+
+    // A backlog on this worker is work another idle worker could steal
+    if (depth >= 2)
+    {
+        ++steal_generation;
+        for (std::size_t i = 0; i < workers.size(); ++i)
+        {
+            worker& other = *workers[i];
+            if (i != index && other.idle.load(std::memory_order_relaxed))
+            {
+                std::lock_guard<std::mutex> lock(other.mtx);
+                other.cv.notify_one();
+                break;
+            }
+        }
+    }
+}
+
+//==============================================================================
+strategy_runtime::market_slot* strategy_runtime::steal(std::size_t thief)
+{
+    // Only steal from a worker with a backlog: a single waiting market is about
+    // to run on its own worker, which still has its data in cache
+    std::size_t victim = workers.size();
+    std::size_t deepest = 1;
+    for (std::size_t i = 0; i < workers.size(); ++i)
+    {
+        const std::size_t depth = workers[i]->queued.load(std::memory_order_relaxed);
+        if (i != thief && depth > deepest)
+        {
+            victim = i;
+            deepest = depth;
+        }
+    }
+    if (victim == workers.size())
+    {
+        return nullptr;
+    }
+
+    worker& w = *workers[victim];
+    std::lock_guard<std::mutex> lock(w.mtx);
+    if (w.ready.size() < 2)
+    {
+        return nullptr;
+    }
+    market_slot* slot = w.ready.back();
+    w.ready.pop_back();
+    w.queued.store(w.ready.size(), std::memory_order_relaxed);
+    ++workers[thief]->steals;
+    return slot;
+}
+
+//==============================================================================
+void strategy_runtime::run_worker(std::size_t index)
+{
+    worker& w = *workers[index];
+    for (;;)
+    {
+        market_slot* slot = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(w.mtx);
+            if (false == w.ready.empty())
+            {
+                slot = w.ready.front();
+                w.ready.pop_front();
+                w.queued.store(w.ready.size(), std::memory_order_relaxed);
+            }
+        }
+        if (nullptr == slot)
+        {
+            slot = steal(index);
+        }
+        if (slot)
+        {
+            run_market(index, *slot);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(w.mtx);
+        if (stopping)
+        {
+            return;
+        }
+        const std::uint64_t generation = steal_generation.load();
+        w.idle = true;
+        w.cv.wait_for(lock, std::chrono::milliseconds(10), [&]()
+        {
+            return stopping || false == w.ready.empty() || steal_generation.load() != generation;
+        });
+        w.idle = false;
+    }
+}
+
+//==============================================================================
+void strategy_runtime::run_market(std::size_t index, market_slot& slot)
+{
+    worker& w = *workers[index];
+    const clock_type::time_point start = clock_type::now();
+
+    std::vector<market_event> batch;
+    {
+        std::lock_guard<std::mutex> lock(slot.mtx);
+        const std::size_t n = std::min(batch_limit, slot.inbox.size());
+        batch.reserve(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            batch.push_back(std::move(slot.inbox.front()));
+            slot.inbox.pop_front();
+        }
+    }
+
+    for (market_event& event : batch)
+    {
+        const clock_type::time_point now = clock_type::now();
+        const std::uint64_t latency = elapsed_ns(event.posted, now);
+        w.latency_total_ns.fetch_add(latency, std::memory_order_relaxed);
+        update_max(w.latency_max_ns, latency);
+        w.events.fetch_add(1, std::memory_order_relaxed);
+        try
+        {
+            if (event.is_update)
+            {
+                if (event.update.first_image)
+                {
+                    slot.full_book = event.update.book;
+                }
+                else
+                {
+                    copy_market_fields(slot.full_book, event.update.book);
+                    merge_runners(slot.full_book.runners, event.update.book.runners);
+                }
+                slot.strat->on_market_update(slot, event.update);
+            }
+            else
+            {
+                --slot.outstanding;
+                ++order_events;
+                slot.strat->on_order_event(slot, event.order);
+            }
+        }
+        catch(std::exception const& e)
+        {
+            ++callback_errors;
+            record_error(std::string("bfapi::runtime::strategy_runtime callback exception occurred (market ") + slot.id + "): " + std::string(e.what()));
+        }
+    }
+
+    // Requeue behind the worker's other markets if more arrived, otherwise release the market
+    // to whichever worker its next event finds it on (this one, unless it was stolen)
+    bool requeue = false;
+    {
+        std::lock_guard<std::mutex> lock(slot.mtx);
+        slot.home = index;
+        requeue = (false == slot.inbox.empty());
+        slot.scheduled = requeue;
+    }
+    w.batches.fetch_add(1, std::memory_order_relaxed);
+    w.busy_ns.fetch_add(elapsed_ns(start, clock_type::now()), std::memory_order_relaxed);
+    pending -= static_cast<std::int64_t>(batch.size());
+    if (requeue)
+    {
+        enqueue(index, &slot);
+    }
+}
+
+//==============================================================================
+std::uint64_t strategy_runtime::submit(market_context& context, const order_intent& intent)
+{
+    market_slot& slot = static_cast<market_slot&>(context);
+    order_intent submitted(intent);
+    submitted.id = next_intent++;
+    ++slot.outstanding;
+    ++intents_submitted;
+    ++pending;
+    if (0 == submit_threads)
+    {
+        execute(slot, submitted);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(submit_mtx);
+        submissions.emplace_back(&slot, submitted);
+        submit_cv.notify_one();
+    }
+    return submitted.id;
+}
+
+//==============================================================================
+void strategy_runtime::execute(market_slot& slot, const order_intent& intent)
+{
+    market_event event;
+    event.is_update = false;
+    event.order.intent_id = intent.id;
+    event.order.type = intent.type;
+    try
+    {
+        if (executor)
+        {
+            event.order.ok = executor(intent, event.order);
+        }
+        else
+        {
+            event.order.error = "bfapi::runtime::strategy_runtime error: No order executor";
+        }
+    }
+    catch(std::exception const& e)
+    {
+        event.order.ok = false;
+        event.order.error = std::string("bfapi::runtime::strategy_runtime executor exception occurred: ") + std::string(e.what());
+    }
+    if (false == event.order.ok)
+    {
+        ++intents_failed;
+    }
+    event.posted = clock_type::now();
+    dispatch(slot, std::move(event));
+    --pending;
+}
+
+//==============================================================================
+void strategy_runtime::run_submitter()
+{
+    for (;;)
+    {
+        std::unique_lock<std::mutex> lock(submit_mtx);
+        submit_cv.wait(lock, [this]() { return stopping || false == submissions.empty(); });
+        if (submissions.empty())
+        {
+            return;
+        }
+        submission s = std::move(submissions.front());
+        submissions.pop_front();
+        lock.unlock();
+        execute(*s.slot, s.intent);
+    }
+}
+
+//==============================================================================
+void strategy_runtime::record_error(const std::string& error)
+{
+    std::lock_guard<std::mutex> lock(error_mtx);
+    error_text = error;
+}
+
+} // end of namespace bfapi::runtime
+} // end of namespace bfapi
@@ -0,0 +1,300 @@
+//==============================================================================
+//
+// Event driven strategy runtime: market updates and order events are delivered
+// to per market strategy objects running on a fixed set of worker threads.
+//
+// Every market belongs to exactly one worker at a time and its events are
+// delivered in order by that worker, so a strategy's state needs no locks.
+// Markets are spread round robin over the workers when added. A worker with
+// nothing to do steals a waiting market from the back of the busiest worker's
+// run queue and becomes its new owner, so uneven load is rebalanced without
+// markets ever running on two threads at once.
+//
+// Callback latency is bounded in two ways: a market processes at most
+// batch_limit events before going to the back of its worker's queue, and
+// consecutive market updates still waiting for a busy market are merged into
+// one (the runners of the later update replace those of the earlier one) so a
+// slow strategy sees the latest book rather than an ever growing backlog.
+//
+// Strategies emit order intents (place, cancel, replace) through their
+// market_context. Intents are handed to an order_executor, either inline on
+// the market's worker or on a separate pool of submission threads, and the
+// result comes back to the same strategy as an order_event after the current
+// callback has returned. live_executor() sends intents to the exchange over a
+// connection_pool; tests and backtests can supply one that calls a
+// simulator::market_simulator instead.
+//
+//==============================================================================
+#ifndef BFAPI_RUNTIME_HPP
+#define BFAPI_RUNTIME_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+#include "connection.hpp"
+#include "orders.hpp"
+#include "polling.hpp"
+#include "responses.hpp"
+
+namespace bfapi {
+namespace runtime {
+
+enum class intent_type { place, cancel, replace };
+
+struct order_intent {
+	std::uint64_t id;                   // Assigned by the runtime on submission
+	intent_type type;
+	bfapi::orders::place_orders_request place;          // Only the member matching type is used
+	bfapi::orders::cancel_orders_request cancel;
+	bfapi::orders::replace_orders_request replace;
+
+	explicit order_intent(const bfapi::orders::place_orders_request& r) : id(0), type(intent_type::place), place(r),
+	                                                                       cancel(r.market_id, std::vector<bfapi::orders::cancel_instruction>()),
+	                                                                       replace(r.market_id, false, std::vector<bfapi::orders::replace_instruction>()) {}
+	explicit order_intent(const bfapi::orders::place_limit_orders_request& r) : id(0), type(intent_type::place),
+	                                                                             place(r.market_id, r.async_placement, bfapi::orders::place_instruction_batch(r.instructions_list)),
+	                                                                             cancel(r.market_id, std::vector<bfapi::orders::cancel_instruction>()),
+	                                                                             replace(r.market_id, false, std::vector<bfapi::orders::replace_instruction>()) {}
+	explicit order_intent(const bfapi::orders::cancel_orders_request& r) : id(0), type(intent_type::cancel),
+	                                                                        place(r.market_id, false, bfapi::orders::place_instruction_batch()), cancel(r),
+	                                                                        replace(r.market_id, false, std::vector<bfapi::orders::replace_instruction>()) {}
+	explicit order_intent(const bfapi::orders::replace_orders_request& r) : id(0), type(intent_type::replace),
+	                                                                         place(r.market_id, false, bfapi::orders::place_instruction_batch()),
+	                                                                         cancel(r.market_id, std::vector<bfapi::orders::cancel_instruction>()), replace(r) {}
+
+	const std::string& market_id() const;
+};
+
+struct order_event {
+	std::uint64_t intent_id;
+	intent_type type;
+	bool ok;                            // The executor succeeded and the report status is SUCCESS
+	std::string error;
+	bfapi::responses::place_execution_report place_report;      // Only the report matching type is populated
+	bfapi::responses::cancel_execution_report cancel_report;
+	bfapi::responses::replace_execution_report replace_report;
+
+	order_event() : intent_id(0), type(intent_type::place), ok(false) {}
+};
+
+// Carries out an intent and fills in the matching report of event. Returns true on success.
+typedef std::function<bool(const order_intent&, order_event&)> order_executor;
+
+// Executor sending intents to placeOrders, cancelOrders or replaceOrders through pool
+order_executor live_executor(bfapi::connection_pool& pool);
+
+class strategy_runtime;
+class strategy;
+
+// A strategy's view of its market, only valid inside its callbacks
+class market_context {
+public:
+	const std::string& market_id() const { return id; }
+
+	// The complete book with every update so far applied
+	const bfapi::responses::market_book& book() const { return full_book; }
+
+	// Submit an order intent. The result arrives later as an order_event. Returns the intent id.
+	std::uint64_t place(const bfapi::orders::place_limit_orders_request& request);
+	std::uint64_t place(const bfapi::orders::place_orders_request& request);
+	std::uint64_t cancel(const bfapi::orders::cancel_orders_request& request);
+	std::uint64_t replace(const bfapi::orders::replace_orders_request& request);
+
+	// Intents submitted whose order_event has not been delivered yet
+	std::size_t pending_intents() const { return outstanding; }
+
+protected:
+	friend class strategy_runtime;
+	market_context(strategy_runtime& rt, const std::string& market_id) : runtime(rt), id(market_id), outstanding(0) {}
+
+	strategy_runtime& runtime;
+	std::string id;
+	bfapi::responses::market_book full_book;
+	std::size_t outstanding;
+};
+
+class strategy {
+public:
+	virtual ~strategy() {}
+
+	// update.book holds the market fields and only the runners that changed; context.book() is already up to date
+	virtual void on_market_update(market_context& context, const bfapi::polling::book_update& update) = 0;
+	virtual void on_order_event(market_context& context, const order_event& event) { (void)context; (void)event; }
+};
+
+// Creates the strategy for a market; may return null to ignore the market
+typedef std::function<std::unique_ptr<strategy>(const std::string& market_id)> strategy_factory;
+
+struct worker_stats {
+	std::uint64_t events;               // Callbacks made
+	std::uint64_t batches;              // Times a market was run
+	std::uint64_t steals;               // Markets taken from other workers
+	std::uint64_t busy_ns;              // Time spent running markets
+	std::uint64_t latency_total_ns;     // From an event being posted to its callback starting
+	std::uint64_t latency_max_ns;
+
+	worker_stats() : events(0), batches(0), steals(0), busy_ns(0), latency_total_ns(0), latency_max_ns(0) {}
+
+	double mean_latency_us() const { return events > 0 ? latency_total_ns / 1000.0 / events : 0.0; }
+};
+
+struct runtime_stats {
+	std::uint64_t markets;
+	std::uint64_t updates_posted;
+	std::uint64_t updates_coalesced;    // Merged into an update that was still waiting
+	std::uint64_t order_events;
+	std::uint64_t intents_submitted;
+	std::uint64_t intents_failed;
+	std::uint64_t callback_errors;      // Exceptions thrown by strategies
+	worker_stats total;                 // Sum over workers (latency_max_ns is the maximum)
+
+	runtime_stats() : markets(0), updates_posted(0), updates_coalesced(0), order_events(0), intents_submitted(0),
+	                  intents_failed(0), callback_errors(0) {}
+};
+
+class strategy_runtime {
+public:
+	// workers = 0 uses one per hardware thread. submit_threads = 0 runs the executor
+	// inline on the market's worker, which suits in-process executors such as the
+	// simulator; a blocking executor such as live_executor() needs its own threads.
+	strategy_runtime(const strategy_factory& factory,
+	                 const order_executor& executor,
+	                 std::size_t workers = 0,
+	                 std::size_t submit_threads = 2);
+	~strategy_runtime();    // Calls stop()
+
+	strategy_runtime(const strategy_runtime&) = delete;
+	strategy_runtime& operator=(const strategy_runtime&) = delete;
+
+	// Settings applied by start()
+	void set_pin_threads(bool enable) { pin_threads = enable; }     // Bind worker n to CPU n (Linux only)
+	void set_batch_limit(std::size_t events) { batch_limit = events > 0 ? events : 1; }
+	void set_coalescing(bool enable) { coalesce = enable; }
+
+	bool start(std::string& error);
+
+	// Deliver every event already posted, including the results of intents they
+	// submit, then stop the threads. Strategies are kept until destruction.
+	void stop();
+
+	// Create the strategy for a market now rather than on its first update
+	bool add_market(const std::string& market_id);
+
+	// Post an update from any thread. Markets not seen before are added using the factory.
+	void post(const bfapi::polling::book_update& update);
+	void post(const bfapi::responses::market_book& book);    // Treated as a complete image
+
+	// Handler for market_book_poller::poll_once() that posts every update
+	bfapi::polling::market_book_poller::update_handler update_handler();
+
+	std::size_t worker_count() const { return workers.size(); }
+	std::size_t market_count() const;
+	runtime_stats get_stats() const;
+	std::vector<worker_stats> get_worker_stats() const;
+	std::string last_error() const;
+
+private:
+	friend class market_context;
+
+	struct market_event {
+		bool is_update;
+		bfapi::polling::book_update update;
+		order_event order;
+		std::chrono::steady_clock::time_point posted;
+
+		market_event() : is_update(true) {}
+	};
+
+	// The context handed to the strategy is the slot itself
+	struct market_slot : public market_context {
+		std::unique_ptr<strategy> strat;
+		std::mutex mtx;
+		std::deque<market_event> inbox;
+		bool scheduled;                 // In a worker's run queue or being run
+		std::size_t home;               // Worker that runs the market next
+
+		market_slot(strategy_runtime& rt, const std::string& market_id, std::size_t worker) : market_context(rt, market_id), scheduled(false), home(worker) {}
+	};
+
+	struct worker {
+		std::mutex mtx;
+		std::condition_variable cv;
+		std::deque<market_slot*> ready;
+		std::atomic<std::size_t> queued;
+		std::atomic<bool> idle;
+		std::thread thread;
+
+		std::atomic<std::uint64_t> events;
+		std::atomic<std::uint64_t> batches;
+		std::atomic<std::uint64_t> steals;
+		std::atomic<std::uint64_t> busy_ns;
+		std::atomic<std::uint64_t> latency_total_ns;
+		std::atomic<std::uint64_t> latency_max_ns;
+
+		worker() : queued(0), idle(false), events(0), batches(0), steals(0), busy_ns(0), latency_total_ns(0), latency_max_ns(0) {}
+	};
+
+	struct submission {
+		market_slot* slot;
+		order_intent intent;
+
+		submission(market_slot* s, const order_intent& i) : slot(s), intent(i) {}
+	};
+
+	market_slot* find_or_add(const std::string& market_id);
+	void dispatch(market_slot& slot, market_event&& event);
+	void enqueue(std::size_t index, market_slot* slot);
+	market_slot* steal(std::size_t thief);
+	void run_worker(std::size_t index);
+	void run_market(std::size_t index, market_slot& slot);
+	std::uint64_t submit(market_context& context, const order_intent& intent);
+	void execute(market_slot& slot, const order_intent& intent);
+	void run_submitter();
+	void record_error(const std::string& error);
+
+	strategy_factory factory;
+	order_executor executor;
+	std::size_t submit_threads;
+	bool pin_threads;
+	std::size_t batch_limit;
+	bool coalesce;
+
+	std::vector<std::unique_ptr<worker>> workers;
+	std::unordered_map<std::string, std::unique_ptr<market_slot>> markets;
+	std::size_t next_home;
+	mutable std::mutex markets_mtx;
+
+	std::deque<submission> submissions;
+	std::vector<std::thread> submitters;
+	std::mutex submit_mtx;
+	std::condition_variable submit_cv;
+
+	std::atomic<bool> running;
+	std::atomic<bool> stopping;
+	std::atomic<std::int64_t> pending;  // Events queued plus intents not yet executed
+	std::atomic<std::uint64_t> steal_generation;    // Bumped to wake idle workers when a queue backs up
+	std::atomic<std::uint64_t> next_intent;
+
+	std::atomic<std::uint64_t> updates_posted;
+	std::atomic<std::uint64_t> updates_coalesced;
+	std::atomic<std::uint64_t> order_events;
+	std::atomic<std::uint64_t> intents_submitted;
+	std::atomic<std::uint64_t> intents_failed;
+	std::atomic<std::uint64_t> callback_errors;
+	std::string error_text;
+	mutable std::mutex error_mtx;
+};
+
+} // end of namespace bfapi::runtime
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,509 @@
+#include "shm_book.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bfapi {
+namespace shm {
+
+namespace {
+
+//==============================================================================
+std::int64_t now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+//==============================================================================
+void copy_string(char* dest, std::size_t size, const std::string& src)
+{
+    const std::size_t n = std::min(size - 1, src.size());
+    std::memcpy(dest, src.data(), n);
+    std::memset(dest + n, 0, size - n);
+}
+
+//==============================================================================
+std::string read_string(const char* src, std::size_t size)
+{
+    return std::string(src, strnlen(src, size));
+}
+
+//==============================================================================
+std::size_t round_up(std::size_t n, std::size_t to)
+{
+    return (n + to - 1) / to * to;
+}
+
+//==============================================================================
+std::size_t block_bytes(std::uint32_t max_runners)
+{
+    return round_up(sizeof(shm_market) + max_runners * sizeof(shm_runner), 64);
+}
+
+//==============================================================================
+void write_runner(shm_runner& r, const bfapi::responses::runner_book& rb)
+{
+    r.selection_id = rb.selection_id;
+    r.handicap = rb.handicap;
+    r.last_price_traded = rb.last_price_traded;
+    r.total_matched = rb.total_matched;
+    copy_string(r.status, sizeof(r.status), rb.status);
+    r.back_count = static_cast<std::uint32_t>(std::min<std::size_t>(shm_depth, rb.available_to_back.size()));
+    r.lay_count = static_cast<std::uint32_t>(std::min<std::size_t>(shm_depth, rb.available_to_lay.size()));
+    for (std::uint32_t l = 0; l < r.back_count; ++l)
+    {
+        r.back[l].price = rb.available_to_back[l].price;
+        r.back[l].size = rb.available_to_back[l].size;
+    }
+    for (std::uint32_t l = 0; l < r.lay_count; ++l)
+    {
+        r.lay[l].price = rb.available_to_lay[l].price;
+        r.lay[l].size = rb.available_to_lay[l].size;
+    }
+}
+
+// Seqlock write side: the sequence is odd from begin_write() until end_write()
+//==============================================================================
+void begin_write(shm_market& m)
+{
+    m.sequence.store(m.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+//==============================================================================
+void end_write(shm_market& m)
+{
+    m.sequence.store(m.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+} // end of anonymous namespace
+
+//==============================================================================
+shm_publisher::shm_publisher(const std::string& n,
+                             std::uint32_t markets,
+                             std::uint32_t runners) : name("/" + n),
+                                                      max_markets(markets > 0 ? markets : 1),
+                                                      max_runners(runners > 0 ? runners : 1),
+                                                      block_size(block_bytes(max_runners)),
+                                                      region_size(sizeof(shm_header) + max_markets * block_size),
+                                                      fd(-1),
+                                                      base(nullptr)
+{
+}
+
+//==============================================================================
+shm_publisher::~shm_publisher()
+{
+    if (base)
+    {
+        munmap(base, region_size);
+        shm_unlink(name.c_str());
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+}
+
+//==============================================================================
+bool shm_publisher::create(std::string& error)
+{
+    error = "";
+    std::lock_guard<std::mutex> lock(mtx);
+    if (base)
+    {
+        return true;
+    }
+
+    // Replace any region left behind by a previous publisher so readers never see a stale layout
+    shm_unlink(name.c_str());
+    fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        error = "bfapi::shm::shm_publisher::create() error: shm_open failed: " + std::string(std::strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(region_size)) != 0)
+    {
+        error = "bfapi::shm::shm_publisher::create() error: ftruncate failed: " + std::string(std::strerror(errno));
+        close(fd);
+        fd = -1;
+        shm_unlink(name.c_str());
+        return false;
+    }
+    void* p = mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == p)
+    {
+        error = "bfapi::shm::shm_publisher::create() error: mmap failed: " + std::string(std::strerror(errno));
+        close(fd);
+        fd = -1;
+        shm_unlink(name.c_str());
+        return false;
+    }
+    base = static_cast<char*>(p);
+
+    // ftruncate zero fills the region, so blocks start unused with sequence 0
+    shm_header* h = new (base) shm_header;
+    h->version = layout_version;
+    h->max_markets = max_markets;
+    h->max_runners = max_runners;
+    h->depth = shm_depth;
+    h->block_size = block_size;
+    h->last_publish.store(0, std::memory_order_relaxed);
+    for (std::uint32_t i = 0; i < max_markets; ++i)
+    {
+        new (block(i)) shm_market;
+        block(i)->sequence.store(0, std::memory_order_relaxed);
+        free_slots.push_back(max_markets - 1 - i);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    h->magic = region_magic;
+    return true;
+}
+
+//==============================================================================
+bool shm_publisher::publish(const bfapi::responses::market_book& book, std::string& error)
+{
+    error = "";
+    std::lock_guard<std::mutex> lock(mtx);
+    shm_market* m = acquire_slot(book.market_id, error);
+    if (nullptr == m)
+    {
+        return false;
+    }
+    begin_write(*m);
+    write_market_fields(*m, book);
+    const bool ok = write_runners(*m, book.runners, false, error);
+    end_write(*m);
+    reinterpret_cast<shm_header*>(base)->last_publish.store(m->publish_time, std::memory_order_relaxed);
+    return ok;
+}
+
+//==============================================================================
+bool shm_publisher::publish(const bfapi::polling::book_update& update, std::string& error)
+{
+    error = "";
+    std::lock_guard<std::mutex> lock(mtx);
+    shm_market* m = acquire_slot(update.market_id, error);
+    if (nullptr == m)
+    {
+        return false;
+    }
+    begin_write(*m);
+    write_market_fields(*m, update.book);
+    const bool ok = write_runners(*m, update.book.runners, false == update.first_image, error);
+    end_write(*m);
+    reinterpret_cast<shm_header*>(base)->last_publish.store(m->publish_time, std::memory_order_relaxed);
+    return ok;
+}
+
+//==============================================================================
+bool shm_publisher::remove(const std::string& market_id)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    auto it = slots.find(market_id);
+    if (it == slots.end())
+    {
+        return false;
+    }
+    shm_market* m = block(it->second);
+    begin_write(*m);
+    std::memset(m->market_id, 0, sizeof(m->market_id));
+    m->runner_count = 0;
+    end_write(*m);
+    free_slots.push_back(it->second);
+    slots.erase(it);
+    return true;
+}
+
+//==============================================================================
+std::size_t shm_publisher::market_count() const
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return slots.size();
+}
+
+//==============================================================================
+shm_market* shm_publisher::block(std::uint32_t slot) const
+{
+    return reinterpret_cast<shm_market*>(base + sizeof(shm_header) + slot * block_size);
+}
+
+//==============================================================================
+shm_market* shm_publisher::acquire_slot(const std::string& market_id, std::string& error)
+{
+    if (nullptr == base)
+    {
+        error = "bfapi::shm::shm_publisher error: Region has not been created!";
+        return nullptr;
+    }
+    auto it = slots.find(market_id);
+    if (it != slots.end())
+    {
+        return block(it->second);
+    }
+    if (market_id.empty() || market_id.size() >= sizeof(shm_market::market_id))
+    {
+        error = "bfapi::shm::shm_publisher error: Invalid market ID \"" + market_id + "\"";
+        return nullptr;
+    }
+    if (free_slots.empty())
+    {
+        error = "bfapi::shm::shm_publisher error: No free market blocks (max_markets = " + std::to_string(max_markets) + ")";
+        return nullptr;
+    }
+    const std::uint32_t slot = free_slots.back();
+    free_slots.pop_back();
+    slots[market_id] = slot;
+
+    shm_market* m = block(slot);
+    begin_write(*m);
+    copy_string(m->market_id, sizeof(m->market_id), market_id);
+    m->runner_count = 0;
+    end_write(*m);
+    return m;
+}
+
+//==============================================================================
+void shm_publisher::write_market_fields(shm_market& m, const bfapi::responses::market_book& book)
+{
+    copy_string(m.status, sizeof(m.status), book.status);
+    m.version = book.version;
+    m.publish_time = now_ms();
+    m.total_matched = book.total_matched;
+    m.total_available = book.total_available;
+    m.inplay = book.inplay ? 1 : 0;
+}
+
+//==============================================================================
+bool shm_publisher::write_runners(shm_market& m,
+                                  const std::vector<bfapi::responses::runner_book>& runners,
+                                  bool merge,
+                                  std::string& error)
+{
+    shm_runner* slots_begin = runners_of(m);
+    if (false == merge)
+    {
+        m.runner_count = 0;
+    }
+    std::size_t dropped = 0;
+    for (const bfapi::responses::runner_book& rb : runners)
+    {
+        std::uint32_t i = 0;
+        if (merge)
+        {
+            while (i < m.runner_count && (slots_begin[i].selection_id != rb.selection_id || slots_begin[i].handicap != rb.handicap))
+            {
+                ++i;
+            }
+        }
+        else
+        {
+            i = m.runner_count;
+        }
+        if (i == m.runner_count)
+        {
+            if (m.runner_count == max_runners)
+            {
+                ++dropped;
+                continue;
+            }
+            ++m.runner_count;
+        }
+        write_runner(slots_begin[i], rb);
+    }
+    if (dropped > 0)
+    {
+        error = "bfapi::shm::shm_publisher error: " + std::to_string(dropped) + " runner(s) exceed max_runners = " + std::to_string(max_runners);
+        return false;
+    }
+    return true;
+}
+
+//==============================================================================
+shm_reader::shm_reader(const std::string& n) : name("/" + n),
+                                               region_size(0),
+                                               base(nullptr),
+                                               header(nullptr)
+{
+}
+
+//==============================================================================
+shm_reader::~shm_reader()
+{
+    if (base)
+    {
+        munmap(const_cast<char*>(base), region_size);
+    }
+}
+
+//==============================================================================
+bool shm_reader::open(std::string& error)
+{
+    error = "";
+    if (base)
+    {
+        return true;
+    }
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        error = "bfapi::shm::shm_reader::open() error: shm_open failed: " + std::string(std::strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(shm_header))
+    {
+        error = "bfapi::shm::shm_reader::open() error: Region is missing or too small";
+        ::close(fd);
+        return false;
+    }
+    void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);    // The mapping stays valid
+    if (MAP_FAILED == p)
+    {
+        error = "bfapi::shm::shm_reader::open() error: mmap failed: " + std::string(std::strerror(errno));
+        return false;
+    }
+
+    const shm_header* h = static_cast<const shm_header*>(p);
+    const std::uint64_t magic = h->magic;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (magic != region_magic || h->version != layout_version || h->depth != static_cast<std::uint32_t>(shm_depth) ||
+        h->block_size != block_bytes(h->max_runners) ||
+        static_cast<std::size_t>(st.st_size) < sizeof(shm_header) + h->max_markets * h->block_size)
+    {
+        error = "bfapi::shm::shm_reader::open() error: Region is not initialised or has an incompatible layout";
+        munmap(p, st.st_size);
+        return false;
+    }
+    base = static_cast<const char*>(p);
+    header = h;
+    region_size = st.st_size;
+    return true;
+}
+
+//==============================================================================
+std::vector<std::string> shm_reader::market_ids() const
+{
+    std::vector<std::string> ids;
+    for (std::uint32_t i = 0; header && i < header->max_markets; ++i)
+    {
+        const shm_market* m = block(i);
+        for (int attempt = 0; attempt < max_read_attempts; ++attempt)
+        {
+            const std::uint64_t before = m->sequence.load(std::memory_order_acquire);
+            if (before & 1)
+            {
+                continue;
+            }
+            const std::string id = read_string(m->market_id, sizeof(m->market_id));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m->sequence.load(std::memory_order_relaxed) == before)
+            {
+                if (false == id.empty())
+                {
+                    ids.push_back(id);
+                }
+                break;
+            }
+        }
+    }
+    return ids;
+}
+
+//==============================================================================
+std::uint64_t shm_reader::sequence(const std::string& market_id)
+{
+    const shm_market* m = locate(market_id);
+    return m ? m->sequence.load(std::memory_order_acquire) : 0;
+}
+
+//==============================================================================
+bool shm_reader::read(const std::string& market_id, bfapi::responses::market_book& book)
+{
+    // Copy into local buffers inside the seqlock window and only build the book once the copy is known to be consistent
+    shm_market fields;
+    std::vector<shm_runner> runners;
+    const bool ok = read_view(market_id, [&](const shm_market& m, const shm_runner* r)
+    {
+        std::memcpy(static_cast<void*>(&fields), static_cast<const void*>(&m), sizeof(shm_market));
+        const std::uint32_t count = std::min(m.runner_count, header->max_runners);
+        runners.assign(r, r + count);
+    });
+    if (false == ok)
+    {
+        return false;
+    }
+
+    book = bfapi::responses::market_book();
+    book.market_id = market_id;
+    book.status = read_string(fields.status, sizeof(fields.status));
+    book.version = fields.version;
+    book.inplay = (fields.inplay != 0);
+    book.total_matched = fields.total_matched;
+    book.total_available = fields.total_available;
+    for (const shm_runner& r : runners)
+    {
+        bfapi::responses::runner_book rb;
+        rb.selection_id = r.selection_id;
+        rb.handicap = r.handicap;
+        rb.last_price_traded = r.last_price_traded;
+        rb.total_matched = r.total_matched;
+        rb.status = read_string(r.status, sizeof(r.status));
+        for (std::uint32_t l = 0; l < r.back_count && l < static_cast<std::uint32_t>(shm_depth); ++l)
+        {
+            rb.available_to_back.push_back(bfapi::responses::price_size(r.back[l].price, r.back[l].size));
+        }
+        for (std::uint32_t l = 0; l < r.lay_count && l < static_cast<std::uint32_t>(shm_depth); ++l)
+        {
+            rb.available_to_lay.push_back(bfapi::responses::price_size(r.lay[l].price, r.lay[l].size));
+        }
+        book.runners.push_back(rb);
+    }
+    return true;
+}
+
+//==============================================================================
+std::int64_t shm_reader::last_publish() const
+{
+    return header ? header->last_publish.load(std::memory_order_relaxed) : 0;
+}
+
+//==============================================================================
+const shm_market* shm_reader::locate(const std::string& market_id)
+{
+    if (nullptr == header)
+    {
+        return nullptr;
+    }
+    auto it = slot_cache.find(market_id);
+    if (it != slot_cache.end())
+    {
+        return block(it->second);
+    }
+    for (std::uint32_t i = 0; i < header->max_markets; ++i)
+    {
+        // Unlocked comparison is only a hint; read_view() checks the ID again inside the seqlock
+        const shm_market* m = block(i);
+        if (0 == std::strncmp(m->market_id, market_id.c_str(), sizeof(m->market_id)))
+        {
+            slot_cache[market_id] = i;
+            return m;
+        }
+    }
+    return nullptr;
+}
+
+//==============================================================================
+const shm_market* shm_reader::block(std::uint32_t slot) const
+{
+    return reinterpret_cast<const shm_market*>(base + sizeof(shm_header) + slot * header->block_size);
+}
+
+} // end of namespace bfapi::shm
+} // end of namespace bfapi
@@ -0,0 +1,224 @@
+//==============================================================================
+//
+// Publication of market books through POSIX shared memory so that several
+// strategy processes can share one login, one set of connections and one
+// market data feed.
+//
+// The publishing process (typically running a polling::market_book_poller)
+// owns a named shared memory region divided into fixed size blocks, one per
+// market. Each block is versioned with a seqlock: the publisher makes the
+// sequence number odd, writes the block and makes it even again. Readers in
+// other processes map the region read only and copy (or inspect in place) a
+// block between two reads of its sequence number, retrying if it changed in
+// between. Neither side takes a lock or makes a system call after setup, and
+// readers never slow the publisher down.
+//
+// Blocks hold market level fields and, per runner, the best shm_depth levels
+// on each side of the book plus last price traded and total matched. The full
+// traded volume ladder is not published as it has no fixed size.
+//
+// On Linux the region appears as /dev/shm/<name>. Link with -lrt on systems
+// where shm_open() is not part of libc.
+//
+//==============================================================================
+#ifndef BFAPI_SHM_BOOK_HPP
+#define BFAPI_SHM_BOOK_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include "responses.hpp"
+#include "polling.hpp"
+
+namespace bfapi {
+namespace shm {
+
+const std::uint64_t region_magic = 0x4246415049534842ULL;    // "BFAPISHB"
+const std::uint32_t layout_version = 1;
+const int shm_depth = 10;                                     // Price levels per side of each runner
+const int max_read_attempts = 1000;                           // Give up if the publisher keeps a block locked this long
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Shared memory seqlocks need lock free 64 bit atomics");
+
+struct shm_level {
+	double price;
+	double size;
+};
+
+struct shm_runner {
+	std::int64_t selection_id;
+	double handicap;
+	double last_price_traded;
+	double total_matched;
+	char status[16];
+	std::uint32_t back_count;
+	std::uint32_t lay_count;
+	shm_level back[shm_depth];          // availableToBack, best first
+	shm_level lay[shm_depth];           // availableToLay, best first
+};
+
+struct alignas(64) shm_header {
+	std::uint64_t magic;                // Written last by the publisher once the region is initialised
+	std::uint32_t version;
+	std::uint32_t max_markets;
+	std::uint32_t max_runners;
+	std::uint32_t depth;
+	std::uint64_t block_size;           // Bytes per market block, including its runners
+	std::atomic<std::int64_t> last_publish;   // Milliseconds since the epoch, lets readers spot a stalled publisher
+};
+
+struct alignas(64) shm_market {
+	std::atomic<std::uint64_t> sequence;      // Odd while the publisher is writing the block
+	char market_id[24];                 // Empty if the block is unused
+	char status[16];
+	std::int64_t version;
+	std::int64_t publish_time;          // Milliseconds since the epoch
+	double total_matched;
+	double total_available;
+	std::uint32_t inplay;
+	std::uint32_t runner_count;
+	// Followed by max_runners shm_runner records
+};
+
+inline const shm_runner* runners_of(const shm_market& m)
+{
+	return reinterpret_cast<const shm_runner*>(reinterpret_cast<const char*>(&m) + sizeof(shm_market));
+}
+
+inline shm_runner* runners_of(shm_market& m)
+{
+	return reinterpret_cast<shm_runner*>(reinterpret_cast<char*>(&m) + sizeof(shm_market));
+}
+
+class shm_publisher {
+public:
+	// name is the shared memory object name without the leading slash
+	shm_publisher(const std::string& name, std::uint32_t max_markets = 256, std::uint32_t max_runners = 64);
+	~shm_publisher();   // Unmaps and removes the region
+
+	shm_publisher(const shm_publisher&) = delete;
+	shm_publisher& operator=(const shm_publisher&) = delete;
+
+	// Create (or replace) the region and initialise every block
+	bool create(std::string& error);
+	bool is_open() const { return nullptr != base; }
+
+	// Write a complete book, replacing whatever was published for the market.
+	// Runners beyond max_runners are dropped and reported as an error.
+	bool publish(const bfapi::responses::market_book& book, std::string& error);
+
+	// Write a poller update: market level fields plus only the runners that changed
+	bool publish(const bfapi::polling::book_update& update, std::string& error);
+
+	// Stop publishing a market and free its block
+	bool remove(const std::string& market_id);
+
+	std::size_t market_count() const;
+
+private:
+	shm_market* block(std::uint32_t slot) const;
+	shm_market* acquire_slot(const std::string& market_id, std::string& error);
+	void write_market_fields(shm_market& m, const bfapi::responses::market_book& book);
+	bool write_runners(shm_market& m, const std::vector<bfapi::responses::runner_book>& runners, bool merge, std::string& error);
+
+	std::string name;
+	std::uint32_t max_markets;
+	std::uint32_t max_runners;
+	std::size_t block_size;
+	std::size_t region_size;
+	int fd;
+	char* base;
+	std::map<std::string, std::uint32_t> slots;
+	std::vector<std::uint32_t> free_slots;
+	mutable std::mutex mtx;
+};
+
+class shm_reader {
+public:
+	explicit shm_reader(const std::string& name);
+	~shm_reader();
+
+	shm_reader(const shm_reader&) = delete;
+	shm_reader& operator=(const shm_reader&) = delete;
+
+	// Map an existing region created by a shm_publisher
+	bool open(std::string& error);
+	bool is_open() const { return nullptr != base; }
+
+	// Markets currently published
+	std::vector<std::string> market_ids() const;
+
+	// Sequence number of the market's block, which changes on every publish (0 if not published).
+	// Cheap enough to poll to find out whether a new copy is worth taking.
+	std::uint64_t sequence(const std::string& market_id);
+
+	// Consistent copy of a published market. Returns false if the market is not published.
+	bool read(const std::string& market_id, bfapi::responses::market_book& book);
+
+	// Zero copy access: f(const shm_market&, const shm_runner*) is called on the shared
+	// memory itself and may be called again if the publisher wrote the block meanwhile,
+	// so it should only read. Returns true once a call saw a consistent block.
+	template<class F>
+	bool read_view(const std::string& market_id, F f);
+
+	// Time of the publisher's last write, milliseconds since the epoch
+	std::int64_t last_publish() const;
+
+private:
+	const shm_market* locate(const std::string& market_id);
+	const shm_market* block(std::uint32_t slot) const;
+
+	std::string name;
+	std::size_t region_size;
+	const char* base;
+	const shm_header* header;
+	std::map<std::string, std::uint32_t> slot_cache;
+};
+
+//==============================================================================
+template<class F>
+bool shm_reader::read_view(const std::string& market_id, F f)
+{
+	// A cached slot may have been reused for another market, in which case look again once
+	for (int lookup = 0; lookup < 2; ++lookup)
+	{
+		const shm_market* m = locate(market_id);
+		if (nullptr == m)
+		{
+			return false;
+		}
+		for (int attempt = 0; attempt < max_read_attempts; ++attempt)
+		{
+			const std::uint64_t before = m->sequence.load(std::memory_order_acquire);
+			if (before & 1)
+			{
+				continue;
+			}
+			const bool same_market = (0 == std::strncmp(m->market_id, market_id.c_str(), sizeof(m->market_id)));
+			if (same_market)
+			{
+				f(*m, runners_of(*m));
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (m->sequence.load(std::memory_order_relaxed) == before)
+			{
+				if (same_market)
+				{
+					return true;
+				}
+				slot_cache.erase(market_id);
+				break;
+			}
+		}
+	}
+	return false;
+}
+
+} // end of namespace bfapi::shm
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,727 @@
+#include "simulator.hpp"
+#include "dates.hpp"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+using bfapi::responses::market_book;
+using bfapi::responses::runner_book;
+using bfapi::responses::price_size;
+
+namespace bfapi {
+namespace simulator {
+
+namespace {
+
+//==============================================================================
+std::string market_closed_code(const std::string& status)
+{
+    return (status == "SUSPENDED") ? "MARKET_SUSPENDED" : "MARKET_NOT_OPEN_FOR_BETTING";
+}
+
+} // end of anonymous namespace
+
+//==============================================================================
+market_simulator::market_simulator(const std::string& id, std::int64_t first_bet_id)
+    : market_id(id),
+      next_bet_id(first_bet_id),
+      now(0),
+      inplay(false)
+{
+}
+
+//==============================================================================
+void market_simulator::on_market_book(const market_book& book, std::int64_t timestamp)
+{
+    ++stats.books;
+    now = timestamp;
+    const bool was_inplay = inplay;
+    status = book.status;
+    inplay = book.inplay;
+    const bool open = (status == "OPEN");
+
+    for (const runner_book& rb : book.runners)
+    {
+        runner_state* runner = find_runner(rb.selection_id);
+        if (nullptr == runner)
+        {
+            runners.emplace_back();
+            runner = &runners.back();
+            runner->selection_id = rb.selection_id;
+        }
+
+        // Remember the previous state at each resting order's price before loading the new one
+        prev_queue.clear();
+        prev_traded.clear();
+        for (std::size_t i : runner->resting)
+        {
+            const sim_order& order = orders[i];
+            prev_queue.push_back(order.lay_side ? runner->raw_back[order.tick] : runner->raw_lay[order.tick]);
+            prev_traded.push_back(runner->traded[order.tick]);
+        }
+        load_runner(*runner, rb);
+
+        if (open && false == runner->resting.empty())
+        {
+            update_resting(*runner);
+        }
+        if (false == runner->active)
+        {
+            lapse(*runner, true);
+        }
+    }
+
+    if (status == "CLOSED")
+    {
+        for (runner_state& runner : runners)
+        {
+            lapse(runner, true);
+        }
+    }
+    else if (inplay && false == was_inplay)
+    {
+        for (runner_state& runner : runners)
+        {
+            lapse(runner, false);
+        }
+    }
+    dispatch_fills();
+}
+
+//==============================================================================
+bool market_simulator::place_orders(const bfapi::orders::place_limit_orders_request& request,
+                                    bfapi::responses::place_execution_report& report)
+{
+    return place_orders(bfapi::orders::place_orders_request(request.market_id, request.async_placement,
+                                                             bfapi::orders::place_instruction_batch(request.instructions_list)),
+                        report);
+}
+
+//==============================================================================
+bool market_simulator::place_orders(const bfapi::orders::place_orders_request& request,
+                                    bfapi::responses::place_execution_report& report)
+{
+    report = bfapi::responses::place_execution_report();
+    report.market_id = request.market_id;
+    if (request.market_id != market_id)
+    {
+        report.status = "FAILURE";
+        report.error_code = "INVALID_MARKET_ID";
+        return false;
+    }
+    if (status != "OPEN")
+    {
+        report.status = "FAILURE";
+        report.error_code = market_closed_code(status);
+        return false;
+    }
+    const bfapi::orders::place_instruction_batch& instructions = request.instructions;
+    if (instructions.empty())
+    {
+        report.status = "FAILURE";
+        report.error_code = "INVALID_INPUT_DATA";
+        return false;
+    }
+
+    // Validate everything first: the live API rejects the whole request if any instruction is invalid
+    std::vector<std::string> codes;
+    bool failed = false;
+    for (std::size_t i = 0; i < instructions.size(); ++i)
+    {
+        codes.push_back(validate(instructions, i));
+        failed = failed || (false == codes.back().empty());
+    }
+
+    for (std::size_t i = 0; i < instructions.size(); ++i)
+    {
+        bfapi::responses::instruction_report ir;
+        if (failed)
+        {
+            ir.status = "FAILURE";
+            ir.error_code = codes[i].empty() ? "ERROR_IN_ORDER" : codes[i];
+            ir.selection_id = instructions.selection_id(i);
+            ir.customer_order_ref = instructions.co_ref(i).str();
+            ++stats.orders_rejected;
+        }
+        else
+        {
+            const std::size_t index = add_order(instructions.selection_id(i), instructions.lay_side(i), instructions.amount(i),
+                                                instructions.price(i), instructions.persist(i), instructions.co_ref(i).str());
+            match_on_entry(*find_runner(instructions.selection_id(i)), index);
+            ir.status = "SUCCESS";
+            fill_place_report(orders[index], ir);
+        }
+        report.instruction_reports.push_back(ir);
+    }
+
+    report.status = failed ? "FAILURE" : "SUCCESS";
+    report.error_code = failed ? "BET_ACTION_ERROR" : "";
+    dispatch_fills();
+    return false == failed;
+}
+
+//==============================================================================
+bool market_simulator::cancel_orders(const bfapi::orders::cancel_orders_request& request,
+                                     bfapi::responses::cancel_execution_report& report)
+{
+    report = bfapi::responses::cancel_execution_report();
+    report.market_id = request.market_id;
+    if (request.market_id != market_id)
+    {
+        report.status = "FAILURE";
+        report.error_code = "INVALID_MARKET_ID";
+        return false;
+    }
+
+    std::vector<bfapi::orders::cancel_instruction> instructions = request.instructions_list;
+    if (instructions.empty())
+    {
+        for (const sim_order& order : orders)
+        {
+            if (order.executable())
+            {
+                instructions.push_back(bfapi::orders::cancel_instruction(order.bet_id));
+            }
+        }
+    }
+
+    std::size_t succeeded = 0;
+    for (const bfapi::orders::cancel_instruction& instruction : instructions)
+    {
+        bfapi::responses::cancel_instruction_report cr;
+        cr.bet_id = instruction.bet_id;
+        cr.size_reduction = instruction.size_reduction;
+        auto it = order_index.find(instruction.bet_id);
+        if (it == order_index.end())
+        {
+            cr.status = "FAILURE";
+            cr.error_code = "INVALID_BET_ID";
+        }
+        else if (false == orders[it->second].executable())
+        {
+            cr.status = "FAILURE";
+            cr.error_code = "BET_TAKEN_OR_LAPSED";
+        }
+        else
+        {
+            cr.status = "SUCCESS";
+            cr.size_cancelled = cancel_unmatched(orders[it->second], instruction.size_reduction);
+            cr.cancelled_date = bfapi::dates::to_iso8601_ms(now);
+            ++stats.orders_cancelled;
+            ++succeeded;
+        }
+        report.instruction_reports.push_back(cr);
+    }
+    for (runner_state& runner : runners)
+    {
+        prune(runner);
+    }
+
+    const bool ok = (succeeded == instructions.size());
+    report.status = ok ? "SUCCESS" : (succeeded > 0 ? "PROCESSED_WITH_ERRORS" : "FAILURE");
+    report.error_code = ok ? "" : "BET_ACTION_ERROR";
+    return ok;
+}
+
+//==============================================================================
+bool market_simulator::replace_orders(const bfapi::orders::replace_orders_request& request,
+                                      bfapi::responses::replace_execution_report& report)
+{
+    report = bfapi::responses::replace_execution_report();
+    report.market_id = request.market_id;
+    if (request.market_id != market_id)
+    {
+        report.status = "FAILURE";
+        report.error_code = "INVALID_MARKET_ID";
+        return false;
+    }
+    if (status != "OPEN")
+    {
+        report.status = "FAILURE";
+        report.error_code = market_closed_code(status);
+        return false;
+    }
+
+    std::size_t succeeded = 0;
+    for (const bfapi::orders::replace_instruction& instruction : request.instructions_list)
+    {
+        bfapi::responses::replace_instruction_report rr;
+        rr.cancel_report.bet_id = instruction.bet_id;
+        auto it = order_index.find(instruction.bet_id);
+        if (it == order_index.end())
+        {
+            rr.error_code = "INVALID_BET_ID";
+        }
+        else if (false == orders[it->second].executable())
+        {
+            rr.error_code = "BET_TAKEN_OR_LAPSED";
+        }
+        else if (ticks::price_to_tick(instruction.new_price) < 0)
+        {
+            rr.error_code = "INVALID_ODDS";
+        }
+
+        if (false == rr.error_code.empty())
+        {
+            rr.status = "FAILURE";
+            rr.cancel_report.status = "FAILURE";
+            rr.cancel_report.error_code = rr.error_code;
+        }
+        else
+        {
+            // Copy what the new order needs: add_order() may reallocate orders
+            const sim_order original = orders[it->second];
+            rr.cancel_report.status = "SUCCESS";
+            rr.cancel_report.size_cancelled = cancel_unmatched(orders[it->second], 0.0);
+            rr.cancel_report.cancelled_date = bfapi::dates::to_iso8601_ms(now);
+
+            const std::size_t index = add_order(original.selection_id, original.lay_side, rr.cancel_report.size_cancelled,
+                                                instruction.new_price, original.persist, original.customer_order_ref);
+            match_on_entry(*find_runner(original.selection_id), index);
+            rr.place_report.status = "SUCCESS";
+            fill_place_report(orders[index], rr.place_report);
+            rr.status = "SUCCESS";
+            ++stats.orders_replaced;
+            ++succeeded;
+        }
+        report.instruction_reports.push_back(rr);
+    }
+    for (runner_state& runner : runners)
+    {
+        prune(runner);
+    }
+
+    const bool ok = (succeeded == request.instructions_list.size());
+    report.status = ok ? "SUCCESS" : (succeeded > 0 ? "PROCESSED_WITH_ERRORS" : "FAILURE");
+    report.error_code = ok ? "" : "BET_ACTION_ERROR";
+    dispatch_fills();
+    return ok;
+}
+
+//==============================================================================
+const sim_order* market_simulator::find_order(const std::string& bet_id) const
+{
+    auto it = order_index.find(bet_id);
+    return (it == order_index.end()) ? nullptr : &orders[it->second];
+}
+
+//==============================================================================
+market_simulator::runner_state* market_simulator::find_runner(std::int64_t selection_id)
+{
+    // Markets have few runners so a linear search beats hashing
+    for (runner_state& runner : runners)
+    {
+        if (runner.selection_id == selection_id)
+        {
+            return &runner;
+        }
+    }
+    return nullptr;
+}
+
+//==============================================================================
+std::string market_simulator::validate(const bfapi::orders::place_instruction_batch& instructions, std::size_t i)
+{
+    // Nothing is settled at the starting price, so its order types are refused as by a market without BSP
+    if (instructions.type(i) != bfapi::orders::order_type::limit)
+    {
+        return "MARKET_NOT_OPEN_FOR_BSP_BETTING";
+    }
+    const runner_state* runner = find_runner(instructions.selection_id(i));
+    if (nullptr == runner)
+    {
+        return "INVALID_RUNNER";
+    }
+    if (false == runner->active)
+    {
+        return "RUNNER_REMOVED";
+    }
+    if (ticks::price_to_tick(instructions.price(i)) < 0)
+    {
+        return "INVALID_ODDS";
+    }
+    if (instructions.amount(i) <= 0.0)
+    {
+        return "INVALID_BET_SIZE";
+    }
+    return "";
+}
+
+//==============================================================================
+std::size_t market_simulator::add_order(std::int64_t selection_id,
+                                        bool lay_side,
+                                        double size,
+                                        double price,
+                                        bool persist,
+                                        const std::string& customer_order_ref)
+{
+    sim_order order;
+    order.bet_id = std::to_string(next_bet_id++);
+    order.selection_id = selection_id;
+    order.lay_side = lay_side;
+    order.tick = ticks::price_to_tick(price);
+    order.price = ticks::tick_to_price(order.tick);
+    order.size = size;
+    order.persist = persist;
+    order.customer_order_ref = customer_order_ref;
+    order.placed_time = now;
+    orders.push_back(order);
+    order_index[order.bet_id] = orders.size() - 1;
+    ++stats.orders_placed;
+    return orders.size() - 1;
+}
+
+//==============================================================================
+void market_simulator::load_runner(runner_state& runner, const runner_book& rb)
+{
+    // Only the ticks of the previous snapshot need clearing
+    for (int t : runner.back_ticks)
+    {
+        runner.raw_back[t] = 0.0;
+    }
+    for (int t : runner.lay_ticks)
+    {
+        runner.raw_lay[t] = 0.0;
+    }
+    runner.back_ticks.clear();
+    runner.lay_ticks.clear();
+    for (const price_size& ps : rb.available_to_back)
+    {
+        const int t = ticks::price_to_tick(ps.price);
+        if (t >= 0 && ps.size > 0.0)
+        {
+            runner.raw_back[t] = ps.size;
+            runner.back_ticks.push_back(t);
+        }
+    }
+    for (const price_size& ps : rb.available_to_lay)
+    {
+        const int t = ticks::price_to_tick(ps.price);
+        if (t >= 0 && ps.size > 0.0)
+        {
+            runner.raw_lay[t] = ps.size;
+            runner.lay_ticks.push_back(t);
+        }
+    }
+
+    // Traded volume is cumulative; if it is not in the price projection the ladder simply stays as it was
+    for (const price_size& ps : rb.traded_volume)
+    {
+        const int t = ticks::price_to_tick(ps.price);
+        if (t >= 0)
+        {
+            runner.traded[t] = ps.size;
+        }
+    }
+
+    // Stake leaving a price in the feed releases what we had taken from it first
+    for (taken_level& level : runner.taken)
+    {
+        const double feed = level.back_offer ? runner.raw_back[level.tick] : runner.raw_lay[level.tick];
+        level.size -= std::max(0.0, level.seen - feed);
+        level.seen = feed;
+    }
+    runner.taken.erase(std::remove_if(runner.taken.begin(), runner.taken.end(),
+                                      [](const taken_level& level) { return level.size <= 1e-9; }),
+                       runner.taken.end());
+
+    runner.active = (rb.status.empty() || rb.status == "ACTIVE");
+}
+
+//==============================================================================
+double market_simulator::available(const runner_state& runner, bool back_offer, int tick) const
+{
+    double size = back_offer ? runner.raw_back[tick] : runner.raw_lay[tick];
+    for (const taken_level& level : runner.taken)
+    {
+        if (level.tick == tick && level.back_offer == back_offer)
+        {
+            size -= level.size;
+        }
+    }
+    return std::max(0.0, size);
+}
+
+//==============================================================================
+void market_simulator::take(runner_state& runner, bool back_offer, int tick, sim_order& order, double price)
+{
+    const double size = std::min(order.size_remaining(), available(runner, back_offer, tick));
+    if (size <= 0.0)
+    {
+        return;
+    }
+    bool found = false;
+    for (taken_level& level : runner.taken)
+    {
+        if (level.tick == tick && level.back_offer == back_offer)
+        {
+            level.size += size;
+            found = true;
+        }
+    }
+    if (false == found)
+    {
+        runner.taken.push_back(taken_level(tick, back_offer, size, back_offer ? runner.raw_back[tick] : runner.raw_lay[tick]));
+    }
+    execute(order, size, price);
+}
+
+//==============================================================================
+void market_simulator::match_on_entry(runner_state& runner, std::size_t index)
+{
+    sim_order& order = orders[index];
+    if (false == order.lay_side)
+    {
+        // A back bet takes lay offers (availableToBack) at its price or higher, best first
+        for (std::size_t i = 0; i < runner.back_ticks.size() && order.executable(); ++i)
+        {
+            const int t = runner.back_ticks[i];
+            if (t >= order.tick)
+            {
+                take(runner, true, t, order, ticks::tick_to_price(t));
+            }
+        }
+    }
+    else
+    {
+        // A lay bet takes back offers (availableToLay) at its price or lower, best first
+        for (std::size_t i = 0; i < runner.lay_ticks.size() && order.executable(); ++i)
+        {
+            const int t = runner.lay_ticks[i];
+            if (t <= order.tick)
+            {
+                take(runner, false, t, order, ticks::tick_to_price(t));
+            }
+        }
+    }
+
+    if (order.executable())
+    {
+        // Join the back of the queue: the stake on offer plus our own earlier orders at this price
+        order.queue_ahead = order.lay_side ? runner.raw_back[order.tick] : runner.raw_lay[order.tick];
+        for (std::size_t i : runner.resting)
+        {
+            const sim_order& other = orders[i];
+            if (other.lay_side == order.lay_side && other.tick == order.tick && other.executable())
+            {
+                order.queue_ahead += other.size_remaining();
+            }
+        }
+        runner.resting.push_back(index);
+    }
+}
+
+//==============================================================================
+void market_simulator::update_resting(runner_state& runner)
+{
+    for (std::size_t j = 0; j < runner.resting.size(); ++j)
+    {
+        sim_order& order = orders[runner.resting[j]];
+        if (false == order.executable())
+        {
+            continue;
+        }
+        const int t = order.tick;
+
+        // A resting back bet is offered in availableToLay, a resting lay bet in availableToBack
+        const double old_queue = prev_queue[j];
+        const double new_queue = order.lay_side ? runner.raw_back[t] : runner.raw_lay[t];
+        const double traded = std::max(0.0, runner.traded[t] - prev_traded[j]);
+
+        if (traded > 0.0)
+        {
+            if (traded <= order.queue_ahead)
+            {
+                order.queue_ahead -= traded;
+            }
+            else
+            {
+                const double size = std::min(order.size_remaining(), traded - order.queue_ahead);
+                order.queue_ahead = 0.0;
+                execute(order, size, order.price);
+            }
+        }
+
+        const double cancelled = old_queue - new_queue - traded;
+        if (cancelled > 0.0 && old_queue > 0.0)
+        {
+            order.queue_ahead -= order.queue_ahead * std::min(1.0, cancelled / old_queue);
+        }
+        order.queue_ahead = std::max(0.0, std::min(order.queue_ahead, new_queue));
+
+        // The opposite side now offered at our price or better would have matched us
+        if (false == order.lay_side)
+        {
+            for (std::size_t i = 0; i < runner.back_ticks.size() && order.executable(); ++i)
+            {
+                if (runner.back_ticks[i] >= t)
+                {
+                    take(runner, true, runner.back_ticks[i], order, order.price);
+                }
+            }
+        }
+        else
+        {
+            for (std::size_t i = 0; i < runner.lay_ticks.size() && order.executable(); ++i)
+            {
+                if (runner.lay_ticks[i] <= t)
+                {
+                    take(runner, false, runner.lay_ticks[i], order, order.price);
+                }
+            }
+        }
+    }
+    prune(runner);
+}
+
+//==============================================================================
+void market_simulator::execute(sim_order& order, double size, double price)
+{
+    if (size <= 0.0)
+    {
+        return;
+    }
+    order.size_matched += size;
+    order.matched_value += size * price;
+    ++stats.fills;
+    stats.size_matched += size;
+
+    fill f;
+    f.bet_id = order.bet_id;
+    f.selection_id = order.selection_id;
+    f.lay_side = order.lay_side;
+    f.price = price;
+    f.size = size;
+    f.timestamp = now;
+    pending_fills.push_back(f);
+}
+
+//==============================================================================
+double market_simulator::cancel_unmatched(sim_order& order, double size_reduction)
+{
+    // A partial cancel keeps the order's place in the queue
+    const double remaining = order.size_remaining();
+    const double size = (size_reduction > 0.0 && size_reduction < remaining) ? size_reduction : remaining;
+    order.size_cancelled += size;
+    return size;
+}
+
+//==============================================================================
+void market_simulator::lapse(runner_state& runner, bool lapse_persistent)
+{
+    for (std::size_t i : runner.resting)
+    {
+        sim_order& order = orders[i];
+        if (order.executable() && (lapse_persistent || false == order.persist))
+        {
+            order.size_lapsed += order.size_remaining();
+            ++stats.orders_lapsed;
+        }
+    }
+    prune(runner);
+}
+
+//==============================================================================
+void market_simulator::prune(runner_state& runner)
+{
+    runner.resting.erase(std::remove_if(runner.resting.begin(), runner.resting.end(),
+                                        [this](std::size_t i) { return false == orders[i].executable(); }),
+                         runner.resting.end());
+}
+
+//==============================================================================
+void market_simulator::fill_place_report(const sim_order& order, bfapi::responses::instruction_report& ir) const
+{
+    ir.order_status = order.executable() ? "EXECUTABLE" : "EXECUTION_COMPLETE";
+    ir.bet_id = order.bet_id;
+    ir.placed_date = bfapi::dates::to_iso8601_ms(order.placed_time);
+    ir.average_price_matched = order.average_price_matched();
+    ir.size_matched = order.size_matched;
+    ir.selection_id = order.selection_id;
+    ir.customer_order_ref = order.customer_order_ref;
+}
+
+//==============================================================================
+void market_simulator::dispatch_fills()
+{
+    // The handler may place further orders, which can add fills of their own
+    std::vector<fill> ready;
+    ready.swap(pending_fills);
+    if (on_fill)
+    {
+        for (const fill& f : ready)
+        {
+            on_fill(f);
+        }
+    }
+}
+
+//==============================================================================
+bool run_backtest(const std::vector<market_feed>& feeds,
+                  const strategy_factory& factory,
+                  std::size_t threads,
+                  std::vector<market_result>& results,
+                  std::string& error)
+{
+    error = "";
+    results.clear();
+    results.resize(feeds.size());
+    if (0 == threads)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::min(threads, std::max<std::size_t>(1, feeds.size()));
+
+    std::atomic<std::size_t> next(0);
+    std::mutex error_mtx;
+
+    auto worker = [&]()
+    {
+        for (;;)
+        {
+            const std::size_t n = next++;
+            if (n >= feeds.size())
+            {
+                return;
+            }
+            const market_feed& feed = feeds[n];
+            try
+            {
+                // Give each market its own range of bet ids so they are unique across the run
+                market_simulator sim(feed.market_id, static_cast<std::int64_t>(n) * 1000000000 + 1);
+                book_handler strategy = factory ? factory(feed.market_id) : book_handler();
+                for (const timed_book& tb : feed.books)
+                {
+                    sim.on_market_book(tb.book, tb.timestamp);
+                    if (strategy)
+                    {
+                        strategy(sim, tb.book);
+                    }
+                }
+                results[n].market_id = feed.market_id;
+                results[n].orders = sim.get_orders();
+                results[n].stats = sim.get_stats();
+            }
+            catch(std::exception const& e)
+            {
+                std::lock_guard<std::mutex> lock(error_mtx);
+                error = std::string("bfapi::simulator::run_backtest() exception occurred (market ") + feed.market_id + "): " + std::string(e.what());
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        pool.emplace_back(worker);
+    }
+    for (std::thread& t : pool)
+    {
+        t.join();
+    }
+    return error.empty();
+}
+
+} // end of namespace bfapi::simulator
+} // end of namespace bfapi
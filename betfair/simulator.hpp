@@ -0,0 +1,231 @@
+//==============================================================================
+//
+// In-process exchange simulator for paper trading and backtests.
+//
+// A market_simulator accepts the same place, cancel and replace request types
+// that are sent to the live API (see orders.hpp) and answers with execution
+// reports in the live format (see responses.hpp). Only LIMIT orders are
+// simulated; LIMIT_ON_CLOSE and MARKET_ON_CLOSE instructions are refused. Orders
+// are matched against a replayed feed of listMarketBook snapshots:
+//
+//  - An order that crosses the prices on offer is matched immediately at the
+//    best available prices, consuming that liquidity until the next snapshot.
+//  - The rest of the order joins the back of the queue at its price. The
+//    stake already waiting at that price is recorded as the queue ahead of
+//    it. Traded volume at the price first works through the queue ahead and
+//    then fills the order. Stake cancelled from the price (the offered amount
+//    falling by more than was traded) is assumed to come evenly from the
+//    whole queue, so it moves the order forward proportionally.
+//  - If the market later offers the opposite side at the order's price or
+//    better, the order is matched at its own price.
+//  - The replayed feed does not know about simulated orders, so stake they
+//    take is remembered per price and hidden from later snapshots until the
+//    feed itself shows that much leaving the price.
+//  - LAPSE orders are lapsed when the market turns in play, all unmatched
+//    orders are lapsed when the market closes or their runner is removed.
+//
+// Prices are held per tick of the price ladder (ticks.hpp) and a snapshot only
+// touches the ticks it or the previous snapshot mention, so replaying costs
+// little more than reading the feed. A simulator is single threaded and covers
+// one market; run_backtest() shards a set of markets across threads.
+//
+//==============================================================================
+#ifndef BFAPI_SIMULATOR_HPP
+#define BFAPI_SIMULATOR_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+#include "orders.hpp"
+#include "responses.hpp"
+#include "ticks.hpp"
+
+namespace bfapi {
+namespace simulator {
+
+struct sim_order {
+	std::string bet_id;
+	std::int64_t selection_id;
+	bool lay_side;
+	int tick;
+	double price;
+	double size;
+	double size_matched;
+	double matched_value;       // Sum of price * size over all fills
+	double size_cancelled;
+	double size_lapsed;
+	double queue_ahead;         // Stake in front of this order at its price
+	bool persist;
+	std::string customer_order_ref;
+	std::int64_t placed_time;   // Milliseconds since the epoch, from the feed
+
+	sim_order() : selection_id(0), lay_side(false), tick(0), price(0.0), size(0.0), size_matched(0.0), matched_value(0.0),
+	              size_cancelled(0.0), size_lapsed(0.0), queue_ahead(0.0), persist(false), placed_time(0) {}
+
+	double size_remaining() const { return size - size_matched - size_cancelled - size_lapsed; }
+	double average_price_matched() const { return size_matched > 0.0 ? matched_value / size_matched : 0.0; }
+	bool executable() const { return size_remaining() > 1e-9; }
+};
+
+struct fill {
+	std::string bet_id;
+	std::int64_t selection_id;
+	bool lay_side;
+	double price;
+	double size;
+	std::int64_t timestamp;
+
+	fill() : selection_id(0), lay_side(false), price(0.0), size(0.0), timestamp(0) {}
+};
+
+struct sim_stats {
+	std::uint64_t books;
+	std::uint64_t orders_placed;
+	std::uint64_t orders_rejected;
+	std::uint64_t orders_cancelled;
+	std::uint64_t orders_replaced;
+	std::uint64_t orders_lapsed;
+	std::uint64_t fills;
+	double size_matched;
+
+	sim_stats() : books(0), orders_placed(0), orders_rejected(0), orders_cancelled(0), orders_replaced(0),
+	              orders_lapsed(0), fills(0), size_matched(0.0) {}
+};
+
+class market_simulator {
+public:
+	typedef std::function<void(const fill&)> fill_handler;
+
+	// Bet ids are issued sequentially from first_bet_id
+	explicit market_simulator(const std::string& market_id, std::int64_t first_bet_id = 1);
+
+	// Apply the next snapshot of the replayed feed. timestamp is in milliseconds
+	// since the epoch and is used for placed/cancelled dates in reports.
+	void on_market_book(const bfapi::responses::market_book& book, std::int64_t timestamp);
+
+	// As the live placeOrders: all instructions are validated first and if any
+	// fails nothing is placed. Returns true if report.status is SUCCESS.
+	bool place_orders(const bfapi::orders::place_limit_orders_request& request,
+	                  bfapi::responses::place_execution_report& report);
+	// As above for instructions of any order type. Only LIMIT orders are matched;
+	// LIMIT_ON_CLOSE and MARKET_ON_CLOSE instructions fail with
+	// MARKET_NOT_OPEN_FOR_BSP_BETTING as there is no starting price to settle at.
+	bool place_orders(const bfapi::orders::place_orders_request& request,
+	                  bfapi::responses::place_execution_report& report);
+
+	// As the live cancelOrders; an empty instruction list cancels every unmatched
+	// order in the market. Returns true if every instruction succeeded.
+	bool cancel_orders(const bfapi::orders::cancel_orders_request& request,
+	                   bfapi::responses::cancel_execution_report& report);
+
+	// As the live replaceOrders: the unmatched stake of each bet is cancelled and
+	// placed again at the new price under a new bet id.
+	bool replace_orders(const bfapi::orders::replace_orders_request& request,
+	                    bfapi::responses::replace_execution_report& report);
+
+	// Called for every (partial) match of an order
+	void set_fill_handler(const fill_handler& handler) { on_fill = handler; }
+
+	const std::string& get_market_id() const { return market_id; }
+	const std::vector<sim_order>& get_orders() const { return orders; }
+	const sim_order* find_order(const std::string& bet_id) const;
+	const std::string& market_status() const { return status; }
+	bool is_inplay() const { return inplay; }
+	std::int64_t current_time() const { return now; }
+	sim_stats get_stats() const { return stats; }
+
+private:
+	struct taken_level {
+		int tick;
+		bool back_offer;                    // Taken from availableToBack (by a back bet) rather than availableToLay
+		double size;
+		double seen;                        // Feed size at the tick when last checked
+
+		taken_level(int t, bool back, double s, double feed) : tick(t), back_offer(back), size(s), seen(feed) {}
+	};
+
+	struct runner_state {
+		std::int64_t selection_id;
+		bool active;
+		std::vector<double> raw_back;       // availableToBack by tick as published in the feed
+		std::vector<double> raw_lay;        // availableToLay by tick as published in the feed
+		std::vector<double> traded;         // Cumulative traded volume by tick
+		std::vector<int> back_ticks;        // Ticks with stake in raw_back, in feed order (best first)
+		std::vector<int> lay_ticks;         // Ticks with stake in raw_lay, in feed order (best first)
+		std::vector<taken_level> taken;     // Stake our orders have taken that the feed still shows
+		std::vector<std::size_t> resting;   // Indices into orders of executable orders on this runner
+
+		runner_state() : selection_id(0), active(true), raw_back(ticks::tick_count, 0.0),
+		                 raw_lay(ticks::tick_count, 0.0), traded(ticks::tick_count, 0.0) {}
+	};
+
+	runner_state* find_runner(std::int64_t selection_id);
+	std::string validate(const bfapi::orders::place_instruction_batch& instructions, std::size_t i);
+	std::size_t add_order(std::int64_t selection_id, bool lay_side, double size, double price, bool persist,
+	                      const std::string& customer_order_ref);
+	void load_runner(runner_state& runner, const bfapi::responses::runner_book& rb);
+	double available(const runner_state& runner, bool back_offer, int tick) const;
+	void take(runner_state& runner, bool back_offer, int tick, sim_order& order, double price);
+	void match_on_entry(runner_state& runner, std::size_t index);
+	void update_resting(runner_state& runner);
+	void execute(sim_order& order, double size, double price);
+	double cancel_unmatched(sim_order& order, double size_reduction);
+	void lapse(runner_state& runner, bool lapse_persistent);
+	void prune(runner_state& runner);
+	void fill_place_report(const sim_order& order, bfapi::responses::instruction_report& ir) const;
+	void dispatch_fills();
+
+	std::string market_id;
+	std::int64_t next_bet_id;
+	std::int64_t now;
+	std::string status;
+	bool inplay;
+	std::vector<runner_state> runners;
+	std::vector<sim_order> orders;
+	std::unordered_map<std::string, std::size_t> order_index;
+	std::vector<double> prev_queue;     // Queue size and traded volume at each resting order's price
+	std::vector<double> prev_traded;    // before the current snapshot, parallel to runner_state::resting
+	std::vector<fill> pending_fills;     // Delivered once the current operation is complete
+	fill_handler on_fill;
+	sim_stats stats;
+};
+
+// Replayed feed for one market: snapshots in time order
+struct timed_book {
+	std::int64_t timestamp;             // Milliseconds since the epoch
+	bfapi::responses::market_book book;
+
+	timed_book() : timestamp(0) {}
+	timed_book(std::int64_t t, const bfapi::responses::market_book& b) : timestamp(t), book(b) {}
+};
+
+struct market_feed {
+	std::string market_id;
+	std::vector<timed_book> books;
+};
+
+struct market_result {
+	std::string market_id;
+	std::vector<sim_order> orders;
+	sim_stats stats;
+};
+
+// Called after each snapshot has been applied; may place, cancel or replace orders
+typedef std::function<void(market_simulator&, const bfapi::responses::market_book&)> book_handler;
+// Creates the strategy instance for one market. Called from the worker threads.
+typedef std::function<book_handler(const std::string& market_id)> strategy_factory;
+
+// Replay every feed through its own market_simulator, spreading the markets
+// over threads (0 = one per hardware thread). results are in feed order.
+bool run_backtest(const std::vector<market_feed>& feeds,
+                  const strategy_factory& factory,
+                  std::size_t threads,
+                  std::vector<market_result>& results,
+                  std::string& error);
+
+} // end of namespace bfapi::simulator
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,224 @@
+#include "stream.hpp"
+#include <algorithm>
+
+namespace bfapi {
+namespace stream {
+
+namespace {
+
+//==============================================================================
+// Price keyed ladder update, size 0 removes the price. ladder is kept in ascending price order.
+void apply_prices(std::vector<price_vol>& ladder, const std::vector<price_vol>& changes)
+{
+    for (const price_vol& pv : changes)
+    {
+        auto it = std::lower_bound(ladder.begin(), ladder.end(), pv.price,
+                                   [](const price_vol& a, double price) { return a.price < price; });
+        const bool found = (it != ladder.end() && it->price == pv.price);
+        if (pv.size == 0.0)
+        {
+            if (found)
+            {
+                ladder.erase(it);
+            }
+        }
+        else if (found)
+        {
+            it->size = pv.size;
+        }
+        else
+        {
+            ladder.insert(it, pv);
+        }
+    }
+}
+
+//==============================================================================
+// Level keyed ladder update, size 0 removes the level. ladder is kept in ascending level order.
+void apply_levels(std::vector<level_price_vol>& ladder, const std::vector<level_price_vol>& changes)
+{
+    for (const level_price_vol& lpv : changes)
+    {
+        auto it = std::lower_bound(ladder.begin(), ladder.end(), lpv.level,
+                                   [](const level_price_vol& a, int level) { return a.level < level; });
+        const bool found = (it != ladder.end() && it->level == lpv.level);
+        if (lpv.size == 0.0)
+        {
+            if (found)
+            {
+                ladder.erase(it);
+            }
+        }
+        else if (found)
+        {
+            *it = lpv;
+        }
+        else
+        {
+            ladder.insert(it, lpv);
+        }
+    }
+}
+
+} // end of anonymous namespace
+
+//==============================================================================
+market_cache::market_cache(const std::string& id) : market_id(id), pt(0), tv(0.0)
+{
+}
+
+//==============================================================================
+void market_cache::apply(const market_change& change, std::int64_t publish_time)
+{
+    if (market_id.empty())
+    {
+        market_id = change.id;
+    }
+    else if (change.id != market_id)
+    {
+        return;
+    }
+    pt = publish_time;
+    if (change.img)
+    {
+        runners.clear();
+        tv = 0.0;
+    }
+    if (change.has_definition)
+    {
+        definition = change.definition;
+    }
+    if (change.has_tv)
+    {
+        tv = change.tv;
+    }
+    for (const runner_change& rc : change.rc)
+    {
+        runner_state& r = find_runner(rc.id, rc.hc);
+        if (rc.has_ltp)
+        {
+            r.ltp = rc.ltp;
+        }
+        if (rc.has_tv)
+        {
+            r.tv = rc.tv;
+        }
+        if (rc.has_spn)
+        {
+            r.spn = rc.spn;
+        }
+        if (rc.has_spf)
+        {
+            r.spf = rc.spf;
+        }
+        apply_prices(r.atb, rc.atb);
+        apply_prices(r.atl, rc.atl);
+        apply_prices(r.trd, rc.trd);
+        apply_prices(r.spb, rc.spb);
+        apply_prices(r.spl, rc.spl);
+        apply_levels(r.batb, rc.batb);
+        apply_levels(r.batl, rc.batl);
+        apply_levels(r.bdatb, rc.bdatb);
+        apply_levels(r.bdatl, rc.bdatl);
+    }
+}
+
+//==============================================================================
+void market_cache::to_market_book(bfapi::responses::market_book& book, int depth) const
+{
+    book = bfapi::responses::market_book();
+    book.market_id = market_id;
+    book.status = definition.status;
+    book.inplay = definition.inplay;
+    book.version = definition.version;
+    book.total_matched = tv;
+
+    auto add_runner = [&](std::int64_t id, double hc, const std::string& status)
+    {
+        bfapi::responses::runner_book rb;
+        rb.selection_id = id;
+        rb.handicap = hc;
+        rb.status = status;
+        auto it = std::find_if(runners.begin(), runners.end(), [&](const runner_state& r) { return r.id == id && r.hc == hc; });
+        if (it != runners.end())
+        {
+            rb.last_price_traded = it->ltp;
+            rb.total_matched = it->tv;
+            if (false == it->atb.empty() || false == it->atl.empty())
+            {
+                // Back offers are best at the highest price, lay offers at the lowest
+                for (auto p = it->atb.rbegin(); p != it->atb.rend() && static_cast<int>(rb.available_to_back.size()) < depth; ++p)
+                {
+                    rb.available_to_back.push_back(bfapi::responses::price_size(p->price, p->size));
+                }
+                for (auto p = it->atl.begin(); p != it->atl.end() && static_cast<int>(rb.available_to_lay.size()) < depth; ++p)
+                {
+                    rb.available_to_lay.push_back(bfapi::responses::price_size(p->price, p->size));
+                }
+            }
+            else
+            {
+                const std::vector<level_price_vol>& back = it->batb.empty() ? it->bdatb : it->batb;
+                const std::vector<level_price_vol>& lay = it->batl.empty() ? it->bdatl : it->batl;
+                for (const level_price_vol& l : back)
+                {
+                    if (l.level < depth)
+                    {
+                        rb.available_to_back.push_back(bfapi::responses::price_size(l.price, l.size));
+                    }
+                }
+                for (const level_price_vol& l : lay)
+                {
+                    if (l.level < depth)
+                    {
+                        rb.available_to_lay.push_back(bfapi::responses::price_size(l.price, l.size));
+                    }
+                }
+            }
+            for (const price_vol& t : it->trd)
+            {
+                rb.traded_volume.push_back(bfapi::responses::price_size(t.price, t.size));
+            }
+        }
+        book.runners.push_back(rb);
+    };
+
+    if (definition.runners.empty())
+    {
+        for (const runner_state& r : runners)
+        {
+            add_runner(r.id, r.hc, "ACTIVE");
+        }
+    }
+    else
+    {
+        std::vector<const runner_definition*> ordered;
+        for (const runner_definition& rd : definition.runners)
+        {
+            ordered.push_back(&rd);
+        }
+        std::stable_sort(ordered.begin(), ordered.end(),
+                         [](const runner_definition* a, const runner_definition* b) { return a->sort_priority < b->sort_priority; });
+        for (const runner_definition* rd : ordered)
+        {
+            add_runner(rd->id, rd->hc, rd->status);
+        }
+    }
+}
+
+//==============================================================================
+market_cache::runner_state& market_cache::find_runner(std::int64_t id, double hc)
+{
+    for (runner_state& r : runners)
+    {
+        if (r.id == id && r.hc == hc)
+        {
+            return r;
+        }
+    }
+    runners.push_back(runner_state(id, hc));
+    return runners.back();
+}
+
+} // end of namespace bfapi::stream
+} // end of namespace bfapi
@@ -0,0 +1,181 @@
+//==============================================================================
+//
+// Exchange Stream API market change types and a market cache that applies
+// them. See "Exchange Stream API":
+//
+// https://docs.developer.betfair.com/display/1smk3cen4v3lu3yomq5qye0ni/Exchange+Stream+API
+//
+// These mirror the MarketChangeMessage (op = "mcm") JSON of the stream, which
+// is also the format of Betfair's historical data files (see historical.hpp).
+// Only the fields used for trading and backtesting are kept.
+//
+// market_cache applies successive changes for one market the way a stream
+// client must: an image (img) replaces the cached market, price ladders are
+// keyed by price (atb, atl, trd, spb, spl) or by level (batb, batl, bdatb,
+// bdatl) and a size of 0 removes the entry. The cached state can be turned
+// into a responses::market_book so the simulator, analytics and runtime
+// modules can be driven from stream or historical data.
+//
+//==============================================================================
+#ifndef BFAPI_STREAM_HPP
+#define BFAPI_STREAM_HPP
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "responses.hpp"
+
+namespace bfapi {
+namespace checkpoint {
+struct access;
+} // end of namespace bfapi::checkpoint
+
+namespace stream {
+
+struct price_vol {
+	double price;
+	double size;
+
+	price_vol() : price(0.0), size(0.0) {}
+	price_vol(double p, double s) : price(p), size(s) {}
+};
+
+struct level_price_vol {
+	int level;
+	double price;
+	double size;
+
+	level_price_vol() : level(0), price(0.0), size(0.0) {}
+	level_price_vol(int l, double p, double s) : level(l), price(p), size(s) {}
+};
+
+// RunnerChange
+struct runner_change {
+	std::int64_t id;                    // Selection ID
+	double hc;                          // Handicap
+	bool has_ltp;
+	double ltp;                         // Last traded price
+	bool has_tv;
+	double tv;                          // Total traded volume
+	bool has_spn;
+	double spn;                         // Starting price near
+	bool has_spf;
+	double spf;                         // Starting price far
+	std::vector<price_vol> atb;         // Available to back, full depth
+	std::vector<price_vol> atl;         // Available to lay, full depth
+	std::vector<price_vol> trd;         // Traded
+	std::vector<price_vol> spb;         // Starting price back
+	std::vector<price_vol> spl;         // Starting price lay
+	std::vector<level_price_vol> batb;  // Best available to back
+	std::vector<level_price_vol> batl;  // Best available to lay
+	std::vector<level_price_vol> bdatb; // Best display (virtual) available to back
+	std::vector<level_price_vol> bdatl; // Best display (virtual) available to lay
+
+	runner_change() : id(0), hc(0.0), has_ltp(false), ltp(0.0), has_tv(false), tv(0.0),
+	                  has_spn(false), spn(0.0), has_spf(false), spf(0.0) {}
+};
+
+// RunnerDefinition
+struct runner_definition {
+	std::int64_t id;
+	double hc;
+	std::string status;                 // ACTIVE, WINNER, LOSER, REMOVED, ...
+	int sort_priority;
+
+	runner_definition() : id(0), hc(0.0), sort_priority(0) {}
+};
+
+// MarketDefinition
+struct market_definition {
+	std::string status;                 // INACTIVE, OPEN, SUSPENDED, CLOSED
+	bool inplay;
+	bool complete;
+	int bet_delay;
+	std::int64_t version;
+	std::string market_type;
+	std::string event_id;
+	std::string event_type_id;
+	std::string market_time;
+	std::vector<runner_definition> runners;
+
+	market_definition() : inplay(false), complete(false), bet_delay(0), version(0) {}
+};
+
+// MarketChange
+struct market_change {
+	std::string id;                     // Market ID
+	bool img;                           // Replace the cached market rather than update it
+	bool has_tv;
+	double tv;
+	bool has_definition;
+	market_definition definition;
+	std::vector<runner_change> rc;
+
+	market_change() : img(false), has_tv(false), tv(0.0), has_definition(false) {}
+};
+
+// MarketChangeMessage
+struct market_change_message {
+	std::string op;                     // "mcm"
+	std::string initial_clk;            // Sent with the first image of a subscription
+	std::string clk;
+	std::int64_t pt;                    // Publish time, milliseconds since the epoch
+	std::vector<market_change> mc;
+
+	market_change_message() : pt(0) {}
+};
+
+class market_cache {
+public:
+	explicit market_cache(const std::string& market_id = "");
+
+	// Apply one market change; changes for other markets are ignored once the ID is set
+	void apply(const market_change& change, std::int64_t pt);
+
+	const std::string& get_market_id() const { return market_id; }
+	const market_definition& get_definition() const { return definition; }
+	std::int64_t publish_time() const { return pt; }
+	double total_traded() const { return tv; }
+
+	// Current state in listMarketBook form: up to depth prices each side (best first),
+	// using the full depth ladders when the stream carries them and the best price
+	// levels otherwise. Runners follow the market definition's order.
+	void to_market_book(bfapi::responses::market_book& book, int depth = 3) const;
+
+private:
+	// Saves and restores the cached state (see checkpoint.hpp)
+	friend struct bfapi::checkpoint::access;
+
+	struct runner_state {
+		std::int64_t id;
+		double hc;
+		double ltp;
+		double tv;
+		double spn;
+		double spf;
+		std::vector<price_vol> atb;     // Ascending price
+		std::vector<price_vol> atl;
+		std::vector<price_vol> trd;
+		std::vector<price_vol> spb;
+		std::vector<price_vol> spl;
+		std::vector<level_price_vol> batb;  // Ascending level
+		std::vector<level_price_vol> batl;
+		std::vector<level_price_vol> bdatb;
+		std::vector<level_price_vol> bdatl;
+
+		runner_state(std::int64_t i, double h) : id(i), hc(h), ltp(0.0), tv(0.0), spn(0.0), spf(0.0) {}
+	};
+
+	runner_state& find_runner(std::int64_t id, double hc);
+
+	std::string market_id;
+	market_definition definition;
+	std::int64_t pt;
+	double tv;
+	std::vector<runner_state> runners;
+};
+
+} // end of namespace bfapi::stream
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,116 @@
+//==============================================================================
+//
+// The Betfair price ladder. Valid odds between 1.01 and 1000 are spaced by an
+// increment that grows with the price, giving 350 ticks in total:
+//
+//         1.01 -> 2      0.01
+//         2    -> 3      0.02
+//         3    -> 4      0.05
+//         4    -> 6      0.1
+//         6    -> 10     0.2
+//         10   -> 20     0.5
+//         20   -> 30     1
+//         30   -> 50     2
+//         50   -> 100    5
+//         100  -> 1000   10
+//
+// Tick indices run from 0 (1.01) to 349 (1000) so per price data can be kept in
+// fixed size arrays instead of maps keyed on doubles.
+//
+//==============================================================================
+#ifndef BFAPI_TICKS_HPP
+#define BFAPI_TICKS_HPP
+
+#include <cmath>
+
+namespace bfapi {
+namespace ticks {
+
+const int tick_count = 350;
+const double min_price = 1.01;
+const double max_price = 1000.0;
+
+struct ladder_band {
+	double from;        // First price of the band
+	double increment;
+	int first_tick;     // Tick index of from
+};
+
+// Band boundaries; the last entry only marks the end of the ladder
+const ladder_band bands[] = {
+	{1.0,    0.01, -1},     // 1.01 is tick 0
+	{2.0,    0.02, 99},
+	{3.0,    0.05, 149},
+	{4.0,    0.1,  169},
+	{6.0,    0.2,  189},
+	{10.0,   0.5,  209},
+	{20.0,   1.0,  229},
+	{30.0,   2.0,  239},
+	{50.0,   5.0,  249},
+	{100.0,  10.0, 259},
+	{1000.0, 0.0,  349}
+};
+const int band_count = 10;
+
+inline double tick_to_price(int tick)
+{
+	if (tick < 0 || tick >= tick_count)
+	{
+		return 0.0;
+	}
+	int b = band_count - 1;
+	while (tick < bands[b].first_tick)
+	{
+		--b;
+	}
+	// Round to two decimal places to remove floating point noise
+	return std::round((bands[b].from + (tick - bands[b].first_tick) * bands[b].increment) * 100.0) / 100.0;
+}
+
+// Tick index of a price, or -1 if the price is not on the ladder
+inline int price_to_tick(double price)
+{
+	if (price < min_price - 1e-9 || price > max_price + 1e-9)
+	{
+		return -1;
+	}
+	int b = band_count - 1;
+	while (b > 0 && price < bands[b].from + 1e-9)
+	{
+		--b;
+	}
+	const double steps = (price - bands[b].from) / bands[b].increment;
+	const long rounded = std::lround(steps);
+	if (std::fabs(steps - rounded) > 1e-6)
+	{
+		return -1;
+	}
+	return bands[b].first_tick + static_cast<int>(rounded);
+}
+
+// Nearest valid price at or above (round_up) or at or below the supplied price
+inline int nearest_tick(double price, bool round_up)
+{
+	if (price <= min_price)
+	{
+		return 0;
+	}
+	if (price >= max_price)
+	{
+		return tick_count - 1;
+	}
+	int b = band_count - 1;
+	while (b > 0 && price < bands[b].from + 1e-9)
+	{
+		--b;
+	}
+	const double steps = (price - bands[b].from) / bands[b].increment;
+	const long whole = static_cast<long>(round_up ? std::ceil(steps - 1e-9) : std::floor(steps + 1e-9));
+	const int tick = bands[b].first_tick + static_cast<int>(whole);
+	return tick < 0 ? 0 : (tick >= tick_count ? tick_count - 1 : tick);
+}
+
+} // end of namespace bfapi::ticks
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,483 @@
+//==============================================================================
+//
+// Blocking network operations with deadlines.
+//
+// The synchronous beast/asio calls (connect, handshake, http::write/read) have
+// no timeout, so a stalled peer blocks the caller forever. beast::tcp_stream
+// supports expiry but only for asynchronous operations. The helpers below
+// start the asynchronous version of each operation and run the stream's
+// io_context until it completes, giving a blocking call that fails with
+// beast::error::timeout once the deadline passes.
+//
+// The io_context passed in must only be used by the calling thread.
+//
+//==============================================================================
+#ifndef BFAPI_TIMED_IO_HPP
+#define BFAPI_TIMED_IO_HPP
+
+#include <chrono>
+#include <string>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/ssl/stream.hpp>
+
+namespace bfapi {
+namespace timed_io {
+
+struct completion {
+	boost::beast::error_code* ec;
+
+	void operator()(boost::beast::error_code e) const { *ec = e; }
+
+	template<class T>
+	void operator()(boost::beast::error_code e, const T&) const { *ec = e; }
+};
+
+// Completion handler calling f with its memory (and that of any composed
+// operation it completes, e.g. beast's http::async_read) taken from alloc
+template<class F, class Allocator>
+struct allocating_handler {
+	typedef Allocator allocator_type;
+
+	F f;
+	Allocator alloc;
+
+	allocator_type get_allocator() const { return alloc; }
+
+	template<class... Args>
+	void operator()(Args&&... args) { f(std::forward<Args>(args)...); }
+};
+
+template<class Allocator, class F>
+allocating_handler<F, Allocator> bind_allocator(const Allocator& alloc, F f)
+{
+	return allocating_handler<F, Allocator>{f, alloc};
+}
+
+// Run handlers until the io_context has no more work
+inline void run(boost::asio::io_context& ioc)
+{
+	ioc.restart();
+	ioc.run();
+}
+
+// getaddrinfo cannot be interrupted: cancelling an asio resolver only takes
+// effect once the lookup returns, so running it on an io_context bounds
+// nothing. The lookup runs on a detached thread instead, and at the deadline
+// the caller stops waiting and the result is dropped when it arrives.
+inline boost::beast::error_code resolve(const std::string& host,
+                                        const std::string& port,
+                                        boost::asio::ip::tcp::resolver::results_type& results,
+                                        std::chrono::steady_clock::duration timeout)
+{
+	struct lookup {
+		std::mutex mtx;
+		std::condition_variable cv;
+		bool done = false;
+		boost::beast::error_code ec;
+		boost::asio::ip::tcp::resolver::results_type results;
+	};
+	const std::shared_ptr<lookup> l = std::make_shared<lookup>();
+	std::thread([l, host, port]()
+	{
+		boost::asio::io_context ioc;
+		boost::asio::ip::tcp::resolver resolver(ioc);
+		boost::beast::error_code ec;
+		boost::asio::ip::tcp::resolver::results_type r = resolver.resolve(host, port, ec);
+		std::lock_guard<std::mutex> lock(l->mtx);
+		l->ec = ec;
+		l->results = r;
+		l->done = true;
+		l->cv.notify_all();
+	}).detach();
+
+	std::unique_lock<std::mutex> lock(l->mtx);
+	if (false == l->cv.wait_for(lock, timeout, [&l] { return l->done; }))
+	{
+		return boost::beast::error::timeout;
+	}
+	results = l->results;
+	return l->ec;
+}
+
+template<class Executor, class RatePolicy>
+boost::beast::error_code connect(boost::asio::io_context& ioc,
+                                 boost::beast::basic_stream<boost::asio::ip::tcp, Executor, RatePolicy>& stream,
+                                 const boost::asio::ip::tcp::resolver::results_type& results,
+                                 std::chrono::steady_clock::duration timeout)
+{
+	boost::beast::error_code ec;
+	stream.expires_after(timeout);
+	stream.async_connect(results, completion{&ec});
+	run(ioc);
+	stream.expires_never();
+	return ec;
+}
+
+struct connect_outcome {
+	bool started;
+	bool completed;                     // False if never started, cancelled after another attempt won, or still pending at the deadline
+	boost::beast::error_code ec;
+	std::chrono::steady_clock::duration elapsed;
+
+	connect_outcome() : started(false), completed(false), elapsed(0) {}
+};
+
+// Connect to the first of several endpoints to answer (RFC 8305 "happy
+// eyeballs"). Attempts start in the order given, the next one once stagger
+// has passed without a connection or as soon as the previous attempt fails.
+// The first connection made wins and the other attempts are cancelled. On
+// success the stream owns the winning socket and winner is its index;
+// outcomes[i] describes the attempt on candidates[i].
+template<class Executor, class RatePolicy>
+boost::beast::error_code race_connect(boost::asio::io_context& ioc,
+                                      boost::beast::basic_stream<boost::asio::ip::tcp, Executor, RatePolicy>& stream,
+                                      const std::vector<boost::asio::ip::tcp::endpoint>& candidates,
+                                      std::chrono::steady_clock::duration stagger,
+                                      std::chrono::steady_clock::duration timeout,
+                                      std::vector<connect_outcome>& outcomes,
+                                      std::size_t& winner)
+{
+	typedef typename boost::beast::basic_stream<boost::asio::ip::tcp, Executor, RatePolicy>::socket_type socket_type;
+	typedef std::chrono::steady_clock clock;
+
+	const std::size_t n = candidates.size();
+	outcomes.assign(n, connect_outcome());
+	if (0 == n)
+	{
+		return boost::asio::error::host_not_found;
+	}
+
+	std::vector<std::unique_ptr<socket_type>> sockets(n);
+	std::vector<clock::time_point> started(n);
+	boost::asio::steady_timer deadline(ioc, timeout);
+	boost::asio::steady_timer next_timer(ioc);
+	boost::beast::error_code last_error;
+	std::size_t next = 0;
+	std::size_t pending = 0;
+	bool won = false;
+	bool timed_out = false;
+
+	auto stop_others = [&](std::size_t keep)
+	{
+		for (std::size_t j = 0; j < n; ++j)
+		{
+			if (j != keep && sockets[j])
+			{
+				boost::beast::error_code ignored;
+				sockets[j]->close(ignored);
+			}
+		}
+		next_timer.cancel();
+	};
+
+	std::function<void()> start_next = [&]()
+	{
+		if (won || timed_out || next >= n)
+		{
+			return;
+		}
+		const std::size_t i = next++;
+		sockets[i].reset(new socket_type(stream.get_executor()));
+		outcomes[i].started = true;
+		started[i] = clock::now();
+		++pending;
+		sockets[i]->async_connect(candidates[i], [&, i](boost::beast::error_code e)
+		{
+			--pending;
+			if (won || timed_out)
+			{
+				return;     // Cancelled - another attempt already decided the race
+			}
+			outcomes[i].completed = true;
+			outcomes[i].ec = e;
+			outcomes[i].elapsed = clock::now() - started[i];
+			if (!e)
+			{
+				won = true;
+				winner = i;
+				stop_others(i);
+				deadline.cancel();
+				return;
+			}
+			last_error = e;
+			if (next < n)
+			{
+				start_next();   // Do not wait out the stagger after a failure
+			}
+			else if (0 == pending)
+			{
+				deadline.cancel();
+			}
+		});
+		if (next < n)
+		{
+			next_timer.expires_after(stagger);
+			next_timer.async_wait([&](boost::beast::error_code e)
+			{
+				if (!e)
+				{
+					start_next();
+				}
+			});
+		}
+	};
+
+	deadline.async_wait([&](boost::beast::error_code e)
+	{
+		if (!e && false == won)
+		{
+			timed_out = true;
+			stop_others(n);
+		}
+	});
+	start_next();
+	run(ioc);
+
+	if (won)
+	{
+		stream.socket() = std::move(*sockets[winner]);
+		return boost::beast::error_code();
+	}
+	return timed_out ? boost::beast::error_code(boost::beast::error::timeout) : last_error;
+}
+
+template<class NextLayer>
+boost::beast::error_code handshake(boost::asio::io_context& ioc,
+                                   boost::beast::ssl_stream<NextLayer>& stream,
+                                   std::chrono::steady_clock::duration timeout)
+{
+	boost::beast::error_code ec;
+	boost::beast::get_lowest_layer(stream).expires_after(timeout);
+	stream.async_handshake(boost::asio::ssl::stream_base::client, completion{&ec});
+	run(ioc);
+	boost::beast::get_lowest_layer(stream).expires_never();
+	return ec;
+}
+
+// Send a request and read the response within a single deadline, allocating
+// everything for the operations with alloc. The deadline is a timer of our own
+// rather than the stream's expiry, since beast starts a timer wait for each
+// read and write which asio allocates from the heap.
+template<class Stream, class Request, class Response, class DynamicBuffer, class Allocator>
+boost::beast::error_code request(boost::asio::io_context& ioc,
+                                 Stream& stream,
+                                 Request& req,
+                                 DynamicBuffer& buffer,
+                                 Response& res,
+                                 std::chrono::steady_clock::duration timeout,
+                                 bool* written,
+                                 const Allocator& alloc)
+{
+	boost::beast::error_code ec;
+	bool timed_out = false;
+	if (written)
+	{
+		*written = false;
+	}
+	boost::asio::steady_timer timer(ioc, timeout);
+	timer.async_wait(bind_allocator(alloc, [&](boost::beast::error_code e)
+	{
+		if (!e)
+		{
+			timed_out = true;
+			boost::beast::get_lowest_layer(stream).cancel();
+		}
+	}));
+	auto on_read = [&](boost::beast::error_code e, std::size_t)
+	{
+		ec = e;
+		timer.cancel();
+	};
+	auto on_write = [&](boost::beast::error_code e, std::size_t)
+	{
+		ec = e;
+		if (ec)
+		{
+			timer.cancel();
+			return;
+		}
+		if (written)
+		{
+			*written = true;
+		}
+		boost::beast::http::async_read(stream, buffer, res, bind_allocator(alloc, on_read));
+	};
+	boost::beast::http::async_write(stream, req, bind_allocator(alloc, on_write));
+	run(ioc);
+	if (timed_out)
+	{
+		ec = boost::beast::error::timeout;
+	}
+	return ec;
+}
+
+// Send a request and read the response within a single deadline
+template<class Stream, class Request, class Response>
+boost::beast::error_code request(boost::asio::io_context& ioc,
+                                 Stream& stream,
+                                 Request& req,
+                                 boost::beast::flat_buffer& buffer,
+                                 Response& res,
+                                 std::chrono::steady_clock::duration timeout,
+                                 bool* written = nullptr)
+{
+	boost::beast::error_code ec;
+	if (written)
+	{
+		*written = false;
+	}
+	boost::beast::get_lowest_layer(stream).expires_after(timeout);
+	boost::beast::http::async_write(stream, req, completion{&ec});
+	run(ioc);
+	if (!ec)
+	{
+		if (written)
+		{
+			*written = true;
+		}
+		boost::beast::http::async_read(stream, buffer, res, completion{&ec});
+		run(ioc);
+	}
+	boost::beast::get_lowest_layer(stream).expires_never();
+	return ec;
+}
+
+// Send every request in reqs back to back (HTTP/1.1 pipelining) while reading
+// the responses, which arrive in the same order, into res. Writing and reading
+// run at the same time within a single deadline. written is the number of
+// requests completely written and answered the number of responses read;
+// res[0, answered) are complete. Reading stops early after a response that
+// closes the connection (returning http::error::end_of_stream if requests are
+// left unanswered) or once the responses to everything written are read after
+// a write error. Unless every request was answered the stream must be closed.
+template<class Stream, class Request, class Response>
+boost::beast::error_code pipeline(boost::asio::io_context& ioc,
+                                  Stream& stream,
+                                  std::vector<Request>& reqs,
+                                  boost::beast::flat_buffer& buffer,
+                                  std::vector<Response>& res,
+                                  std::chrono::steady_clock::duration timeout,
+                                  std::size_t& written,
+                                  std::size_t& answered)
+{
+	const std::size_t n = reqs.size();
+	res.clear();
+	res.resize(n);
+	written = 0;
+	answered = 0;
+	if (0 == n)
+	{
+		return boost::beast::error_code();
+	}
+
+	boost::beast::error_code write_error;
+	boost::beast::error_code read_error;
+	bool writing_done = false;
+	bool reading_done = false;
+	bool closed = false;
+	bool timed_out = false;
+	boost::asio::steady_timer timer(ioc, timeout);
+
+	// Whichever side finishes second stops the deadline; a side that fails stops the other
+	auto stop = [&](bool failed)
+	{
+		if (writing_done && reading_done)
+		{
+			timer.cancel();
+		}
+		else if (failed)
+		{
+			boost::beast::get_lowest_layer(stream).cancel();
+		}
+	};
+
+	std::function<void()> write_next = [&]()
+	{
+		boost::beast::http::async_write(stream, reqs[written], [&](boost::beast::error_code e, std::size_t)
+		{
+			if (e)
+			{
+				write_error = e;
+				writing_done = true;
+				// Nothing more will be answered once the responses to what was written are in
+				stop(answered >= written);
+				return;
+			}
+			++written;
+			if (written < n && false == reading_done)
+			{
+				write_next();
+				return;
+			}
+			writing_done = true;
+			stop(false);
+		});
+	};
+
+	std::function<void()> read_next = [&]()
+	{
+		boost::beast::http::async_read(stream, buffer, res[answered], [&](boost::beast::error_code e, std::size_t)
+		{
+			if (e)
+			{
+				read_error = e;
+				reading_done = true;
+				stop(true);
+				return;
+			}
+			const bool keep_alive = res[answered].keep_alive();
+			++answered;
+			if (answered < n && keep_alive && false == (writing_done && answered >= written))
+			{
+				read_next();
+				return;
+			}
+			closed = (false == keep_alive);
+			reading_done = true;
+			stop(answered < n);
+		});
+	};
+
+	timer.async_wait([&](boost::beast::error_code e)
+	{
+		if (!e)
+		{
+			timed_out = true;
+			boost::beast::get_lowest_layer(stream).cancel();
+		}
+	});
+	write_next();
+	read_next();
+	run(ioc);
+
+	if (timed_out)
+	{
+		return boost::beast::error::timeout;
+	}
+	if (read_error)
+	{
+		return read_error;
+	}
+	if (answered < n)
+	{
+		// After a closing response the writer only fails because it was stopped
+		return (write_error && false == closed) ? write_error : boost::beast::error_code(boost::beast::http::error::end_of_stream);
+	}
+	return boost::beast::error_code();
+}
+
+} // end of namespace bfapi::timed_io
+} // end of namespace bfapi
+
+#endif
@@ -0,0 +1,174 @@
+//==============================================================================
+//
+// Benchmark the market analytics kernels against a naive loop over each
+// runner_book. Synthetic books with 10 to 40 runners are used so no login is
+// needed. For each market size the time per book update is reported for:
+//
+//  - naive: a per runner loop over the price_size vectors of the book
+//  - kernels: market_analytics::recompute() over ladders already held in
+//    array form, with each instruction set the CPU supports
+//  - load: market_analytics::load(), i.e. copying the book into arrays first
+//  - incremental: market_analytics::apply() with two changed runners
+//
+//==============================================================================
+#include "../betfair/analytics.hpp"
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <random>
+
+using std::chrono::steady_clock;
+using bfapi::responses::market_book;
+using bfapi::responses::runner_book;
+using bfapi::responses::price_size;
+
+const int depth = 3;
+
+struct naive_result {
+    double back_book;
+    double lay_book;
+    std::vector<double> implied_back;
+    std::vector<double> implied_lay;
+    std::vector<double> back_wap;
+    std::vector<double> lay_wap;
+    std::vector<double> vwap;
+};
+
+//==============================================================================
+// What a strategy typically does on every update without the analytics module
+void naive_analytics(const market_book& book, naive_result& r)
+{
+    r.back_book = 0.0;
+    r.lay_book = 0.0;
+    r.implied_back.clear();
+    r.implied_lay.clear();
+    r.back_wap.clear();
+    r.lay_wap.clear();
+    r.vwap.clear();
+    for (const runner_book& rb : book.runners)
+    {
+        const double back = rb.available_to_back.empty() ? 0.0 : 1.0 / rb.available_to_back.front().price;
+        const double lay = rb.available_to_lay.empty() ? 0.0 : 1.0 / rb.available_to_lay.front().price;
+        r.back_book += back;
+        r.lay_book += lay;
+        r.implied_back.push_back(back);
+        r.implied_lay.push_back(lay);
+
+        double num = 0.0, den = 0.0;
+        for (std::size_t l = 0; l < rb.available_to_back.size() && l < depth; ++l)
+        {
+            num += rb.available_to_back[l].price * rb.available_to_back[l].size;
+            den += rb.available_to_back[l].size;
+        }
+        r.back_wap.push_back(den > 0.0 ? num / den : 0.0);
+        num = 0.0;
+        den = 0.0;
+        for (std::size_t l = 0; l < rb.available_to_lay.size() && l < depth; ++l)
+        {
+            num += rb.available_to_lay[l].price * rb.available_to_lay[l].size;
+            den += rb.available_to_lay[l].size;
+        }
+        r.lay_wap.push_back(den > 0.0 ? num / den : 0.0);
+        num = 0.0;
+        den = 0.0;
+        for (const price_size& ps : rb.traded_volume)
+        {
+            num += ps.price * ps.size;
+            den += ps.size;
+        }
+        r.vwap.push_back(den > 0.0 ? num / den : 0.0);
+    }
+}
+
+//==============================================================================
+market_book make_book(int runners, std::mt19937& rng)
+{
+    std::uniform_real_distribution<double> price(1.5, 50.0);
+    std::uniform_real_distribution<double> size(2.0, 500.0);
+    market_book book;
+    book.market_id = "1.1";
+    book.status = "OPEN";
+    for (int i = 0; i < runners; ++i)
+    {
+        runner_book rb;
+        rb.selection_id = 1000 + i;
+        rb.status = "ACTIVE";
+        const double p = price(rng);
+        for (int l = 0; l < depth; ++l)
+        {
+            rb.available_to_back.push_back(price_size(p - 0.1 * l, size(rng)));
+            rb.available_to_lay.push_back(price_size(p + 0.1 * (l + 1), size(rng)));
+        }
+        for (int l = 0; l < 20; ++l)
+        {
+            rb.traded_volume.push_back(price_size(p + 0.1 * (l - 10), size(rng)));
+        }
+        book.runners.push_back(rb);
+    }
+    return book;
+}
+
+//==============================================================================
+template<class F>
+double ns_per_call(int iterations, F f)
+{
+    auto t1 = steady_clock::now();
+    for (int i = 0; i < iterations; ++i)
+    {
+        f(i);
+    }
+    auto t2 = steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t2 - t1).count() / iterations;
+}
+
+int main()
+{
+    std::mt19937 rng(42);
+    const int iterations = 200000;
+    const bfapi::analytics::simd_level detected = bfapi::analytics::detected_simd();
+    std::cout << "Detected instruction set: " << bfapi::analytics::simd_name(detected) << "\n";
+
+    for (int runners : {10, 20, 40})
+    {
+        const market_book book = make_book(runners, rng);
+        std::vector<runner_book> changed(book.runners.begin(), book.runners.begin() + 2);
+        std::cout << runners << " runners, ns per update:\n";
+
+        naive_result naive;
+        double sink = 0.0;
+        std::cout << "    naive            " << ns_per_call(iterations, [&](int) { naive_analytics(book, naive); sink += naive.back_book; }) << "\n";
+
+        bfapi::analytics::market_analytics analytics(depth);
+        analytics.load(book);
+        for (bfapi::analytics::simd_level level : {bfapi::analytics::simd_level::scalar,
+                                                   bfapi::analytics::simd_level::sse2,
+                                                   bfapi::analytics::simd_level::avx2})
+        {
+            if (static_cast<int>(level) > static_cast<int>(detected))
+            {
+                continue;
+            }
+            bfapi::analytics::set_simd(level);
+            const std::string name = bfapi::analytics::simd_name(level);
+            std::cout << "    kernels (" << name << ")" << std::string(7 - name.size(), ' ')
+                      << ns_per_call(iterations, [&](int) { analytics.recompute(); sink += analytics.back_overround(); }) << "\n";
+        }
+        bfapi::analytics::set_simd(detected);
+        std::cout << "    load             " << ns_per_call(iterations, [&](int) { analytics.load(book); sink += analytics.back_overround(); }) << "\n";
+        std::cout << "    incremental      " << ns_per_call(iterations, [&](int) { analytics.apply(changed); sink += analytics.back_overround(); }) << "\n";
+
+        // Check the results agree with the naive version
+        naive_analytics(book, naive);
+        analytics.load(book);
+        double max_error = std::abs(naive.back_book * 100.0 - analytics.back_overround()) + std::abs(naive.lay_book * 100.0 - analytics.lay_overround());
+        for (int i = 0; i < runners; ++i)
+        {
+            max_error = std::max(max_error, std::abs(naive.back_wap[i] - analytics.back_wap()[i]));
+            max_error = std::max(max_error, std::abs(naive.lay_wap[i] - analytics.lay_wap()[i]));
+            max_error = std::max(max_error, std::abs(naive.vwap[i] - analytics.traded_vwap()[i]));
+        }
+        std::cout << "    back book " << analytics.back_overround() << "%, lay book " << analytics.lay_overround()
+                  << "%, max difference from naive " << max_error << (sink != 0.0 ? "" : " ") << "\n";
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,384 @@
+//==============================================================================
+//
+// Replay a recorded day of markets through the simulator with run_backtest()
+// and report throughput. The recording is read with bfapi::historical (tar,
+// bz2, plain or columnar files, as historical_ingest.cpp) and each market's
+// stream is turned into a feed of market books through a market_cache. With
+// no paths a synthetic day is written to a temporary directory first: markets
+// of six runners whose prices wander a tick at a time and trade on both sides,
+// turning in play near the end and then closing.
+//
+// The strategy joins the queues on both sides of the first runner every 100
+// books until the market turns in play, when the simulator lapses what is left.
+// The backtest is run on one thread and then on threads threads (0 = one per
+// hardware thread); both runs must give the same orders and fills.
+//
+//         ./backtest_replay.out [-t threads] [-m markets] [-u updates per market] [path...]
+//
+// Exits with a failure status if a check fails.
+//==============================================================================
+#include "../betfair/simulator.hpp"
+#include "../betfair/historical.hpp"
+#include "../betfair/dates.hpp"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+using bfapi::simulator::market_feed;
+using bfapi::simulator::market_result;
+
+const int runner_count = 6;
+
+//==============================================================================
+void append_level(std::string& out, const char* key, const std::map<int, double>& levels)
+{
+    char buf[64];
+    out += std::string(",\"") + key + "\":[";
+    bool first = true;
+    for (const auto& level : levels)
+    {
+        std::snprintf(buf, sizeof(buf), "%s[%.2f,%.2f]", first ? "" : ",", bfapi::ticks::tick_to_price(level.first), level.second);
+        out += buf;
+        first = false;
+    }
+    out += "]";
+}
+
+//==============================================================================
+std::string definition_json(const std::string& status, bool inplay, const std::string& market_time)
+{
+    std::string out = "\"marketDefinition\":{\"status\":\"" + status + "\",\"inPlay\":" + (inplay ? "true" : "false") +
+                      ",\"betDelay\":" + (inplay ? "1" : "0") + ",\"version\":1,\"marketType\":\"WIN\",\"eventId\":\"1\","
+                      "\"eventTypeId\":\"7\",\"marketTime\":\"" + market_time + "\",\"runners\":[";
+    for (int r = 0; r < runner_count; ++r)
+    {
+        out += (r ? "," : "") + std::string("{\"id\":") + std::to_string(1000 + r) + ",\"status\":\"ACTIVE\",\"sortPriority\":" +
+               std::to_string(r + 1) + "}";
+    }
+    return out + "]}";
+}
+
+//==============================================================================
+// Write one stream file for each market: an image, then updates one second
+// apart each moving one runner, in play for the last tenth, then closed.
+// Returns the number of messages written.
+std::uint64_t write_day(const std::string& dir, int markets, int updates, std::string& error)
+{
+    std::int64_t day_start = 0;
+    bfapi::dates::parse_iso8601("2024-06-01T12:00:00.000Z", day_start);
+    std::uint64_t messages = 0;
+    for (int m = 0; m < markets; ++m)
+    {
+        const std::string market_id = "1." + std::to_string(200000000 + m);
+        std::ofstream file(dir + "/" + market_id);
+        if (false == file.good())
+        {
+            error = "Cannot write to " + dir;
+            return 0;
+        }
+        std::mt19937 rng(static_cast<unsigned>(m) + 1);
+        std::int64_t pt = day_start + static_cast<std::int64_t>(m) * 60000;
+        const std::string market_time = bfapi::dates::to_iso8601_ms(pt + updates * 1000LL * 9 / 10);
+
+        // Best back tick per runner; the three ticks at and below it are offered
+        // to back, the three above to lay
+        std::vector<int> best(runner_count);
+        std::vector<std::map<int, double>> traded(runner_count);
+        std::string line;
+        for (int u = 0; u <= updates + 1; ++u, pt += 1000)
+        {
+            line = "{\"op\":\"mcm\",\"clk\":\"" + std::to_string(u) + "\",\"pt\":" + std::to_string(pt) + ",\"mc\":[{\"id\":\"" + market_id + "\"";
+            if (0 == u)
+            {
+                line += ",\"img\":true," + definition_json("OPEN", false, market_time);
+            }
+            else if (updates * 9 / 10 == u)
+            {
+                line += "," + definition_json("OPEN", true, market_time);
+            }
+            else if (updates + 1 == u)
+            {
+                line += "," + definition_json("CLOSED", true, market_time) + "}]}\n";
+                file << line;
+                ++messages;
+                break;
+            }
+            line += ",\"rc\":[";
+            for (int r = 0; r < runner_count; ++r)
+            {
+                if (0 != u && static_cast<int>(rng() % runner_count) != r)
+                {
+                    continue;
+                }
+                std::map<int, double> atb, atl;
+                const int old = best[r];
+                best[r] = (0 == u) ? 20 + 15 * r : std::max(3, std::min(bfapi::ticks::tick_count - 5, old + static_cast<int>(rng() % 3) - 1));
+                if (0 != u && best[r] != old)
+                {
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        atb[old - k] = 0.0;
+                        atl[old + 1 + k] = 0.0;
+                    }
+                }
+                for (int k = 0; k < 3; ++k)
+                {
+                    atb[best[r] - k] = 20.0 + rng() % 200;
+                    atl[best[r] + 1 + k] = 20.0 + rng() % 200;
+                }
+                std::map<int, double> trd;
+                const int trade_tick = best[r] + static_cast<int>(rng() % 2);
+                trd[trade_tick] = (traded[r][trade_tick] += 2.0 + rng() % 40);
+                line += (line.back() == '[' ? "{\"id\":" : ",{\"id\":") + std::to_string(1000 + r);
+                append_level(line, "atb", atb);
+                append_level(line, "atl", atl);
+                append_level(line, "trd", trd);
+                line += "}";
+            }
+            line += "]}]}\n";
+            file << line;
+            ++messages;
+        }
+        if (false == file.good())
+        {
+            error = "Cannot write to " + dir;
+            return 0;
+        }
+    }
+    return messages;
+}
+
+//==============================================================================
+// Passive orders on both sides of the first runner every 100 books before the off
+bfapi::simulator::book_handler make_strategy(const std::string& market_id)
+{
+    std::uint64_t books = 0;
+    int orders = 0;
+    return [market_id, books, orders](bfapi::simulator::market_simulator& sim, const bfapi::responses::market_book& book) mutable
+    {
+        if (0 != ++books % 100 || book.inplay || "OPEN" != book.status || book.runners.empty())
+        {
+            return;
+        }
+        const bfapi::responses::runner_book& rb = book.runners.front();
+        if (rb.available_to_back.empty() || rb.available_to_lay.empty())
+        {
+            return;
+        }
+        std::vector<bfapi::orders::limit_order_instruction> order_list;
+        order_list.emplace_back(rb.selection_id, false, 2.0, rb.available_to_lay.front().price, false,
+                                bfapi::orders::customer_order_ref("BT_" + std::to_string(++orders)));
+        order_list.emplace_back(rb.selection_id, true, 2.0, rb.available_to_back.front().price, false,
+                                bfapi::orders::customer_order_ref("BT_" + std::to_string(++orders)));
+        bfapi::orders::place_limit_orders_request request(market_id, false, order_list);
+        bfapi::responses::place_execution_report report;
+        sim.place_orders(request, report);
+    };
+}
+
+//==============================================================================
+bool check(bool ok, const std::string& what)
+{
+    std::cout << (ok ? "PASS: " : "FAIL: ") << what << std::endl;
+    return ok;
+}
+
+//==============================================================================
+// A placeOrders request of any order type: LIMIT instructions are matched, and
+// one MARKET_ON_CLOSE instruction fails the request as the live API would
+bool check_order_types()
+{
+    bfapi::simulator::market_simulator sim("1.1");
+    bfapi::responses::market_book book;
+    book.market_id = "1.1";
+    book.status = "OPEN";
+    book.runners.resize(1);
+    book.runners[0].selection_id = 10;
+    book.runners[0].status = "ACTIVE";
+    book.runners[0].available_to_back.emplace_back(2.0, 100.0);
+    book.runners[0].available_to_lay.emplace_back(2.02, 100.0);
+    sim.on_market_book(book, 0);
+
+    bfapi::orders::place_instruction_batch limits;
+    limits.emplace_limit(10, false, 5.0, 2.0, false);
+    bfapi::responses::place_execution_report report;
+    const bool placed = sim.place_orders(bfapi::orders::place_orders_request("1.1", false, limits), report) &&
+                        1 == report.instruction_reports.size() && 5.0 == report.instruction_reports[0].size_matched;
+
+    bfapi::orders::place_instruction_batch mixed = limits;
+    mixed.emplace_market_on_close(10, true, 5.0);
+    const bool refused = false == sim.place_orders(bfapi::orders::place_orders_request("1.1", false, mixed), report) &&
+                         2 == report.instruction_reports.size() &&
+                         "ERROR_IN_ORDER" == report.instruction_reports[0].error_code &&
+                         "MARKET_NOT_OPEN_FOR_BSP_BETTING" == report.instruction_reports[1].error_code &&
+                         1 == sim.get_orders().size();
+    return check(placed && refused, "LIMIT instructions of a placeOrders request matched, MARKET_ON_CLOSE refused");
+}
+
+//==============================================================================
+// Run the backtest and report throughput; totals of the run are returned in total
+bool replay(const std::vector<market_feed>& feeds, std::size_t threads, std::uint64_t books,
+            std::vector<market_result>& results, bfapi::simulator::sim_stats& total)
+{
+    std::string error = "";
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const bool ok = bfapi::simulator::run_backtest(feeds, make_strategy, threads, results, error);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (false == ok)
+    {
+        std::cerr << error << std::endl;
+        return false;
+    }
+
+    total = bfapi::simulator::sim_stats();
+    for (const market_result& r : results)
+    {
+        total.books += r.stats.books;
+        total.orders_placed += r.stats.orders_placed;
+        total.orders_lapsed += r.stats.orders_lapsed;
+        total.fills += r.stats.fills;
+        total.size_matched += r.stats.size_matched;
+    }
+    std::cout << "Backtest on " << (threads ? std::to_string(threads) : std::string("all")) << " thread(s): " << seconds * 1000.0
+              << " ms, " << static_cast<std::uint64_t>(books / seconds) << " books/s, " << feeds.size() / seconds
+              << " markets/s; " << total.orders_placed << " orders placed, " << total.fills << " fills, matched "
+              << total.size_matched << ", " << total.orders_lapsed << " lapsed" << std::endl;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t threads = 0;
+    int markets = 50;
+    int updates = 2000;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc)
+        {
+            threads = std::stoul(argv[++i]);
+        }
+        else if (arg == "-m" && i + 1 < argc)
+        {
+            markets = std::stoi(argv[++i]);
+        }
+        else if (arg == "-u" && i + 1 < argc)
+        {
+            updates = std::stoi(argv[++i]);
+        }
+        else
+        {
+            paths.push_back(arg);
+        }
+    }
+
+    std::string error = "";
+    std::string temp_dir = "";
+    if (paths.empty())
+    {
+        char dir[] = "/tmp/bfapi_backtest_XXXXXX";
+        if (nullptr == ::mkdtemp(dir))
+        {
+            std::cerr << "Cannot create a temporary directory" << std::endl;
+            return EXIT_FAILURE;
+        }
+        temp_dir = dir;
+        const std::uint64_t written = write_day(temp_dir, markets, updates, error);
+        if (0 == written)
+        {
+            std::cerr << error << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::cout << "Synthetic day: " << markets << " markets, " << written << " messages in " << temp_dir << std::endl;
+        paths.push_back(temp_dir);
+    }
+
+    // A market_cache per market turns its changes into books; each market is
+    // only updated by the thread reading its source, so the lock is only
+    // needed to find the entry
+    struct market_entry {
+        bfapi::stream::market_cache cache;
+        market_feed feed;
+
+        explicit market_entry(const std::string& id) : cache(id) { feed.market_id = id; }
+    };
+    std::mutex mtx;
+    std::map<std::string, std::unique_ptr<market_entry>> entries;
+    auto handler = [&](const bfapi::historical::source&, const bfapi::stream::market_change_message& msg)
+    {
+        for (const bfapi::stream::market_change& mc : msg.mc)
+        {
+            market_entry* entry = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                std::unique_ptr<market_entry>& e = entries[mc.id];
+                if (nullptr == e)
+                {
+                    e.reset(new market_entry(mc.id));
+                }
+                entry = e.get();
+            }
+            entry->cache.apply(mc, msg.pt);
+            entry->feed.books.emplace_back(msg.pt, bfapi::responses::market_book());
+            entry->cache.to_market_book(entry->feed.books.back().book);
+        }
+    };
+    bfapi::historical::ingest_stats stats;
+    const bool ingested = bfapi::historical::ingest(paths, threads, handler, stats, error);
+    if (false == temp_dir.empty())
+    {
+        std::vector<bfapi::historical::source> sources;
+        std::string ignored;
+        bfapi::historical::list_sources(paths, sources, ignored);
+        for (const bfapi::historical::source& s : sources)
+        {
+            ::unlink(s.path.c_str());
+        }
+        ::rmdir(temp_dir.c_str());
+    }
+    if (false == error.empty())
+    {
+        std::cerr << error << std::endl;
+    }
+    if (false == ingested)
+    {
+        return EXIT_FAILURE;
+    }
+
+    std::vector<market_feed> feeds;
+    std::uint64_t books = 0;
+    for (auto& e : entries)
+    {
+        books += e.second->feed.books.size();
+        feeds.push_back(std::move(e.second->feed));
+    }
+    entries.clear();
+    std::cout << "Ingest: " << stats.messages << " messages in " << stats.elapsed_ns / 1e6 << " ms, " << feeds.size()
+              << " markets, " << books << " books" << std::endl;
+
+    bool ok = check_order_types();
+    std::vector<market_result> single_results, results;
+    bfapi::simulator::sim_stats single, total;
+    ok = check(replay(feeds, 1, books, single_results, single), "backtest on one thread") && ok;
+    ok = check(replay(feeds, threads, books, results, total), "backtest on several threads") && ok;
+    ok = check(books == total.books && total.orders_placed > 0 && total.fills > 0, "every book replayed and orders filled") && ok;
+
+    bool same = single_results.size() == results.size();
+    for (std::size_t i = 0; same && i < results.size(); ++i)
+    {
+        same = results[i].market_id == single_results[i].market_id && results[i].stats.fills == single_results[i].stats.fills &&
+               results[i].stats.size_matched == single_results[i].stats.size_matched &&
+               results[i].orders.size() == single_results[i].orders.size();
+    }
+    ok = check(same, "same results whatever the number of threads") && ok;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,106 @@
+//==============================================================================
+//
+// Combine several API calls into a single JSON-RPC round trip. Two low risk lay
+// orders are placed on the Superbowl winner market alongside a listMarketBook
+// call for the same market, and the results are pulled back out by call id.
+// The batch is sent on a keep-alive connection leased from a pool.
+//
+//==============================================================================
+#include "../betfair/bfapi.hpp"
+#include "../betfair/connection.hpp"
+#include "../betfair/jsonrpc.hpp"
+#include <iostream>
+#include <string>
+#include <chrono>
+
+using std::chrono::high_resolution_clock;
+using std::chrono::duration;
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        std::cerr << "Invalid parameters (must supply path to config file)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string session_token = "";
+    bfapi::accinfo user_info;
+    if (bfapi::extract_user_credentials(argv[1], user_info))
+    {
+        std::string error = "";
+        if (false == bfapi::login(user_info,session_token,error))
+        {
+            std::cerr << "Betfair login failed: " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        std::cerr << "Unable to extract user credentials from supplied config filename." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string market_id = "1.209995594";        // Superbowl Winner 2023/24 Season
+    const std::int64_t selection_id = 50198;            // Carolina Panthers
+
+    std::vector<bfapi::orders::limit_order_instruction> first;
+    first.emplace_back(selection_id, true, 1.0, 1.01, false, "TEST_BATCH_1");
+    std::vector<bfapi::orders::limit_order_instruction> second;
+    second.emplace_back(selection_id, true, 1.0, 1.02, false, "TEST_BATCH_2");
+
+    std::string error = "";
+    bfapi::jsonrpc::batch b;
+    const int po1 = b.add_place_orders(bfapi::orders::place_limit_orders_request(market_id, false, first), error);
+    if (po1 < 0)
+    {
+        std::cerr << "First placeOrders rejected: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+    const int po2 = b.add_place_orders(bfapi::orders::place_limit_orders_request(market_id, false, second), error);
+    if (po2 < 0)
+    {
+        std::cerr << "Second placeOrders rejected: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+    const int mb  = b.add_list_market_book({market_id});
+
+    bfapi::connection_pool pool(user_info, session_token, 1);
+    auto t1 = high_resolution_clock::now();
+    const bool sent = b.send(*pool.acquire(), error);
+    auto t2 = high_resolution_clock::now();
+    duration<double, std::milli> ms_double = t2 - t1;
+    std::cout << "Batch of " << b.size() << " calls returned after " << ms_double.count() << "ms\n";
+    if (false == sent)
+    {
+        std::cerr << "Batch failed: " << error << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    for (const int id : {po1, po2})
+    {
+        bfapi::responses::place_execution_report report;
+        if (b.get_place_orders_result(id, report, error))
+        {
+            std::cout << "placeOrders (id " << id << ") status = " << report.status << ", errorCode = " << report.error_code << std::endl;
+        }
+        else
+        {
+            std::cout << error << std::endl;
+        }
+    }
+
+    std::vector<bfapi::responses::market_book> books;
+    if (b.get_market_book_result(mb, books, error))
+    {
+        for (const bfapi::responses::market_book& book : books)
+        {
+            std::cout << "Market " << book.market_id << " status = " << book.status << ", runners = " << book.runners.size() << std::endl;
+        }
+    }
+    else
+    {
+        std::cout << error << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
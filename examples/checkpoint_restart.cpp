@@ -0,0 +1,254 @@
+//==============================================================================
+//
+// Checkpoint synthetic market caches and current orders, restore them as a
+// restarted process would and check that the restored state matches and that
+// further stream changes apply the same way. Reports how long capture() holds
+// up the calling thread compared with the background write, and the restore
+// time. No login is needed:
+//
+//         ./checkpoint_restart.out [markets] [runners] [file]
+//
+// Exits with a failure status if any check fails or if a warm capture()
+// allocates.
+//==============================================================================
+#include "../betfair/alloc_counter.hpp"
+#include "../betfair/checkpoint.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+using clock_type = std::chrono::steady_clock;
+
+//==============================================================================
+bool check(bool ok, const std::string& what)
+{
+    std::cout << (ok ? "PASS " : "FAIL ") << what << std::endl;
+    return ok;
+}
+
+//==============================================================================
+// A market change with a full depth ladder for every runner; img replaces the
+// cached market, otherwise only a few levels are updated
+bfapi::stream::market_change make_change(int market, int runners, int round, bool img)
+{
+    bfapi::stream::market_change mc;
+    mc.id = "1.2" + std::to_string(10000000 + market);
+    mc.img = img;
+    mc.has_tv = true;
+    mc.tv = 1000.0 * market + 10.0 * round;
+    if (img)
+    {
+        mc.has_definition = true;
+        mc.definition.status = "OPEN";
+        mc.definition.version = 1000 + round;
+        mc.definition.bet_delay = 0;
+        mc.definition.market_type = "WIN";
+        mc.definition.event_id = std::to_string(30000000 + market / 8);
+        mc.definition.event_type_id = "7";
+        mc.definition.market_time = "2026-10-19T14:30:00.000Z";
+        for (int r = 0; r < runners; ++r)
+        {
+            bfapi::stream::runner_definition rd;
+            rd.id = 100000 + r;
+            rd.status = "ACTIVE";
+            rd.sort_priority = r + 1;
+            mc.definition.runners.push_back(rd);
+        }
+    }
+    const int depth = img ? 30 : 3;
+    for (int r = 0; r < runners; ++r)
+    {
+        bfapi::stream::runner_change rc;
+        rc.id = 100000 + r;
+        rc.has_ltp = true;
+        rc.ltp = 2.0 + r + 0.01 * round;
+        rc.has_tv = true;
+        rc.tv = 50.0 * r + round;
+        for (int l = 0; l < depth; ++l)
+        {
+            const double back = 2.0 + r - 0.01 * (l + 1);
+            const double lay = 2.0 + r + 0.01 * (l + 1);
+            const double size = 10.0 + l + round;
+            rc.atb.emplace_back(back, size);
+            rc.atl.emplace_back(lay, size);
+            rc.trd.emplace_back(back, 5.0 * size);
+            if (l < 10)
+            {
+                rc.batb.emplace_back(l, back, size);
+                rc.batl.emplace_back(l, lay, size);
+            }
+        }
+        mc.rc.push_back(rc);
+    }
+    return mc;
+}
+
+//==============================================================================
+bool same_books(const bfapi::stream::market_cache& a, const bfapi::stream::market_cache& b)
+{
+    bfapi::responses::market_book x;
+    bfapi::responses::market_book y;
+    a.to_market_book(x, 1000);
+    b.to_market_book(y, 1000);
+    auto same_ladder = [](const std::vector<bfapi::responses::price_size>& p, const std::vector<bfapi::responses::price_size>& q)
+    {
+        if (p.size() != q.size())
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < p.size(); ++i)
+        {
+            if (p[i].price != q[i].price || p[i].size != q[i].size)
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+    if (x.market_id != y.market_id || x.status != y.status || x.inplay != y.inplay || x.version != y.version ||
+        x.total_matched != y.total_matched || x.runners.size() != y.runners.size() ||
+        a.publish_time() != b.publish_time() || a.get_definition().market_time != b.get_definition().market_time)
+    {
+        return false;
+    }
+    for (std::size_t i = 0; i < x.runners.size(); ++i)
+    {
+        const bfapi::responses::runner_book& r = x.runners[i];
+        const bfapi::responses::runner_book& s = y.runners[i];
+        if (r.selection_id != s.selection_id || r.status != s.status || r.last_price_traded != s.last_price_traded ||
+            r.total_matched != s.total_matched || false == same_ladder(r.available_to_back, s.available_to_back) ||
+            false == same_ladder(r.available_to_lay, s.available_to_lay) || false == same_ladder(r.traded_volume, s.traded_volume))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const int market_count = argc > 1 ? std::atoi(argv[1]) : 200;
+    const int runner_count = argc > 2 ? std::atoi(argv[2]) : 20;
+    const std::string path = argc > 3 ? argv[3] : "checkpoint_restart.bin";
+    if (market_count <= 0 || runner_count <= 0)
+    {
+        std::cerr << "Invalid parameters (markets and runners must be positive)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<bfapi::stream::market_cache> caches;
+    std::vector<const bfapi::stream::market_cache*> markets;
+    const std::int64_t pt = 1792420000000;
+    for (int m = 0; m < market_count; ++m)
+    {
+        caches.emplace_back();
+        caches.back().apply(make_change(m, runner_count, 0, true), pt);
+        caches.back().apply(make_change(m, runner_count, 1, false), pt + 50);
+    }
+    for (const bfapi::stream::market_cache& c : caches)
+    {
+        markets.push_back(&c);
+    }
+    std::vector<bfapi::responses::current_order> orders(50);
+    for (std::size_t i = 0; i < orders.size(); ++i)
+    {
+        orders[i].bet_id = std::to_string(350000000000 + i);
+        orders[i].market_id = caches[i % caches.size()].get_market_id();
+        orders[i].selection_id = 100000 + i % runner_count;
+        orders[i].price = 3.5;
+        orders[i].size = 2.0 + i;
+        orders[i].side = i % 2 ? "LAY" : "BACK";
+        orders[i].status = "EXECUTABLE";
+        orders[i].customer_order_ref = "ref-" + std::to_string(i);
+    }
+    bfapi::checkpoint::stream_clocks market_clocks;
+    bfapi::stream::market_change_message msg;
+    msg.initial_clk = "G1EsH5nJFcgJ2rGd8QnB2ZqB7A==";
+    msg.clk = "AAAAAAAAAAAAAA==";
+    market_clocks.update(msg);
+    msg.initial_clk.clear();
+    msg.clk = "AMkNAJk+AOEN";
+    market_clocks.update(msg);
+    bfapi::checkpoint::stream_clocks order_clocks;
+    order_clocks.initial_clk = "2BSUiQPpI5AEkQTIBJAE";
+    order_clocks.clk = "AAAAAAAA";
+
+    bool ok = true;
+    std::string error = "";
+    {
+        // The first captures grow the buffers; later ones reuse them
+        bfapi::checkpoint::checkpointer cp(path, std::chrono::seconds(0));
+        const int rounds = 20;
+        bfapi::alloc_counter::counts warm;
+        for (int i = 0; i < rounds; ++i)
+        {
+            bfapi::alloc_counter::scope s;
+            cp.capture(markets, orders, market_clocks, order_clocks);
+            if (i >= 2)
+            {
+                const bfapi::alloc_counter::counts c = s.elapsed();
+                warm.allocations += c.allocations;
+            }
+        }
+        ok = check(cp.flush(error), error.empty() ? "snapshots written" : "snapshots written: " + error) && ok;
+        const bfapi::checkpoint::checkpoint_stats st = cp.stats();
+        std::cout << "Captured " << st.captured << ", written " << st.written << ", superseded " << st.superseded
+                  << ", file " << st.last_bytes / 1e6 << " MB" << std::endl;
+        std::cout << "capture() on the caller: last " << st.last_capture_us << " us, max " << st.max_capture_us
+                  << " us; background write: last " << st.last_write_ms << " ms, max " << st.max_write_ms << " ms" << std::endl;
+        ok = check(0 == warm.allocations, "no heap allocations in warm capture()") && ok;
+        ok = check(st.written + st.superseded == st.captured, "every capture written or superseded") && ok;
+    }
+
+    bfapi::checkpoint::restored_state state;
+    const clock_type::time_point start = clock_type::now();
+    const bool restored = bfapi::checkpoint::restore(path, state, error);
+    const double restore_ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+    ok = check(restored, error.empty() ? "restore" : "restore: " + error) && ok;
+    std::cout << "Restored " << state.markets.size() << " markets and " << state.orders.size() << " orders in " << restore_ms
+              << " ms" << std::endl;
+
+    bool same = state.markets.size() == caches.size() && state.orders.size() == orders.size();
+    for (std::size_t i = 0; same && i < caches.size(); ++i)
+    {
+        same = same_books(caches[i], state.markets[i]);
+    }
+    for (std::size_t i = 0; same && i < orders.size(); ++i)
+    {
+        same = state.orders[i].bet_id == orders[i].bet_id && state.orders[i].size == orders[i].size &&
+               state.orders[i].side == orders[i].side && state.orders[i].customer_order_ref == orders[i].customer_order_ref;
+    }
+    ok = check(same, "restored markets and orders match") && ok;
+    ok = check(state.market_stream.initial_clk == market_clocks.initial_clk && state.market_stream.clk == market_clocks.clk &&
+               state.order_stream.clk == order_clocks.clk, "restored clocks match") && ok;
+
+    // The deltas a resumed stream would send must apply the same way to the restored caches
+    for (std::size_t i = 0; i < caches.size() && i < state.markets.size(); ++i)
+    {
+        const bfapi::stream::market_change delta = make_change(static_cast<int>(i), runner_count, 2, false);
+        caches[i].apply(delta, pt + 100);
+        state.markets[i].apply(delta, pt + 100);
+        same = same && same_books(caches[i], state.markets[i]);
+    }
+    ok = check(same, "deltas after restore match") && ok;
+
+    std::cout << bfapi::checkpoint::market_subscription_json(1, state.market_stream, "{\"eventTypeIds\":[\"7\"]}",
+                                                              "{\"fields\":[\"EX_ALL_OFFERS\",\"EX_TRADED\"]}") << std::endl;
+    std::cout << bfapi::checkpoint::order_subscription_json(2, state.order_stream) << std::endl;
+
+    // A damaged file must be refused rather than half restored
+    if (FILE* f = std::fopen(path.c_str(), "r+b"))
+    {
+        std::fseek(f, -1, SEEK_END);
+        std::fputc('x', f);
+        std::fclose(f);
+    }
+    bfapi::checkpoint::restored_state damaged;
+    ok = check(false == bfapi::checkpoint::restore(path, damaged, error) && damaged.markets.empty(), "corrupt file refused") && ok;
+    std::remove(path.c_str());
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
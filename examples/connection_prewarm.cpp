@@ -0,0 +1,198 @@
+//==============================================================================
+//
+// Pre-warm pool connections ahead of two scheduled markets and compare the
+// first order at each start with the first order on a cold pool. Requests are
+// answered by a TLS server on the loopback interface in this process, which
+// waits setup_delay_ms before each handshake (standing in for the DNS, TCP and
+// TLS round trips to a distant host) and drops connections idle for
+// idle_timeout_ms, as servers and load balancers do. No login is needed.
+//
+// A certificate and key for the local server are required, e.g.
+//
+//         openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 30 -subj "/CN=localhost"
+//         ./connection_prewarm.out cert.pem key.pem
+//
+// Exits with a failure status if a check fails.
+//==============================================================================
+#include "../betfair/prewarm.hpp"
+#include "../betfair/dates.hpp"
+#include "loopback_tls_server.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <ctime>
+#include <cstdlib>
+
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+using tcp = net::ip::tcp;
+using wall_clock = std::chrono::system_clock;
+
+const int setup_delay_ms = 60;
+const int idle_timeout_ms = 700;
+
+struct server_counts {
+    std::atomic<int> connections{0};
+    std::atomic<int> keep_alives{0};
+    std::atomic<int> orders{0};
+};
+
+//==============================================================================
+loopback::request_handler accept_connection(server_counts& counts)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(setup_delay_ms));
+    ++counts.connections;
+    return [&counts](tcp::socket&, const loopback::request& req, loopback::response& res)
+    {
+        const bool order = (req.target() == bfapi::place_orders_endpoint);
+        ++(order ? counts.orders : counts.keep_alives);
+        res.body() = order ? "{\"status\":\"SUCCESS\",\"marketId\":\"1.1\",\"instructionReports\":[]}"
+                           : "[{\"eventType\":{\"id\":\"7\",\"name\":\"Horse Racing\"},\"marketCount\":412}]";
+        return loopback::action::respond;
+    };
+}
+
+//==============================================================================
+bool check(bool ok, const std::string& what)
+{
+    std::cout << (ok ? "PASS: " : "FAIL: ") << what << std::endl;
+    return ok;
+}
+
+//==============================================================================
+// Send an order the way a strategy would at the off, returning the time taken
+// to acquire the connection and get the response
+double place_order(bfapi::connection_pool& pool, bfapi::connection_prewarmer* warmer, const std::string& market_id, bool& ok)
+{
+    const std::string body = "{\"marketId\":\"" + market_id + "\",\"instructions\":[{\"selectionId\":50198,\"side\":\"LAY\","
+                             "\"orderType\":\"LIMIT\",\"limitOrder\":{\"size\":2.0,\"price\":1.01,\"persistenceType\":\"LAPSE\"}}]}";
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bfapi::connection_pool::lease conn = warmer ? warmer->acquire_for_order(market_id) : pool.acquire();
+    bfapi::http_result result;
+    std::string error;
+    ok = conn->post(bfapi::place_orders_endpoint, body, result, error) && 200 == result.status;
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if (false == ok)
+    {
+        std::cout << "Order on " << market_id << " failed: " << error << std::endl;
+    }
+    return ms;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Invalid parameters (must supply paths to server certificate and key files)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        loopback::tls_server server(argv[1], argv[2]);
+        const std::string port = server.port();
+        server_counts counts;
+        server.set_idle_timeout(std::chrono::milliseconds(idle_timeout_ms));
+        server.serve_connections([&counts](tcp::socket&) { return accept_connection(counts); });
+
+        bfapi::accinfo user_info;
+        user_info.appkey = "appkey";
+        bool ok = true;
+        bool sent = false;
+
+        // Baseline: the first order on a pool that has not connected yet
+        bfapi::connection_pool cold_pool(user_info, "token", 4, "127.0.0.1", port);
+        cold_pool.tls_context().set_verify_mode(ssl::verify_none);     // Self signed local certificate
+        const double cold_ms = place_order(cold_pool, nullptr, "1.100", sent);
+        ok = check(sent, "cold order") && ok;
+
+        // Two markets from a catalogue, starting on the next whole seconds (catalogue times have no fractions)
+        const std::time_t now = std::time(nullptr);
+        std::vector<bfapi::responses::market_catalogue> catalogue(2);
+        catalogue[0].market_id = "1.201";
+        catalogue[0].market_start_time = bfapi::dates::to_iso8601(now + 2);
+        catalogue[1].market_id = "1.202";
+        catalogue[1].market_start_time = bfapi::dates::to_iso8601(now + 3);
+
+        bfapi::prewarm_policy policy;
+        policy.lead_time = std::chrono::milliseconds(1000);
+        policy.hold_time = std::chrono::milliseconds(300);
+        policy.connections_per_market = 2;
+        policy.keep_alive_interval = std::chrono::milliseconds(250);
+        policy.max_idle = std::chrono::milliseconds(idle_timeout_ms - 100);
+        policy.tick_interval = std::chrono::milliseconds(50);
+        bfapi::connection_pool pool(user_info, "token", 4, "127.0.0.1", port);
+        pool.tls_context().set_verify_mode(ssl::verify_none);
+        bfapi::connection_prewarmer warmer(pool, policy);
+        ok = check(2 == warmer.schedule(catalogue), "markets scheduled from the catalogue") && ok;
+        ok = check(0 == warmer.target(wall_clock::from_time_t(now)) &&
+                   4 == warmer.target(wall_clock::from_time_t(now + 2)), "target connections follow the market windows") && ok;
+        warmer.start();
+
+        // Idle until each off (longer than the server's idle timeout), then send the first order
+        std::vector<double> warm_ms;
+        for (const bfapi::responses::market_catalogue& m : catalogue)
+        {
+            std::time_t start = 0;
+            bfapi::dates::from_iso8601(m.market_start_time, start);
+            std::this_thread::sleep_until(wall_clock::from_time_t(start));
+            warm_ms.push_back(place_order(pool, &warmer, m.market_id, sent));
+            ok = check(sent, "order at the start of " + m.market_id) && ok;
+        }
+
+        // Long after both windows the connections have been dropped, so an unscheduled market finds a cold one
+        std::this_thread::sleep_for(std::chrono::milliseconds(policy.hold_time + std::chrono::milliseconds(idle_timeout_ms + 200)));
+        const double late_ms = place_order(pool, &warmer, "1.300", sent);
+        ok = check(sent, "order on an unscheduled market") && ok;
+        // The window of 1.201 has passed but it has not been unscheduled, so this is not a first order
+        place_order(pool, &warmer, "1.201", sent);
+        ok = check(sent, "later order on a scheduled market") && ok;
+        warmer.stop();
+
+        const bfapi::prewarm_stats st = warmer.stats();
+        std::cout << "First order on a cold pool " << cold_ms << " ms; at the off with pre-warming " << warm_ms[0] << " ms and "
+                  << warm_ms[1] << " ms; unscheduled market after idling " << late_ms << " ms" << std::endl;
+        std::cout << "Pre-warmer: " << st.connects << " connects (" << st.total_connect_ms << " ms off the order path), "
+                  << st.keep_alives << " keep-alives, " << st.stale_closed << " stale connections closed, " << st.warm_orders
+                  << " of " << st.orders << " orders warm" << std::endl;
+        std::cout << "Server: " << counts.connections << " connections, " << counts.keep_alives << " keep-alives, "
+                  << server.idle_closes() << " closed when idle" << std::endl;
+        for (const bfapi::first_order_record& r : st.first_orders)
+        {
+            std::cout << "  first order " << r.market_id << (r.warm ? " warm" : " cold")
+                      << (r.scheduled ? ", " + std::to_string(r.ms_from_start) + " ms after the start" : ", not scheduled") << std::endl;
+        }
+
+        ok = check(3 == st.first_orders.size() && st.first_orders[0].warm && st.first_orders[1].warm &&
+                   st.first_orders[0].scheduled && st.first_orders[1].scheduled, "first orders of scheduled markets found warm connections") && ok;
+        ok = check(3 == st.first_orders.size() && false == st.first_orders[2].warm && false == st.first_orders[2].scheduled,
+                   "unscheduled market after the windows found a cold connection") && ok;
+        ok = check(st.keep_alives > 0 && 0 == st.keep_alive_failures && st.connects >= 2 && 0 == st.connect_failures,
+                   "connections opened ahead of the start and kept alive") && ok;
+        ok = check(warm_ms[0] < cold_ms - setup_delay_ms / 2 && warm_ms[1] < cold_ms - setup_delay_ms / 2,
+                   "warm first orders skip connection setup") && ok;
+
+        // A long running process keeps only the most recent first orders
+        bfapi::prewarm_policy small;
+        small.max_first_orders = 2;
+        bfapi::connection_prewarmer bounded(pool, small);
+        for (const char* market_id : {"1.401", "1.402", "1.403", "1.403"})
+        {
+            place_order(pool, &bounded, market_id, sent);
+        }
+        bounded.unschedule("1.402");
+        place_order(pool, &bounded, "1.402", sent);
+        const bfapi::prewarm_stats bst = bounded.stats();
+        ok = check(2 == bst.first_orders.size() && "1.403" == bst.first_orders[0].market_id && "1.402" == bst.first_orders[1].market_id,
+                   "first orders capped at max_first_orders and recorded again after unschedule()") && ok;
+        loopback::finish(ok);
+    }
+    catch(std::exception const& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
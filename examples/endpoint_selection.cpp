@@ -0,0 +1,273 @@
+//==============================================================================
+//
+// Exercise bfapi::endpoint_selector against loopback listeners, with a
+// stand-in resolver so no DNS or Betfair login is needed. The stand-in
+// answers "api.test" with four addresses, each on the same port:
+//
+//         127.0.0.1   black hole: accept queue kept full, so connects hang
+//         127.0.0.4   nothing listening, so connects are refused
+//         127.0.0.2   TLS server answering each request after 5 ms
+//         127.0.0.3   TLS server answering each request after 1 ms
+//
+// It checks that the first connect races past the black hole and the refused
+// address, that resolutions are cached for their TTL, that a due re-probe runs
+// in the background without holding up the connect and marks the dead
+// addresses unhealthy, that addresses are ranked on connect RTT until every
+// healthy one has a request RTT, that a server whose requests time out is left
+// for the other one, and that new connections follow the faster server once
+// both have request RTTs, including when the injected delays are swapped.
+//
+// A certificate and key for the local servers are required, e.g.
+//
+//         openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 30 -subj "/CN=localhost"
+//         ./endpoint_selection.out cert.pem key.pem
+//
+//==============================================================================
+#include "../betfair/connection.hpp"
+#include "../betfair/endpoints.hpp"
+#include "loopback_tls_server.hpp"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+
+namespace beast = boost::beast;
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+using tcp = net::ip::tcp;
+
+//==============================================================================
+// Answer every request after delay_ms
+loopback::request_handler delayed_answer(const std::atomic<int>& delay_ms)
+{
+    return [&delay_ms](tcp::socket&, const loopback::request&, loopback::response& res)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms.load()));
+        res.body() = "{}";
+        return loopback::action::respond;
+    };
+}
+
+//==============================================================================
+std::string address_of(const bfapi::api_connection& conn)
+{
+    return conn.connected_endpoint() ? conn.connected_endpoint()->address().address().to_string() : "none";
+}
+
+//==============================================================================
+void print_stats(const bfapi::endpoint_selector& selector, const std::string& port)
+{
+    std::cout << "  address      healthy  connects  failures  connect RTT us  request RTT us\n";
+    for (const bfapi::endpoint_stats& s : selector.stats("api.test", port))
+    {
+        std::cout << "  " << std::left << std::setw(12) << s.address.address().to_string() << " " << std::setw(8)
+                  << (s.healthy ? "yes" : "no") << " " << std::right << std::setw(8) << s.connects << " " << std::setw(9)
+                  << s.failures << " " << std::setw(15) << std::fixed << std::setprecision(0) << s.connect_rtt.srtt_us
+                  << " " << std::setw(15) << s.request_rtt.srtt_us << "\n";
+    }
+}
+
+//==============================================================================
+// Address ranked first for a new connection
+std::string best_address(bfapi::endpoint_selector& selector, const std::string& port)
+{
+    std::vector<bfapi::endpoint_selector::endpoint_ptr> ordered;
+    std::chrono::steady_clock::duration stagger;
+    const boost::system::error_code ec = selector.resolve("api.test", port, std::chrono::seconds(1), ordered, stagger);
+    return ec || ordered.empty() ? "none" : ordered.front()->address().address().to_string();
+}
+
+//==============================================================================
+// Wait for the background probes to reach count
+bool wait_for_probes(const bfapi::endpoint_selector& selector, std::uint64_t count)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (selector.probes() < count && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return selector.probes() >= count;
+}
+
+//==============================================================================
+bool check(bool ok, const std::string& what)
+{
+    std::cout << (ok ? "PASS: " : "FAIL: ") << what << std::endl;
+    return ok;
+}
+
+//==============================================================================
+// Connect a new connection, send requests on it and return the address it
+// used. Timed out requests are counted in timeouts (if given) rather than
+// ending the run; the next request reconnects.
+std::string new_connection(ssl::context& ctx, const std::shared_ptr<bfapi::endpoint_selector>& selector,
+                           const std::string& port, int requests, double& connect_ms,
+                           int request_ms = 2000, int* timeouts = nullptr)
+{
+    bfapi::api_connection conn(ctx, "appkey", "token", "api.test", port);
+    conn.set_endpoint_selector(selector);
+    conn.set_deadlines(bfapi::deadlines(std::chrono::milliseconds(1000), std::chrono::milliseconds(request_ms)));
+    std::string error;
+    const auto t1 = std::chrono::steady_clock::now();
+    if (false == conn.connect(error))
+    {
+        std::cerr << "Connect failed: " << error << std::endl;
+        loopback::finish(false);
+    }
+    connect_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count();
+    bfapi::http_result result;
+    for (int i = 0; i < requests; ++i)
+    {
+        if (false == conn.post("/test", "{}", result, error, true))
+        {
+            if (timeouts && conn.timed_out())
+            {
+                ++*timeouts;
+                continue;
+            }
+            std::cerr << "Request failed: " << error << std::endl;
+            loopback::finish(false);
+        }
+    }
+    return address_of(conn);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Invalid parameters (must supply paths to server certificate and key files)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        // Servers on 127.0.0.2 and 127.0.0.3, and the black hole on 127.0.0.1, share one port
+        loopback::tls_server slow(argv[1], argv[2], "127.0.0.2");
+        const unsigned short port_number = slow.endpoint().port();
+        const std::string port = slow.port();
+        loopback::tls_server fast(argv[1], argv[2], "127.0.0.3", port_number);
+        std::atomic<int> slow_delay(5);
+        std::atomic<int> fast_delay(1);
+        slow.serve(delayed_answer(slow_delay));
+        fast.serve(delayed_answer(fast_delay));
+
+        // Black hole: a listener that never accepts, with its accept queue filled so later SYNs are dropped
+        net::io_context ioc;
+        tcp::acceptor hole(ioc);
+        hole.open(tcp::v4());
+        hole.set_option(tcp::acceptor::reuse_address(true));
+        hole.bind(tcp::endpoint(net::ip::make_address("127.0.0.1"), port_number));
+        hole.listen(0);
+        net::io_context filler_ioc;
+        std::vector<std::unique_ptr<tcp::socket>> fillers;
+        for (int i = 0; i < 4; ++i)
+        {
+            fillers.emplace_back(new tcp::socket(filler_ioc));
+            fillers.back()->async_connect(hole.local_endpoint(), [](beast::error_code) {});
+        }
+        filler_ioc.run_for(std::chrono::milliseconds(200));
+
+        // Stand-in resolver with a 2 second TTL
+        std::atomic<int> resolver_calls(0);
+        bfapi::endpoint_selector::resolver_function resolver = [&](const std::string& host, const std::string& p,
+                                                                   std::chrono::steady_clock::duration,
+                                                                   std::vector<tcp::endpoint>& addresses,
+                                                                   std::chrono::seconds& ttl) -> boost::system::error_code
+        {
+            ++resolver_calls;
+            if (host != "api.test")
+            {
+                return net::error::host_not_found;
+            }
+            const unsigned short n = static_cast<unsigned short>(std::stoi(p));
+            for (const char* a : {"127.0.0.1", "127.0.0.4", "127.0.0.2", "127.0.0.3"})
+            {
+                addresses.push_back(tcp::endpoint(net::ip::make_address(a), n));
+            }
+            ttl = std::chrono::seconds(2);
+            return boost::system::error_code();
+        };
+
+        bfapi::endpoint_policy policy;
+        policy.probe_interval = std::chrono::seconds(3);
+        policy.max_stagger = std::chrono::milliseconds(100);
+        policy.failures_until_unhealthy = 1;       // The black hole only fails in the probe; the race cancels it
+        std::shared_ptr<bfapi::endpoint_selector> selector = std::make_shared<bfapi::endpoint_selector>(policy, resolver);
+
+        ssl::context ctx(ssl::context::tlsv12_client);
+        ctx.set_verify_mode(ssl::verify_none);     // Self signed local certificate
+        bool ok = true;
+        double connect_ms = 0.0;
+
+        std::cout << "Cold connect (black hole first, then the refused address):\n";
+        std::string used = new_connection(ctx, selector, port, 20, connect_ms);
+        std::cout << "  connected to " << used << " in " << connect_ms << " ms\n";
+        print_stats(*selector, port);
+        ok = check(used == "127.0.0.2" && connect_ms < 500.0, "raced past the black hole and the refused address") && ok;
+
+        std::cout << "Warm connect:\n";
+        used = new_connection(ctx, selector, port, 0, connect_ms);
+        std::cout << "  connected to " << used << " in " << connect_ms << " ms\n";
+        ok = check(used == "127.0.0.2" && connect_ms < 50.0, "went straight to the measured address") && ok;
+        ok = check(1 == resolver_calls.load(), "resolution cached (" + std::to_string(resolver_calls.load()) + " resolver call)") && ok;
+
+        std::cout << "After the probe interval:\n";
+        std::this_thread::sleep_for(std::chrono::milliseconds(3100));
+        used = new_connection(ctx, selector, port, 20, connect_ms);
+        std::cout << "  connected to " << used << " in " << connect_ms << " ms while the probe ran\n";
+        ok = check(connect_ms < 50.0, "connect did not wait for the probe of the black hole") && ok;
+        ok = check(wait_for_probes(*selector, 1), "re-probed in the background") && ok;
+        print_stats(*selector, port);
+        ok = check(2 == resolver_calls.load(), "re-resolved after the TTL expired") && ok;
+        std::vector<bfapi::endpoint_stats> stats = selector->stats("api.test", port);
+        ok = check(false == stats[0].healthy && false == stats[1].healthy, "black hole and refused address marked unhealthy") && ok;
+
+        // 127.0.0.3 has a connect RTT from the probe but no request RTT, so the
+        // 5 ms requests on 127.0.0.2 must not be weighed against it
+        const std::string by_connect = stats[3].connect_rtt.srtt_us < stats[2].connect_rtt.srtt_us ? "127.0.0.3" : "127.0.0.2";
+        used = best_address(*selector, port);
+        std::cout << "  ranked first: " << used << "\n";
+        ok = check(used == by_connect, "ranked on connect RTT while 127.0.0.3 has no request RTT") && ok;
+
+        std::cout << "127.0.0.2 stalls (answers after 300 ms, requests time out after 200 ms):\n";
+        slow_delay.store(300);
+        int timeouts = 0;
+        used = new_connection(ctx, selector, port, 20, connect_ms, 200, &timeouts);
+        slow_delay.store(5);
+        std::cout << "  " << timeouts << " request(s) timed out, requests ended on " << used << "\n";
+        stats = selector->stats("api.test", port);
+        print_stats(*selector, port);
+        ok = check(used == "127.0.0.3" && timeouts <= 1 && stats[3].request_rtt.samples > 0,
+                   "requests moved to 127.0.0.3 after at most one timeout") && ok;
+
+        // The next probe finds 127.0.0.2 answering again, so both healthy addresses have request RTTs
+        std::this_thread::sleep_for(std::chrono::milliseconds(3100));
+        new_connection(ctx, selector, port, 0, connect_ms);
+        ok = check(wait_for_probes(*selector, 2) && selector->stats("api.test", port)[2].healthy, "stalled server healthy again after a probe") && ok;
+        used = new_connection(ctx, selector, port, 0, connect_ms);
+        std::cout << "  next connection to " << used << "\n";
+        print_stats(*selector, port);
+        ok = check(used == "127.0.0.3", "new connection to the server with the lower request RTT") && ok;
+
+        std::cout << "Delays swapped (127.0.0.3 now answers after 20 ms):\n";
+        fast_delay.store(20);
+        used = new_connection(ctx, selector, port, 10, connect_ms);
+        std::cout << "  requests sent on " << used << "\n";
+        used = new_connection(ctx, selector, port, 0, connect_ms);
+        std::cout << "  next connection to " << used << "\n";
+        print_stats(*selector, port);
+        ok = check(used == "127.0.0.2", "new connection moved back to the now faster server") && ok;
+
+        loopback::finish(ok);
+    }
+    catch(std::exception const& e)
+    {
+        std::cerr << "ERROR: Exception thrown (" << e.what() << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
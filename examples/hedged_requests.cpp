@@ -0,0 +1,221 @@
+//==============================================================================
+//
+// Exercise connection_pool::post_hedged() against a TLS server on the loopback
+// interface, so no Betfair login is needed. The server answers after 1 ms
+// unless told to hold back the next requests it receives; while holding one
+// back it watches the connection and counts it as cancelled if the client
+// closes it first.
+//
+// It checks that fast calls send no hedge, that a stalled request is hedged on
+// a second connection which wins while the stalled one is cancelled, that a
+// slow hedge loses to the original request and is cancelled in turn, and that
+// the hedges are sent from threads the pool keeps rather than one per call.
+//
+// A certificate and key for the local server are required, e.g.
+//
+//         openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 30 -subj "/CN=localhost"
+//         ./hedged_requests.out cert.pem key.pem
+//
+// Exits with a failure status if a check fails.
+//==============================================================================
+#include "../betfair/connection.hpp"
+#include "loopback_tls_server.hpp"
+#include <iostream>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <fstream>
+#include <cstdlib>
+#include <poll.h>
+#include <dirent.h>
+
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+using tcp = net::ip::tcp;
+
+// Delays for the next requests the server receives, in the order received
+struct server_plan {
+    std::mutex mtx;
+    std::deque<int> delays_ms;
+    std::atomic<int> cancelled{0};      // Held back requests whose connection the client closed
+
+    int next_delay()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (delays_ms.empty())
+        {
+            return 1;
+        }
+        const int d = delays_ms.front();
+        delays_ms.pop_front();
+        return d;
+    }
+};
+
+//==============================================================================
+loopback::action answer(server_plan& plan, tcp::socket& socket, loopback::response& res)
+{
+    // Nothing more is sent on a connection waiting for a response, so any input is the client closing it
+    pollfd pfd = {socket.native_handle(), POLLIN, 0};
+    if (::poll(&pfd, 1, plan.next_delay()) > 0)
+    {
+        ++plan.cancelled;
+        return loopback::action::drop;
+    }
+    res.body() = "[{\"eventType\":{\"id\":\"7\",\"name\":\"Horse Racing\"},\"marketCount\":412}]";
+    return loopback::action::respond;
+}
+
+//==============================================================================
+bool check(bool ok, const std::string& what)
+{
+    std::cout << (ok ? "PASS: " : "FAIL: ") << what << std::endl;
+    return ok;
+}
+
+//==============================================================================
+// Threads of this process other than the server's (named "server")
+int client_threads()
+{
+    int count = 0;
+    if (DIR* d = ::opendir("/proc/self/task"))
+    {
+        while (dirent* e = ::readdir(d))
+        {
+            std::string name;
+            if ('.' != e->d_name[0] && std::getline(std::ifstream(std::string("/proc/self/task/") + e->d_name + "/comm"), name))
+            {
+                count += ("server" == name) ? 0 : 1;
+            }
+        }
+        ::closedir(d);
+    }
+    return count;
+}
+
+//==============================================================================
+// Wait up to a second for the server to see count cancellations
+bool wait_for_cancelled(const server_plan& plan, int count)
+{
+    for (int i = 0; i < 100 && plan.cancelled < count; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return plan.cancelled >= count;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Invalid parameters (must supply paths to server certificate and key files)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        loopback::tls_server server(argv[1], argv[2]);
+        const std::string port = server.port();
+        server_plan plan;
+        server.serve([&plan](tcp::socket& socket, const loopback::request&, loopback::response& res) { return answer(plan, socket, res); });
+
+        bfapi::accinfo user_info;
+        user_info.appkey = "appkey";
+        bool ok = true;
+        {
+            bfapi::connection_pool pool(user_info, "token", 4, "127.0.0.1", port);
+            pool.tls_context().set_verify_mode(ssl::verify_none);      // Self signed local certificate
+            pool.set_deadlines(bfapi::deadlines(std::chrono::milliseconds(1000), std::chrono::milliseconds(3000)));
+            bfapi::endpoint_policy no_probes;
+            no_probes.probe_interval = std::chrono::seconds(0);        // No probe thread among those counted
+            pool.set_endpoint_selector(std::make_shared<bfapi::endpoint_selector>(no_probes));
+            bfapi::hedge_policy policy;
+            policy.min_samples = 5;
+            policy.min_delay = std::chrono::milliseconds(20);
+            policy.max_delay = std::chrono::milliseconds(100);
+
+            const std::string target = bfapi::list_event_types_endpoint;
+            const std::string body = "{\"filter\":{\"eventTypeIds\":[\"7\"]}}";
+            bfapi::http_result result;
+            std::string error;
+
+            // Fast answers: the primary always wins before the hedge delay
+            const int threads_before = client_threads();    // This thread
+            bool sent = true;
+            for (int i = 0; i < 20; ++i)
+            {
+                sent = pool.post_hedged(target, body, result, error, policy) && 200 == result.status && sent;
+            }
+            bfapi::request_stats st = pool.get_stats();
+            ok = check(sent && 20 == st.hedged_requests && 0 == st.hedges_sent, "fast calls sent no hedge") && ok;
+            ok = check(client_threads() - threads_before <= 2, "hedge thread kept for sequential calls") && ok;
+
+            // The primary is held back for 2 s; the hedge is answered at once
+            {
+                std::lock_guard<std::mutex> lock(plan.mtx);
+                plan.delays_ms.assign({2000, 1});
+            }
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            sent = pool.post_hedged(target, body, result, error, policy) && 200 == result.status;
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            st = pool.get_stats();
+            std::cout << "  stalled primary: answered in " << ms << " ms" << std::endl;
+            ok = check(sent && 1 == st.hedges_sent && 1 == st.hedge_wins && ms < 500.0, "hedge won against a stalled request") && ok;
+            ok = check(wait_for_cancelled(plan, 1), "stalled request cancelled") && ok;
+
+            // The primary is answered after 60 ms, after the hedge delay; the hedge is held back for 2 s
+            {
+                std::lock_guard<std::mutex> lock(plan.mtx);
+                plan.delays_ms.assign({60, 2000});
+            }
+            start = std::chrono::steady_clock::now();
+            sent = pool.post_hedged(target, body, result, error, policy) && 200 == result.status;
+            ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            st = pool.get_stats();
+            std::cout << "  slow hedge: answered in " << ms << " ms" << std::endl;
+            ok = check(sent && 2 == st.hedges_sent && 1 == st.primary_wins && ms < 500.0, "original request won against a slow hedge") && ok;
+            ok = check(wait_for_cancelled(plan, 2), "slow hedge cancelled") && ok;
+
+            // Concurrent calls each need a hedge thread; later calls reuse them
+            std::vector<std::thread> callers;
+            std::atomic<int> answered(0);
+            for (int round = 0; round < 2; ++round)
+            {
+                for (int i = 0; i < 3; ++i)
+                {
+                    callers.emplace_back([&]()
+                    {
+                        bfapi::http_result r;
+                        std::string e;
+                        answered += (pool.post_hedged(target, body, r, e, policy) && 200 == r.status) ? 1 : 0;
+                    });
+                }
+                for (std::thread& t : callers)
+                {
+                    t.join();
+                }
+                callers.clear();
+            }
+            const int hedge_threads = client_threads() - threads_before;
+            ok = check(6 == answered && hedge_threads >= 1 && hedge_threads <= static_cast<int>(pool.max_size()),
+                       "concurrent calls answered, " + std::to_string(hedge_threads) + " hedge thread(s) kept") && ok;
+
+            st = pool.get_stats();
+            std::cout << "Requests " << st.requests << ", hedged " << st.hedged_requests << ", hedges sent " << st.hedges_sent
+                      << " (rate " << st.hedge_rate() << "), hedge wins " << st.hedge_wins << ", primary wins " << st.primary_wins
+                      << std::endl;
+        }
+        ok = check(1 == client_threads(), "hedge threads stopped with the pool") && ok;
+
+        loopback::finish(ok);
+    }
+    catch(std::exception const& e)
+    {
+        std::cerr << "ERROR: Exception thrown (" << e.what() << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+//==============================================================================
+//
+// Ingest Betfair historical data files (tar, bz2, plain or columnar) on a pool
+// of threads, keeping a market cache per market, and report throughput. No
+// login is needed. With -o each source is instead converted to the columnar
+// format in the given directory, which can then be ingested much faster:
+//
+//         ./historical_ingest.out [-t threads] [-o output directory] path...
+//
+//==============================================================================
+#include "../betfair/historical.hpp"
+#include <iostream>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+
+//==============================================================================
+void print_stats(const bfapi::historical::ingest_stats& stats)
+{
+    std::cout << "Sources: " << stats.sources << ", read " << stats.input_bytes / 1e6 << " MB, text "
+              << stats.text_bytes / 1e6 << " MB" << std::endl;
+    std::cout << "Lines: " << stats.lines << ", messages: " << stats.messages << ", market changes: " << stats.market_changes
+              << ", runner changes: " << stats.runner_changes << ", parse errors: " << stats.parse_errors << std::endl;
+    std::cout << "Elapsed " << stats.elapsed_ns / 1e6 << " ms (" << stats.text_mb_per_second() << " MB/s of text), decompress "
+              << stats.decompress_ns / 1e6 << " ms, parse " << stats.parse_ns / 1e6 << " ms ("
+              << stats.parse_mb_per_core_second() << " MB/s per core), " << static_cast<std::uint64_t>(stats.messages_per_second())
+              << " messages/s" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t threads = 0;
+    std::string output_dir = "";
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        if (arg == "-t" && i + 1 < argc)
+        {
+            threads = std::stoul(argv[++i]);
+        }
+        else if (arg == "-o" && i + 1 < argc)
+        {
+            output_dir = argv[++i];
+        }
+        else
+        {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty())
+    {
+        std::cerr << "Invalid parameters (must supply at least one file or directory)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string error = "";
+    bfapi::historical::ingest_stats stats;
+    if (false == output_dir.empty())
+    {
+        if (false == bfapi::historical::convert_to_columnar(paths, output_dir, threads, stats, error))
+        {
+            std::cerr << error << std::endl;
+            return EXIT_FAILURE;
+        }
+        print_stats(stats);
+        return EXIT_SUCCESS;
+    }
+
+    // Each market is only ever updated by the thread reading its source, so the
+    // lock is only needed to find the cache
+    std::mutex mtx;
+    std::map<std::string, std::unique_ptr<bfapi::stream::market_cache>> caches;
+    auto handler = [&](const bfapi::historical::source& src, const bfapi::stream::market_change_message& msg)
+    {
+        (void)src;
+        for (const bfapi::stream::market_change& mc : msg.mc)
+        {
+            bfapi::stream::market_cache* cache = nullptr;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                std::unique_ptr<bfapi::stream::market_cache>& entry = caches[mc.id];
+                if (nullptr == entry)
+                {
+                    entry.reset(new bfapi::stream::market_cache(mc.id));
+                }
+                cache = entry.get();
+            }
+            cache->apply(mc, msg.pt);
+        }
+    };
+    const bool ok = bfapi::historical::ingest(paths, threads, handler, stats, error);
+    if (false == error.empty())
+    {
+        std::cerr << error << std::endl;
+    }
+    if (false == ok)
+    {
+        return EXIT_FAILURE;
+    }
+    print_stats(stats);
+
+    // Final state of the first market as a check
+    if (false == caches.empty())
+    {
+        bfapi::responses::market_book book;
+        caches.begin()->second->to_market_book(book);
+        std::cout << "Markets: " << caches.size() << ", " << book.market_id << " " << book.status << " with "
+                  << book.runners.size() << " runners, matched " << book.total_matched << std::endl;
+        for (const bfapi::responses::runner_book& rb : book.runners)
+        {
+            std::cout << "    " << rb.selection_id << " " << rb.status << " ltp " << rb.last_price_traded;
+            if (false == rb.available_to_back.empty())
+            {
+                std::cout << " back " << rb.available_to_back.front().price << " @ " << rb.available_to_back.front().size;
+            }
+            if (false == rb.available_to_lay.empty())
+            {
+                std::cout << " lay " << rb.available_to_lay.front().price << " @ " << rb.available_to_lay.front().size;
+            }
+            std::cout << std::endl;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+//==============================================================================
+//
+// Compare client CPU cost per MB of response data with user space TLS and with
+// kernel TLS (kTLS) offload, against a TLS server running on the loopback
+// interface in this process.
+//
+// A certificate and key for the local server are required, e.g.
+//
+//         openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 30 -subj "/CN=localhost"
+//         ./ktls_bench.out cert.pem key.pem
+//
+// kTLS needs the kernel "tls" module ("modprobe tls"). If it is unavailable the
+// kTLS run reports that it fell back to user space TLS.
+//==============================================================================
+#include "../betfair/connection.hpp"
+#include "loopback_tls_server.hpp"
+#include <sys/resource.h>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+using tcp = net::ip::tcp;
+
+//==============================================================================
+// Answer every request with a body whose size in bytes is the last path
+// segment of the target, e.g. POST /bytes/65536
+loopback::action answer(const loopback::request& req, loopback::response& res)
+{
+    const std::string target(req.target());
+    res.body().assign(std::stoul(target.substr(target.find_last_of('/') + 1)), 'x');
+    return loopback::action::respond;
+}
+
+//==============================================================================
+double thread_cpu_seconds()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+//==============================================================================
+void run_client(const std::string& port, bool use_ktls, std::size_t response_size, int requests)
+{
+    ssl::context ctx(ssl::context::tlsv12_client);
+    ctx.set_verify_mode(ssl::verify_none);     // Self signed local certificate
+
+    bfapi::api_connection conn(ctx, "appkey", "token", "127.0.0.1", port);
+    conn.set_ktls(use_ktls);
+
+    bfapi::http_result result;
+    std::string error;
+    const std::string target = "/bytes/" + std::to_string(response_size);
+
+    // Warm up (and connect) before measuring
+    if (false == conn.post(target, "{}", result, error))
+    {
+        std::cerr << "Request failed: " << error << std::endl;
+        return;
+    }
+
+    const double cpu_start = thread_cpu_seconds();
+    auto t1 = std::chrono::steady_clock::now();
+    std::size_t bytes = 0;
+    for (int i = 0; i < requests; ++i)
+    {
+        if (false == conn.post(target, "{}", result, error))
+        {
+            std::cerr << "Request failed: " << error << std::endl;
+            return;
+        }
+        bytes += result.body.size();
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    const double cpu = thread_cpu_seconds() - cpu_start;
+    const double mb = bytes / (1024.0 * 1024.0);
+    std::chrono::duration<double> wall = t2 - t1;
+
+    std::cout << (use_ktls ? "kTLS requested" : "user space TLS") << " (kTLS active = " << conn.ktls_active() << "): "
+              << mb << " MB, " << (cpu * 1e3 / mb) << " ms CPU per MB, " << (mb / wall.count()) << " MB/s\n";
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Invalid parameters (must supply paths to server certificate and key files)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        loopback::tls_server server(argv[1], argv[2]);
+        const std::string port = server.port();
+        server.serve([](tcp::socket&, const loopback::request& req, loopback::response& res) { return answer(req, res); });
+
+        for (const std::size_t size : {4096, 65536, 1048576})
+        {
+            const int requests = static_cast<int>(256 * 1048576 / size / 4);
+            std::cout << "Response size " << size << " bytes, " << requests << " requests\n";
+            run_client(port, false, size, requests);
+            run_client(port, true, size, requests);
+        }
+
+        loopback::finish(true);
+    }
+    catch(std::exception const& e)
+    {
+        std::cerr << "ERROR: Exception thrown (" << e.what() << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
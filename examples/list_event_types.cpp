@@ -2,42 +2,19 @@
 // List all available event types using broadest possible filter (empty filter)
 //==============================================================================
 #include "../betfair/bfapi.hpp"
-#include <boost/beast/core.hpp>
-#include <boost/beast/http.hpp>
-#include <boost/beast/ssl.hpp>
-#include <boost/beast/version.hpp>
-#include <boost/asio/connect.hpp>
-#include <boost/asio/ip/tcp.hpp>
-#include <boost/asio/ssl/error.hpp>
-#include <boost/asio/ssl/stream.hpp>
-#include <boost/version.hpp>
+#include "../betfair/connection.hpp"
+#include "../betfair/operations.hpp"
+#include <boost/asio/ssl/context.hpp>
 #include <iostream>
 #include <cstdlib>
-#include <iostream>
 #include <string>
-#include <fstream>
+#include <vector>
 #include <chrono>
-#include <thread>
-#include <set>
-
-namespace beast = boost::beast; 
-namespace http = beast::http;   
-namespace net = boost::asio;    
-namespace ssl = net::ssl;       
-using tcp = net::ip::tcp;      
 
+namespace ssl = boost::asio::ssl;
 
 int main(int argc, char** argv)
-{   
-	// Print boost version
-	std::cout << "Boost version: " 
-          << BOOST_VERSION / 100000
-          << "."
-          << BOOST_VERSION / 100 % 1000
-          << "."
-          << BOOST_VERSION % 100 
-          << std::endl;   
-    // TODO: remove the above 
+{
     if (argc != 2)
     {
         std::cerr << "Invalid parameters (must supply path to config file)" << std::endl;
@@ -64,108 +41,43 @@ int main(int argc, char** argv)
     
     // If we get here we logged in successfully                 
     try
-    {                                        
-        // The io_context is required for all I/O
-        net::io_context ioc;
-
-        // The SSL context is required, and holds certificates
+    {
+        // Verify server certificate
         ssl::context ctx(ssl::context::tlsv12_client);
-
-        // Only need cert and key files on login      
-
-        // Verify server certificate 
-        ctx.set_verify_mode(ssl::verify_peer);                
+        ctx.set_verify_mode(ssl::verify_peer);
         ctx.set_default_verify_paths();
-        
-        // These objects perform our I/O
-        tcp::resolver resolver(ioc);
-        beast::ssl_stream<beast::tcp_stream> stream(ioc, ctx);
 
-        // Set SNI Hostname (many hosts need this to handshake successfully)
-        if(! SSL_set_tlsext_host_name(stream.native_handle(), bfapi::bf_host.c_str()))
+        bfapi::api_connection conn(ctx, user_info.appkey, session_token);
+        std::string error;
+        if (false == conn.connect(error))
         {
-            beast::error_code ec{static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()};
-            throw beast::system_error{ec};
+            std::cerr << "Connection failed: " << error << std::endl;
+            return EXIT_FAILURE;
         }
 
-        // Look up the domain name
-        auto const results = resolver.resolve(bfapi::bf_host, bfapi::port);
-
-        // Make the connection on the IP address we get from a lookup
-        beast::get_lowest_layer(stream).connect(results);
-
-        // Perform the SSL handshake
-        stream.handshake(ssl::stream_base::client);   
-        
-        // Sleep for 1 second
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000));           
-                        
         using std::chrono::high_resolution_clock;
-        using std::chrono::duration_cast;
         using std::chrono::duration;
-        using std::chrono::milliseconds;
-                              
-        auto t1 = high_resolution_clock::now();        
-        
-        http::request<http::string_body> req{http::verb::post, bfapi::list_event_types_endpoint, bfapi::http_version};                
-        req.set(http::field::host, bfapi::bf_host);        
-        req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
-        
-        // Require a custom header field "X-Application" used to send our application key        
-        req.set("X-Application",user_info.appkey);
-        req.set("X-Authentication",session_token);
-        req.set("Connection","keep-alive");
-        req.set("accept","application/json");
-        req.set(http::field::content_type, "application/json");            
-        req.body() = "{\"filter\":{}}";
-        req.prepare_payload();                                                    
 
-        // Send the HTTP request to the remote host
-        http::write(stream, req);
+        bfapi::arena a;
+        bfapi::operations::list_event_types_request request;
+        std::vector<bfapi::responses::event_type_result> event_types;
 
-        // This buffer is used for reading and must be persisted
-        beast::flat_buffer buffer;
-
-        // Declare a container to hold the response
-        http::response<http::string_body> res;               
+        auto t1 = high_resolution_clock::now();
+        if (false == bfapi::operations::call<bfapi::operations::list_event_types>(conn, request, event_types, a, error))
+        {
+            std::cerr << error << std::endl;
+            return EXIT_FAILURE;
+        }
+        auto t2 = high_resolution_clock::now();
 
-        // Receive the HTTP response
-        http::read(stream, buffer, res);      
-        
-        if (res.result_int() != 200)
+        for (const bfapi::responses::event_type_result& et : event_types)
         {
-            std::cout << "HTTP ERROR status " << res.result() << " code " << std::to_string(res.result_int()) << std::endl;                           
-        }  
-        
-        // Dump JSON respons to console
-        std::cout << res.body() << std::endl;
-        
-        auto t2 = high_resolution_clock::now();        
+            std::cout << et.event_type_id << " " << et.event_type_name << " (" << et.market_count << " markets)\n";
+        }
 
         // Get number of milliseconds as a double
-        duration<double, std::milli> ms_double = t2 - t1;    
-        
+        duration<double, std::milli> ms_double = t2 - t1;
         std::cout << "listEventTypes operation took " << ms_double.count() << "ms\n";
-        
-        // Gracefully close the stream after sleeping for 1 second
-        std::this_thread::sleep_for(std::chrono::milliseconds(1000));           
-        
-        beast::error_code ec;
-        stream.shutdown(ec);
-        
-        // Shutdown always seems to result in a "Stream truncated" error. We log this to console while trying to 
-        // work out what the solution is
-        if(ec == net::error::eof)
-        {
-            // Rationale:
-            // http://stackoverflow.com/questions/25587403/boost-asio-ssl-async-shutdown-always-finishes-with-an-error
-            ec = {};
-        }
-        if (ec)
-        {
-            std::cerr << "Shutdown error: " << ec.message() << std::endl;        
-            //throw beast::system_error{ec};
-        }        
     }
     catch(std::exception const& e)
     {
@@ -0,0 +1,200 @@
+//==============================================================================
+//
+// Keep-alive HTTPS server on the loopback interface for the examples that run
+// without a Betfair login.
+//
+// The server listens on an ephemeral port (or a given one) and serves each
+// accepted connection on its own detached thread, passing every request to a
+// handler that fills in the response. The response starts as an empty 200 with
+// a JSON content type and the request's keep-alive; the handler also chooses
+// what happens to the connection afterwards. For per connection state,
+// serve_connections() takes a function that is called on the new connection's
+// thread before the TLS handshake and returns the handler for its requests.
+//
+//         loopback::tls_server server(argv[1], argv[2]);
+//         server.serve([](tcp::socket&, const loopback::request& req, loopback::response& res)
+//         {
+//             res.body() = "[]";
+//             return loopback::action::respond;
+//         });
+//         bfapi::connection_pool pool(user_info, "token", 4, "127.0.0.1", server.port());
+//         ...
+//         loopback::finish(ok);
+//
+// Server threads are named "server" and stay blocked in accept() and read()
+// for the life of the process, so examples end with finish() rather than by
+// returning from main().
+//
+//==============================================================================
+#ifndef BFAPI_LOOPBACK_TLS_SERVER_HPP
+#define BFAPI_LOOPBACK_TLS_SERVER_HPP
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <iostream>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <poll.h>
+#include <pthread.h>
+
+namespace loopback {
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+using tcp = net::ip::tcp;
+
+typedef http::request<http::string_body> request;
+typedef http::response<http::string_body> response;
+
+// What happens to the connection once the handler has returned
+enum class action {
+	respond,            // Write the response and wait for the next request
+	respond_and_drop,   // Write the response, then drop the connection without a TLS close_notify
+	drop                // Close the connection without responding
+};
+
+typedef std::function<action(tcp::socket& socket, const request& req, response& res)> request_handler;
+typedef std::function<request_handler(tcp::socket& socket)> connection_handler;
+
+class tls_server {
+public:
+	// Listen on address:port (0 for an ephemeral port) with the PEM certificate and key
+	tls_server(const std::string& cert_file,
+	           const std::string& key_file,
+	           const std::string& address = "127.0.0.1",
+	           unsigned short port = 0) : s(std::make_shared<state>())
+	{
+		s->ctx.use_certificate_file(cert_file, ssl::context::pem);
+		s->ctx.use_private_key_file(key_file, ssl::context::pem);
+		const tcp::endpoint ep(net::ip::make_address(address), port);
+		s->acceptor.open(ep.protocol());
+		s->acceptor.set_option(tcp::acceptor::reuse_address(true));
+		s->acceptor.bind(ep);
+		s->acceptor.listen();
+	}
+
+	// Close connections that send no request for this long (0, the default,
+	// keeps them open). Set before serve(). Only for clients that send one
+	// request at a time, as data already read by TLS is not seen as waiting.
+	void set_idle_timeout(std::chrono::milliseconds timeout) { s->idle_timeout = timeout; }
+
+	// Start accepting connections, passing every request to handler
+	void serve(const request_handler& handler)
+	{
+		serve_connections([handler](tcp::socket&) { return handler; });
+	}
+
+	void serve_connections(const connection_handler& handler)
+	{
+		std::shared_ptr<state> st = s;
+		std::thread([st, handler]()
+		{
+			pthread_setname_np(pthread_self(), "server");
+			for (;;)
+			{
+				tcp::socket socket(st->ioc);
+				beast::error_code ec;
+				st->acceptor.accept(socket, ec);
+				if (ec)
+				{
+					return;
+				}
+				std::thread(&tls_server::serve_connection, st, std::move(socket), handler).detach();
+			}
+		}).detach();
+	}
+
+	tcp::endpoint endpoint() const { return s->acceptor.local_endpoint(); }
+	std::string port() const { return std::to_string(endpoint().port()); }
+
+	// Connections closed by the idle timeout
+	int idle_closes() const { return s->idle_closes; }
+
+private:
+	// Shared with the server threads, which outlive the tls_server object
+	struct state {
+		net::io_context ioc;
+		ssl::context ctx;
+		tcp::acceptor acceptor;
+		std::chrono::milliseconds idle_timeout;
+		std::atomic<int> idle_closes;
+
+		state() : ctx(ssl::context::tlsv12_server), acceptor(ioc), idle_timeout(0), idle_closes(0) {}
+	};
+
+	static void serve_connection(std::shared_ptr<state> st, tcp::socket socket, connection_handler on_connect)
+	{
+		pthread_setname_np(pthread_self(), "server");
+		beast::error_code ec;
+		socket.set_option(tcp::no_delay(true), ec);     // Or Nagle holds back each response until the last is acknowledged
+		const request_handler handler = on_connect(socket);
+		beast::ssl_stream<tcp::socket&> stream(socket, st->ctx);
+		stream.handshake(ssl::stream_base::server, ec);
+		beast::flat_buffer buffer;
+		while (!ec)
+		{
+			if (st->idle_timeout.count() > 0 && 0 == buffer.size())
+			{
+				pollfd pfd = {socket.native_handle(), POLLIN, 0};
+				if (::poll(&pfd, 1, static_cast<int>(st->idle_timeout.count())) == 0)
+				{
+					++st->idle_closes;
+					break;
+				}
+			}
+			request req;
+			http::read(stream, buffer, req, ec);
+			if (ec)
+			{
+				break;
+			}
+			response res{http::status::ok, req.version()};
+			res.set(http::field::content_type, "application/json");
+			res.keep_alive(req.keep_alive());
+			const action a = handler(socket, req, res);
+			if (action::drop == a)
+			{
+				break;
+			}
+			res.prepare_payload();
+			http::write(stream, res, ec);
+			if (action::respond_and_drop == a)
+			{
+				// Drop the connection as a restarting server would. Requests already
+				// received are discarded rather than left unread, which would make the
+				// close a reset that can also destroy responses the client has not read yet.
+				socket.shutdown(tcp::socket::shutdown_send, ec);
+				char discard[4096];
+				while (!ec)
+				{
+					socket.read_some(net::buffer(discard), ec);
+				}
+				break;
+			}
+		}
+		socket.close(ec);
+	}
+
+	std::shared_ptr<state> s;
+};
+
+// End the example. Server threads are still blocked in accept() and read(), so
+// the process ends here rather than running exit handlers underneath them.
+[[noreturn]] inline void finish(bool ok)
+{
+	std::cout.flush();
+	std::_Exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+} // end of namespace loopback
+
+#endif
@@ -0,0 +1,209 @@
+//==============================================================================
+//
+// Count heap allocations and time per placeOrders call on a warm keep-alive
+// connection, comparing the default path (std::string bodies, property_tree
+// parsing) with the arena path of api_connection::place_orders(). Requests are
+// answered by a TLS server on the loopback interface in this process, so no
+// Betfair login is needed.
+//
+// A certificate and key for the local server are required, e.g.
+//
+//         openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 30 -subj "/CN=localhost"
+//         ./order_path_bench.out cert.pem key.pem
+//
+// Exits with a failure status if the warm arena path makes any allocation
+// outside OpenSSL (whose record layer allocates internally on some versions),
+// or if an order with an over long customerOrderRef is not rejected.
+//==============================================================================
+#include "../betfair/alloc_counter.hpp"
+#include "../betfair/connection.hpp"
+#include "loopback_tls_server.hpp"
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+using tcp = net::ip::tcp;
+
+//==============================================================================
+// A successful PlaceExecutionReport for four instructions, the server's answer to every request
+std::string make_report()
+{
+    std::string report = "{\"status\":\"SUCCESS\",\"marketId\":\"1.209995594\",\"instructionReports\":[";
+    for (int i = 1; i <= 4; ++i)
+    {
+        report += std::string(i > 1 ? "," : "") + "{\"status\":\"SUCCESS\",\"instruction\":{\"selectionId\":50198,\"limitOrder\":"
+                  "{\"size\":1.0,\"price\":1.0" + std::to_string(i) + ",\"persistenceType\":\"LAPSE\"},\"orderType\":\"LIMIT\","
+                  "\"side\":\"LAY\",\"customerOrderRef\":\"TEST_CO_REF_" + std::to_string(i) + "\"},\"betId\":\"31234567890" +
+                  std::to_string(i) + "\",\"placedDate\":\"2023-10-01T12:00:00.000Z\",\"averagePriceMatched\":0.0,"
+                  "\"sizeMatched\":0.0,\"orderStatus\":\"EXECUTABLE\"}";
+    }
+    return report + "]}";
+}
+
+//==============================================================================
+bfapi::orders::place_limit_orders_request make_request()
+{
+    std::vector<bfapi::orders::limit_order_instruction> order_list;
+    for (int i = 1; i <= 4; ++i)
+    {
+        order_list.emplace_back(50198, true, 1.0, 1.0 + i / 100.0, false, "TEST_CO_REF_" + std::to_string(i));
+    }
+    return bfapi::orders::place_limit_orders_request("1.209995594", false, std::move(order_list));
+}
+
+//==============================================================================
+// The same market with every order type, emplaced straight into the batch columns
+bfapi::orders::place_orders_request make_mixed_request()
+{
+    bfapi::orders::place_instruction_batch batch(4);
+    batch.emplace_limit(50198, true, 1.0, 1.01, false, "TEST_CO_REF_1");
+    batch.emplace_limit(50198, false, 2.0, 1.02, true, "TEST_CO_REF_2");
+    batch.emplace_limit_on_close(50198, true, 5.0, 1.5, "TEST_CO_REF_3");
+    batch.emplace_market_on_close(50198, false, 10.0, "TEST_CO_REF_4");
+    return bfapi::orders::place_orders_request("1.209995594", false, std::move(batch));
+}
+
+int main(int argc, char** argv)
+{
+    // Must run before OpenSSL allocates anything
+    const bool openssl_counted = bfapi::alloc_counter::count_openssl();
+
+    if (argc != 3)
+    {
+        std::cerr << "Invalid parameters (must supply paths to server certificate and key files)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const int requests = 2000;
+    bool warm_path_clean = false;
+    bool long_ref_rejected = false;
+    try
+    {
+        loopback::tls_server server(argv[1], argv[2]);
+        const std::string port = server.port();
+        const std::string report_body = make_report();
+        server.serve([report_body](tcp::socket&, const loopback::request&, loopback::response& res)
+        {
+            res.body() = report_body;
+            return loopback::action::respond;
+        });
+
+        ssl::context ctx(ssl::context::tlsv12_client);
+        ctx.set_verify_mode(ssl::verify_none);     // Self signed local certificate
+        const bfapi::orders::place_limit_orders_request request = make_request();
+        const bfapi::orders::place_orders_request mixed = make_mixed_request();
+        std::cout << "sizeof(limit_order_instruction) = " << sizeof(bfapi::orders::limit_order_instruction)
+                  << ", sizeof(place_instruction) = " << sizeof(bfapi::orders::place_instruction) << "\n";
+        std::cout << "Mixed request: " << mixed.as_json_string() << "\n";
+        std::string error;
+
+        // Default path: request.as_json_string(), http_result and property_tree parsing
+        {
+            bfapi::api_connection conn(ctx, "appkey", "token", "127.0.0.1", port);
+            bfapi::http_result result;
+            bfapi::responses::place_execution_report report;
+            conn.post(bfapi::place_orders_endpoint, request.as_json_string(), result, error);
+
+            bfapi::alloc_counter::scope s;
+            auto t1 = std::chrono::steady_clock::now();
+            for (int i = 0; i < requests; ++i)
+            {
+                if (false == conn.post(bfapi::place_orders_endpoint, request.as_json_string(), result, error) ||
+                    false == bfapi::responses::parse_place_execution_report(result.body, report, error))
+                {
+                    std::cerr << "Request failed: " << error << std::endl;
+                    loopback::finish(false);
+                }
+            }
+            std::chrono::duration<double, std::micro> us = std::chrono::steady_clock::now() - t1;
+            const bfapi::alloc_counter::counts c = s.elapsed();
+            std::cout << "Default path: " << static_cast<double>(c.allocations) / requests << " allocations ("
+                      << c.bytes / requests << " bytes) and " << static_cast<double>(c.openssl_allocations) / requests
+                      << " OpenSSL allocations per call, " << us.count() / requests << " us per call\n";
+        }
+
+        // Arena path: one arena and one report reused for every call
+        {
+            bfapi::api_connection conn(ctx, "appkey", "token", "127.0.0.1", port);
+            bfapi::arena a;
+            bfapi::responses::place_execution_report report;
+
+            // The first calls connect and size the arena, report and read buffer
+            for (int i = 0; i < 3; ++i)
+            {
+                if (false == conn.place_orders(request, a, report, error))
+                {
+                    std::cerr << "Request failed: " << error << std::endl;
+                    loopback::finish(false);
+                }
+            }
+
+            bfapi::alloc_counter::scope s;
+            auto t1 = std::chrono::steady_clock::now();
+            for (int i = 0; i < requests; ++i)
+            {
+                if (false == conn.place_orders(request, a, report, error))
+                {
+                    std::cerr << "Request failed: " << error << std::endl;
+                    loopback::finish(false);
+                }
+            }
+            std::chrono::duration<double, std::micro> us = std::chrono::steady_clock::now() - t1;
+            const bfapi::alloc_counter::counts c = s.elapsed();
+            std::cout << "Arena path:   " << static_cast<double>(c.allocations) / requests << " allocations ("
+                      << c.bytes / requests << " bytes) and " << static_cast<double>(c.openssl_allocations) / requests
+                      << " OpenSSL allocations per call, " << us.count() / requests << " us per call, arena peak "
+                      << a.peak_bytes() << " bytes, " << a.upstream_allocations() << " arena blocks allocated\n";
+            std::cout << "Last report: " << report.status << ", " << report.instruction_reports.size() << " instructions, first bet "
+                      << report.instruction_reports.front().bet_id << " (" << report.instruction_reports.front().customer_order_ref << ")\n";
+            warm_path_clean = (0 == c.allocations);
+
+            // Every order type from a structure of arrays batch, on the same warm arena
+            if (false == conn.place_orders(mixed, a, report, error))
+            {
+                std::cerr << "Request failed: " << error << std::endl;
+                loopback::finish(false);
+            }
+            bfapi::alloc_counter::scope m;
+            t1 = std::chrono::steady_clock::now();
+            for (int i = 0; i < requests; ++i)
+            {
+                if (false == conn.place_orders(mixed, a, report, error))
+                {
+                    std::cerr << "Request failed: " << error << std::endl;
+                    loopback::finish(false);
+                }
+            }
+            us = std::chrono::steady_clock::now() - t1;
+            const bfapi::alloc_counter::counts cm = m.elapsed();
+            std::cout << "Batch path:   " << static_cast<double>(cm.allocations) / requests << " allocations per call, "
+                      << us.count() / requests << " us per call\n";
+            warm_path_clean = warm_path_clean && (0 == cm.allocations);
+
+            // A customerOrderRef over 32 characters rejects the request before it is sent
+            bfapi::orders::place_instruction_batch long_ref(1);
+            long_ref.emplace_limit(50198, true, 1.0, 1.01, false, std::string(33, 'R'));
+            const std::size_t sent = conn.requests_on_connection();
+            long_ref_rejected = (false == conn.place_orders(bfapi::orders::place_orders_request("1.209995594", false, long_ref), a, report, error)) &&
+                                sent == conn.requests_on_connection();
+            std::cout << (long_ref_rejected ? "PASS" : "FAIL") << ": over long customerOrderRef rejected (" << error << ")\n";
+        }
+        if (false == openssl_counted)
+        {
+            std::cout << "OpenSSL allocations could not be counted\n";
+        }
+        std::cout << (warm_path_clean ? "PASS: no heap allocations on the warm arena path" : "FAIL: the warm arena path allocated") << std::endl;
+
+        loopback::finish(warm_path_clean && long_ref_rejected);
+    }
+    catch(std::exception const& e)
+    {
+        std::cerr << "ERROR: Exception thrown (" << e.what() << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+//==============================================================================
+//
+// Trace orders from submit to final fill with bfapi::order_trace. Orders are
+// placed with the in-process simulator (as in paper_trade.cpp) on two markets
+// of different types, each driven by its own thread, with sleeps standing in
+// for the network: the acknowledgement arrives a few hundred microseconds after
+// submit, and a synthetic feed then trades through the queue in front of each
+// order until it is filled in two parts. Order stream updates are derived from
+// the simulator's fills. A third thread collects events while orders are in
+// flight, and the percentile summary per market type is printed at the end.
+//
+// A long run is then traced with a small sample limit, to show that the
+// percentiles come from a bounded reservoir while counts and maxima cover every
+// order. Finally several threads record events into a small ring as fast as
+// they can to show the cost per event and that a full ring drops rather than
+// blocks.
+//
+//         ./order_trace.out [orders per market]
+//
+//==============================================================================
+#include "../betfair/order_trace.hpp"
+#include "../betfair/simulator.hpp"
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <atomic>
+
+using bfapi::responses::market_book;
+using bfapi::responses::runner_book;
+using bfapi::responses::price_size;
+
+const std::int64_t selection_id = 1000;
+const int order_tick = 100;
+
+//==============================================================================
+std::int64_t now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+//==============================================================================
+market_book make_book(const std::string& market_id, double traded)
+{
+    market_book book;
+    book.market_id = market_id;
+    book.status = "OPEN";
+    runner_book rb;
+    rb.selection_id = selection_id;
+    rb.status = "ACTIVE";
+    rb.available_to_back.push_back(price_size(bfapi::ticks::tick_to_price(order_tick), 20.0));
+    rb.available_to_lay.push_back(price_size(bfapi::ticks::tick_to_price(order_tick + 1), 20.0));
+    rb.traded_volume.push_back(price_size(bfapi::ticks::tick_to_price(order_tick), traded));
+    book.runners.push_back(rb);
+    return book;
+}
+
+//==============================================================================
+void trade_market(bfapi::order_trace::tracer& trace, const std::string& market_id, const std::string& market_type, int orders)
+{
+    const std::uint16_t type = trace.market_type_id(market_type);
+    std::mt19937 rng(static_cast<unsigned>(type) + 1);
+    std::uniform_int_distribution<int> network_us(200, 900);
+    std::uniform_int_distribution<int> feed_us(100, 400);
+
+    bfapi::simulator::market_simulator sim(market_id);
+    double traded = 0.0;
+    sim.on_market_book(make_book(market_id, traded), now_ms());
+
+    // Order stream: an update for every fill, with the order's state after it
+    sim.set_fill_handler([&](const bfapi::simulator::fill& f)
+    {
+        const bfapi::simulator::sim_order* order = sim.find_order(f.bet_id);
+        trace.order_update(f.bet_id, order->customer_order_ref, order->executable(), order->size_matched);
+    });
+
+    for (int i = 0; i < orders; ++i)
+    {
+        // Lay 15 at the best back price, which queues behind the 20 on offer
+        bfapi::orders::place_instruction_batch batch(1);
+        batch.emplace_limit(selection_id, true, 15.0, bfapi::ticks::tick_to_price(order_tick), false,
+                            market_type + "_" + std::to_string(i));
+        const bfapi::orders::place_orders_request request(market_id, true, std::move(batch));
+
+        trace.submit(request, type);
+        std::this_thread::sleep_for(std::chrono::microseconds(network_us(rng)));
+
+        bfapi::responses::place_execution_report report;
+        sim.on_market_book(make_book(market_id, traded), now_ms());     // Sets the simulator clock for placedDate
+        sim.place_orders(request, report);
+        trace.acknowledged(report);
+
+        // First order stream update shows the order resting
+        std::this_thread::sleep_for(std::chrono::microseconds(feed_us(rng)));
+        const bfapi::simulator::sim_order* order = sim.find_order(report.instruction_reports.front().bet_id);
+        trace.order_update(order->bet_id, order->customer_order_ref, order->executable(), order->size_matched);
+
+        // 10 traded per book: two books clear the queue, the next two fill 10 then 5
+        while (order->executable())
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(feed_us(rng)));
+            traded += 10.0;
+            sim.on_market_book(make_book(market_id, traded), now_ms());
+            order = sim.find_order(report.instruction_reports.front().bet_id);
+        }
+    }
+}
+
+//==============================================================================
+// Acknowledgements 1 us to orders us after submit, uniformly, kept in a
+// reservoir of limit samples
+void bounded_samples(int orders, std::size_t limit)
+{
+    bfapi::order_trace::tracer trace;
+    trace.set_sample_limit(limit);
+    const std::uint16_t type = trace.market_type_id("WIN");
+    for (int i = 1; i <= orders; ++i)
+    {
+        const std::string ref = "LONG_" + std::to_string(i);
+        const bfapi::orders::customer_order_ref co_ref(ref.c_str());
+        trace.submit(co_ref, type);
+        bfapi::responses::instruction_report report;
+        report.customer_order_ref = ref;
+        trace.acknowledged(report, bfapi::order_trace::tracer::steady_now() + i * 1000LL);
+        trace.order_update("", co_ref, false, 0.0);    // Lapsed unmatched
+        if (0 == i % 1000)
+        {
+            trace.collect();
+        }
+    }
+    const std::vector<bfapi::order_trace::summary> s = trace.summaries();
+    if (1 == s.size())
+    {
+        std::cout << "Long run of " << s[0].count << " orders with " << limit << " samples kept: ack p50 " << s[0].p50_us
+                  << " us, p90 " << s[0].p90_us << " us (expected about " << orders * 0.5 << " and " << orders * 0.9
+                  << "), max " << s[0].max_us << " us\n";
+    }
+}
+
+//==============================================================================
+void flood_ring()
+{
+    const int threads = 4;
+    const int events_per_thread = 1000000;
+    bfapi::order_trace::tracer trace(4096);
+    const std::uint16_t type = trace.market_type_id("WIN");
+    std::atomic<bool> done(false);
+
+    // The consumer drains as fast as it can while the producers run
+    std::thread consumer([&]()
+    {
+        while (false == done.load())
+        {
+            trace.collect();
+        }
+    });
+
+    const auto t1 = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < threads; ++p)
+    {
+        producers.emplace_back([&trace, type, p]()
+        {
+            const bfapi::orders::customer_order_ref ref(("FLOOD_" + std::to_string(p)).c_str());
+            for (int i = 0; i < events_per_thread; ++i)
+            {
+                trace.submit(ref, type);
+            }
+        });
+    }
+    for (std::thread& th : producers)
+    {
+        th.join();
+    }
+    const std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - t1;
+    done.store(true);
+    consumer.join();
+    trace.collect();
+
+    std::cout << "Ring of " << 4096 << " events, " << threads << " producers: " << ns.count() / events_per_thread
+              << " ns per event per thread, " << trace.dropped() << " of " << threads * events_per_thread
+              << " events dropped while the consumer was behind\n";
+}
+
+int main(int argc, char** argv)
+{
+    const int orders = argc > 1 ? std::stoi(argv[1]) : 200;
+
+    bfapi::order_trace::tracer trace;
+    std::atomic<bool> done(false);
+    std::thread collector([&]()
+    {
+        while (false == done.load())
+        {
+            trace.collect();
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    });
+
+    std::thread win(trade_market, std::ref(trace), "1.100000001", "WIN", orders);
+    std::thread match_odds(trade_market, std::ref(trace), "1.100000002", "MATCH_ODDS", orders);
+    win.join();
+    match_odds.join();
+    done.store(true);
+    collector.join();
+
+    std::cout << trace.summary_table();
+    std::cout << "Open orders " << trace.open_orders() << ", unmatched events " << trace.unmatched()
+              << ", dropped events " << trace.dropped() << "\n\n";
+
+    bounded_samples(100000, 1000);
+    flood_ring();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,113 @@
+//==============================================================================
+//
+// Paper trading: the same kind of small lay bet as place_bet2.cpp, but placed
+// with the in-process simulator instead of the exchange. The market is polled
+// live and every book is replayed into the simulator, which fills the bet once
+// enough has traded at its price to clear the queue in front of it.
+//
+//         ./paper_trade.out config.ini 1.209995594 50198 1.5
+//
+//==============================================================================
+#include "../betfair/bfapi.hpp"
+#include "../betfair/polling.hpp"
+#include "../betfair/simulator.hpp"
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+
+int main(int argc, char** argv)
+{
+    if (argc != 5)
+    {
+        std::cerr << "Invalid parameters (must supply path to config file, market ID, selection ID and lay price)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string session_token = "";
+    bfapi::accinfo user_info;
+    if (bfapi::extract_user_credentials(argv[1], user_info))
+    {
+        std::string error = "";
+        if (false == bfapi::login(user_info,session_token,error))
+        {
+            std::cerr << "Betfair login failed: " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        std::cerr << "Unable to extract user credentials from supplied config filename." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::string market_id = argv[2];
+    const std::int64_t selection_id = std::stoll(argv[3]);
+    const double price = std::stod(argv[4]);
+
+    bfapi::connection_pool pool(user_info, session_token, 1);
+    bfapi::polling::market_book_poller poller(pool, 1);
+    bfapi::polling::price_projection projection;
+    projection.ex_traded = true;        // Traded volume drives the queue model
+    poller.add_market(market_id, projection);
+
+    bfapi::simulator::market_simulator sim(market_id);
+    sim.set_fill_handler([](const bfapi::simulator::fill& f)
+    {
+        std::cout << "Fill: bet " << f.bet_id << " " << (f.lay_side ? "LAY " : "BACK ") << f.size << " @ " << f.price << std::endl;
+    });
+
+    bool placed = false;
+    std::string bet_id = "";
+    for (int cycle = 0; cycle < 60; ++cycle)
+    {
+        std::string error = "";
+        if (false == poller.poll_once([](const bfapi::polling::book_update&) {}, error))
+        {
+            std::cerr << error << std::endl;
+        }
+        bfapi::responses::market_book book;
+        if (poller.last_book(market_id, book))
+        {
+            const std::int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            sim.on_market_book(book, now);
+
+            if (false == placed)
+            {
+                std::vector<bfapi::orders::limit_order_instruction> order_list;
+                order_list.emplace_back(selection_id, true, 1.0, price, false, "PAPER_CO_REF_1");
+                bfapi::orders::place_limit_orders_request request(market_id, false, order_list);
+                bfapi::responses::place_execution_report report;
+                sim.place_orders(request, report);
+                std::cout << "placeOrders status = " << report.status << ", errorCode = " << report.error_code << std::endl;
+                for (const bfapi::responses::instruction_report& ir : report.instruction_reports)
+                {
+                    std::cout << "    bet " << ir.bet_id << " " << ir.status << " " << ir.error_code << " " << ir.order_status
+                              << ", matched " << ir.size_matched << " @ " << ir.average_price_matched << std::endl;
+                    bet_id = ir.bet_id;
+                }
+                placed = true;
+            }
+        }
+
+        const bfapi::simulator::sim_order* order = sim.find_order(bet_id);
+        if (order)
+        {
+            std::cout << "Bet " << bet_id << ": matched " << order->size_matched << ", remaining " << order->size_remaining()
+                      << ", queue ahead " << order->queue_ahead << std::endl;
+            if (false == order->executable())
+            {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    }
+
+    // Cancel whatever is still unmatched
+    bfapi::orders::cancel_orders_request cancel(market_id, std::vector<bfapi::orders::cancel_instruction>());
+    bfapi::responses::cancel_execution_report cancel_report;
+    sim.cancel_orders(cancel, cancel_report);
+    std::cout << "cancelOrders status = " << cancel_report.status << ", orders cancelled = " << cancel_report.instruction_reports.size() << std::endl;
+    return EXIT_SUCCESS;
+}
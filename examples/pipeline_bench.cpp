@@ -0,0 +1,335 @@
+//==============================================================================
+//
+// Compare sending bursts of 10 to 100 requests on one keep-alive connection
+// serially (each request waits for the previous response) and pipelined
+// (api_connection::post_pipelined: all requests written back to back, the
+// responses read in order as they arrive).
+//
+// The local TLS server echoes each request body so responses can be checked
+// against the requests they answer. Bursts are timed directly over loopback
+// and through a TCP proxy that delays traffic in each direction by half of an
+// emulated round trip time, as a network would.
+//
+// A burst is then sent with a request governor that can only admit part of it.
+// Finally the server is made to close connections part way through a burst,
+// first without warning (no TLS close_notify) and then with "Connection:
+// close", to show which requests are resent on a new connection and which are
+// reported as unanswered.
+//
+// A certificate and key for the local server are required, e.g.
+//
+//         openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 30 -subj "/CN=localhost"
+//         ./pipeline_bench.out cert.pem key.pem [round trip ms]
+//
+//==============================================================================
+#include "../betfair/connection.hpp"
+#include "loopback_tls_server.hpp"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <sstream>
+#include <cstdlib>
+
+namespace beast = boost::beast;
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+using tcp = net::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+// Server behaviour: 0 keeps connections open, otherwise a connection is
+// closed after this many responses
+std::atomic<int> close_after(0);
+std::atomic<bool> graceful_close(false);
+
+//==============================================================================
+// Echo each request body, dropping the connection after close_after responses
+// if set when it was accepted
+loopback::request_handler echo(tcp::socket&)
+{
+    const int limit = close_after.load();
+    const bool graceful = graceful_close.load();
+    int count = 0;
+    return [limit, graceful, count](tcp::socket&, const loopback::request& req, loopback::response& res) mutable
+    {
+        const bool last = (limit > 0 && ++count >= limit);
+        res.keep_alive(req.keep_alive() && false == (last && graceful));
+        res.body() = req.body();
+        return last ? loopback::action::respond_and_drop : loopback::action::respond;
+    };
+}
+
+//==============================================================================
+// Forward bytes from one socket to another, each chunk delayed by delay
+void pump(std::shared_ptr<tcp::socket> from, std::shared_ptr<tcp::socket> to, clock_type::duration delay)
+{
+    struct chunk {
+        clock_type::time_point due;
+        std::string data;       // Empty at end of stream
+    };
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<chunk> queue;
+
+    std::thread writer([&]()
+    {
+        for (;;)
+        {
+            chunk c;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&] { return false == queue.empty(); });
+                c = std::move(queue.front());
+                queue.pop_front();
+            }
+            std::this_thread::sleep_until(c.due);
+            beast::error_code ec;
+            if (c.data.empty())
+            {
+                to->shutdown(tcp::socket::shutdown_send, ec);
+                return;
+            }
+            net::write(*to, net::buffer(c.data), ec);
+        }
+    });
+
+    char data[16384];
+    for (;;)
+    {
+        beast::error_code ec;
+        const std::size_t n = from->read_some(net::buffer(data), ec);
+        std::lock_guard<std::mutex> lock(mtx);
+        queue.push_back(chunk{clock_type::now() + delay, ec ? std::string() : std::string(data, n)});
+        cv.notify_one();
+        if (ec)
+        {
+            break;
+        }
+    }
+    writer.join();
+}
+
+//==============================================================================
+void proxy(tcp::acceptor& acceptor, tcp::endpoint server, clock_type::duration one_way)
+{
+    for (;;)
+    {
+        std::shared_ptr<tcp::socket> client = std::make_shared<tcp::socket>(acceptor.get_executor());
+        std::shared_ptr<tcp::socket> upstream = std::make_shared<tcp::socket>(acceptor.get_executor());
+        beast::error_code ec;
+        acceptor.accept(*client, ec);
+        if (ec)
+        {
+            return;
+        }
+        upstream->connect(server, ec);
+        if (ec)
+        {
+            continue;
+        }
+        client->set_option(tcp::no_delay(true));
+        upstream->set_option(tcp::no_delay(true));
+        std::thread(pump, client, upstream, one_way).detach();
+        std::thread(pump, upstream, client, one_way).detach();
+    }
+}
+
+//==============================================================================
+std::vector<bfapi::pipelined_request> make_burst(int n, bool idempotent)
+{
+    std::vector<bfapi::pipelined_request> burst;
+    for (int i = 0; i < n; ++i)
+    {
+        burst.emplace_back(bfapi::list_market_book_endpoint, "{\"marketIds\":[\"1." + std::to_string(100000000 + i) + "\"]}", idempotent);
+    }
+    return burst;
+}
+
+//==============================================================================
+bool check(bool ok, const std::string& what)
+{
+    std::cout << (ok ? "PASS: " : "FAIL: ") << what << std::endl;
+    return ok;
+}
+
+//==============================================================================
+// Time serial and pipelined bursts on conn; false if a response does not match its request
+bool bench(bfapi::api_connection& conn, const std::string& name)
+{
+    std::cout << name << ":\n"
+              << "  burst   serial ms   pipelined ms   serial req/s   pipelined req/s   speedup\n";
+    bool ok = true;
+    for (int n : {10, 25, 50, 100})
+    {
+        const std::vector<bfapi::pipelined_request> burst = make_burst(n, true);
+        const int reps = 5;
+        std::string error;
+        bfapi::http_result result;
+        std::vector<bfapi::http_result> results;
+
+        const clock_type::time_point t1 = clock_type::now();
+        for (int r = 0; r < reps; ++r)
+        {
+            for (const bfapi::pipelined_request& req : burst)
+            {
+                if (false == conn.post(req.target, req.body, result, error, true) || result.body != req.body)
+                {
+                    std::cerr << "Serial request failed: " << error << std::endl;
+                    return false;
+                }
+            }
+        }
+        const clock_type::time_point t2 = clock_type::now();
+        for (int r = 0; r < reps; ++r)
+        {
+            if (false == conn.post_pipelined(burst, results, error))
+            {
+                std::cerr << "Pipelined burst failed: " << error << std::endl;
+                return false;
+            }
+            for (int i = 0; i < n; ++i)
+            {
+                ok = ok && (200 == results[i].status && results[i].body == burst[i].body);
+            }
+        }
+        const clock_type::time_point t3 = clock_type::now();
+
+        const double serial_ms = std::chrono::duration<double, std::milli>(t2 - t1).count() / reps;
+        const double pipelined_ms = std::chrono::duration<double, std::milli>(t3 - t2).count() / reps;
+        std::cout << "  " << std::setw(5) << n << std::fixed << std::setprecision(2) << std::setw(12) << serial_ms
+                  << std::setw(15) << pipelined_ms << std::setprecision(0) << std::setw(15) << n * 1000.0 / serial_ms
+                  << std::setw(18) << n * 1000.0 / pipelined_ms << std::setprecision(1) << std::setw(10)
+                  << serial_ms / pipelined_ms << "x\n";
+    }
+    return check(ok, name + ": every pipelined response matched its request");
+}
+
+//==============================================================================
+// Server closes after 12 responses: orders (not idempotent) left unanswered are reported, market data is resent
+bool closing_server(ssl::context& ctx, const std::string& port, bool graceful)
+{
+    const std::string how = graceful ? "\"Connection: close\"" : "close without warning";
+    close_after.store(12);
+    graceful_close.store(graceful);
+    bool ok = true;
+    std::string error;
+    std::vector<bfapi::http_result> results;
+
+    bfapi::api_connection orders(ctx, "appkey", "token", "127.0.0.1", port);
+    std::vector<bfapi::pipelined_request> burst = make_burst(20, false);
+    for (bfapi::pipelined_request& r : burst)
+    {
+        r.target = bfapi::place_orders_endpoint;
+    }
+    const bool orders_ok = orders.post_pipelined(burst, results, error);
+    int answered = 0;
+    bool matched = true;
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        answered += results[i].status ? 1 : 0;
+        matched = matched && (0 == results[i].status || results[i].body == burst[i].body);
+    }
+    std::cout << "  placeOrders burst of 20, " << how << " after 12: " << answered << " answered, error \"" << error << "\"\n";
+    ok = check(false == orders_ok && answered >= 12 && answered < 20 && matched && 200 == results[11].status,
+               how + ": orders answered before the close kept, the rest reported and not resent") && ok;
+
+    bfapi::api_connection data(ctx, "appkey", "token", "127.0.0.1", port);
+    burst = make_burst(20, true);
+    const bool data_ok = data.post_pipelined(burst, results, error);
+    matched = true;
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        matched = matched && (200 == results[i].status && results[i].body == burst[i].body);
+    }
+    ok = check(data_ok && matched, how + ": idempotent requests left unanswered resent on a new connection") && ok;
+
+    close_after.store(0);
+    return ok;
+}
+
+//==============================================================================
+// A governor with tokens for 6 of 10 requests: the 6 admitted are sent and
+// answered, the rest are reported unsent, and only the 6 sent keep a token
+bool governed_burst(ssl::context& ctx, const std::string& port)
+{
+    bfapi::governor_policy policy;
+    policy.account_rate = 1.0;
+    policy.operation_rate = 1.0;
+    policy.burst = 6.0;
+    policy.order_reserve = 0.0;
+    policy.max_queue_delay = std::chrono::milliseconds(100);
+    std::shared_ptr<bfapi::request_governor> governor = std::make_shared<bfapi::request_governor>(policy);
+
+    bfapi::api_connection conn(ctx, "appkey", "token", "127.0.0.1", port);
+    conn.set_governor(governor);
+    const std::vector<bfapi::pipelined_request> burst = make_burst(10, true);
+    std::vector<bfapi::http_result> results;
+    std::string error;
+    const bool all_ok = conn.post_pipelined(burst, results, error);
+    int answered = 0;
+    bool in_order = true;
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        answered += results[i].status ? 1 : 0;
+        in_order = in_order && (i < 6 ? 200 == results[i].status && results[i].body == burst[i].body : 0 == results[i].status);
+    }
+    const std::uint64_t granted = governor->stats(bfapi::list_market_book_endpoint).granted[1];
+    std::cout << "  burst of 10 with tokens for 6: " << answered << " answered, " << granted << " tokens granted, error \"" << error << "\"\n";
+    return check(false == all_ok && in_order && 6 == granted, "governor: requests admitted before one was refused are sent, the rest are not");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Invalid parameters (must supply paths to server certificate and key files)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const double rtt_ms = argc > 3 ? std::stod(argv[3]) : 1.0;
+
+    try
+    {
+        loopback::tls_server server(argv[1], argv[2]);
+        const std::string port = server.port();
+        server.serve_connections(echo);
+
+        net::io_context ioc;
+        tcp::acceptor delayed(ioc, tcp::endpoint(net::ip::make_address("127.0.0.1"), 0));
+        const std::string delayed_port = std::to_string(delayed.local_endpoint().port());
+        const clock_type::duration one_way = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double, std::milli>(rtt_ms / 2));
+        std::thread(proxy, std::ref(delayed), server.endpoint(), one_way).detach();
+
+        ssl::context ctx(ssl::context::tlsv12_client);
+        ctx.set_verify_mode(ssl::verify_none);     // Self signed local certificate
+
+        bool ok = true;
+        bfapi::api_connection direct(ctx, "appkey", "token", "127.0.0.1", port);
+        ok = bench(direct, "Loopback") && ok;
+        std::ostringstream name;
+        name << "Through proxy with " << rtt_ms << " ms round trip";
+        bfapi::api_connection proxied(ctx, "appkey", "token", "127.0.0.1", delayed_port);
+        ok = bench(proxied, name.str()) && ok;
+
+        std::cout << "Request governor:\n";
+        ok = governed_burst(ctx, port) && ok;
+
+        std::cout << "Server closing mid-pipeline:\n";
+        ok = closing_server(ctx, port, false) && ok;
+        ok = closing_server(ctx, port, true) && ok;
+
+        // Proxy threads are blocked on objects on this stack as well
+        loopback::finish(ok);
+    }
+    catch(std::exception const& e)
+    {
+        std::cerr << "ERROR: Exception thrown (" << e.what() << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,75 @@
+//==============================================================================
+//
+// Poll one or more markets with listMarketBook and print only the runners that
+// change between polls. Market IDs are supplied after the config file path, e.g.
+//
+//         ./poll_markets.out config.ini 1.209995594 1.209995595
+//
+//==============================================================================
+#include "../betfair/bfapi.hpp"
+#include "../betfair/polling.hpp"
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Invalid parameters (must supply path to config file followed by one or more market IDs)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string session_token = "";
+    bfapi::accinfo user_info;
+    if (bfapi::extract_user_credentials(argv[1], user_info))
+    {
+        std::string error = "";
+        if (false == bfapi::login(user_info,session_token,error))
+        {
+            std::cerr << "Betfair login failed: " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        std::cerr << "Unable to extract user credentials from supplied config filename." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::size_t concurrency = 4;
+    bfapi::connection_pool pool(user_info, session_token, concurrency);
+    bfapi::polling::market_book_poller poller(pool, concurrency);
+    for (int i = 2; i < argc; ++i)
+    {
+        poller.add_market(argv[i]);
+    }
+
+    auto print_update = [](const bfapi::polling::book_update& update)
+    {
+        std::cout << update.market_id << (update.first_image ? " (image)" : "") << " status = " << update.book.status
+                  << ", changed runners = " << update.book.runners.size() << std::endl;
+        for (const bfapi::responses::runner_book& r : update.book.runners)
+        {
+            std::cout << "    " << r.selection_id << " back "
+                      << (r.available_to_back.empty() ? 0.0 : r.available_to_back.front().price) << " lay "
+                      << (r.available_to_lay.empty() ? 0.0 : r.available_to_lay.front().price) << std::endl;
+        }
+    };
+
+    for (int cycle = 0; cycle < 10; ++cycle)
+    {
+        std::string error = "";
+        if (false == poller.poll_once(print_update, error))
+        {
+            std::cerr << error << std::endl;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    }
+
+    const bfapi::polling::poll_stats stats = poller.get_stats();
+    std::cout << "Requests: " << stats.requests << ", failures: " << stats.failed_requests
+              << ", updates: " << stats.updates_emitted << ", runners: " << stats.runners_emitted << std::endl;
+    return EXIT_SUCCESS;
+}
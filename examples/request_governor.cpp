@@ -0,0 +1,307 @@
+//==============================================================================
+//
+// Pace requests with bfapi::request_governor against a local TLS server that
+// throttles like Betfair: it allows 50 requests per second across all
+// connections (bursts of 5) and answers anything faster with HTTP 400 and a
+// TOO_MANY_REQUESTS APINGException.
+//
+// Four threads poll listMarketBook as fast as they can, retrying straight
+// away when throttled, while a fifth places an order every 100 ms. This runs
+// once with no governor and once with all five connections sharing one, and
+// compares how many requests were throttled, the useful throughput and the
+// order latency (which includes time spent waiting for the governor).
+// It also checks that a JSON-RPC batch holding a placeOrders call is admitted
+// as an order.
+//
+// A certificate and key for the local server are required, e.g.
+//
+//         openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 30 -subj "/CN=localhost"
+//         ./request_governor.out cert.pem key.pem
+//
+//==============================================================================
+#include "../betfair/connection.hpp"
+#include "../betfair/governor.hpp"
+#include "../betfair/jsonrpc.hpp"
+#include "loopback_tls_server.hpp"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <cstdlib>
+
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+using tcp = net::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+const double server_rate = 50.0;
+const double server_burst = 5.0;
+const int data_threads = 4;
+const std::chrono::milliseconds order_interval(100);
+const std::chrono::seconds run_time(5);
+
+const char* throttled_body = "{\"faultcode\":\"Client\",\"faultstring\":\"ANGX-0007\",\"detail\":{\"APINGException\":"
+                             "{\"requestUUID\":\"test\",\"errorCode\":\"TOO_MANY_REQUESTS\",\"errorDetails\":\"\"},"
+                             "\"exceptionname\":\"APINGException\"}}";
+
+// The server's view of the account: one token bucket for every request
+struct server_limit {
+    std::mutex mtx;
+    double tokens = server_burst;
+    clock_type::time_point last = clock_type::now();
+
+    bool allow()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        const clock_type::time_point now = clock_type::now();
+        tokens = std::min(server_burst, tokens + std::chrono::duration<double>(now - last).count() * server_rate);
+        last = now;
+        if (tokens < 1.0)
+        {
+            return false;
+        }
+        tokens -= 1.0;
+        return true;
+    }
+};
+
+//==============================================================================
+loopback::action answer(server_limit& limit, loopback::response& res)
+{
+    if (limit.allow())
+    {
+        res.body() = "[]";
+    }
+    else
+    {
+        res.result(loopback::http::status::bad_request);
+        res.body() = throttled_body;
+    }
+    return loopback::action::respond;
+}
+
+struct run_result {
+    std::atomic<int> data_ok{0};
+    std::atomic<int> data_throttled{0};
+    std::atomic<int> orders_ok{0};
+    std::atomic<int> orders_throttled{0};
+    std::atomic<int> data_rejected{0};
+    std::atomic<int> orders_rejected{0};
+    std::vector<double> order_ms;
+
+    int requests() const { return data_ok + data_throttled + orders_ok + orders_throttled; }
+    double throttled_fraction() const { return requests() > 0 ? static_cast<double>(data_throttled + orders_throttled) / requests() : 0.0; }
+};
+
+//==============================================================================
+double percentile(std::vector<double> v, double p)
+{
+    if (v.empty())
+    {
+        return 0.0;
+    }
+    std::sort(v.begin(), v.end());
+    return v[std::min(v.size() - 1, static_cast<std::size_t>(p * v.size()))];
+}
+
+//==============================================================================
+void run(ssl::context& ctx, const std::string& port, const std::shared_ptr<bfapi::request_governor>& governor, run_result& r)
+{
+    const clock_type::time_point end = clock_type::now() + run_time;
+    auto make_connection = [&]()
+    {
+        std::unique_ptr<bfapi::api_connection> conn(new bfapi::api_connection(ctx, "appkey", "token", "127.0.0.1", port));
+        conn->set_governor(governor);
+        return conn;
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < data_threads; ++i)
+    {
+        threads.emplace_back([&]()
+        {
+            std::unique_ptr<bfapi::api_connection> conn = make_connection();
+            bfapi::http_result result;
+            std::string error;
+            while (clock_type::now() < end)
+            {
+                if (false == conn->post(bfapi::list_market_book_endpoint, "{\"marketIds\":[\"1.1\"]}", result, error, true))
+                {
+                    ++r.data_rejected;
+                    continue;
+                }
+                // Blind retry: go again at once either way
+                ++(200 == result.status ? r.data_ok : r.data_throttled);
+            }
+        });
+    }
+    threads.emplace_back([&]()
+    {
+        std::unique_ptr<bfapi::api_connection> conn = make_connection();
+        bfapi::http_result result;
+        std::string error;
+        clock_type::time_point next = clock_type::now();
+        while (next < end)
+        {
+            std::this_thread::sleep_until(next);
+            next += order_interval;
+            const clock_type::time_point t1 = clock_type::now();
+            if (false == conn->post(bfapi::place_orders_endpoint, "{\"marketId\":\"1.1\",\"instructions\":[]}", result, error))
+            {
+                ++r.orders_rejected;
+                continue;
+            }
+            r.order_ms.push_back(std::chrono::duration<double, std::milli>(clock_type::now() - t1).count());
+            ++(200 == result.status ? r.orders_ok : r.orders_throttled);
+        }
+    });
+    for (std::thread& t : threads)
+    {
+        t.join();
+    }
+}
+
+//==============================================================================
+void print(const std::string& name, const run_result& r)
+{
+    const double seconds = std::chrono::duration<double>(run_time).count();
+    std::cout << name << ": " << r.requests() << " requests, " << std::fixed << std::setprecision(1)
+              << 100.0 * r.throttled_fraction() << "% throttled, " << (r.data_ok + r.orders_ok) / seconds
+              << " successful per second\n"
+              << "  listMarketBook " << r.data_ok << " ok, " << r.data_throttled << " throttled; placeOrders "
+              << r.orders_ok << " ok, " << r.orders_throttled << " throttled; not admitted " << r.data_rejected
+              << " listMarketBook, " << r.orders_rejected << " placeOrders\n"
+              << "  order latency p50 " << std::setprecision(2) << percentile(r.order_ms, 0.5) << " ms, p99 "
+              << percentile(r.order_ms, 0.99) << " ms\n";
+}
+
+//==============================================================================
+bool check(bool ok, const std::string& what)
+{
+    std::cout << (ok ? "PASS: " : "FAIL: ") << what << std::endl;
+    return ok;
+}
+
+//==============================================================================
+// A listMarketBook request waiting out a TOO_MUCH_DATA cut of its own bucket
+// must not hold up a request to another operation whose buckets have tokens
+bool check_operation_queues()
+{
+    bfapi::request_governor governor;
+    governor.set_rate(bfapi::list_market_book_endpoint, 1.0);
+    const char body[] = "{\"detail\":{\"APINGException\":{\"errorCode\":\"TOO_MUCH_DATA\"}}}";
+    governor.record(bfapi::list_market_book_endpoint, 400, body, sizeof(body) - 1);
+
+    std::thread waiting([&governor]() { governor.acquire(bfapi::list_market_book_endpoint); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const bool granted = governor.acquire(bfapi::list_market_catalogue_endpoint);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    waiting.join();
+    return check(granted && ms < 100.0, "a request waiting on its operation's bucket does not hold up other operations");
+}
+
+//==============================================================================
+// A JSON-RPC batch holding a placeOrders call is an order: once data requests
+// have left only the order reserve it is still admitted, where a batch of
+// listMarketBook calls is not
+bool check_batch_priority(ssl::context& ctx, const std::string& port)
+{
+    bfapi::governor_policy policy;
+    policy.account_rate = 1.0;
+    policy.operation_rate = 1.0;
+    policy.burst = 2.0;
+    policy.order_reserve = 1.0;
+    policy.max_queue_delay = std::chrono::milliseconds(100);
+    std::shared_ptr<bfapi::request_governor> governor = std::make_shared<bfapi::request_governor>(policy);
+    bfapi::api_connection conn(ctx, "appkey", "token", "127.0.0.1", port);
+    conn.set_governor(governor);
+
+    std::string error;
+    bfapi::jsonrpc::batch data;
+    data.add_list_market_book({"1.1"});
+    data.send(conn, error);
+    bfapi::jsonrpc::batch more_data;
+    more_data.add_list_market_book({"1.1"});
+    more_data.send(conn, error);
+
+    std::vector<bfapi::orders::limit_order_instruction> bets;
+    bets.emplace_back(1, true, 2.0, 1.01, false, "BATCH");
+    bfapi::jsonrpc::batch orders;
+    orders.add_place_orders(bfapi::orders::place_limit_orders_request("1.1", false, bets), error);
+    orders.add_list_market_book({"1.1"});
+    orders.send(conn, error);
+
+    const bfapi::governor_stats stats = governor->stats(bfapi::betting_jsonrpc_endpoint);
+    return check(1 == stats.granted[static_cast<int>(bfapi::request_priority::data)] &&
+                 1 == stats.rejected[static_cast<int>(bfapi::request_priority::data)] &&
+                 1 == stats.granted[static_cast<int>(bfapi::request_priority::order)],
+                 "a batched placeOrders takes the order reserve that a batched listMarketBook may not");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Invalid parameters (must supply paths to server certificate and key files)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        loopback::tls_server server(argv[1], argv[2]);
+        const std::string port = server.port();
+        server_limit limit;
+        server.serve([&limit](tcp::socket&, const loopback::request&, loopback::response& res) { return answer(limit, res); });
+
+        ssl::context ctx(ssl::context::tlsv12_client);
+        ctx.set_verify_mode(ssl::verify_none);     // Self signed local certificate
+
+        run_result ungoverned;
+        run(ctx, port, nullptr, ungoverned);
+        print("No governor", ungoverned);
+
+        // Let the server's bucket refill, then start at the default rate and let
+        // slow start and AIMD find the limit (a faster increase than the default
+        // so it settles within the run)
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        bfapi::governor_policy policy;
+        policy.increase = 10.0;
+        std::shared_ptr<bfapi::request_governor> governor = std::make_shared<bfapi::request_governor>(policy);
+        run_result governed;
+        run(ctx, port, governor, governed);
+        print("Governor", governed);
+
+        const bfapi::governor_stats account = governor->account_stats();
+        std::cout << "  account rate " << std::setprecision(1) << account.rate << "/s after " << account.decreases
+                  << " decreases; order wait max " << std::setprecision(2) << account.max_wait_ms[0]
+                  << " ms, data wait max " << account.max_wait_ms[1] << " ms\n";
+        for (const auto& op : governor->all_stats())
+        {
+            std::cout << "  " << op.first << " rate " << std::setprecision(1) << op.second.rate << "/s, "
+                      << op.second.throttled << " throttled\n";
+        }
+
+        bool ok = check_operation_queues();
+        ok = check_batch_priority(ctx, port) && ok;
+        ok = check(governed.throttled_fraction() < 0.1 && governed.throttled_fraction() < ungoverned.throttled_fraction() / 5,
+                   "governor keeps throttled requests under 10%") && ok;
+        ok = check(governed.data_ok + governed.orders_ok >= 0.7 * server_rate * run_time.count(),
+                   "governor sustains at least 70% of the server's limit") && ok;
+        ok = check(governed.orders_throttled <= ungoverned.orders_throttled && 0 == governed.orders_rejected,
+                   "orders throttled no more often than without the governor, none left unsent") && ok;
+
+        loopback::finish(ok);
+    }
+    catch(std::exception const& e)
+    {
+        std::cerr << "ERROR: Exception thrown (" << e.what() << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
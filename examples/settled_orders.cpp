@@ -0,0 +1,152 @@
+//==============================================================================
+//
+// Download every settled order in a date range (by default the 7 days up to
+// the start of the run) using parallel paginated listClearedOrders requests
+// and print a profit summary:
+//
+//         ./settled_orders.out config [from to]      (e.g. 2024-03-01T00:00:00Z)
+//
+// Progress is saved to settled_orders.checkpoint and the range to
+// settled_orders.range, so an interrupted run can simply be restarted and
+// resumes the same windows. Orders are appended to settled_orders.csv as they
+// arrive and the totals are computed from it, so they include the orders
+// fetched by earlier runs. Both progress files are removed once the download
+// is complete.
+//
+//==============================================================================
+#include "../betfair/bfapi.hpp"
+#include "../betfair/bulk.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <set>
+#include <chrono>
+#include <cstdio>
+
+using std::chrono::high_resolution_clock;
+using std::chrono::duration;
+
+const char* checkpoint_file = "settled_orders.checkpoint";
+const char* range_file = "settled_orders.range";
+const char* orders_file = "settled_orders.csv";
+
+int main(int argc, char** argv)
+{
+    if (argc != 2 && argc != 4)
+    {
+        std::cerr << "Invalid parameters (must supply path to config file and optionally a from and to date)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // The range must stay the same across restarts for the checkpointed windows to match
+    bfapi::bulk::cleared_orders_query query;
+    std::ifstream saved_range(range_file);
+    const bool resuming = saved_range >> query.settled_from >> query.settled_to ? true : false;
+    if (argc == 4)
+    {
+        std::time_t from = 0;
+        std::time_t to = 0;
+        if (false == bfapi::bulk::from_iso8601(argv[2], from) || false == bfapi::bulk::from_iso8601(argv[3], to) || from >= to)
+        {
+            std::cerr << "Invalid date range (dates must be ISO 8601 and from must be before to)" << std::endl;
+            return EXIT_FAILURE;
+        }
+        if (resuming && (from != query.settled_from || to != query.settled_to))
+        {
+            std::cerr << "An interrupted download of another range exists (delete " << range_file << " and "
+                      << checkpoint_file << " to discard it)" << std::endl;
+            return EXIT_FAILURE;
+        }
+        query.settled_from = from;
+        query.settled_to = to;
+    }
+    else if (false == resuming)
+    {
+        query.settled_to = std::time(nullptr);
+        query.settled_from = query.settled_to - 7 * 24 * 3600;
+    }
+    if (false == resuming)
+    {
+        std::ofstream(range_file) << query.settled_from << " " << query.settled_to << "\n";
+        std::ofstream(orders_file, std::ios::trunc);
+        std::remove(checkpoint_file);
+    }
+    std::cout << (resuming ? "Resuming " : "Downloading ") << bfapi::bulk::to_iso8601(query.settled_from) << " to "
+              << bfapi::bulk::to_iso8601(query.settled_to) << std::endl;
+
+    std::string session_token = "";
+    bfapi::accinfo user_info;
+    if (bfapi::extract_user_credentials(argv[1], user_info))
+    {
+        std::string error = "";
+        if (false == bfapi::login(user_info,session_token,error))
+        {
+            std::cerr << "Betfair login failed: " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        std::cerr << "Unable to extract user credentials from supplied config filename." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    bfapi::bulk::bulk_options options;
+    options.concurrency = 4;
+    options.max_requests_per_second = 5.0;
+    options.window_seconds = 24 * 3600;
+    options.checkpoint_file = checkpoint_file;
+
+    bfapi::connection_pool pool(user_info, session_token, options.concurrency);
+    bfapi::bulk::bulk_progress progress;
+    bfapi::bulk::bulk_stats stats;
+
+    std::ofstream orders(orders_file, std::ios::app);
+    auto sink = [&](const std::vector<bfapi::responses::cleared_order>& page)
+    {
+        for (const bfapi::responses::cleared_order& co : page)
+        {
+            orders << co.bet_id << "," << co.profit << "," << co.commission << "\n";
+        }
+        orders.flush();
+    };
+
+    std::string error = "";
+    auto t1 = high_resolution_clock::now();
+    const bool ok = bfapi::bulk::fetch_cleared_orders(pool, query, options, progress, sink, stats, error);
+    auto t2 = high_resolution_clock::now();
+    duration<double, std::milli> ms_double = t2 - t1;
+
+    orders.close();
+
+    // A page fetched again after an interruption appears twice in the file, so count each bet once
+    double profit = 0.0;
+    double commission = 0.0;
+    std::set<std::string> bets;
+    std::ifstream in(orders_file);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string bet_id;
+        std::string p;
+        std::string c;
+        if (std::getline(fields, bet_id, ',') && std::getline(fields, p, ',') && std::getline(fields, c) && bets.insert(bet_id).second)
+        {
+            profit += std::stod(p);
+            commission += std::stod(c);
+        }
+    }
+
+    std::cout << stats.records << " settled orders in " << stats.requests << " requests, took " << ms_double.count() << "ms\n";
+    std::cout << bets.size() << " settled orders in total: profit = " << profit << ", commission = " << commission << std::endl;
+    if (false == ok)
+    {
+        std::cerr << error << " (run again to resume)" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::remove(checkpoint_file);
+    std::remove(range_file);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+//==============================================================================
+//
+// Poll one or more markets with listMarketBook and publish every update to a
+// shared memory region so that other processes (see shm_read.cpp) can read
+// the books without logging in themselves. Usage:
+//
+//         ./shm_publish.out config.ini bfapi_books 1.209995594 1.209995595
+//
+// The region is removed when the publisher exits.
+//
+//==============================================================================
+#include "../betfair/bfapi.hpp"
+#include "../betfair/polling.hpp"
+#include "../betfair/shm_book.hpp"
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cerr << "Invalid parameters (must supply path to config file, region name and one or more market IDs)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string session_token = "";
+    bfapi::accinfo user_info;
+    if (bfapi::extract_user_credentials(argv[1], user_info))
+    {
+        std::string error = "";
+        if (false == bfapi::login(user_info,session_token,error))
+        {
+            std::cerr << "Betfair login failed: " << error << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        std::cerr << "Unable to extract user credentials from supplied config filename." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string error = "";
+    bfapi::shm::shm_publisher publisher(argv[2]);
+    if (false == publisher.create(error))
+    {
+        std::cerr << error << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    const std::size_t concurrency = 4;
+    bfapi::connection_pool pool(user_info, session_token, concurrency);
+    bfapi::polling::market_book_poller poller(pool, concurrency);
+    for (int i = 3; i < argc; ++i)
+    {
+        poller.add_market(argv[i]);
+    }
+
+    std::size_t published = 0;
+    auto publish_update = [&](const bfapi::polling::book_update& update)
+    {
+        std::string publish_error = "";
+        if (false == publisher.publish(update, publish_error))
+        {
+            std::cerr << publish_error << std::endl;
+        }
+        ++published;
+    };
+
+    std::cout << "Publishing " << (argc - 3) << " market(s) to /dev/shm/" << argv[2] << " for 10 minutes" << std::endl;
+    for (int cycle = 0; cycle < 600; ++cycle)
+    {
+        if (false == poller.poll_once(publish_update, error))
+        {
+            std::cerr << error << std::endl;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    }
+    std::cout << "Updates published: " << published << std::endl;
+    return EXIT_SUCCESS;
+}
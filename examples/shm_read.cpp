@@ -0,0 +1,68 @@
+//==============================================================================
+//
+// Attach to a shared memory region written by shm_publish.cpp (or any other
+// bfapi::shm::shm_publisher) and print each published market whenever it
+// changes. No login is needed, and any number of readers can run at once:
+//
+//         ./shm_read.out bfapi_books
+//
+//==============================================================================
+#include "../betfair/shm_book.hpp"
+#include <iostream>
+#include <string>
+#include <map>
+#include <chrono>
+#include <thread>
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Invalid parameters (must supply the shared memory region name)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string error = "";
+    bfapi::shm::shm_reader reader(argv[1]);
+    if (false == reader.open(error))
+    {
+        std::cerr << error << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::map<std::string, std::uint64_t> seen;
+    for (int cycle = 0; cycle < 600; ++cycle)
+    {
+        for (const std::string& market_id : reader.market_ids())
+        {
+            // Only take a copy when the block has been written since the last one
+            const std::uint64_t sequence = reader.sequence(market_id);
+            if (seen[market_id] == sequence)
+            {
+                continue;
+            }
+            bfapi::responses::market_book book;
+            if (false == reader.read(market_id, book))
+            {
+                continue;
+            }
+            seen[market_id] = sequence;
+
+            double back_book = 0.0;
+            for (const bfapi::responses::runner_book& r : book.runners)
+            {
+                back_book += r.available_to_back.empty() ? 0.0 : 100.0 / r.available_to_back.front().price;
+            }
+            std::cout << market_id << " status = " << book.status << (book.inplay ? " (in play)" : "")
+                      << ", matched = " << book.total_matched << ", back book = " << back_book << "%" << std::endl;
+            for (const bfapi::responses::runner_book& r : book.runners)
+            {
+                std::cout << "    " << r.selection_id << " back "
+                          << (r.available_to_back.empty() ? 0.0 : r.available_to_back.front().price) << " lay "
+                          << (r.available_to_lay.empty() ? 0.0 : r.available_to_lay.front().price) << std::endl;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    }
+    return EXIT_SUCCESS;
+}
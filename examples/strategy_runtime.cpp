@@ -0,0 +1,205 @@
+//==============================================================================
+//
+// Run a simple strategy on many markets at once with the strategy runtime, fed
+// by synthetic market updates so no login is needed. Each market has its own
+// simulator (as in paper_trade.cpp) and the strategy places a small back bet
+// below the best price every 50 updates, so order intents and order events go
+// through the runtime too. A tenth of the markets get ten times the updates of
+// the rest to show work stealing evening out the load.
+//
+//         ./strategy_runtime.out [workers] [markets] [updates per second] [seconds]
+//
+// The defaults are one worker per hardware thread, 200 markets, 50000 updates
+// per second and 5 seconds. An update rate of 0 posts as fast as possible.
+//
+//==============================================================================
+#include "../betfair/runtime.hpp"
+#include "../betfair/simulator.hpp"
+#include <iostream>
+#include <string>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <random>
+
+using bfapi::responses::market_book;
+using bfapi::responses::runner_book;
+using bfapi::responses::price_size;
+
+const int runners_per_market = 12;
+
+//==============================================================================
+std::int64_t now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+//==============================================================================
+market_book make_book(const std::string& market_id)
+{
+    market_book book;
+    book.market_id = market_id;
+    book.status = "OPEN";
+    for (int i = 0; i < runners_per_market; ++i)
+    {
+        runner_book rb;
+        rb.selection_id = 1000 + i;
+        rb.status = "ACTIVE";
+        const int tick = 60 + 8 * i;
+        for (int l = 0; l < 3; ++l)
+        {
+            rb.available_to_back.push_back(price_size(bfapi::ticks::tick_to_price(tick - l), 50.0 + 10 * l));
+            rb.available_to_lay.push_back(price_size(bfapi::ticks::tick_to_price(tick + 1 + l), 50.0 + 10 * l));
+        }
+        book.runners.push_back(rb);
+    }
+    return book;
+}
+
+class ladder_strategy : public bfapi::runtime::strategy {
+public:
+    explicit ladder_strategy(bfapi::simulator::market_simulator& s) : sim(s), updates(0), filled(0.0) {}
+
+    virtual void on_market_update(bfapi::runtime::market_context& context, const bfapi::polling::book_update& update)
+    {
+        (void)update;
+        sim.on_market_book(context.book(), now_ms());
+
+        // Back the favourite one tick below the best back price now and again
+        if (++updates % 50 == 0 && 0 == context.pending_intents())
+        {
+            const runner_book* favourite = nullptr;
+            for (const runner_book& rb : context.book().runners)
+            {
+                if (false == rb.available_to_back.empty() &&
+                    (nullptr == favourite || rb.available_to_back.front().price < favourite->available_to_back.front().price))
+                {
+                    favourite = &rb;
+                }
+            }
+            if (favourite)
+            {
+                const int tick = bfapi::ticks::price_to_tick(favourite->available_to_back.front().price);
+                std::vector<bfapi::orders::limit_order_instruction> order_list;
+                order_list.emplace_back(favourite->selection_id, false, 2.0, bfapi::ticks::tick_to_price(tick + 1), false, "");
+                context.place(bfapi::orders::place_limit_orders_request(context.market_id(), false, order_list));
+            }
+        }
+    }
+
+    virtual void on_order_event(bfapi::runtime::market_context& context, const bfapi::runtime::order_event& event)
+    {
+        (void)context;
+        for (const bfapi::responses::instruction_report& ir : event.place_report.instruction_reports)
+        {
+            filled += ir.size_matched;
+        }
+    }
+
+private:
+    bfapi::simulator::market_simulator& sim;
+    std::uint64_t updates;
+    double filled;
+};
+
+int main(int argc, char** argv)
+{
+    const std::size_t workers = argc > 1 ? std::stoul(argv[1]) : 0;
+    const int market_count = argc > 2 ? std::stoi(argv[2]) : 200;
+    const double rate = argc > 3 ? std::stod(argv[3]) : 50000.0;
+    const int seconds = argc > 4 ? std::stoi(argv[4]) : 5;
+
+    // One simulator per market, created up front so the executor only reads the map
+    std::vector<std::string> market_ids;
+    std::map<std::string, std::unique_ptr<bfapi::simulator::market_simulator>> simulators;
+    for (int i = 0; i < market_count; ++i)
+    {
+        const std::string id = "1." + std::to_string(200000000 + i);
+        market_ids.push_back(id);
+        simulators[id].reset(new bfapi::simulator::market_simulator(id, static_cast<std::int64_t>(i) * 1000000000 + 1));
+    }
+
+    auto factory = [&](const std::string& market_id) -> std::unique_ptr<bfapi::runtime::strategy>
+    {
+        return std::unique_ptr<bfapi::runtime::strategy>(new ladder_strategy(*simulators.at(market_id)));
+    };
+
+    // Runs inline on the market's worker, the only thread touching that market's simulator
+    auto executor = [&](const bfapi::runtime::order_intent& intent, bfapi::runtime::order_event& event) -> bool
+    {
+        return simulators.at(intent.market_id())->place_orders(intent.place, event.place_report);
+    };
+
+    bfapi::runtime::strategy_runtime runtime(factory, executor, workers, 0);
+    std::string error = "";
+    if (false == runtime.start(error))
+    {
+        std::cerr << error << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Complete images first, then updates changing two runners each
+    std::vector<market_book> books;
+    for (const std::string& id : market_ids)
+    {
+        books.push_back(make_book(id));
+        runtime.post(books.back());
+    }
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> any_market(0, market_count - 1);
+    std::uniform_int_distribution<int> hot_market(0, std::max(1, market_count / 10) - 1);
+    std::uniform_int_distribution<int> any_runner(0, runners_per_market - 1);
+    std::uniform_real_distribution<double> size(2.0, 200.0);
+    std::bernoulli_distribution pick_hot(0.5);      // Half the updates go to 10% of the markets
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto end = start + std::chrono::seconds(seconds);
+    std::uint64_t posted = 0;
+    while (std::chrono::steady_clock::now() < end)
+    {
+        if (rate > 0.0)
+        {
+            const auto due = start + std::chrono::nanoseconds(static_cast<std::int64_t>(posted * 1e9 / rate));
+            while (std::chrono::steady_clock::now() < due)
+            {
+            }
+        }
+        market_book& book = books[pick_hot(rng) ? hot_market(rng) : any_market(rng)];
+        bfapi::polling::book_update update;
+        update.market_id = book.market_id;
+        update.book = book;
+        update.book.runners.clear();
+        for (int k = 0; k < 2; ++k)
+        {
+            runner_book& rb = book.runners[any_runner(rng)];
+            rb.available_to_back.front().size = size(rng);
+            rb.available_to_lay.front().size = size(rng);
+            update.book.runners.push_back(rb);
+        }
+        runtime.post(update);
+        ++posted;
+    }
+    runtime.stop();
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const bfapi::runtime::runtime_stats stats = runtime.get_stats();
+    std::cout << "Workers: " << runtime.worker_count() << ", markets: " << stats.markets << std::endl;
+    std::cout << "Updates posted: " << stats.updates_posted << " (" << static_cast<std::uint64_t>(stats.updates_posted / elapsed)
+              << "/s), coalesced: " << stats.updates_coalesced << std::endl;
+    std::cout << "Callbacks: " << stats.total.events << ", order intents: " << stats.intents_submitted
+              << ", failed: " << stats.intents_failed << ", order events: " << stats.order_events << std::endl;
+    std::cout << "Callback latency: mean " << stats.total.mean_latency_us() << " us, max " << stats.total.latency_max_ns / 1000.0 << " us" << std::endl;
+    const std::vector<bfapi::runtime::worker_stats> per_worker = runtime.get_worker_stats();
+    for (std::size_t i = 0; i < per_worker.size(); ++i)
+    {
+        const bfapi::runtime::worker_stats& ws = per_worker[i];
+        std::cout << "    worker " << i << ": callbacks " << ws.events << ", busy " << ws.busy_ns / 1e6 << " ms, steals " << ws.steals
+                  << ", ns per callback " << (ws.events > 0 ? ws.busy_ns / ws.events : 0) << std::endl;
+    }
+    if (false == runtime.last_error().empty())
+    {
+        std::cout << "Last error: " << runtime.last_error() << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,352 @@
+//==============================================================================
+//
+// Send every typed operation of bfapi::operations through call<Op>() to a
+// local TLS server that answers each endpoint with a canned response, and
+// check the request bodies and parsed responses, and that an order report with
+// status FAILURE fails the call. Then compare listMarketBook
+// polling through call<list_market_book>() (arena, single pass parsing) with
+// api_connection::post() and property_tree parsing, counting heap allocations
+// per call.
+//
+// A certificate and key for the local server are required, e.g.
+//
+//         openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 30 -subj "/CN=localhost"
+//         ./typed_calls.out cert.pem key.pem
+//
+// Exits with a failure status if a check fails or a warm call<>() allocates.
+//==============================================================================
+#include "../betfair/alloc_counter.hpp"
+#include "../betfair/connection.hpp"
+#include "../betfair/operations.hpp"
+#include "loopback_tls_server.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+namespace ops = bfapi::operations;
+using tcp = net::ip::tcp;
+
+const int book_markets = 10;
+const int book_runners = 12;
+
+//==============================================================================
+// listMarketBook for book_markets markets with book_runners runners and three
+// levels of prices each side
+std::string market_books_json()
+{
+    std::string json = "[";
+    for (int m = 0; m < book_markets; ++m)
+    {
+        json += std::string(m > 0 ? "," : "") + "{\"marketId\":\"1.20999559" + std::to_string(m) + "\",\"isMarketDataDelayed\":false,"
+                "\"status\":\"OPEN\",\"betDelay\":0,\"bspReconciled\":false,\"complete\":true,\"inplay\":false,\"numberOfWinners\":1,"
+                "\"numberOfRunners\":" + std::to_string(book_runners) + ",\"totalMatched\":12345.67,\"totalAvailable\":89012.34,"
+                "\"version\":4567" + std::to_string(m) + ",\"runners\":[";
+        for (int r = 0; r < book_runners; ++r)
+        {
+            json += std::string(r > 0 ? "," : "") + "{\"selectionId\":" + std::to_string(50000 + r) + ",\"handicap\":0.0,"
+                    "\"status\":\"ACTIVE\",\"lastPriceTraded\":3.45,\"totalMatched\":1234.5,\"ex\":{\"availableToBack\":["
+                    "{\"price\":3.4,\"size\":120.5},{\"price\":3.35,\"size\":80.0},{\"price\":3.3,\"size\":44.12}],"
+                    "\"availableToLay\":[{\"price\":3.5,\"size\":95.0},{\"price\":3.55,\"size\":60.25},{\"price\":3.6,\"size\":12.0}],"
+                    "\"tradedVolume\":[]}}";
+        }
+        json += "]}";
+    }
+    return json + "]";
+}
+
+//==============================================================================
+std::map<std::string, std::string> canned_responses()
+{
+    std::map<std::string, std::string> r;
+    r[bfapi::paths::list_event_types] = "[{\"eventType\":{\"id\":\"1\",\"name\":\"Soccer\"},\"marketCount\":9123},"
+                                        "{\"eventType\":{\"id\":\"7\",\"name\":\"Horse Racing\"},\"marketCount\":412}]";
+    r[bfapi::paths::list_market_catalogue] = "[{\"marketId\":\"1.209995594\",\"marketName\":\"2m Hcap\",\"marketStartTime\":\"2024-03-01T14:30:00.000Z\","
+                                             "\"totalMatched\":1500.5,\"runners\":[{\"selectionId\":50198,\"handicap\":0.0,\"runnerName\":\"Alpha\","
+                                             "\"sortPriority\":1},{\"selectionId\":50199,\"handicap\":0.0,\"runnerName\":\"Bravo \\u00e9\",\"sortPriority\":2}],"
+                                             "\"eventType\":{\"id\":\"7\",\"name\":\"Horse Racing\"},\"event\":{\"id\":\"33012345\",\"name\":\"Kempton 1st Mar\","
+                                             "\"countryCode\":\"GB\",\"timezone\":\"Europe/London\",\"venue\":\"Kempton\",\"openDate\":\"2024-03-01T13:00:00.000Z\"}}]";
+    r[bfapi::paths::list_market_book] = market_books_json();
+    r[bfapi::paths::list_runner_book] = "[{\"marketId\":\"1.209995594\",\"status\":\"OPEN\",\"inplay\":true,\"version\":99,\"runners\":"
+                                        "[{\"selectionId\":50198,\"handicap\":0.0,\"status\":\"ACTIVE\",\"lastPriceTraded\":null,"
+                                        "\"ex\":{\"availableToBack\":[{\"price\":2.0,\"size\":10.0}],\"availableToLay\":[],\"tradedVolume\":[]}}]}]";
+    r[bfapi::paths::list_current_orders] = "{\"currentOrders\":[{\"betId\":\"31234567890\",\"marketId\":\"1.209995594\",\"selectionId\":50198,"
+                                           "\"handicap\":0.0,\"priceSize\":{\"price\":3.4,\"size\":2.0},\"bspLiability\":0.0,\"side\":\"BACK\","
+                                           "\"status\":\"EXECUTABLE\",\"persistenceType\":\"LAPSE\",\"orderType\":\"LIMIT\",\"placedDate\":"
+                                           "\"2024-03-01T14:00:00.000Z\",\"averagePriceMatched\":3.4,\"sizeMatched\":0.5,\"sizeRemaining\":1.5,"
+                                           "\"sizeLapsed\":0.0,\"sizeCancelled\":0.0,\"sizeVoided\":0.0,\"regulatorCode\":\"GAMBLING COMMISSION\","
+                                           "\"customerOrderRef\":\"REF1\"}],\"moreAvailable\":false}";
+    r[bfapi::paths::list_cleared_orders] = "{\"clearedOrders\":[{\"eventTypeId\":\"7\",\"eventId\":\"33012345\",\"marketId\":\"1.209995594\","
+                                           "\"selectionId\":50198,\"handicap\":0.0,\"betId\":\"31234567890\",\"placedDate\":\"2024-03-01T14:00:00.000Z\","
+                                           "\"persistenceType\":\"LAPSE\",\"orderType\":\"LIMIT\",\"side\":\"BACK\",\"betOutcome\":\"WON\","
+                                           "\"priceRequested\":3.4,\"settledDate\":\"2024-03-01T14:40:00.000Z\",\"betCount\":1,\"priceMatched\":3.4,"
+                                           "\"priceReduced\":false,\"sizeSettled\":2.0,\"profit\":4.8}],\"moreAvailable\":true}";
+    r[bfapi::paths::place_orders] = "{\"status\":\"SUCCESS\",\"marketId\":\"1.209995594\",\"instructionReports\":[{\"status\":\"SUCCESS\","
+                                    "\"instruction\":{\"selectionId\":50198,\"customerOrderRef\":\"REF1\"},\"betId\":\"31234567891\","
+                                    "\"placedDate\":\"2024-03-01T14:00:00.000Z\",\"averagePriceMatched\":0.0,\"sizeMatched\":0.0,"
+                                    "\"orderStatus\":\"EXECUTABLE\"}]}";
+    r[bfapi::paths::cancel_orders] = "{\"status\":\"SUCCESS\",\"marketId\":\"1.209995594\",\"instructionReports\":[{\"status\":\"SUCCESS\","
+                                     "\"instruction\":{\"betId\":\"31234567891\",\"sizeReduction\":1.0},\"sizeCancelled\":1.0,"
+                                     "\"cancelledDate\":\"2024-03-01T14:01:00.000Z\"}]}";
+    r[bfapi::paths::replace_orders] = "{\"status\":\"SUCCESS\",\"marketId\":\"1.209995594\",\"instructionReports\":[{\"status\":\"SUCCESS\","
+                                      "\"cancelInstructionReport\":{\"status\":\"SUCCESS\",\"instruction\":{\"betId\":\"31234567891\"},"
+                                      "\"sizeCancelled\":2.0},\"placeInstructionReport\":{\"status\":\"SUCCESS\",\"instruction\":"
+                                      "{\"selectionId\":50198},\"betId\":\"31234567892\",\"orderStatus\":\"EXECUTABLE\"}}]}";
+    return r;
+}
+
+// Bodies the server received, by target, and the number of requests
+struct server_log {
+    std::mutex mtx;
+    std::map<std::string, std::string> bodies;
+    std::atomic<int> requests{0};
+};
+
+//==============================================================================
+loopback::action answer(const std::map<std::string, std::string>& responses, server_log& log,
+                        const loopback::request& req, loopback::response& res)
+{
+    ++log.requests;
+    const std::string target(req.target());
+    {
+        std::lock_guard<std::mutex> lock(log.mtx);
+        log.bodies[target] = req.body();
+    }
+    auto it = responses.find(target);
+    const bool too_much = (std::string::npos != req.body().find("TOO_MUCH"));
+    const bool suspended = (std::string::npos != req.body().find("SUSPENDED"));
+    res.result((responses.end() == it || too_much) ? loopback::http::status::bad_request : loopback::http::status::ok);
+    res.body() = too_much ? "{\"faultcode\":\"Client\",\"faultstring\":\"ANGX-0001\",\"detail\":{\"APINGException\":{\"errorCode\":"
+                            "\"TOO_MUCH_DATA\"},\"exceptionname\":\"APINGException\"}}"
+               : suspended ? "{\"status\":\"FAILURE\",\"errorCode\":\"MARKET_SUSPENDED\",\"marketId\":\"SUSPENDED\",\"instructionReports\":[]}"
+                          : (responses.end() == it ? std::string("{}") : it->second);
+    return loopback::action::respond;
+}
+
+//==============================================================================
+std::string with_error(const std::string& what, const std::string& error)
+{
+    return error.empty() ? what : what + ": " + error;
+}
+
+//==============================================================================
+bool check(bool ok, const std::string& what)
+{
+    std::cout << (ok ? "PASS: " : "FAIL: ") << what << std::endl;
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    // Must run before OpenSSL allocates anything
+    bfapi::alloc_counter::count_openssl();
+
+    if (argc != 3)
+    {
+        std::cerr << "Invalid parameters (must supply paths to server certificate and key files)" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try
+    {
+        loopback::tls_server server(argv[1], argv[2]);
+        const std::string port = server.port();
+        const std::map<std::string, std::string> responses = canned_responses();
+        server_log log;
+        server.serve([&](tcp::socket&, const loopback::request& req, loopback::response& res) { return answer(responses, log, req, res); });
+
+        ssl::context ctx(ssl::context::tlsv12_client);
+        ctx.set_verify_mode(ssl::verify_none);     // Self signed local certificate
+        bfapi::api_connection conn(ctx, "appkey", "token", "127.0.0.1", port);
+        bfapi::arena a;
+        std::string error;
+        bool ok = true;
+        auto body_of = [&](const char* path)
+        {
+            std::lock_guard<std::mutex> lock(log.mtx);
+            return log.bodies[path];
+        };
+
+        // Every operation once
+        {
+            ops::list_event_types_request req;
+            ops::list_event_types::response_type res;
+            const bool sent = ops::call<ops::list_event_types>(conn, req, res, a, error);
+            ok = check(sent && 2 == res.size() && "Horse Racing" == res[1].event_type_name && 9123 == res[0].market_count &&
+                       "{\"filter\":{}}" == body_of(bfapi::paths::list_event_types), with_error("listEventTypes", error)) && ok;
+        }
+        {
+            ops::list_market_catalogue_request req;
+            req.filter_json = "\"eventTypeIds\":[\"7\"]";
+            req.market_projection = {"EVENT", "RUNNER_DESCRIPTION"};
+            req.sort = "FIRST_TO_START";
+            req.max_results = 50;
+            ops::list_market_catalogue::response_type res;
+            const bool sent = ops::call<ops::list_market_catalogue>(conn, req, res, a, error);
+            ok = check(sent && 1 == res.size() && "Kempton" == res[0].venue && 2 == res[0].runners.size() &&
+                       "Bravo \xc3\xa9" == res[0].runners[1].runner_name && "Horse Racing" == res[0].event_type_name &&
+                       "{\"filter\":{\"eventTypeIds\":[\"7\"]},\"marketProjection\":[\"EVENT\",\"RUNNER_DESCRIPTION\"],\"sort\":"
+                       "\"FIRST_TO_START\",\"maxResults\":50}" == body_of(bfapi::paths::list_market_catalogue),
+                       with_error("listMarketCatalogue", error)) && ok;
+        }
+        {
+            ops::list_runner_book_request req;
+            req.market_id = "1.209995594";
+            req.selection_id = 50198;
+            ops::list_runner_book::response_type res;
+            const bool sent = ops::call<ops::list_runner_book>(conn, req, res, a, error);
+            ok = check(sent && 1 == res.size() && res[0].inplay && 1 == res[0].runners.size() &&
+                       0.0 == res[0].runners[0].last_price_traded && 1 == res[0].runners[0].available_to_back.size() &&
+                       "{\"marketId\":\"1.209995594\",\"selectionId\":50198,\"priceProjection\":{\"priceData\":[\"EX_BEST_OFFERS\"]}}" ==
+                       body_of(bfapi::paths::list_runner_book), with_error("listRunnerBook", error)) && ok;
+        }
+        {
+            ops::list_current_orders_request req;
+            req.market_ids = {"1.209995594"};
+            req.order_projection = "EXECUTABLE";
+            ops::list_current_orders::response_type res;
+            const bool sent = ops::call<ops::list_current_orders>(conn, req, res, a, error);
+            ok = check(sent && 1 == res.current_orders.size() && 3.4 == res.current_orders[0].price &&
+                       1.5 == res.current_orders[0].size_remaining && "REF1" == res.current_orders[0].customer_order_ref &&
+                       "{\"fromRecord\":0,\"marketIds\":[\"1.209995594\"],\"orderProjection\":\"EXECUTABLE\"}" ==
+                       body_of(bfapi::paths::list_current_orders), with_error("listCurrentOrders", error)) && ok;
+        }
+        {
+            ops::list_cleared_orders_request req;
+            req.event_type_ids = {"7"};
+            req.settled_to = "2024-03-02T00:00:00Z";
+            req.record_count = 100;
+            ops::list_cleared_orders::response_type res;
+            const bool sent = ops::call<ops::list_cleared_orders>(conn, req, res, a, error);
+            ok = check(sent && res.more_available && 1 == res.cleared_orders.size() && 4.8 == res.cleared_orders[0].profit &&
+                       "WON" == res.cleared_orders[0].bet_outcome &&
+                       "{\"betStatus\":\"SETTLED\",\"eventTypeIds\":[\"7\"],\"settledDateRange\":{\"to\":\"2024-03-02T00:00:00Z\"},"
+                       "\"fromRecord\":0,\"recordCount\":100}" == body_of(bfapi::paths::list_cleared_orders), with_error("listClearedOrders", error)) && ok;
+        }
+        {
+            bfapi::orders::place_instruction_batch batch(1);
+            batch.emplace_limit(50198, false, 2.0, 3.4, false, "REF1");
+            const bfapi::orders::place_orders_request req("1.209995594", false, std::move(batch));
+            ops::place_orders::response_type res;
+            const bool sent = ops::call<ops::place_orders>(conn, req, res, a, error);
+            ok = check(sent && "SUCCESS" == res.status && "31234567891" == res.instruction_reports[0].bet_id &&
+                       req.as_json_string() == body_of(bfapi::paths::place_orders), with_error("placeOrders", error)) && ok;
+        }
+        {
+            const bfapi::orders::cancel_orders_request req("1.209995594", {bfapi::orders::cancel_instruction("31234567891", 1.0)});
+            ops::cancel_orders::response_type res;
+            const bool sent = ops::call<ops::cancel_orders>(conn, req, res, a, error);
+            ok = check(sent && "SUCCESS" == res.status && 1.0 == res.instruction_reports[0].size_cancelled &&
+                       "31234567891" == res.instruction_reports[0].bet_id &&
+                       "{\"marketId\":\"1.209995594\",\"instructions\":[{\"betId\":\"31234567891\",\"sizeReduction\":1.000000}]}" ==
+                       body_of(bfapi::paths::cancel_orders), with_error("cancelOrders", error)) && ok;
+        }
+        {
+            const bfapi::orders::replace_orders_request req("1.209995594", false, {bfapi::orders::replace_instruction("31234567891", 3.5)});
+            ops::replace_orders::response_type res;
+            const bool sent = ops::call<ops::replace_orders>(conn, req, res, a, error);
+            ok = check(sent && "SUCCESS" == res.status && 2.0 == res.instruction_reports[0].cancel_report.size_cancelled &&
+                       "31234567892" == res.instruction_reports[0].place_report.bet_id &&
+                       req.as_json_string() == body_of(bfapi::paths::replace_orders), with_error("replaceOrders", error)) && ok;
+        }
+
+        // Over weight requests are refused without being sent; API errors carry their code
+        {
+            ops::list_market_book_request req;
+            req.market_ids.assign(41, "1.1");
+            ops::list_market_book::response_type res;
+            const int before = log.requests;
+            const bool sent = ops::call<ops::list_market_book>(conn, req, res, a, error);
+            ok = check(false == sent && before == log.requests, "41 markets at weight 5 refused: " + error) && ok;
+
+            req.market_ids.assign(1, "TOO_MUCH");
+            const bool rejected = (false == ops::call<ops::list_market_book>(conn, req, res, a, error));
+            ok = check(rejected && std::string::npos != error.find("TOO_MUCH_DATA"), "API error reported: " + error) && ok;
+        }
+
+        // An order report with status FAILURE (answered with HTTP 200) fails both order paths
+        {
+            bfapi::orders::place_instruction_batch batch(1);
+            batch.emplace_limit(50198, false, 2.0, 3.4, false, "REF1");
+            const bfapi::orders::place_orders_request req("SUSPENDED", false, std::move(batch));
+            ops::place_orders::response_type res;
+            const bool placed = ops::call<ops::place_orders>(conn, req, res, a, error);
+            ok = check(false == placed && "FAILURE" == res.status && std::string::npos != error.find("MARKET_SUSPENDED"),
+                       "call<place_orders> failure reported: " + error) && ok;
+            const bool placed_by_conn = conn.place_orders(req, a, res, error);
+            ok = check(false == placed_by_conn && std::string::npos != error.find("MARKET_SUSPENDED"),
+                       "api_connection::place_orders failure reported: " + error) && ok;
+        }
+
+        // listMarketBook polling: call<>() against post() and property_tree parsing
+        ops::list_market_book_request req;
+        for (int m = 0; m < book_markets; ++m)
+        {
+            req.market_ids.push_back("1.20999559" + std::to_string(m));
+        }
+        req.projection.ex_best_offers = true;
+        const int requests = 2000;
+        {
+            bfapi::http_result result;
+            std::vector<bfapi::responses::market_book> books;
+            std::string body;
+            bfapi::alloc_counter::scope s;
+            const auto t1 = std::chrono::steady_clock::now();
+            for (int i = 0; i < requests; ++i)
+            {
+                body.clear();
+                req.append_json(body);
+                if (false == conn.post(bfapi::list_market_book_endpoint, body, result, error, true) ||
+                    false == bfapi::responses::parse_market_books(result.body, books, error))
+                {
+                    std::cerr << "Request failed: " << error << std::endl;
+                    loopback::finish(false);
+                }
+            }
+            const std::chrono::duration<double, std::micro> us = std::chrono::steady_clock::now() - t1;
+            const bfapi::alloc_counter::counts c = s.elapsed();
+            std::cout << "post() + property_tree: " << static_cast<double>(c.allocations) / requests << " allocations per call, "
+                      << us.count() / requests << " us per call\n";
+        }
+        {
+            std::vector<bfapi::responses::market_book> books;
+            for (int i = 0; i < 3; ++i)
+            {
+                ops::call<ops::list_market_book>(conn, req, books, a, error);
+            }
+            bfapi::alloc_counter::scope s;
+            const auto t1 = std::chrono::steady_clock::now();
+            for (int i = 0; i < requests; ++i)
+            {
+                if (false == ops::call<ops::list_market_book>(conn, req, books, a, error))
+                {
+                    std::cerr << "Request failed: " << error << std::endl;
+                    loopback::finish(false);
+                }
+            }
+            const std::chrono::duration<double, std::micro> us = std::chrono::steady_clock::now() - t1;
+            const bfapi::alloc_counter::counts c = s.elapsed();
+            std::cout << "call<list_market_book>: " << static_cast<double>(c.allocations) / requests << " allocations per call, "
+                      << us.count() / requests << " us per call, arena peak " << a.peak_bytes() << " bytes\n";
+            ok = check(book_markets == static_cast<int>(books.size()) && book_runners == static_cast<int>(books[9].runners.size()) &&
+                       3.55 == books[9].runners[11].available_to_lay[1].price && 45679 == books[9].version,
+                       "listMarketBook parsed") && ok;
+            ok = check(0 == c.allocations, "no heap allocations on warm call<list_market_book>") && ok;
+        }
+
+        loopback::finish(ok);
+    }
+    catch(std::exception const& e)
+    {
+        std::cerr << "ERROR: Exception thrown (" << e.what() << ")" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}